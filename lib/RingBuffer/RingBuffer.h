@@ -0,0 +1,291 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+// Lock-free ring buffers for passing data between interrupts and loop(), or
+// between threads in the host tools.
+//
+// SpscRing: one producer and one consumer, e.g. a CAN RX interrupt feeding
+//   loop(). Supports batch push/pop and zero-copy reserve/commit on both
+//   sides.
+// MpscRing: any number of producers (nested interrupts of different priority
+//   and loop(), or host threads) and one consumer.
+//
+// CAPACITY must be a power of two. Indices are free-running uint32_t counters
+// that are masked on access, so all CAPACITY slots are usable. T must be
+// trivially copyable; elements are moved with memcpy.
+//
+// Ordering: the producer publishes with a release store after writing the
+// slot, and the consumer reads the index with an acquire load before reading
+// it (and the reverse for freeing slots). On the Cortex-M7 these compile to
+// plain loads/stores plus DMB, which orders the accesses against the other
+// context on the single core and against DMA. On x86 they are plain moves
+// that only constrain the compiler. The producer and consumer indices sit in
+// separate cache lines so that two cores do not fight over one line.
+
+#if defined(__arm__)
+// Cortex-M7 L1 cache line.
+const size_t kRingCacheLineSize = 32;
+#else
+const size_t kRingCacheLineSize = 64;
+#endif
+
+template <typename T, uint32_t CAPACITY>
+class SpscRing {
+  static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0,
+                "Capacity must be a power of two");
+  static const uint32_t kMask = CAPACITY - 1;
+
+ public:
+  // A contiguous run of slots handed out by Reserve() or Peek(). It may be
+  // shorter than requested when the run reaches the end of the storage.
+  struct Span {
+    T *data;
+    uint32_t size;
+  };
+
+ private:
+  // Written by the producer only.
+  alignas(kRingCacheLineSize) std::atomic<uint32_t> tail_;
+  // Written by the consumer only.
+  alignas(kRingCacheLineSize) std::atomic<uint32_t> head_;
+  alignas(kRingCacheLineSize) T items_[CAPACITY];
+
+ public:
+  SpscRing() : tail_(0), head_(0) {}
+
+  static constexpr uint32_t Capacity() { return CAPACITY; }
+
+  // Producer side.
+  bool Push(const T &item);
+  // Pushes as many of the count items as fit. Returns how many.
+  uint32_t PushBatch(const T *items, uint32_t count);
+  // Up to count free slots to fill in place, published by Commit().
+  Span Reserve(uint32_t count);
+  void Commit(uint32_t count);
+
+  // Consumer side.
+  bool Pop(T &item);
+  uint32_t PopBatch(T *items, uint32_t count);
+  // Up to count filled slots to read in place, freed by Release().
+  Span Peek(uint32_t count);
+  void Release(uint32_t count);
+
+  // Exact from either side for its own view, a snapshot from anywhere else.
+  uint32_t Size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+  bool Empty() const { return Size() == 0; }
+};
+
+template <typename T, uint32_t CAPACITY>
+bool SpscRing<T, CAPACITY>::Push(const T &item) {
+  uint32_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail - head_.load(std::memory_order_acquire) == CAPACITY) {
+    return false;
+  }
+  memcpy(&items_[tail & kMask], &item, sizeof(T));
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T, uint32_t CAPACITY>
+uint32_t SpscRing<T, CAPACITY>::PushBatch(const T *items, uint32_t count) {
+  uint32_t tail = tail_.load(std::memory_order_relaxed);
+  uint32_t free_slots = CAPACITY - (tail - head_.load(std::memory_order_acquire));
+  if (count > free_slots) {
+    count = free_slots;
+  }
+  // At most two copies: up to the end of the storage, then from the start.
+  uint32_t start = tail & kMask;
+  uint32_t first = count < CAPACITY - start ? count : CAPACITY - start;
+  memcpy(&items_[start], items, first * sizeof(T));
+  memcpy(&items_[0], items + first, (count - first) * sizeof(T));
+  tail_.store(tail + count, std::memory_order_release);
+  return count;
+}
+
+template <typename T, uint32_t CAPACITY>
+typename SpscRing<T, CAPACITY>::Span SpscRing<T, CAPACITY>::Reserve(
+    uint32_t count) {
+  uint32_t tail = tail_.load(std::memory_order_relaxed);
+  uint32_t free_slots = CAPACITY - (tail - head_.load(std::memory_order_acquire));
+  uint32_t start = tail & kMask;
+  if (count > free_slots) {
+    count = free_slots;
+  }
+  if (count > CAPACITY - start) {
+    count = CAPACITY - start;
+  }
+  return {&items_[start], count};
+}
+
+template <typename T, uint32_t CAPACITY>
+void SpscRing<T, CAPACITY>::Commit(uint32_t count) {
+  tail_.store(tail_.load(std::memory_order_relaxed) + count,
+              std::memory_order_release);
+}
+
+template <typename T, uint32_t CAPACITY>
+bool SpscRing<T, CAPACITY>::Pop(T &item) {
+  uint32_t head = head_.load(std::memory_order_relaxed);
+  if (tail_.load(std::memory_order_acquire) == head) {
+    return false;
+  }
+  memcpy(&item, &items_[head & kMask], sizeof(T));
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T, uint32_t CAPACITY>
+uint32_t SpscRing<T, CAPACITY>::PopBatch(T *items, uint32_t count) {
+  uint32_t head = head_.load(std::memory_order_relaxed);
+  uint32_t available = tail_.load(std::memory_order_acquire) - head;
+  if (count > available) {
+    count = available;
+  }
+  uint32_t start = head & kMask;
+  uint32_t first = count < CAPACITY - start ? count : CAPACITY - start;
+  memcpy(items, &items_[start], first * sizeof(T));
+  memcpy(items + first, &items_[0], (count - first) * sizeof(T));
+  head_.store(head + count, std::memory_order_release);
+  return count;
+}
+
+template <typename T, uint32_t CAPACITY>
+typename SpscRing<T, CAPACITY>::Span SpscRing<T, CAPACITY>::Peek(
+    uint32_t count) {
+  uint32_t head = head_.load(std::memory_order_relaxed);
+  uint32_t available = tail_.load(std::memory_order_acquire) - head;
+  uint32_t start = head & kMask;
+  if (count > available) {
+    count = available;
+  }
+  if (count > CAPACITY - start) {
+    count = CAPACITY - start;
+  }
+  return {&items_[start], count};
+}
+
+template <typename T, uint32_t CAPACITY>
+void SpscRing<T, CAPACITY>::Release(uint32_t count) {
+  head_.store(head_.load(std::memory_order_relaxed) + count,
+              std::memory_order_release);
+}
+
+// Multi-producer ring after Vyukov's bounded queue: producers claim slots by
+// advancing tail_ with a compare-and-swap, and each slot carries a sequence
+// number that says whether it is free for the lap being written or holds
+// data for the consumer. A producer that is interrupted between claiming and
+// publishing holds up the consumer at that slot until it resumes (the
+// consumer sees "empty"), but never blocks the other producers.
+template <typename T, uint32_t CAPACITY>
+class MpscRing {
+  static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0,
+                "Capacity must be a power of two");
+  static const uint32_t kMask = CAPACITY - 1;
+
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    T item;
+  };
+
+  alignas(kRingCacheLineSize) std::atomic<uint32_t> tail_;
+  alignas(kRingCacheLineSize) std::atomic<uint32_t> head_;
+  alignas(kRingCacheLineSize) Slot slots_[CAPACITY];
+
+ public:
+  MpscRing();
+
+  static constexpr uint32_t Capacity() { return CAPACITY; }
+
+  // Safe from any number of contexts at once.
+  bool Push(const T &item);
+  // Claims count consecutive slots in one compare-and-swap, so the batch
+  // stays contiguous in the consumer's order. All or nothing.
+  bool PushBatch(const T *items, uint32_t count);
+
+  // Consumer only.
+  bool Pop(T &item);
+  uint32_t PopBatch(T *items, uint32_t count);
+
+  // Snapshot; may include claimed but unpublished slots.
+  uint32_t Size() const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+  bool Empty() const { return Size() == 0; }
+};
+
+template <typename T, uint32_t CAPACITY>
+MpscRing<T, CAPACITY>::MpscRing() : tail_(0), head_(0) {
+  for (uint32_t i = 0; i < CAPACITY; i++) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T, uint32_t CAPACITY>
+bool MpscRing<T, CAPACITY>::Push(const T &item) {
+  return PushBatch(&item, 1);
+}
+
+template <typename T, uint32_t CAPACITY>
+bool MpscRing<T, CAPACITY>::PushBatch(const T *items, uint32_t count) {
+  if (count == 0 || count > CAPACITY) {
+    return count == 0;
+  }
+  uint32_t tail = tail_.load(std::memory_order_relaxed);
+  for (;;) {
+    // The last slot of the batch must have been freed by the consumer for
+    // this lap; the earlier ones were freed before it.
+    uint32_t last = tail + count - 1;
+    uint32_t sequence =
+        slots_[last & kMask].sequence.load(std::memory_order_acquire);
+    if ((int32_t)(sequence - last) < 0) {
+      return false;  // full
+    }
+    if (sequence != last) {
+      // Another producer got there first.
+      tail = tail_.load(std::memory_order_relaxed);
+    } else if (tail_.compare_exchange_weak(tail, tail + count,
+                                           std::memory_order_relaxed,
+                                           std::memory_order_relaxed)) {
+      break;
+    }
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    Slot &slot = slots_[(tail + i) & kMask];
+    memcpy(&slot.item, &items[i], sizeof(T));
+    slot.sequence.store(tail + i + 1, std::memory_order_release);
+  }
+  return true;
+}
+
+template <typename T, uint32_t CAPACITY>
+bool MpscRing<T, CAPACITY>::Pop(T &item) {
+  return PopBatch(&item, 1) == 1;
+}
+
+template <typename T, uint32_t CAPACITY>
+uint32_t MpscRing<T, CAPACITY>::PopBatch(T *items, uint32_t count) {
+  uint32_t head = head_.load(std::memory_order_relaxed);
+  uint32_t popped = 0;
+  while (popped < count) {
+    Slot &slot = slots_[head & kMask];
+    if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+      break;  // empty, or the next producer has not published yet
+    }
+    memcpy(&items[popped], &slot.item, sizeof(T));
+    // Free the slot for the producers' next lap.
+    slot.sequence.store(head + CAPACITY, std::memory_order_release);
+    head++;
+    popped++;
+  }
+  head_.store(head, std::memory_order_release);
+  return popped;
+}
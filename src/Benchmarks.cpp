@@ -0,0 +1,464 @@
+#include "Benchmarks.h"
+
+#include <Streaming.h>
+
+#include "DataLogger.h"
+#include "Kinematics.h"
+#include "LegLanes.h"
+#include "LogDump.h"
+#include "PolicyObservation.h"
+#include "RingBuffer.h"
+#include "RowFormatter.h"
+#include "Utils.h"
+
+namespace {
+
+const uint32_t kIterations = 100;
+
+// Swallows everything so that only the formatting cost is measured.
+class NullPrint : public Print {
+ public:
+  size_t write(uint8_t) override { return 1; }
+  size_t write(const uint8_t *, size_t size) override { return size; }
+};
+
+// Cycles per status row: Print::print(float, 2) as PrintStatus used to do
+// against RowFormatter, over the same DebugData() values.
+void BenchmarkStatusFormatting(DriveSystem &drive, Print &out) {
+  auto data = drive.DebugData();
+  NullPrint sink;
+
+  uint32_t start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    for (uint8_t i = 0; i < kNumDriveSystemDebugValues; i++) {
+      sink.print(data(i), 2);
+      sink.print(',');
+    }
+    sink.println();
+  }
+  uint32_t print_cycles = ARM_DWT_CYCCNT - start;
+
+  char line[kMaxStatusLineLength];
+  RowFormatter row(line, sizeof(line), ',');
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    row.Clear();
+    for (uint8_t i = 0; i < kNumDriveSystemDebugValues; i++) {
+      row.AddFixed(data(i));
+    }
+    row.EndLine();
+  }
+  uint32_t formatter_cycles = ARM_DWT_CYCCNT - start;
+  sink.write(reinterpret_cast<const uint8_t *>(row.Data()), row.Length());
+
+  out << "status row, " << kNumDriveSystemDebugValues
+      << " values [cycles/row]: Print " << print_cycles / kIterations
+      << ", RowFormatter " << formatter_cycles / kIterations << endl;
+}
+
+// Cycles per logged row at 1 kHz: the old copy through DebugData() and
+// AddData() against filling the row in place, with every signal and with
+// time plus joint positions and velocities only.
+void BenchmarkLogging(DriveSystem &drive, Print &out) {
+  static DataLogger<8, kNumDriveSystemDebugValues> logger;
+  const uint32_t subset = 1 | 1 << kNumDriveScalarSignals |
+                          1 << (kNumDriveScalarSignals + 1);
+
+  uint32_t start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    logger.AddData(drive.DebugData());
+  }
+  uint32_t copy_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    drive.WriteDebugRow(logger.BeginRow());
+  }
+  uint32_t in_place_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    drive.WriteDebugRow(logger.BeginRow(), subset);
+  }
+  uint32_t subset_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  // Share of a 1 kHz control tick, in hundredths of a percent.
+  uint32_t tick_cycles = F_CPU_ACTUAL / 1000;
+  out << "log row [cycles/row]: DebugData+AddData " << copy_cycles
+      << ", WriteDebugRow " << in_place_cycles << ", WriteDebugRow(ts,p,v) "
+      << subset_cycles << endl;
+  out << "  share of 1 kHz tick [0.01%]: " << copy_cycles * 10000 / tick_cycles
+      << ", " << in_place_cycles * 10000 / tick_cycles << ", "
+      << subset_cycles * 10000 / tick_cycles << endl;
+}
+
+// Cycles per item through the interrupt-to-loop rings, one item at a time and
+// in batches of 16, against disabling interrupts around a plain array ring.
+void BenchmarkRingBuffer(Print &out) {
+  static SpscRing<uint32_t, 256> spsc;
+  static MpscRing<uint32_t, 256> mpsc;
+  static uint32_t locked[256];
+  const uint32_t kBatch = 16;
+  uint32_t batch[kBatch] = {};
+  uint32_t item = 0;
+  uint32_t sum = 0;
+
+  uint32_t start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    spsc.Push(iteration);
+    spsc.Pop(item);
+    sum += item;
+  }
+  uint32_t spsc_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    spsc.PushBatch(batch, kBatch);
+    spsc.PopBatch(batch, kBatch);
+  }
+  uint32_t spsc_batch_cycles =
+      (ARM_DWT_CYCCNT - start) / (kIterations * kBatch);
+
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    mpsc.Push(iteration);
+    mpsc.Pop(item);
+    sum += item;
+  }
+  uint32_t mpsc_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    mpsc.PushBatch(batch, kBatch);
+    mpsc.PopBatch(batch, kBatch);
+  }
+  uint32_t mpsc_batch_cycles =
+      (ARM_DWT_CYCCNT - start) / (kIterations * kBatch);
+
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    noInterrupts();
+    locked[tail++ & 255] = iteration;
+    interrupts();
+    noInterrupts();
+    item = locked[head++ & 255];
+    interrupts();
+    sum += item;
+  }
+  uint32_t locked_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  out << "ring push+pop [cycles/item]: spsc " << spsc_cycles << ", batch "
+      << spsc_batch_cycles << "; mpsc " << mpsc_cycles << ", batch "
+      << mpsc_batch_cycles << "; interrupts off " << locked_cycles << " ("
+      << (sum & 1) << ")" << endl;
+}
+
+// Cycles per control tick to look up and interpolate the cogging tables for
+// all 12 axes and convert the result to amps, as CommandCurrents() does.
+void BenchmarkCoggingCompensation(DriveSystem &drive, Print &out) {
+  const DriveSnapshot &snapshot = drive.Snapshot();
+  std::array<int32_t, 12> compensation_mA;
+  ActuatorCurrentVector currents = {};
+
+  uint32_t start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    drive.Cogging().Compute(snapshot.rotor_counts, compensation_mA);
+    for (size_t i = 0; i < 12; i++) {
+      currents[i] += compensation_mA[i] * 0.001f;
+    }
+  }
+  uint32_t cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  uint32_t tick_cycles = F_CPU_ACTUAL / 1000;
+  out << "cogging compensation, 12 axes [cycles/tick]: " << cycles
+      << ", share of 1 kHz tick [0.01%]: " << cycles * 10000 / tick_cycles
+      << " (" << (currents[0] > 0) << ")" << endl;
+}
+
+// Cycles per control tick to integrate the power of all 12 joints, as
+// DriveSystem::Update() does, with a window completing every 10 ticks.
+void BenchmarkEnergyAccounting(DriveSystem &drive, Print &out) {
+  const DriveSnapshot &snapshot = drive.Snapshot();
+  EnergyMeter meter(10000);
+  uint32_t windows = 0;
+
+  uint32_t start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    windows += meter.Update(iteration * 1000, snapshot.electrical_power,
+                            snapshot.mechanical_power);
+  }
+  uint32_t cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  uint32_t tick_cycles = F_CPU_ACTUAL / 1000;
+  out << "energy accounting, 12 joints [cycles/tick]: " << cycles
+      << ", share of 1 kHz tick [0.01%]: " << cycles * 10000 / tick_cycles
+      << " (" << windows << " windows)" << endl;
+}
+
+// Cycles per control tick of the control laws for mixed per-leg modes. All
+// cartesian with every motor active is what kCartesianPositionControl cost
+// before idle and inactive legs were skipped.
+void BenchmarkLegControl(DriveSystem &drive, Print &out) {
+  const LegControlMode kOff = LegControlMode::kIdle;
+  const LegControlMode kJoint = LegControlMode::kJointPosition;
+  const LegControlMode kCart = LegControlMode::kCartesianPosition;
+  const LegControlMode kCur = LegControlMode::kCurrent;
+  struct Config {
+    const char *name;
+    LegControlModes modes;
+    ActuatorActivations mask;
+  };
+  const ActuatorActivations all = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+  const ActuatorActivations front = {1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0};
+  const Config configs[] = {
+      {"4 cartesian", {kCart, kCart, kCart, kCart}, all},
+      {"2 cartesian, 2 joint", {kCart, kCart, kJoint, kJoint}, all},
+      {"1 cartesian, 3 idle", {kCart, kOff, kOff, kOff}, all},
+      {"4 joint", {kJoint, kJoint, kJoint, kJoint}, all},
+      {"4 current", {kCur, kCur, kCur, kCur}, all},
+      {"4 cartesian, rear inactive", {kCart, kCart, kCart, kCart}, front},
+  };
+  float sum = 0.0f;
+  uint32_t tick_cycles = F_CPU_ACTUAL / 1000;
+  for (const Config &config : configs) {
+    uint32_t start = ARM_DWT_CYCCNT;
+    for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+      sum += drive.LegControlCurrents(config.modes, config.mask)[0];
+    }
+    uint32_t cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+    out << "leg control, " << config.name << " [cycles/tick]: " << cycles
+        << ", share of 1 kHz tick [0.01%]: " << cycles * 10000 / tick_cycles
+        << endl;
+  }
+  out << "(" << (sum > 0) << ")" << endl;
+}
+
+// Cycles per control tick of the cartesian law for four legs: the per-leg
+// loop of CartesianPositionControl() against the leg-as-lane formulation, on
+// the current joint state.
+void BenchmarkCartesianLanes(DriveSystem &drive, Print &out) {
+  const DriveSnapshot &snapshot = drive.Snapshot();
+  LegParameters leg_params;
+  PDGains3x3 gains = {Utils::DiagonalMatrix3x3({2000, 2000, 2000}),
+                      Utils::DiagonalMatrix3x3({50, 50, 50})};
+  KneeSoftLimit knee_limit = {-PI / 6, 8.0};
+  std::array<float, 12> zero = {};
+  float sum = 0.0f;
+
+  uint32_t start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    for (uint8_t leg = 0; leg < 4; leg++) {
+      BLA::Matrix<3> angles = {snapshot.positions[3 * leg],
+                               snapshot.positions[3 * leg + 1],
+                               snapshot.positions[3 * leg + 2]};
+      BLA::Matrix<3> velocities = {snapshot.velocities[3 * leg],
+                                   snapshot.velocities[3 * leg + 1],
+                                   snapshot.velocities[3 * leg + 2]};
+      BLA::Matrix<3> reference = {0, 0, -0.15};
+      BLA::Matrix<3> torques = CartesianLegControl(
+          angles, velocities, reference, {0, 0, 0}, {0, 0, 0}, gains,
+          knee_limit, 2.0, leg_params, leg);
+      sum += torques(0);
+    }
+  }
+  uint32_t per_leg_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  std::array<float, 12> reference;
+  for (uint8_t leg = 0; leg < 4; leg++) {
+    reference[3 * leg] = 0;
+    reference[3 * leg + 1] = 0;
+    reference[3 * leg + 2] = -0.15;
+  }
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    LegLanes3 torques = CartesianLegControlLanes(
+        ToLegLanes(snapshot.positions), ToLegLanes(snapshot.velocities),
+        ToLegLanes(reference), ToLegLanes(zero), ToLegLanes(zero), gains,
+        knee_limit, 2.0, leg_params);
+    sum += torques[0][0];
+  }
+  uint32_t lane_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  uint32_t tick_cycles = F_CPU_ACTUAL / 1000;
+  out << "cartesian law, 4 legs [cycles/tick]: per-leg loop "
+      << per_leg_cycles << ", leg lanes " << lane_cycles
+      << ", share of 1 kHz tick [0.01%]: "
+      << per_leg_cycles * 10000 / tick_cycles << " vs "
+      << lane_cycles * 10000 / tick_cycles << " (" << (sum > 0) << ")"
+      << endl;
+}
+
+// Cycles and bytes per dumped logger row: printing it as text against the
+// compressed dump, exact and quantized, over rows logged from the current
+// state.
+void BenchmarkLogDumpCompression(DriveSystem &drive, Print &out) {
+  static DataLogger<kIterations, kNumDriveSystemDebugValues> logger;
+  static LogDumpEncoder encoder;
+  for (uint32_t i = 0; i < kIterations; i++) {
+    drive.WriteDebugRow(logger.BeginRow());
+  }
+  NullPrint sink;
+
+  uint32_t start = ARM_DWT_CYCCNT;
+  uint32_t text_bytes = 0;
+  for (uint32_t n = 0; n < kIterations; n++) {
+    logger.PrintRow(sink, n);
+  }
+  uint32_t text_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+  // PrintRow() does not return the size, so count it separately.
+  for (uint32_t n = 0; n < kIterations; n++) {
+    const float *row = logger.Row(n);
+    for (uint8_t i = 0; i < kNumDriveSystemDebugValues; i++) {
+      text_bytes += sink.print(row[i]) + 1;
+    }
+    text_bytes += 2;
+  }
+
+  uint32_t compressed_cycles[2];
+  uint32_t compressed_bytes[2];
+  for (int quantize = 0; quantize < 2; quantize++) {
+    start = ARM_DWT_CYCCNT;
+    encoder.Begin(sink, kIterations, nullptr, kNumDriveSystemDebugValues,
+                  quantize, 0);
+    for (uint32_t n = 0; n < kIterations; n++) {
+      encoder.AddRow(logger.Row(n));
+    }
+    encoder.End(0);
+    compressed_cycles[quantize] = (ARM_DWT_CYCCNT - start) / kIterations;
+    compressed_bytes[quantize] = encoder.CodedBytes() / kIterations;
+  }
+
+  out << "log dump, " << kNumDriveSystemDebugValues
+      << " values [cycles/row]: text " << text_cycles << ", compressed "
+      << compressed_cycles[0] << ", quantized " << compressed_cycles[1]
+      << ", [bytes/row]: text " << text_bytes / kIterations << ", raw "
+      << encoder.RawBytes() / kIterations << ", compressed "
+      << compressed_bytes[0] << ", quantized " << compressed_bytes[1]
+      << endl;
+}
+
+// Cycles per leg of the kinematics differentiated with dual numbers: the foot
+// position alone, the jacobian, and the jacobian with dJ/dt * qdot, on the
+// current joint state.
+void BenchmarkLegJacobian(DriveSystem &drive, Print &out) {
+  const DriveSnapshot &snapshot = drive.Snapshot();
+  LegParameters leg_params;
+  BLA::Matrix<3> angles = {snapshot.positions[0], snapshot.positions[1],
+                           snapshot.positions[2]};
+  BLA::Matrix<3> velocities = {snapshot.velocities[0],
+                               snapshot.velocities[1],
+                               snapshot.velocities[2]};
+  float sum = 0.0f;
+
+  uint32_t start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    sum += ForwardKinematics(angles, leg_params, iteration % 4)(2);
+  }
+  uint32_t position_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    sum += LegJacobian(angles, leg_params, iteration % 4)(2, 2);
+  }
+  uint32_t jacobian_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  BLA::Matrix<3, 3> jacobian;
+  BLA::Matrix<3> bias;
+  start = ARM_DWT_CYCCNT;
+  for (uint32_t iteration = 0; iteration < kIterations; iteration++) {
+    LegJacobianAndBias(angles, velocities, leg_params, iteration % 4,
+                       jacobian, bias);
+    sum += bias(2);
+  }
+  uint32_t bias_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  out << "leg kinematics [cycles/leg]: position " << position_cycles
+      << ", jacobian " << jacobian_cycles << ", jacobian and dJ/dt*qdot "
+      << bias_cycles << " (" << (sum > 0) << ")" << endl;
+}
+
+// Cycles per control tick and per policy step of the policy observations,
+// every DebugData column stacked 5 deep with a step every 10 ticks, against
+// collecting the row.
+void BenchmarkPolicyObservation(DriveSystem &drive, Print &out) {
+  static PolicyObservation policy;
+  uint8_t columns[kNumDriveSystemDebugValues];
+  uint8_t num_columns = DebugDataColumns(kAllDriveSignals, columns);
+  const uint16_t kDecimation = 10;
+  policy.Configure(columns, num_columns, 5, kDecimation);
+  policy.SetClip(5.0f);
+  float row[kNumDriveSystemDebugValues];
+
+  uint32_t start = ARM_DWT_CYCCNT;
+  for (uint32_t i = 0; i < kIterations; i++) {
+    drive.WriteDebugRow({row, kNumDriveSystemDebugValues});
+  }
+  uint32_t row_cycles = (ARM_DWT_CYCCNT - start) / kIterations;
+
+  uint32_t tick_cycles = 0;
+  uint32_t step_cycles = 0;
+  for (uint32_t i = 0; i < kIterations * kDecimation; i++) {
+    start = ARM_DWT_CYCCNT;
+    bool step = policy.AddTick(row, i);
+    uint32_t cycles = ARM_DWT_CYCCNT - start;
+    (step ? step_cycles : tick_cycles) += cycles;
+  }
+  tick_cycles /= kIterations * (kDecimation - 1);
+  step_cycles /= kIterations;
+  out << "policy observation, " << num_columns << " x 5 values [cycles]: row "
+      << row_cycles << ", tick " << tick_cycles << ", step " << step_cycles
+      << " (" << (policy.Observation()[0] > 0) << ")" << endl;
+}
+
+}  // namespace
+
+void RunBenchmark(uint8_t id, DriveSystem &drive, Print &out) {
+  switch (static_cast<BenchmarkId>(id)) {
+    case BenchmarkId::kStatusFormatting: {
+      BenchmarkStatusFormatting(drive, out);
+      break;
+    }
+    case BenchmarkId::kLogging: {
+      BenchmarkLogging(drive, out);
+      break;
+    }
+    case BenchmarkId::kRingBuffer: {
+      BenchmarkRingBuffer(out);
+      break;
+    }
+    case BenchmarkId::kCoggingCompensation: {
+      BenchmarkCoggingCompensation(drive, out);
+      break;
+    }
+    case BenchmarkId::kEnergyAccounting: {
+      BenchmarkEnergyAccounting(drive, out);
+      break;
+    }
+    case BenchmarkId::kLegControl: {
+      BenchmarkLegControl(drive, out);
+      break;
+    }
+    case BenchmarkId::kCartesianLanes: {
+      BenchmarkCartesianLanes(drive, out);
+      break;
+    }
+    case BenchmarkId::kLogDumpCompression: {
+      BenchmarkLogDumpCompression(drive, out);
+      break;
+    }
+    case BenchmarkId::kLegJacobian: {
+      BenchmarkLegJacobian(drive, out);
+      break;
+    }
+    case BenchmarkId::kPolicyObservation: {
+      BenchmarkPolicyObservation(drive, out);
+      break;
+    }
+    default: {
+      out << "Unknown benchmark: " << id << endl;
+      break;
+    }
+  }
+}
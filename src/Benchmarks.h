@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "DriveSystem.h"
+
+// On-device micro-benchmarks, run with {"bench": id}. Each one prints a line
+// with the measured cost in CPU cycles (ARM_DWT_CYCCNT).
+enum class BenchmarkId : uint8_t {
+  kStatusFormatting = 1,
+  kLogging = 2,
+  kRingBuffer = 3,
+  kCoggingCompensation = 4,
+  kEnergyAccounting = 5,
+  kLegControl = 6,
+  kCartesianLanes = 7,
+  kLogDumpCompression = 8,
+  kLegJacobian = 9,
+  kPolicyObservation = 10,
+};
+
+// Runs the benchmark with the given id and prints the result to out.
+void RunBenchmark(uint8_t id, DriveSystem &drive, Print &out);
@@ -0,0 +1,135 @@
+#include "CoggingCompensation.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "Utils.h"
+
+namespace {
+const uint32_t kTableMagic = 0x54474f43;  // "COGT"
+}  // namespace
+
+CoggingCompensation::CoggingCompensation()
+    : valid_(false), sequence_(0), calibration_axis_(0) {
+  Clear();
+  memset(sums_, 0, sizeof(sums_));
+  memset(counts_, 0, sizeof(counts_));
+}
+
+void CoggingCompensation::Clear() {
+  memset(table_, 0, sizeof(table_));
+  valid_ = false;
+}
+
+void CoggingCompensation::Compute(
+    const std::array<int32_t, kNumAxes> &rotor_counts,
+    std::array<int32_t, kNumAxes> &currents_mA) const {
+  // Each bin holds the mean over its width, so interpolate between bin
+  // centres: shift by half a bin before splitting into bin and fraction.
+  for (uint32_t i = 0; i < kNumAxes; i++) {
+    uint32_t counts = (static_cast<uint32_t>(rotor_counts[i]) +
+                       kCountsPerRevolution - kCountsPerBin / 2) %
+                      kCountsPerRevolution;
+    uint32_t bin = counts / kCountsPerBin;
+    int32_t fraction = counts % kCountsPerBin;
+    int32_t low = table_[i][bin];
+    int32_t high = table_[i][bin + 1];
+    currents_mA[i] = low + (high - low) * fraction / (int32_t)kCountsPerBin;
+  }
+}
+
+void CoggingCompensation::BeginAxis(uint8_t axis) {
+  calibration_axis_ = axis;
+  memset(sums_, 0, sizeof(sums_));
+  memset(counts_, 0, sizeof(counts_));
+}
+
+void CoggingCompensation::AddSample(int32_t rotor_counts, int32_t current_mA,
+                                    int direction) {
+  if (direction == 0) {
+    return;
+  }
+  uint32_t bin =
+      static_cast<uint32_t>(rotor_counts) % kCountsPerRevolution / kCountsPerBin;
+  uint8_t d = direction > 0;
+  if (counts_[d][bin] < 0xffff) {
+    sums_[d][bin] += current_mA;
+    counts_[d][bin]++;
+  }
+}
+
+bool CoggingCompensation::FinishAxis() {
+  int32_t means[kNumBins];
+  int32_t total = 0;
+  for (uint32_t bin = 0; bin < kNumBins; bin++) {
+    if (counts_[0][bin] == 0 || counts_[1][bin] == 0) {
+      return false;
+    }
+    means[bin] = (sums_[0][bin] / counts_[0][bin] +
+                  sums_[1][bin] / counts_[1][bin]) / 2;
+    total += means[bin];
+  }
+  int32_t offset = total / (int32_t)kNumBins;
+  int16_t *row = table_[calibration_axis_];
+  for (uint32_t bin = 0; bin < kNumBins; bin++) {
+    int32_t value = means[bin] - offset;
+    row[bin] = value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+  }
+  row[kNumBins] = row[0];
+  valid_ = true;
+  return true;
+}
+
+bool CoggingCompensation::Load(LogStorage &storage) {
+  if (storage.NumSectors() < 2 ||
+      storage.SectorSize() < sizeof(Header) + sizeof(table_)) {
+    return false;
+  }
+  bool found = false;
+  for (uint32_t sector = 0; sector < 2; sector++) {
+    Header header;
+    uint32_t offset = sector * storage.SectorSize();
+    if (!storage.Read(offset, &header, sizeof(header)) ||
+        header.magic != kTableMagic || header.num_axes != kNumAxes ||
+        header.num_bins != kNumBins || (found && header.sequence <= sequence_)) {
+      continue;
+    }
+    int16_t table[kNumAxes][kNumBins + 1];
+    if (!storage.Read(offset + sizeof(header), table, sizeof(table))) {
+      continue;
+    }
+    uint32_t crc = Utils::Crc32(&header, offsetof(Header, crc));
+    if (Utils::Crc32(table, sizeof(table), crc) != header.crc) {
+      continue;
+    }
+    memcpy(table_, table, sizeof(table_));
+    sequence_ = header.sequence;
+    found = true;
+  }
+  valid_ = found;
+  return found;
+}
+
+bool CoggingCompensation::Save(LogStorage &storage) {
+  if (storage.NumSectors() < 2 ||
+      storage.SectorSize() < sizeof(Header) + sizeof(table_)) {
+    return false;
+  }
+  // The current table lives in the sector with sequence_ parity.
+  uint32_t sector = (sequence_ + 1) % 2;
+  Header header;
+  header.magic = kTableMagic;
+  header.sequence = sequence_ + 1;
+  header.num_axes = kNumAxes;
+  header.num_bins = kNumBins;
+  header.crc = Utils::Crc32(&header, offsetof(Header, crc));
+  header.crc = Utils::Crc32(table_, sizeof(table_), header.crc);
+  uint32_t offset = sector * storage.SectorSize();
+  if (!storage.Erase(sector) ||
+      !storage.Program(offset + sizeof(header), table_, sizeof(table_)) ||
+      !storage.Program(offset, &header, sizeof(header))) {
+    return false;
+  }
+  sequence_ = header.sequence;
+  return true;
+}
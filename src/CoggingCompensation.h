@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+
+#include "LogStorage.h"
+#include "Platform.h"
+
+// Per-actuator cogging and torque ripple compensation. The M2006 cogging
+// repeats with the rotor angle, which the C610 reports as 0..8191 counts per
+// rotor revolution independent of the gearbox and of where the robot was
+// homed. Each actuator gets a table of kNumBins currents (int16 mA, motor
+// frame) over one rotor revolution, linearly interpolated between bins; the
+// whole set is 12 x 128 x 2 = 3 KB.
+//
+// The tables are measured by sweeping each axis slowly under PD control in
+// both directions and averaging the commanded current per bin (see
+// DriveSystem::CoggingCalibration()). Averaging the two directions cancels
+// Coulomb friction, and subtracting the mean removes gravity and load.
+class CoggingCompensation {
+ public:
+  static const uint32_t kNumAxes = 12;
+  static const uint32_t kCountsPerRevolution = 8192;
+  static const uint32_t kNumBins = 128;
+  static const uint32_t kCountsPerBin = kCountsPerRevolution / kNumBins;
+  // M2006 gearbox, rotor revolutions per output revolution.
+  static const uint32_t kGearRatio = 36;
+
+ private:
+  struct Header {
+    uint32_t magic;
+    uint32_t sequence;
+    uint16_t num_axes;
+    uint16_t num_bins;
+    uint32_t crc;  // of the header up to here and the table
+  };
+
+  // The extra entry repeats bin 0 so that interpolating across the
+  // wrap-around needs no special case.
+  int16_t table_[kNumAxes][kNumBins + 1];
+  bool valid_;
+  uint32_t sequence_;
+
+  // Calibration accumulators for one axis, per bin and sweep direction.
+  int32_t sums_[2][kNumBins];
+  uint16_t counts_[2][kNumBins];
+  uint8_t calibration_axis_;
+
+ public:
+  CoggingCompensation();
+
+  // Compensation in mA, motor frame, for every axis at its rotor counts.
+  void Compute(const std::array<int32_t, kNumAxes> &rotor_counts,
+               std::array<int32_t, kNumAxes> &currents_mA) const;
+
+  // True once a table was loaded or calibrated.
+  bool Valid() const { return valid_; }
+  void Clear();
+
+  // Accumulate samples for one axis. direction is the sign of the sweep
+  // velocity. FinishAxis() replaces that axis' table and returns false if a
+  // bin was not visited in both directions.
+  void BeginAxis(uint8_t axis);
+  void AddSample(int32_t rotor_counts, int32_t current_mA, int direction);
+  bool FinishAxis();
+
+  // Load the newest valid table from storage, which needs at least two
+  // sectors. Save() rewrites the older sector so that a reset during the
+  // write leaves the previous table intact.
+  bool Load(LogStorage &storage);
+  bool Save(LogStorage &storage);
+
+  int16_t Value(uint8_t axis, uint32_t bin) const {
+    return table_[axis][bin];
+  }
+};
@@ -6,6 +6,7 @@
 
 #include <array>
 
+#include "JsonHeapCounter.h"
 #include "PID.h"
 #include "RobotTypes.h"
 
@@ -25,6 +26,24 @@ struct CheckResult {
   bool do_homing = false;
   bool new_debug = false;
   bool new_fault_velocity = false;
+  bool new_query = false;
+  bool new_batch = false;
+  bool do_benchmark = false;
+  bool do_schema = false;
+  bool new_log_mask = false;
+  bool do_dump_log = false;
+  bool new_flash_log = false;
+  bool do_dump_flash_log = false;
+  bool new_cogging = false;
+  bool do_cogging_calibration = false;
+  bool new_current_frame = false;
+  bool new_lockstep = false;
+  bool new_stream_timeout = false;
+  bool new_energy_window = false;
+  bool new_leg_modes = false;
+  bool new_motion = false;
+  bool new_policy = false;
+  bool new_policy_normalization = false;
   CheckResultFlag flag = CheckResultFlag::kNothing;
 };
 
@@ -39,10 +58,29 @@ class CommandInterpreter {
   PDGains gain_command_;
   float max_current_;
   float fault_velocity_;
+  StateQuery query_;
 
   bool print_debug_info_;
+  bool batch_telemetry_;
+  uint8_t benchmark_id_;
+  uint32_t log_mask_;
+  bool dump_log_compressed_;
+  bool dump_log_quantized_;
+  uint8_t dump_log_level_;
+  bool flash_log_;
+  uint32_t flash_log_mask_;
+  bool cogging_;
+  CurrentFrame current_frame_;
+  bool lockstep_;
+  uint32_t stream_timeout_;
+  uint32_t energy_window_;
+  LegControlModes leg_modes_;
+  MotionCommand motion_;
+  PolicyCommand policy_;
+  PolicyNormalization policy_normalization_;
 
-  StaticJsonDocument<512> doc_;
+  JsonHeapCounter doc_heap_;
+  JsonDocument doc_;
   NonBlockingSerialBuffer<512> reader_;
 
   const bool use_msgpack_;
@@ -58,6 +96,9 @@ class CommandInterpreter {
   // fast as possible.
   CheckResult CheckForMessages();
 
+  // Heap held by the command document.
+  const JsonHeapCounter &JsonHeap() const { return doc_heap_; }
+
   // Returns an ActuatorPositionVector with the latest position commands.
   ActuatorPositionVector LatestPositionCommand();
 
@@ -67,6 +108,64 @@ class CommandInterpreter {
 
   bool LatestDebug();
 
+  bool LatestBatch();
+
+  uint8_t LatestBenchmark();
+
+  // Signal mask for on-device logging, 0 when logging is off.
+  uint32_t LatestLogMask();
+
+  // Whether the last dump_log asked for the compressed binary dump, sent as
+  // {"dump_log": true, "compress": true}.
+  bool LatestDumpLogCompressed();
+
+  // Whether the last compressed dump_log asked for the lossy quantized
+  // format, sent as "quantize": true.
+  bool LatestDumpLogQuantized();
+
+  // Logger level the last dump_log asked for, sent as "level": 0 for the
+  // full-rate rows (default), 1 and 2 for the 10x and 100x envelopes.
+  uint8_t LatestDumpLogLevel();
+
+  // Whether DebugData rows are appended to the persistent flash log.
+  bool LatestFlashLog();
+
+  // Signal mask of the flash log, sent as {"flash_log": true, "signals":
+  // mask}. Kept from the last flash_log that had one; 0 for every signal.
+  uint32_t LatestFlashLogMask();
+
+  // Whether cogging compensation should be applied.
+  bool LatestCogging();
+
+  // Latest streamed currents, sent as {"cur": [12 x mA], "seq": n}.
+  CurrentFrame LatestCurrentFrame();
+
+  // Whether every current frame is answered with a state frame.
+  bool LatestLockstep();
+
+  // Idle the drive if no current frame arrives for this long, 0 to disable.
+  uint32_t LatestStreamTimeout();
+
+  // Energy report window in [us], 0 to stop the reports.
+  uint32_t LatestEnergyWindow();
+
+  // Per-leg control laws, sent as {"leg_modes": [4 x LegControlMode]}.
+  LegControlModes LatestLegModes();
+
+  // Motion primitive to play, sent as {"motion": id, "speed": s}; speed is
+  // optional and defaults to 1.
+  MotionCommand LatestMotion();
+
+  // Policy observations, sent as {"policy": signal_mask, "history": h,
+  // "decimation": d, "clip": c}. history defaults to 1, decimation to 10
+  // (100 Hz) and clip to 0 (none).
+  PolicyCommand LatestPolicy();
+
+  // Normalisation of some policy features, sent as {"policy_norm": start,
+  // "mean": [...], "std": [...]} with at most kPolicyNormalizationChunk
+  // values each.
+  PolicyNormalization LatestPolicyNormalization();
+
   // Empty the input buffer
   void Flush();
 
@@ -77,6 +176,7 @@ class CommandInterpreter {
   ActuatorCurrentVector LatestFeedForwardForce();
   float LatestMaxCurrent();
   float LatestFaultVelocity();
+  StateQuery LatestQuery();
 };
 
 // Start character: 0x00
@@ -84,7 +184,9 @@ class CommandInterpreter {
 // Add '\0' to treat input as a string? : true
 CommandInterpreter::CommandInterpreter(bool use_msgpack, uint8_t start_byte,
                                        Stream &stream)
-    : reader_(start_byte, stream, true), use_msgpack_(use_msgpack) {}
+    : doc_(&doc_heap_),
+      reader_(start_byte, stream, true),
+      use_msgpack_(use_msgpack) {}
 
 template <class T, unsigned int SIZE>
 CheckResultFlag CopyJsonArray(JsonArray json, std::array<T, SIZE> &arr) {
@@ -209,6 +311,152 @@ CheckResult CommandInterpreter::CheckForMessages() {
         result.do_idle = true;
       }
     }
+    if (obj.containsKey("query")) {
+      query_.signals = obj["query"].as<uint32_t>();
+      query_.id = obj["id"].as<uint32_t>();
+      result.new_query = true;
+      result.flag = CheckResultFlag::kNewCommand;
+    }
+    if (obj.containsKey("batch")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_batch = true;
+      batch_telemetry_ = obj["batch"].as<bool>();
+    }
+    if (obj.containsKey("bench")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.do_benchmark = true;
+      benchmark_id_ = obj["bench"].as<uint8_t>();
+    }
+    if (obj.containsKey("schema")) {
+      if (obj["schema"].as<bool>()) {
+        result.flag = CheckResultFlag::kNewCommand;
+        result.do_schema = true;
+      }
+    }
+    if (obj.containsKey("log")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_log_mask = true;
+      log_mask_ = obj["log"].as<uint32_t>();
+    }
+    if (obj.containsKey("dump_log")) {
+      if (obj["dump_log"].as<bool>()) {
+        result.flag = CheckResultFlag::kNewCommand;
+        result.do_dump_log = true;
+        dump_log_compressed_ = obj.containsKey("compress")
+                                   ? obj["compress"].as<bool>()
+                                   : false;
+        dump_log_quantized_ = obj.containsKey("quantize")
+                                  ? obj["quantize"].as<bool>()
+                                  : false;
+        dump_log_level_ =
+            obj.containsKey("level") ? obj["level"].as<uint8_t>() : 0;
+      }
+    }
+    if (obj.containsKey("flash_log")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_flash_log = true;
+      flash_log_ = obj["flash_log"].as<bool>();
+      if (obj.containsKey("signals")) {
+        flash_log_mask_ = obj["signals"].as<uint32_t>();
+      }
+    }
+    if (obj.containsKey("dump_flash_log")) {
+      if (obj["dump_flash_log"].as<bool>()) {
+        result.flag = CheckResultFlag::kNewCommand;
+        result.do_dump_flash_log = true;
+      }
+    }
+    if (obj.containsKey("cogging")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_cogging = true;
+      cogging_ = obj["cogging"].as<bool>();
+    }
+    if (obj.containsKey("calibrate_cogging")) {
+      if (obj["calibrate_cogging"].as<bool>()) {
+        result.flag = CheckResultFlag::kNewCommand;
+        result.do_cogging_calibration = true;
+      }
+    }
+    if (obj.containsKey("cur")) {
+      // Integer milliamps keep the frame small, about 50 bytes with "seq".
+      std::array<int32_t, 12> currents_mA;
+      result.flag = CopyJsonArray(obj["cur"].as<JsonArray>(), currents_mA);
+      if (result.flag == CheckResultFlag::kError) {
+        return result;
+      }
+      for (uint8_t i = 0; i < 12; i++) {
+        current_frame_.currents[i] = currents_mA[i] * 0.001f;
+      }
+      current_frame_.seq = obj["seq"].as<uint32_t>();
+      result.new_current_frame = true;
+    }
+    if (obj.containsKey("lockstep")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_lockstep = true;
+      lockstep_ = obj["lockstep"].as<bool>();
+    }
+    if (obj.containsKey("stream_timeout")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_stream_timeout = true;
+      stream_timeout_ = obj["stream_timeout"].as<uint32_t>();
+    }
+    if (obj.containsKey("energy")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_energy_window = true;
+      energy_window_ = obj["energy"].as<uint32_t>();
+    }
+    if (obj.containsKey("leg_modes")) {
+      std::array<uint8_t, 4> modes;
+      result.flag = CopyJsonArray(obj["leg_modes"].as<JsonArray>(), modes);
+      if (result.flag == CheckResultFlag::kError) {
+        return result;
+      }
+      for (uint8_t i = 0; i < 4; i++) {
+        if (modes[i] >= kNumLegControlModes) {
+          Serial << "Error: Invalid leg control mode." << endl;
+          result.flag = CheckResultFlag::kError;
+          return result;
+        }
+        leg_modes_[i] = static_cast<LegControlMode>(modes[i]);
+      }
+      result.new_leg_modes = true;
+    }
+    if (obj.containsKey("motion")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_motion = true;
+      motion_.id = obj["motion"].as<uint8_t>();
+      motion_.speed =
+          obj.containsKey("speed") ? obj["speed"].as<float>() : 1.0f;
+    }
+    if (obj.containsKey("policy")) {
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_policy = true;
+      policy_.signals = obj["policy"].as<uint32_t>();
+      policy_.history =
+          obj.containsKey("history") ? obj["history"].as<uint8_t>() : 1;
+      policy_.decimation = obj.containsKey("decimation")
+                               ? obj["decimation"].as<uint16_t>()
+                               : 10;
+      policy_.clip = obj.containsKey("clip") ? obj["clip"].as<float>() : 0.0f;
+    }
+    if (obj.containsKey("policy_norm")) {
+      auto mean = obj["mean"].as<JsonArray>();
+      auto stddev = obj["std"].as<JsonArray>();
+      if (mean.size() != stddev.size() ||
+          mean.size() > kPolicyNormalizationChunk) {
+        Serial << "Error: Invalid policy normalization." << endl;
+        result.flag = CheckResultFlag::kError;
+        return result;
+      }
+      policy_normalization_.start = obj["policy_norm"].as<uint8_t>();
+      policy_normalization_.count = mean.size();
+      for (uint8_t i = 0; i < mean.size(); i++) {
+        policy_normalization_.mean[i] = mean[i].as<float>();
+        policy_normalization_.stddev[i] = stddev[i].as<float>();
+      }
+      result.flag = CheckResultFlag::kNewCommand;
+      result.new_policy_normalization = true;
+    }
     if (obj.containsKey("debug")) {
       result.flag = CheckResultFlag::kNewCommand;
       result.new_debug = true;
@@ -220,6 +468,46 @@ CheckResult CommandInterpreter::CheckForMessages() {
 
 bool CommandInterpreter::LatestDebug() { return print_debug_info_; }
 
+bool CommandInterpreter::LatestBatch() { return batch_telemetry_; }
+
+uint8_t CommandInterpreter::LatestBenchmark() { return benchmark_id_; }
+
+uint32_t CommandInterpreter::LatestLogMask() { return log_mask_; }
+
+bool CommandInterpreter::LatestDumpLogCompressed() {
+  return dump_log_compressed_;
+}
+
+bool CommandInterpreter::LatestDumpLogQuantized() {
+  return dump_log_quantized_;
+}
+
+uint8_t CommandInterpreter::LatestDumpLogLevel() { return dump_log_level_; }
+
+bool CommandInterpreter::LatestFlashLog() { return flash_log_; }
+
+uint32_t CommandInterpreter::LatestFlashLogMask() { return flash_log_mask_; }
+
+bool CommandInterpreter::LatestCogging() { return cogging_; }
+
+CurrentFrame CommandInterpreter::LatestCurrentFrame() { return current_frame_; }
+
+bool CommandInterpreter::LatestLockstep() { return lockstep_; }
+
+uint32_t CommandInterpreter::LatestStreamTimeout() { return stream_timeout_; }
+
+uint32_t CommandInterpreter::LatestEnergyWindow() { return energy_window_; }
+
+LegControlModes CommandInterpreter::LatestLegModes() { return leg_modes_; }
+
+MotionCommand CommandInterpreter::LatestMotion() { return motion_; }
+
+PolicyCommand CommandInterpreter::LatestPolicy() { return policy_; }
+
+PolicyNormalization CommandInterpreter::LatestPolicyNormalization() {
+  return policy_normalization_;
+}
+
 ActuatorPositionVector CommandInterpreter::LatestPositionCommand() {
   return position_command_;
 }
@@ -249,4 +537,6 @@ float CommandInterpreter::LatestMaxCurrent() { return max_current_; }
 
 float CommandInterpreter::LatestFaultVelocity() { return fault_velocity_; }
 
+StateQuery CommandInterpreter::LatestQuery() { return query_; }
+
 void CommandInterpreter::Flush() { reader_.FlushStream(); }
\ No newline at end of file
@@ -3,6 +3,12 @@
 // #include <array>
 #include <BasicLinearAlgebra.h>
 
+// Writable view of one logger row.
+struct LogRow {
+  float *values;
+  uint32_t size;
+};
+
 template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES>
 class DataLogger {
   private:
@@ -11,12 +17,29 @@ class DataLogger {
   public:
     DataLogger();
     void AddData(BLA::Matrix<NUM_ATTRIBUTES> data);
-    void PrintData(HardwareSerial &serial);
+
+    // Claim the next row and return it for the caller to fill in place.
+    // Columns the caller does not write keep their previous contents, so
+    // call Clear() when changing which columns are written.
+    LogRow BeginRow();
+
+    // Zero every row and restart at the first one.
+    void Clear();
+
+    // Print the rows from oldest to newest as comma separated text.
+    void PrintData(Print &serial);
+
+    // Print the n-th oldest row. n must be below LOG_SIZE.
+    void PrintRow(Print &serial, uint32_t n);
+
+    // The NUM_ATTRIBUTES values of the n-th oldest row. n must be below
+    // LOG_SIZE.
+    const float *Row(uint32_t n);
 };
 
 // #include "DataLogger.h"
 template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES>
-DataLogger<LOG_SIZE, NUM_ATTRIBUTES>::DataLogger() {
+DataLogger<LOG_SIZE, NUM_ATTRIBUTES>::DataLogger() : write_index_(0) {
   data_.Fill(0.0);
 }
 
@@ -32,12 +55,39 @@ void DataLogger<LOG_SIZE, NUM_ATTRIBUTES>::AddData(BLA::Matrix<NUM_ATTRIBUTES> d
 }
 
 template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES>
-void DataLogger<LOG_SIZE, NUM_ATTRIBUTES>::PrintData(HardwareSerial &serial) {
-  for(uint32_t row = 0; row < LOG_SIZE; row++) {
-    for (uint8_t i = 0; i < NUM_ATTRIBUTES; i++) {
-      serial.print(data_(row, i));
-      serial.print(",");
-    }
-    serial.println();
+LogRow DataLogger<LOG_SIZE, NUM_ATTRIBUTES>::BeginRow() {
+  LogRow row = {&data_(write_index_, 0), NUM_ATTRIBUTES};
+  write_index_++;
+  if(write_index_ >= LOG_SIZE) {
+    write_index_ = 0;
+  }
+  return row;
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES>
+void DataLogger<LOG_SIZE, NUM_ATTRIBUTES>::Clear() {
+  data_.Fill(0.0);
+  write_index_ = 0;
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES>
+void DataLogger<LOG_SIZE, NUM_ATTRIBUTES>::PrintData(Print &serial) {
+  for(uint32_t n = 0; n < LOG_SIZE; n++) {
+    PrintRow(serial, n);
   }
-}
\ No newline at end of file
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES>
+const float *DataLogger<LOG_SIZE, NUM_ATTRIBUTES>::Row(uint32_t n) {
+  return &data_((write_index_ + n) % LOG_SIZE, 0);
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES>
+void DataLogger<LOG_SIZE, NUM_ATTRIBUTES>::PrintRow(Print &serial, uint32_t n) {
+  uint32_t row = (write_index_ + n) % LOG_SIZE;
+  for (uint8_t i = 0; i < NUM_ATTRIBUTES; i++) {
+    serial.print(data_(row, i));
+    serial.print(",");
+  }
+  serial.println();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <tuple>
+
+// Enum for the various control modes: idle, position control, current control
+enum class DriveControlMode {
+  kIdle,
+  kError,  // For robot errors, not coding mistakes.
+  kHoming,
+  kPositionControl,
+  kCartesianPositionControl,
+  kCurrentControl,
+  kCoggingCalibration,
+  kPerLegControl,  // each leg runs its own LegControlMode
+};
+
+// Base of the controller of one drive mode. Derived defines
+//   static const DriveControlMode kMode;
+//   void Step(Drive &drive);    one control tick in the mode
+// and may define
+//   void OnEnter(Drive &drive); when the drive switches to the mode
+// to compute, once, what stays fixed while the mode runs.
+template <class Derived>
+struct DriveModeController {
+  template <class Drive>
+  void OnEnter(Drive &) {}
+};
+
+// The controllers of every mode, dispatched on the mode by comparing it with
+// each kMode in turn: no virtual calls and no function pointers, so each
+// Step() can be inlined into the dispatch. A controller only costs its own
+// mode a call.
+template <class... Controllers>
+class DriveModeSet {
+ public:
+  template <class Drive>
+  void Enter(DriveControlMode mode, Drive &drive) {
+    ((mode == Controllers::kMode &&
+      (std::get<Controllers>(controllers_).OnEnter(drive), true)) ||
+     ...);
+  }
+
+  template <class Drive>
+  void Step(DriveControlMode mode, Drive &drive) {
+    ((mode == Controllers::kMode &&
+      (std::get<Controllers>(controllers_).Step(drive), true)) ||
+     ...);
+  }
+
+  template <class Controller>
+  Controller &Get() {
+    return std::get<Controller>(controllers_);
+  }
+
+ private:
+  std::tuple<Controllers...> controllers_;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Platform.h"
+
+// The one list of signals that DriveSystem reports. DebugData (and through it
+// the DataLogger and TelemetryBatcher rows), PrintStatus, PrintHeader,
+// PrintMsgPackStatus and the schema sent to the host are all expanded from
+// these tables, so adding a signal here adds it everywhere.
+//
+// X(key, label, type, scale, option, accessor)
+//   key:      msgpack key and schema name
+//   label:    column label for PrintHeader
+//   type:     C++ type the value is reported as (float or uint32_t)
+//   scale:    multiply the reported value by this to get SI units
+//   option:   DrivePrintOptions flag that enables the signal in the printed
+//             and msgpack formats. DebugData always holds every signal.
+//   accessor: expression evaluated inside DriveSystem. Per-actuator signals
+//             are evaluated with the actuator index in i. Actuator readings
+//             come from the snapshot taken at the start of Update().
+#define DRIVE_SCALAR_SIGNALS(X)                             \
+  X(ts, "T", uint32_t, 0.001f, time, snapshot_.time_millis) \
+  X(yaw, "yaw", float, 1.0f, imu, imu.yaw)                  \
+  X(pitch, "pitch", float, 1.0f, imu, imu.pitch)            \
+  X(roll, "roll", float, 1.0f, imu, imu.roll)               \
+  X(yaw_rate, "wz", float, 1.0f, imu, imu.yaw_rate)         \
+  X(pitch_rate, "wy", float, 1.0f, imu, imu.pitch_rate)     \
+  X(roll_rate, "wx", float, 1.0f, imu, imu.roll_rate)
+
+#define DRIVE_ACTUATOR_SIGNALS(X)                                         \
+  X(pos, "p", float, 1.0f, positions, snapshot_.positions[i])             \
+  X(vel, "v", float, 1.0f, velocities, snapshot_.velocities[i])           \
+  X(cur, "I", float, 1.0f, currents, snapshot_.currents[i])               \
+  X(pref, "pr", float, 1.0f, position_references, position_reference_[i]) \
+  X(vref, "vr", float, 1.0f, velocity_references, velocity_reference_[i]) \
+  X(cref, "Ir", float, 1.0f, current_references, current_reference_[i])   \
+  X(lcur, "Il", float, 1.0f, last_current, last_commanded_current_[i])
+
+#define DRIVE_SIGNAL_COUNT(key, label, type, scale, option, accessor) +1
+
+const uint8_t kNumDriveScalarSignals = 0 DRIVE_SCALAR_SIGNALS(DRIVE_SIGNAL_COUNT);
+const uint8_t kNumDriveActuatorSignals =
+    0 DRIVE_ACTUATOR_SIGNALS(DRIVE_SIGNAL_COUNT);
+
+// Bit s of a signal mask selects kDriveSignals[s].
+const uint32_t kAllDriveSignals =
+    (1ul << (kNumDriveScalarSignals + kNumDriveActuatorSignals)) - 1;
+
+// Value type codes used in the schema.
+enum class DriveSignalType : uint8_t { kFloat, kUint32 };
+
+template <class T>
+struct DriveSignalTypeOf;
+template <>
+struct DriveSignalTypeOf<float> {
+  static constexpr DriveSignalType value = DriveSignalType::kFloat;
+};
+template <>
+struct DriveSignalTypeOf<uint32_t> {
+  static constexpr DriveSignalType value = DriveSignalType::kUint32;
+};
+
+// One DebugData value as its signal's type, for the status formats.
+union DriveSignalValue {
+  float f;
+  uint32_t u;
+};
+
+// Schema entry for one signal. count is 1 for scalar signals and the number
+// of actuators for per-actuator signals.
+struct DriveSignalInfo {
+  const char *key;
+  const char *label;
+  DriveSignalType type;
+  float scale;
+  uint8_t count;
+};
@@ -5,16 +5,86 @@
 
 #include "Utils.h"
 
+#define SCALAR_SIGNAL_INFO(key, label, type, scale, option, accessor) \
+  {#key, label, DriveSignalTypeOf<type>::value, scale, 1},
+#define ACTUATOR_SIGNAL_INFO(key, label, type, scale, option, accessor) \
+  {#key, label, DriveSignalTypeOf<type>::value, scale,                  \
+   DriveSystem::kNumActuators},
+const DriveSignalInfo kDriveSignals[] = {
+    DRIVE_SCALAR_SIGNALS(SCALAR_SIGNAL_INFO)
+        DRIVE_ACTUATOR_SIGNALS(ACTUATOR_SIGNAL_INFO)};
+#undef SCALAR_SIGNAL_INFO
+#undef ACTUATOR_SIGNAL_INFO
+const uint8_t kNumDriveSignals =
+    kNumDriveScalarSignals + kNumDriveActuatorSignals;
+
+uint8_t DebugDataColumns(uint32_t signal_mask, uint8_t *columns) {
+  uint8_t count = 0;
+  uint8_t column = 0;
+  for (uint8_t s = 0; s < kNumDriveScalarSignals; s++, column++) {
+    if (signal_mask & 1ul << s) {
+      columns[count++] = column;
+    }
+  }
+  for (uint8_t i = 0; i < DriveSystem::kNumActuators; i++) {
+    for (uint8_t s = 0; s < kNumDriveActuatorSignals; s++, column++) {
+      if (signal_mask & 1ul << (kNumDriveScalarSignals + s)) {
+        columns[count++] = column;
+      }
+    }
+  }
+  return count;
+}
+
+namespace {
+void AddStatusFloat(RowFormatter &row, DriveSignalValue value) {
+  row.AddFixed(value.f);
+}
+void AddStatusUnsigned(RowFormatter &row, DriveSignalValue value) {
+  row.AddUnsigned(value.u);
+}
+void SetJsonFloat(JsonVariant variant, DriveSignalValue value) {
+  variant.set(value.f);
+}
+void SetJsonUnsigned(JsonVariant variant, DriveSignalValue value) {
+  variant.set(value.u);
+}
+
+// Indexed by DriveSignalType.
+void (*const kAddStatusValue[])(RowFormatter &, DriveSignalValue) = {
+    AddStatusFloat, AddStatusUnsigned};
+void (*const kSetJsonValue[])(JsonVariant, DriveSignalValue) = {
+    SetJsonFloat, SetJsonUnsigned};
+
+void SetSignalValue(DriveSignalValue &out, float value) { out.f = value; }
+void SetSignalValue(DriveSignalValue &out, uint32_t value) { out.u = value; }
+
+// The signal a DebugData column holds.
+uint8_t ColumnSignal(uint8_t column) {
+  return column < kNumDriveScalarSignals
+             ? column
+             : kNumDriveScalarSignals +
+                   (column - kNumDriveScalarSignals) % kNumDriveActuatorSignals;
+}
+}  // namespace
+
 DriveSystem::DriveSystem() : front_bus_(), rear_bus_() {
   control_mode_ = DriveControlMode::kIdle;
   fault_current_ = 10.0;
   fault_position_ = PI;
   fault_velocity_ = 7.0;
   max_current_ = 0.0;
+  dropped_status_lines_ = 0;
+  status_signal_mask_ = 0;
+  status_columns_valid_ = false;
+  num_status_signals_ = 0;
+  num_status_scalars_ = 0;
+  num_status_columns_ = 0;
   position_reference_.fill(0.0);
   velocity_reference_.fill(0.0);
   current_reference_.fill(0.0);
   active_mask_.fill(false);
+  leg_modes_.fill(LegControlMode::kIdle);
   zero_position_.fill(0.0);
   start_position_.fill(0.0);
 
@@ -47,7 +117,6 @@ DriveSystem::DriveSystem() : front_bus_(), rear_bus_() {
   std::array<bool, 12> homed_axes = {false, false, false, false, false, false,
                                      false, false, false, false, false, false};
   homed_axes_ = homed_axes;
-  just_homed_ = false;
 
   homing_velocity = 0.0005;
   std::array<int, 4> knee_axes = {2, 5, 8, 11};
@@ -62,6 +131,24 @@ DriveSystem::DriveSystem() : front_bus_(), rear_bus_() {
 
   knee_soft_limit = -PI / 6;
 
+  cogging_enabled_ = false;
+  cogging_storage_ = nullptr;
+
+  streaming_ = false;
+  stream_timeout_micros_ = 10000;
+  last_stream_frame_micros_ = 0;
+  last_state_frame_micros_ = 0;
+  host_latency_micros_ = 0;
+  stream_timeouts_ = 0;
+
+  energy_window_done_ = false;
+  motion_id_ = -1;
+  memory_budget_ = nullptr;
+  dropped_packets_ = nullptr;
+
+  for (uint8_t i = 0; i < 4; i++) {
+    hip_positions_[i] = HipPosition(hip_layout_parameters_, i);
+  }
   SetDefaultCartesianPositions();
 }
 
@@ -76,26 +163,89 @@ DriveControlMode DriveSystem::CheckErrors() {
     if (abs(GetActuatorPosition(i)) > fault_position_) {
       Serial << "actuator[" << i << "] hit fault position: " << fault_position_
              << endl;
+      RecordFault(DriveFaultCode::kPosition, i, GetActuatorPosition(i));
       return DriveControlMode::kError;
     }
     // check velocities
     if (abs(GetActuatorVelocity(i)) > fault_velocity_) {
       Serial << "actuator[" << i << "] hit fault velocity: " << fault_velocity_
              << endl;
+      RecordFault(DriveFaultCode::kVelocity, i, GetActuatorVelocity(i));
       return DriveControlMode::kError;
     }
   }
   return DriveControlMode::kIdle;
 }
 
-void DriveSystem::SetIdle() { control_mode_ = DriveControlMode::kIdle; }
+void DriveSystem::RecordFault(DriveFaultCode code, int8_t actuator,
+                              float value) {
+  last_fault_.code = code;
+  last_fault_.actuator = actuator;
+  last_fault_.value = value;
+  last_fault_.time_millis = millis();
+}
+
+DriveFault DriveSystem::LastFault() { return last_fault_; }
+
+void DriveSystem::SetIdle() {
+  EnterMode(DriveControlMode::kIdle);
+  streaming_ = false;
+  homing_transition_ = Task();
+  StopMotion();
+  cogging_calibration_ = Task();
+}
+
+void DriveSystem::EnterMode(DriveControlMode mode) {
+  if (mode == control_mode_) {
+    return;
+  }
+  control_mode_ = mode;
+  modes_.Enter(mode, *this);
+}
+
+void DriveSystem::SelectMode(DriveControlMode mode) {
+  if (control_mode_ != DriveControlMode::kPerLegControl) {
+    EnterMode(mode);
+  }
+}
+
+void DriveSystem::SetLegModes(const LegControlModes &modes) {
+  leg_modes_ = modes;
+  homing_transition_ = Task();
+  cogging_calibration_ = Task();
+  EnterMode(DriveControlMode::kPerLegControl);
+}
+
+bool DriveSystem::LoadCoggingTable(LogStorage &storage) {
+  cogging_storage_ = &storage;
+  return cogging_.Load(storage);
+}
+
+void DriveSystem::StartCoggingCalibration() {
+  cogging_calibration_ = CoggingCalibration();
+  if (cogging_calibration_.Done()) {
+    Serial << "Could not start the cogging calibration" << endl;
+    return;
+  }
+  homing_transition_ = Task();
+  EnterMode(DriveControlMode::kCoggingCalibration);
+}
+
+void DriveSystem::SetCoggingCompensation(bool enabled) {
+  cogging_enabled_ = enabled;
+}
+
+bool DriveSystem::IsIdle() const {
+  return control_mode_ == DriveControlMode::kIdle ||
+         control_mode_ == DriveControlMode::kError;
+}
 
 void DriveSystem::SetupIMU(int filter_frequency) { imu.Setup(filter_frequency); }
 
 void DriveSystem::UpdateIMU() { imu.Update(); }
 
 void DriveSystem::ExecuteHomingSequence() {
-  control_mode_ = DriveControlMode::kHoming;
+  EnterMode(DriveControlMode::kHoming);
   for (size_t i = 0; i < kNumActuators; i++) {
     homed_axes_[i] = false;
   }
@@ -126,8 +276,8 @@ void DriveSystem::SetZeroPositions(ActuatorPositionVector zero) {
 ActuatorPositionVector DriveSystem::DefaultCartesianPositions() {
   ActuatorPositionVector pos;
   for (int i = 0; i < 4; i++) {
-    BLA::Matrix<3> p = ForwardKinematics({0, 0, 0}, leg_parameters_, i) +
-                       HipPosition(hip_layout_parameters_, i);
+    BLA::Matrix<3> p =
+        ForwardKinematics({0, 0, 0}, leg_parameters_, i) + hip_positions_[i];
     pos[3 * i] = p(0);
     pos[3 * i + 1] = p(1);
     pos[3 * i + 2] = p(2);
@@ -140,8 +290,26 @@ void DriveSystem::SetDefaultCartesianPositions() {
 }
 
 void DriveSystem::SetJointPositions(ActuatorPositionVector pos) {
-  control_mode_ = DriveControlMode::kPositionControl;
+  SelectMode(DriveControlMode::kPositionControl);
   position_reference_ = pos;
+  StopMotion();
+}
+
+bool DriveSystem::PlayMotion(uint8_t id, float speed) {
+  const MotionPrimitive *primitive = GetMotionPrimitive(id);
+  if (primitive == nullptr || !(speed > 0.0f && speed <= kMaxMotionSpeed)) {
+    return false;
+  }
+  // Free the frame of a primitive that is still playing first.
+  StopMotion();
+  motion_ = MotionPlayback(*primitive, speed);
+  if (motion_.Done()) {
+    return false;
+  }
+  motion_id_ = id;
+  homing_transition_ = Task();
+  SelectMode(DriveControlMode::kPositionControl);
+  return true;
 }
 
 void DriveSystem::SetPositionKp(float kp) { position_gains_.kp = kp; }
@@ -157,12 +325,12 @@ void DriveSystem::SetCartesianKd3x3(BLA::Matrix<3, 3> kd) {
 }
 
 void DriveSystem::SetCartesianPositions(ActuatorPositionVector pos) {
-  control_mode_ = DriveControlMode::kCartesianPositionControl;
+  SelectMode(DriveControlMode::kCartesianPositionControl);
   cartesian_position_reference_ = pos;
 }
 
 void DriveSystem::SetCartesianVelocities(ActuatorVelocityVector vel) {
-  control_mode_ = DriveControlMode::kCartesianPositionControl;
+  SelectMode(DriveControlMode::kCartesianPositionControl);
   cartesian_velocity_reference_ = vel;
 }
 
@@ -171,8 +339,77 @@ void DriveSystem::SetFeedForwardForce(BLA::Matrix<12> force) {
 }
 
 void DriveSystem::SetCurrent(uint8_t i, float current_reference) {
-  control_mode_ = DriveControlMode::kCurrentControl;
+  SelectMode(DriveControlMode::kCurrentControl);
   current_reference_[i] = current_reference;
+  streaming_ = false;
+}
+
+void DriveSystem::StreamCurrents(const ActuatorCurrentVector &currents) {
+  uint32_t now = micros();
+  if (streaming_ && (control_mode_ == DriveControlMode::kCurrentControl ||
+                     control_mode_ == DriveControlMode::kPerLegControl)) {
+    host_latency_micros_ = now - last_state_frame_micros_;
+  }
+  SelectMode(DriveControlMode::kCurrentControl);
+  current_reference_ = currents;
+  streaming_ = true;
+  last_stream_frame_micros_ = now;
+}
+
+void DriveSystem::SetStreamTimeout(uint32_t timeout_micros) {
+  stream_timeout_micros_ = timeout_micros;
+}
+
+void DriveSystem::WriteStreamState(uint32_t seq) {
+  const uint32_t kPayloadSize = 16 + 3 * 4 * kNumActuators;
+  uint8_t frame[4 + kPayloadSize];
+  frame[0] = 0x47;
+  frame[1] = 0x47;
+  frame[2] = kPayloadSize >> 8 & 0xff;
+  frame[3] = kPayloadSize & 0xff;
+  memcpy(frame + 4, &seq, 4);
+  memcpy(frame + 8, &snapshot_.time_micros, 4);
+  memcpy(frame + 12, &host_latency_micros_, 4);
+  frame[16] = static_cast<uint8_t>(control_mode_);
+  frame[17] = static_cast<uint8_t>(last_fault_.code);
+  memcpy(frame + 18, &stream_timeouts_, 2);
+  uint8_t *values = frame + 20;
+  memcpy(values, snapshot_.positions.data(), 4 * kNumActuators);
+  memcpy(values + 4 * kNumActuators, snapshot_.velocities.data(),
+         4 * kNumActuators);
+  memcpy(values + 8 * kNumActuators, snapshot_.currents.data(),
+         4 * kNumActuators);
+  Serial.write(frame, sizeof(frame));
+  last_state_frame_micros_ = micros();
+}
+
+void DriveSystem::SetEnergyWindow(uint32_t window_micros) {
+  energy_.Reset(window_micros);
+  energy_window_done_ = false;
+}
+
+void DriveSystem::WriteEnergyFrame() {
+  const uint32_t kPayloadSize = 8 + 6 * 4 * kNumActuators;
+  uint8_t frame[4 + kPayloadSize];
+  frame[0] = 0x48;
+  frame[1] = 0x48;
+  frame[2] = kPayloadSize >> 8 & 0xff;
+  frame[3] = kPayloadSize & 0xff;
+  const EnergyMeter::Window &window = energy_.LastWindow();
+  const EnergyMeter::Totals &totals = energy_.GetTotals();
+  memcpy(frame + 4, &snapshot_.time_micros, 4);
+  memcpy(frame + 8, &window.duration_micros, 4);
+  float values[6 * kNumActuators];
+  for (uint8_t i = 0; i < kNumActuators; i++) {
+    values[i] = window.electrical_power[i];
+    values[kNumActuators + i] = window.mechanical_power[i];
+    values[2 * kNumActuators + i] = totals.consumed[i];
+    values[3 * kNumActuators + i] = totals.regenerated[i];
+    values[4 * kNumActuators + i] = totals.positive_work[i];
+    values[5 * kNumActuators + i] = totals.negative_work[i];
+  }
+  memcpy(frame + 12, values, sizeof(values));
+  Serial.write(frame, sizeof(frame));
 }
 
 void DriveSystem::SetFaultCurrent(float fault_current) {
@@ -190,149 +427,349 @@ void DriveSystem::SetMaxCurrent(float max_current) {
 BLA::Matrix<12> DriveSystem::CartesianPositionControl() {
   BLA::Matrix<12> actuator_torques;
   for (int leg_index = 0; leg_index < 4; leg_index++) {
-    auto joint_angles = LegJointAngles(leg_index);
-    auto joint_velocities = LegJointVelocities(leg_index);
-    BLA::Matrix<3, 3> jac =
-        LegJacobian(joint_angles, leg_parameters_, leg_index);
-
-    auto measured_hip_relative_positions =
-        ForwardKinematics(joint_angles, leg_parameters_, leg_index);
-    auto measured_velocities = jac * joint_velocities;
-    auto reference_hip_relative_positions =
-        LegCartesianPositionReference(leg_index) -
-        HipPosition(hip_layout_parameters_, leg_index);
-    auto reference_velocities = LegCartesianVelocityReference(leg_index);
-
-    auto cartesian_forces =
-        PDControl3(measured_hip_relative_positions, measured_velocities,
-                   reference_hip_relative_positions, reference_velocities,
-                   cartesian_position_gains_) +
-        LegFeedForwardForce(leg_index);
-    auto knee_angle = joint_angles(2);
-    auto knee_constraint_torque = (knee_angle > knee_soft_limit) ? position_gains_.kp * (knee_soft_limit - knee_angle) : 0.0;
-    auto joint_torques = ~jac * cartesian_forces;
-
-    // Ensures that the direction of the force is preserved when motors
-    // saturate
-    float norm = Utils::InfinityNorm3(joint_torques);
-    if (norm > max_current_) {
-      joint_torques = joint_torques * max_current_ / norm;
+    BLA::Matrix<3> joint_torques = {0, 0, 0};
+    if (LegActive(active_mask_, leg_index)) {
+      joint_torques = CartesianLegCurrents(leg_index);
     }
-
     actuator_torques(3 * leg_index) = joint_torques(0);
     actuator_torques(3 * leg_index + 1) = joint_torques(1);
-    actuator_torques(3 * leg_index + 2) = joint_torques(2) + knee_constraint_torque;
+    actuator_torques(3 * leg_index + 2) = joint_torques(2);
   }
   return actuator_torques;
 }
 
-void DriveSystem::Update() {
-  // If there are errors, put the system in the error state.
-  if (CheckErrors() == DriveControlMode::kError) {
-    control_mode_ = DriveControlMode::kError;
-  }
+BLA::Matrix<3> DriveSystem::CartesianLegCurrents(uint8_t leg_index) {
+  KneeSoftLimit knee_limit = {knee_soft_limit, position_gains_.kp};
+  auto reference_hip_relative_positions =
+      LegCartesianPositionReference(leg_index) - hip_positions_[leg_index];
+  return CartesianLegControl(
+      LegJointAngles(leg_index), LegJointVelocities(leg_index),
+      reference_hip_relative_positions,
+      LegCartesianVelocityReference(leg_index), LegFeedForwardForce(leg_index),
+      cartesian_position_gains_, knee_limit, max_current_, leg_parameters_,
+      leg_index);
+}
 
-  switch (control_mode_) {
-    case DriveControlMode::kError: {
-      Serial << "ERROR" << endl;
-      CommandIdle();
-      break;
-    }
-    case DriveControlMode::kIdle: {
-      CommandIdle();
-      break;
-    }
-    case DriveControlMode::kHoming: {
-      start_position_ = GetRawActuatorPositions();
-      bool position_warning = false;
+bool DriveSystem::LegActive(const ActuatorActivations &mask,
+                            uint8_t leg_index) {
+  return mask[3 * leg_index] || mask[3 * leg_index + 1] ||
+         mask[3 * leg_index + 2];
+}
 
-      for (size_t i = 0; i < kNumActuators; i++) {
-        if (abs(start_position_[i]) > 0.15) {
-          position_warning = true;
+ActuatorCurrentVector DriveSystem::LegControlCurrents(
+    const LegControlModes &modes, const ActuatorActivations &mask) {
+  ActuatorCurrentVector currents;
+  currents.fill(0.0f);
+  for (uint8_t leg_index = 0; leg_index < 4; leg_index++) {
+    if (!LegActive(mask, leg_index)) {
+      continue;
+    }
+    switch (modes[leg_index]) {
+      case LegControlMode::kIdle: {
+        break;
+      }
+      case LegControlMode::kJointPosition: {
+        for (uint8_t i = 3 * leg_index; i < 3 * leg_index + 3; i++) {
+          if (mask[i]) {
+            PD(currents[i], GetActuatorPosition(i), GetActuatorVelocity(i),
+               position_reference_[i], velocity_reference_[i],
+               position_gains_);
+          }
         }
+        break;
       }
-
-      if (position_warning) {
-        Serial << "WARNING: Initial position is not zero" << endl;
-        control_mode_ = DriveControlMode::kError;
+      case LegControlMode::kCartesianPosition: {
+        BLA::Matrix<3> joint_currents = CartesianLegCurrents(leg_index);
+        for (uint8_t j = 0; j < 3; j++) {
+          currents[3 * leg_index + j] = joint_currents(j);
+        }
         break;
       }
-
-      for (size_t i = 0; i < kNumActuators; i++) {
-        zero_position_[i] = start_position_[i] -
-                            (zero_positions_cmd_[i] *
-                             direction_multipliers_[i] * homing_directions_[i]);
-        homed_axes_[i] = true;
+      case LegControlMode::kCurrent: {
+        for (uint8_t i = 3 * leg_index; i < 3 * leg_index + 3; i++) {
+          currents[i] = current_reference_[i];
+        }
+        break;
       }
-      ActuatorPositionVector non_constrained_positions;
+    }
+  }
+  return currents;
+}
 
-      for (size_t i = 0; i < kNumActuators; i++) {
-        non_constrained_positions[i] =
-            initial_positions_[i] * homing_directions_[i];
-      }
+ActuatorActivations DriveSystem::OutputMask() const {
+  if (control_mode_ != DriveControlMode::kPerLegControl) {
+    return active_mask_;
+  }
+  ActuatorActivations mask = active_mask_;
+  for (uint8_t leg_index = 0; leg_index < 4; leg_index++) {
+    if (leg_modes_[leg_index] == LegControlMode::kIdle) {
+      mask[3 * leg_index] = false;
+      mask[3 * leg_index + 1] = false;
+      mask[3 * leg_index + 2] = false;
+    }
+  }
+  return mask;
+}
 
-      position_reference_ =
-          Utils::Constrain(non_constrained_positions, float(-PI), float(PI));
-      Serial << "Homing complete" << endl;
-      // Switch to position control mode
-      just_homed_ = true;
-      control_mode_ = DriveControlMode::kPositionControl;
+bool DriveSystem::CheckStreamTimeout() {
+  uint32_t silence = micros() - last_stream_frame_micros_;
+  if (!streaming_ || stream_timeout_micros_ == 0 ||
+      silence <= stream_timeout_micros_) {
+    return false;
+  }
+  RecordFault(DriveFaultCode::kStreamTimeout, -1, silence);
+  stream_timeouts_++;
+  SetIdle();
+  CommandIdle();
+  return true;
+}
+
+Task DriveSystem::HomingTransition() {
+  const unsigned long transition_duration = 5000;
+  unsigned long transition_start_time = millis();
+  ActuatorPositionVector start_positions = GetActuatorPositions();
+  ActuatorPositionVector target_positions = position_reference_;
+
+  // Every tick ends in CommandCurrents(): the tick that reaches the targets
+  // finishes the task without suspending, so the next tick is plain
+  // position control.
+  while (true) {
+    float progress =
+        (float)(millis() - transition_start_time) / transition_duration;
+    progress = (progress < 0.0f)   ? 0.0f
+               : (progress > 1.0f) ? 1.0f
+                                   : progress;
+    float smooth_progress = 0.5f - 0.5f * cos(progress * PI);
+
+    ActuatorCurrentVector pd_current;
+    for (size_t i = 0; i < kNumActuators; i++) {
+      float interpolated_position =
+          start_positions[i] +
+          (target_positions[i] - start_positions[i]) * smooth_progress;
+      PD(pd_current[i], GetActuatorPosition(i), GetActuatorVelocity(i),
+         interpolated_position, velocity_reference_[i], position_gains_);
     }
-    case DriveControlMode::kPositionControl: {
-      if (just_homed_) {
-        static unsigned long transition_start_time = millis();
-        static ActuatorPositionVector start_positions = GetActuatorPositions();
-        static ActuatorPositionVector target_positions = position_reference_;
-
-        const unsigned long transition_duration = 5000;
-        float progress =
-            (float)(millis() - transition_start_time) / transition_duration;
-        progress = (progress < 0.0f)   ? 0.0f
-                   : (progress > 1.0f) ? 1.0f
-                                       : progress;
-        float smooth_progress = 0.5f - 0.5f * cos(progress * PI);
-
-        ActuatorPositionVector interpolated_positions;
-        for (size_t i = 0; i < kNumActuators; i++) {
-          interpolated_positions[i] =
-              start_positions[i] +
-              (target_positions[i] - start_positions[i]) * smooth_progress;
-        }
+    CommandCurrents(pd_current);
+    if (progress >= 1.0f) {
+      break;
+    }
+    co_await NextTick();
+  }
+}
 
-        ActuatorCurrentVector pd_current;
-        for (size_t i = 0; i < kNumActuators; i++) {
-          PD(pd_current[i], GetActuatorPosition(i), GetActuatorVelocity(i),
-             interpolated_positions[i], velocity_reference_[i],
-             position_gains_);
-        }
-        CommandCurrents(pd_current);
+void DriveSystem::StopMotion() {
+  motion_ = Task();
+  motion_id_ = -1;
+  velocity_reference_.fill(0.0);
+}
+
+Task DriveSystem::MotionPlayback(const MotionPrimitive &primitive,
+                                 float speed) {
+  MotionPlayer player;
+  player.Start(primitive, GetActuatorPositions(), speed);
+  uint32_t start = micros();
+  while (player.Sample(micros() - start, position_reference_,
+                       velocity_reference_)) {
+    co_await NextTick();
+  }
+  // No text here: this runs in the control tick, between binary frames.
+  // The end shows as "motion": -1 in a kQueryMode reply.
+  motion_id_ = -1;
+}
+
+Task DriveSystem::CoggingCalibration() {
+  // Two rotor revolutions centred on the hold position, so every bin is
+  // crossed at least twice per direction.
+  const float kRange = 2 * 2 * PI / CoggingCompensation::kGearRatio;
+  const float kSweepVelocity = 0.1;  // rad/s at the output
+  const uint32_t kMoveMillis = 1000;   // to and from the sweep start
+  const uint32_t kSettleMillis = 200;  // not sampled after each reversal
+  const uint32_t sweep_millis = 1000 * kRange / kSweepVelocity;
+  // Out to -kRange/2, sweep up, sweep down, back to the hold position.
+  const float phase_starts[4] = {0, -kRange / 2, kRange / 2, -kRange / 2};
+  const float phase_ends[4] = {-kRange / 2, kRange / 2, -kRange / 2, 0};
+
+  ActuatorPositionVector hold = GetActuatorPositions();
+  for (uint8_t axis = 0; axis < kNumActuators; axis++) {
+    if (!active_mask_[axis]) {
+      continue;
+    }
+    cogging_.BeginAxis(axis);
+    for (int phase = 0; phase < 4; phase++) {
+      bool sweep = phase == 1 || phase == 2;
+      uint32_t duration = sweep ? sweep_millis : kMoveMillis;
+      uint32_t start = millis();
+      uint32_t elapsed = 0;
+      while (elapsed < duration) {
+        elapsed = millis() - start;
+        elapsed = elapsed > duration ? duration : elapsed;
+        ActuatorPositionVector reference = hold;
+        reference[axis] += phase_starts[phase] +
+                           (phase_ends[phase] - phase_starts[phase]) *
+                               elapsed / duration;
 
-        if (progress >= 1.0f) {
-          just_homed_ = false;
-        }
-      } else {
         ActuatorCurrentVector pd_current;
         for (size_t i = 0; i < kNumActuators; i++) {
           PD(pd_current[i], GetActuatorPosition(i), GetActuatorVelocity(i),
-             position_reference_[i], velocity_reference_[i], position_gains_);
+             reference[i], 0.0f, position_gains_);
         }
         CommandCurrents(pd_current);
+        if (sweep && elapsed >= kSettleMillis) {
+          // The tables are in the motor frame.
+          int direction = (phase == 1 ? 1 : -1) * direction_multipliers_[axis];
+          cogging_.AddSample(
+              snapshot_.rotor_counts[axis],
+              last_commanded_current_[axis] * direction_multipliers_[axis] *
+                  1000,
+              direction);
+        }
+        co_await NextTick();
       }
-      break;
     }
-    case DriveControlMode::kCartesianPositionControl: {
-      CommandCurrents(Utils::VectorToArray<12, 12>(CartesianPositionControl()));
-      break;
+    if (!cogging_.FinishAxis()) {
+      Serial << "Cogging calibration incomplete for axis " << axis << endl;
     }
-    case DriveControlMode::kCurrentControl: {
-      CommandCurrents(current_reference_);
-      break;
+  }
+  if (cogging_storage_ && cogging_.Valid() &&
+      !cogging_.Save(*cogging_storage_)) {
+    Serial << "Could not save the cogging table" << endl;
+  }
+  Serial << "Cogging calibration done" << endl;
+  position_reference_ = hold;
+  EnterMode(DriveControlMode::kPositionControl);
+}
+
+void DriveSystem::UpdateSnapshot() {
+  snapshot_.time_millis = millis();
+  snapshot_.time_micros = micros();
+  for (uint8_t i = 0; i < kNumActuators; i++) {
+    C610 controller = GetController(i);
+    snapshot_.positions[i] =
+        (controller.Position() - zero_position_[i]) * direction_multipliers_[i];
+    snapshot_.velocities[i] = controller.Velocity() * direction_multipliers_[i];
+    snapshot_.currents[i] = controller.Current() * direction_multipliers_[i];
+    snapshot_.rotor_counts[i] = controller.Counts();
+    snapshot_.electrical_power[i] = controller.ElectricalPower();
+    snapshot_.mechanical_power[i] = controller.MechanicalPower();
+  }
+}
+
+const DriveSnapshot &DriveSystem::Snapshot() { return snapshot_; }
+
+void DriveSystem::Update() {
+  UpdateSnapshot();
+  energy_window_done_ =
+      energy_.Update(snapshot_.time_micros, snapshot_.electrical_power,
+                     snapshot_.mechanical_power);
+
+  // Advance the references of a playing motion before the laws use them.
+  if (!motion_.Done() && !IsIdle()) {
+    motion_.Resume();
+  }
+
+  // If there are errors, put the system in the error state.
+  if (CheckErrors() == DriveControlMode::kError) {
+    EnterMode(DriveControlMode::kError);
+  }
+
+  modes_.Step(control_mode_, *this);
+}
+
+void DriveSystem::IdleController::Step(DriveSystem &drive) {
+  drive.CommandIdle();
+}
+
+void DriveSystem::ErrorController::Step(DriveSystem &drive) {
+  Serial << "ERROR" << endl;
+  drive.CommandIdle();
+}
+
+void DriveSystem::HomingController::OnEnter(DriveSystem &drive) {
+  ActuatorPositionVector non_constrained_positions;
+  for (size_t i = 0; i < kNumActuators; i++) {
+    homed_offsets[i] = drive.zero_positions_cmd_[i] *
+                       drive.direction_multipliers_[i] *
+                       drive.homing_directions_[i];
+    non_constrained_positions[i] =
+        drive.initial_positions_[i] * drive.homing_directions_[i];
+  }
+  targets = Utils::Constrain(non_constrained_positions, float(-PI), float(PI));
+}
+
+void DriveSystem::HomingController::Step(DriveSystem &drive) {
+  drive.start_position_ = drive.GetRawActuatorPositions();
+  bool position_warning = false;
+
+  for (size_t i = 0; i < kNumActuators; i++) {
+    if (abs(drive.start_position_[i]) > 0.15) {
+      position_warning = true;
+      drive.RecordFault(DriveFaultCode::kHomingPosition, i,
+                        drive.start_position_[i]);
+    }
+  }
+
+  if (position_warning) {
+    Serial << "WARNING: Initial position is not zero" << endl;
+    drive.EnterMode(DriveControlMode::kError);
+    return;
+  }
+
+  for (size_t i = 0; i < kNumActuators; i++) {
+    drive.zero_position_[i] = drive.start_position_[i] - homed_offsets[i];
+    drive.homed_axes_[i] = true;
+  }
+  drive.position_reference_ = targets;
+  Serial << "Homing complete" << endl;
+  // Switch to position control mode and start easing to the targets now.
+  drive.homing_transition_ = drive.HomingTransition();
+  drive.EnterMode(DriveControlMode::kPositionControl);
+  drive.modes_.Get<PositionController>().Step(drive);
+}
+
+void DriveSystem::PositionController::Step(DriveSystem &drive) {
+  if (!drive.homing_transition_.Done()) {
+    drive.homing_transition_.Resume();
+    return;
+  }
+  ActuatorCurrentVector pd_current;
+  for (size_t i = 0; i < kNumActuators; i++) {
+    pd_current[i] = 0.0f;
+    if (drive.active_mask_[i]) {
+      PD(pd_current[i], drive.GetActuatorPosition(i),
+         drive.GetActuatorVelocity(i), drive.position_reference_[i],
+         drive.velocity_reference_[i], drive.position_gains_);
     }
   }
+  drive.CommandCurrents(pd_current);
+}
+
+void DriveSystem::CartesianController::Step(DriveSystem &drive) {
+  drive.CommandCurrents(
+      Utils::VectorToArray<12, 12>(drive.CartesianPositionControl()));
+}
+
+void DriveSystem::CurrentController::Step(DriveSystem &drive) {
+  if (drive.CheckStreamTimeout()) {
+    return;
+  }
+  drive.CommandCurrents(drive.current_reference_);
+}
+
+void DriveSystem::CoggingController::Step(DriveSystem &drive) {
+  drive.cogging_calibration_.Resume();
+}
+
+void DriveSystem::PerLegController::Step(DriveSystem &drive) {
+  if (drive.CheckStreamTimeout()) {
+    return;
+  }
+  drive.CommandCurrents(
+      drive.LegControlCurrents(drive.leg_modes_, drive.active_mask_));
 }
 
 void DriveSystem::SetActivations(ActuatorActivations acts) {
   active_mask_ = acts;  // Is this a copy?
+  status_columns_valid_ = false;
 }
 
 void DriveSystem::CommandIdle() {
@@ -342,16 +779,31 @@ void DriveSystem::CommandIdle() {
 }
 
 void DriveSystem::CommandCurrents(ActuatorCurrentVector currents) {
+  // Cogging compensation goes in before the limits so that they still hold.
+  // It is left out while idle, where the motors must get exactly 0 A, and
+  // while the tables are being measured.
+  if (cogging_enabled_ && cogging_.Valid() && !IsIdle() &&
+      control_mode_ != DriveControlMode::kCoggingCalibration) {
+    std::array<int32_t, kNumActuators> compensation_mA;
+    cogging_.Compute(snapshot_.rotor_counts, compensation_mA);
+    for (size_t i = 0; i < kNumActuators; i++) {
+      currents[i] += compensation_mA[i] * direction_multipliers_[i] * 0.001f;
+    }
+  }
   ActuatorCurrentVector current_command =
       Utils::Constrain(currents, -max_current_, max_current_);
   if (Utils::Maximum(current_command) > fault_current_ ||
       Utils::Minimum(current_command) < -fault_current_) {
     Serial << "Requested current too large. Erroring out. Current request: " << current_command << endl;
-    control_mode_ = DriveControlMode::kError;
+    float largest = Utils::Maximum(current_command);
+    float smallest = Utils::Minimum(current_command);
+    RecordFault(DriveFaultCode::kCurrent, -1,
+                largest > -smallest ? largest : smallest);
+    EnterMode(DriveControlMode::kError);
     return;
   }
-  // Set disabled motors to zero current
-  current_command = Utils::MaskArray(current_command, active_mask_);
+  // Set disabled motors, and the motors of idle legs, to zero current
+  current_command = Utils::MaskArray(current_command, OutputMask());
 
   // Update record of last commanded current
   last_commanded_current_ = current_command;
@@ -376,7 +828,8 @@ C610 DriveSystem::GetController(uint8_t i) {
     return rear_bus_.Get(i - 6);
   } else {
     Serial << "Invalid actuator index. Must be 0<=i<=11." << endl;
-    control_mode_ = DriveControlMode::kError;
+    RecordFault(DriveFaultCode::kInvalidActuator, i, 0.0);
+    EnterMode(DriveControlMode::kError);
     return C610();
   }
 }
@@ -458,70 +911,111 @@ BLA::Matrix<3> DriveSystem::LegFeedForwardForce(uint8_t i) {
   return {ff_force_(3 * i), ff_force_(3 * i + 1), ff_force_(3 * i + 2)};
 }
 
-void DriveSystem::PrintHeader(DrivePrintOptions options) {
-  if (options.time) {
-    Serial << "T" << options.delimiter;
+void DriveSystem::UpdateStatusColumns(DrivePrintOptions options) {
+  uint32_t signal_mask = 0;
+  uint32_t signal_bit = 1;
+#define OPTION_BIT(key, label, type, scale, option, accessor) \
+  signal_mask |= options.option ? signal_bit : 0;             \
+  signal_bit <<= 1;
+  DRIVE_SCALAR_SIGNALS(OPTION_BIT)
+  DRIVE_ACTUATOR_SIGNALS(OPTION_BIT)
+#undef OPTION_BIT
+  if (status_columns_valid_ && signal_mask == status_signal_mask_) {
+    return;
   }
-  for (size_t i = 0; i < kNumActuators; i++) {
-    if (!active_mask_[i]) continue;
-    if (options.positions) {
-      Serial << "p[" << i << "]" << options.delimiter;
-    }
-    if (options.velocities) {
-      Serial << "v[" << i << "]" << options.delimiter;
-    }
-    if (options.currents) {
-      Serial << "I[" << i << "]" << options.delimiter;
+  status_signal_mask_ = signal_mask;
+  status_columns_valid_ = true;
+
+  num_status_signals_ = 0;
+  num_status_scalars_ = 0;
+  for (uint8_t s = 0; s < kNumDriveSignals; s++) {
+    if (signal_mask & 1ul << s) {
+      status_signals_[num_status_signals_++] = s;
+      num_status_scalars_ += s < kNumDriveScalarSignals;
     }
-    if (options.position_references) {
-      Serial << "pr[" << i << "]" << options.delimiter;
-    }
-    if (options.velocity_references) {
-      Serial << "vr[" << i << "]" << options.delimiter;
-    }
-    if (options.current_references) {
-      Serial << "Ir[" << i << "]" << options.delimiter;
+  }
+
+  uint8_t columns[kNumDriveSystemDebugValues];
+  uint8_t num_columns = DebugDataColumns(signal_mask, columns);
+  num_status_columns_ = 0;
+  for (uint8_t k = 0; k < num_columns; k++) {
+    uint8_t column = columns[k];
+    if (column >= kNumDriveScalarSignals &&
+        !active_mask_[(column - kNumDriveScalarSignals) /
+                      kNumDriveActuatorSignals]) {
+      continue;
     }
-    if (options.last_current) {
-      Serial << "Il[" << i << "]" << options.delimiter;
+    status_columns_[num_status_columns_] = column;
+    status_formatters_[num_status_columns_] = kAddStatusValue[static_cast<
+        uint8_t>(kDriveSignals[ColumnSignal(column)].type)];
+    num_status_columns_++;
+  }
+}
+
+void DriveSystem::WriteSignalValues(DriveSignalValue *values) {
+#define WRITE_VALUE(key, label, type, scale, option, accessor) \
+  SetSignalValue(*values++, static_cast<type>(accessor));
+  DRIVE_SCALAR_SIGNALS(WRITE_VALUE)
+  for (uint8_t i = 0; i < kNumActuators; i++) {
+    DRIVE_ACTUATOR_SIGNALS(WRITE_VALUE)
+  }
+#undef WRITE_VALUE
+}
+
+void DriveSystem::PrintHeader(DrivePrintOptions options) {
+  UpdateStatusColumns(options);
+  for (uint8_t k = 0; k < num_status_columns_; k++) {
+    uint8_t column = status_columns_[k];
+    Serial << kDriveSignals[ColumnSignal(column)].label;
+    if (column >= kNumDriveScalarSignals) {
+      Serial << "["
+             << (column - kNumDriveScalarSignals) / kNumDriveActuatorSignals
+             << "]";
     }
+    Serial << options.delimiter;
   }
   Serial << endl;
 }
 
 void DriveSystem::PrintMsgPackStatus(DrivePrintOptions options) {
-  StaticJsonDocument<2048> doc;
-  // 21 micros to put this doc together
-  doc["ts"] = millis();
-  doc["yaw"] = imu.yaw;
-  doc["pitch"] = imu.pitch;
-  doc["roll"] = imu.roll;
-  doc["yaw_rate"] = imu.yaw_rate;
-  doc["pitch_rate"] = imu.pitch_rate;
-  doc["roll_rate"] = imu.roll_rate;
-  for (uint8_t i = 0; i < kNumActuators; i++) {
-    if (options.positions) {
-      doc["pos"][i] = GetActuatorPosition(i);
-    }
-    if (options.velocities) {
-      doc["vel"][i] = GetActuatorVelocity(i);
-    }
-    if (options.currents) {
-      doc["cur"][i] = GetActuatorCurrent(i);
-    }
-    if (options.position_references) {
-      doc["pref"][i] = position_reference_[i];
-    }
-    if (options.velocity_references) {
-      doc["vref"][i] = velocity_reference_[i];
-    }
-    if (options.current_references) {
-      doc["cref"][i] = current_reference_[i];
-    }
-    if (options.last_current) {
-      doc["lcur"][i] = last_commanded_current_[i];
+  UpdateStatusColumns(options);
+  DriveSignalValue values[kNumDriveSystemDebugValues];
+  WriteSignalValues(values);
+  JsonDocument doc(&json_heap_);
+  for (uint8_t k = 0; k < num_status_scalars_; k++) {
+    uint8_t s = status_signals_[k];
+    kSetJsonValue[static_cast<uint8_t>(kDriveSignals[s].type)](
+        doc[kDriveSignals[s].key].to<JsonVariant>(), values[s]);
+  }
+  for (uint8_t k = num_status_scalars_; k < num_status_signals_; k++) {
+    uint8_t s = status_signals_[k];
+    auto set_value = kSetJsonValue[static_cast<uint8_t>(kDriveSignals[s].type)];
+    JsonArray array = doc[kDriveSignals[s].key].to<JsonArray>();
+    for (uint8_t i = 0; i < kNumActuators; i++) {
+      set_value(array.add<JsonVariant>(),
+                values[kNumDriveScalarSignals + i * kNumDriveActuatorSignals +
+                       s - kNumDriveScalarSignals]);
     }
   }
+  WriteMsgPackFrame(doc);
+}
+
+void DriveSystem::PrintMsgPackSchema() {
+  JsonDocument doc(&json_heap_);
+  doc["row"] = kNumDriveSystemDebugValues;
+  JsonArray schema = doc["schema"].to<JsonArray>();
+  for (uint8_t s = 0; s < kNumDriveSignals; s++) {
+    JsonArray entry = schema.add<JsonArray>();
+    entry.add(kDriveSignals[s].key);
+    entry.add(kDriveSignals[s].label);
+    entry.add(static_cast<uint8_t>(kDriveSignals[s].type));
+    entry.add(kDriveSignals[s].scale);
+    entry.add(kDriveSignals[s].count);
+  }
+  WriteMsgPackFrame(doc);
+}
+
+void DriveSystem::WriteMsgPackFrame(const JsonDocument &doc) {
   uint16_t num_bytes = measureMsgPack(doc);
   // Serial.println(num_bytes);
   Serial.write(69);
@@ -532,71 +1026,141 @@ void DriveSystem::PrintMsgPackStatus(DrivePrintOptions options) {
   Serial.println();
 }
 
-void DriveSystem::PrintStatus(DrivePrintOptions options) {
-  char delimiter = options.delimiter;
-  if (options.time) {
-    Serial << millis() << delimiter;
-  }
-  Serial << imu.yaw << delimiter;
-  Serial << imu.pitch << delimiter;
-  Serial << imu.roll << delimiter;
-  Serial << imu.yaw_rate << delimiter;
-  Serial << imu.pitch_rate << delimiter;
-  Serial << imu.roll_rate << delimiter;
-
-  for (uint8_t i = 0; i < kNumActuators; i++) {
-    if (!active_mask_[i]) continue;
-    if (options.positions) {
-      Serial.print(GetActuatorPosition(i), 2);
-      Serial << delimiter;
+void DriveSystem::PrintMsgPackQuery(StateQuery query) {
+  JsonDocument doc(&json_heap_);
+  doc["qid"] = query.id;
+  doc["ts"] = snapshot_.time_millis;
+  if (query.signals & kQueryJointStates) {
+    // Same readings as the control step used, not a fresh CAN read.
+    JsonArray pos = doc["pos"].to<JsonArray>();
+    JsonArray vel = doc["vel"].to<JsonArray>();
+    JsonArray cur = doc["cur"].to<JsonArray>();
+    for (uint8_t i = 0; i < kNumActuators; i++) {
+      pos.add(snapshot_.positions[i]);
+      vel.add(snapshot_.velocities[i]);
+      cur.add(snapshot_.currents[i]);
     }
-    if (options.velocities) {
-      Serial.print(GetActuatorVelocity(i), 2);
-      Serial << delimiter;
-    }
-    if (options.currents) {
-      Serial.print(GetActuatorCurrent(i), 2);
-      Serial << delimiter;
-    }
-    if (options.position_references) {
-      Serial.print(position_reference_[i], 2);
-      Serial << delimiter;
+  }
+  if (query.signals & kQueryReferences) {
+    JsonArray pref = doc["pref"].to<JsonArray>();
+    JsonArray vref = doc["vref"].to<JsonArray>();
+    JsonArray cref = doc["cref"].to<JsonArray>();
+    JsonArray lcur = doc["lcur"].to<JsonArray>();
+    JsonArray cart_pref = doc["cart_pref"].to<JsonArray>();
+    JsonArray ff = doc["ff"].to<JsonArray>();
+    for (uint8_t i = 0; i < kNumActuators; i++) {
+      pref.add(position_reference_[i]);
+      vref.add(velocity_reference_[i]);
+      cref.add(current_reference_[i]);
+      lcur.add(last_commanded_current_[i]);
+      cart_pref.add(cartesian_position_reference_[i]);
+      ff.add(ff_force_(i));
     }
-    if (options.velocity_references) {
-      Serial.print(velocity_reference_[i], 2);
-      Serial << delimiter;
+  }
+  if (query.signals & kQueryIMU) {
+    doc["yaw"] = imu.yaw;
+    doc["pitch"] = imu.pitch;
+    doc["roll"] = imu.roll;
+    doc["yaw_rate"] = imu.yaw_rate;
+    doc["pitch_rate"] = imu.pitch_rate;
+    doc["roll_rate"] = imu.roll_rate;
+  }
+  if (query.signals & kQueryMetrics) {
+    doc["elec_power"] = GetTotalElectricalPower();
+    doc["mech_power"] = GetTotalMechanicalPower();
+    doc["dropped_lines"] = dropped_status_lines_;
+    if (dropped_packets_ != nullptr) {
+      doc["dropped_packets"] = *dropped_packets_;
     }
-    if (options.current_references) {
-      Serial.print(current_reference_[i], 2);
-      Serial << delimiter;
+  }
+  if (query.signals & kQueryMode) {
+    doc["mode"] = static_cast<uint8_t>(control_mode_);
+    doc["max_current"] = max_current_;
+    JsonArray leg_modes = doc["leg_modes"].to<JsonArray>();
+    for (uint8_t i = 0; i < 4; i++) {
+      leg_modes.add(static_cast<uint8_t>(leg_modes_[i]));
     }
-    if (options.last_current) {
-      Serial.print(last_commanded_current_[i], 2);
-      Serial << delimiter;
+    doc["motion"] = motion_id_;
+    JsonArray act = doc["act"].to<JsonArray>();
+    for (uint8_t i = 0; i < kNumActuators; i++) {
+      act.add(active_mask_[i]);
     }
   }
-  Serial << endl;
-  Serial.flush();
+  if (query.signals & kQueryFault) {
+    doc["fault"] = static_cast<uint8_t>(last_fault_.code);
+    doc["fault_act"] = last_fault_.actuator;
+    doc["fault_val"] = last_fault_.value;
+    doc["fault_ts"] = last_fault_.time_millis;
+  }
+  if (query.signals & kQueryMemory && memory_budget_ != nullptr) {
+    memory_budget_->Report(doc);
+  }
+  WriteMsgPackFrame(doc);
+}
+
+void DriveSystem::SetMemoryBudget(const MemoryBudget *budget) {
+  memory_budget_ = budget;
 }
 
+void DriveSystem::SetDroppedPackets(const uint32_t *dropped_packets) {
+  dropped_packets_ = dropped_packets;
+}
+
+void DriveSystem::FormatStatus(DrivePrintOptions options, RowFormatter &row) {
+  UpdateStatusColumns(options);
+  DriveSignalValue values[kNumDriveSystemDebugValues];
+  WriteSignalValues(values);
+  for (uint8_t k = 0; k < num_status_columns_; k++) {
+    status_formatters_[k](row, values[status_columns_[k]]);
+  }
+  row.EndLine();
+}
+
+void DriveSystem::PrintStatus(DrivePrintOptions options) {
+  char line[kMaxStatusLineLength];
+  RowFormatter row(line, sizeof(line), options.delimiter);
+  FormatStatus(options, row);
+  // Drop the line rather than block the control loop on a full USB buffer.
+  if (row.Overflowed() ||
+      Serial.availableForWrite() < static_cast<int>(row.Length())) {
+    dropped_status_lines_++;
+    return;
+  }
+  Serial.write(row.Data(), row.Length());
+}
+
+uint32_t DriveSystem::DroppedStatusLines() { return dropped_status_lines_; }
+
 BLA::Matrix<kNumDriveSystemDebugValues> DriveSystem::DebugData() {
   uint32_t write_index = 0;
   BLA::Matrix<kNumDriveSystemDebugValues> output;
-  output(write_index++) = millis();
-  output(write_index++) = imu.yaw;
-  output(write_index++) = imu.pitch;
-  output(write_index++) = imu.roll;
-  output(write_index++) = imu.yaw_rate;
-  output(write_index++) = imu.pitch_rate;
-  output(write_index++) = imu.roll_rate;
+#define WRITE_SIGNAL(key, label, type, scale, option, accessor) \
+  output(write_index++) = static_cast<type>(accessor);
+  DRIVE_SCALAR_SIGNALS(WRITE_SIGNAL)
   for (uint8_t i = 0; i < kNumActuators; i++) {
-    output(write_index++) = GetActuatorPosition(i);
-    output(write_index++) = GetActuatorVelocity(i);
-    output(write_index++) = GetActuatorCurrent(i);
-    output(write_index++) = position_reference_[i];
-    output(write_index++) = velocity_reference_[i];
-    output(write_index++) = current_reference_[i];
-    output(write_index++) = last_commanded_current_[i];
+    DRIVE_ACTUATOR_SIGNALS(WRITE_SIGNAL)
   }
+#undef WRITE_SIGNAL
   return output;
-}
\ No newline at end of file
+}
+
+void DriveSystem::WriteDebugRow(LogRow row, uint32_t signal_mask) {
+  if (row.size < kNumDriveSystemDebugValues) {
+    return;
+  }
+  float *out = row.values;
+  uint32_t signal_bit = 1;
+#define WRITE_SELECTED(key, label, type, scale, option, accessor) \
+  if (signal_mask & signal_bit) {                                 \
+    *out = static_cast<type>(accessor);                           \
+  }                                                               \
+  out++;                                                          \
+  signal_bit <<= 1;
+  DRIVE_SCALAR_SIGNALS(WRITE_SELECTED)
+  uint32_t first_actuator_bit = signal_bit;
+  for (uint8_t i = 0; i < kNumActuators; i++) {
+    signal_bit = first_actuator_bit;
+    DRIVE_ACTUATOR_SIGNALS(WRITE_SELECTED)
+  }
+#undef WRITE_SELECTED
+}
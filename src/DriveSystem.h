@@ -1,21 +1,72 @@
 #pragma once
 
+#include <ArduinoJson.h>
 #include <BasicLinearAlgebra.h>
 
 #include "C610Bus.h"
+#include "CoggingCompensation.h"
+#include "DataLogger.h"
+#include "DriveModes.h"
+#include "DriveSignals.h"
+#include "EnergyMeter.h"
+#include "JsonHeapCounter.h"
 #include "Kinematics.h"
+#include "MemoryBudget.h"
+#include "MotionPrimitives.h"
+#include "LegControl.h"
 #include "PID.h"
 #include "RobotTypes.h"
+#include "RowFormatter.h"
+#include "Task.h"
 #include "IMU.h"
 
-// Enum for the various control modes: idle, position control, current control
-enum class DriveControlMode {
-  kIdle,
-  kError,  // For robot errors, not coding mistakes.
-  kHoming,
-  kPositionControl,
-  kCartesianPositionControl,
-  kCurrentControl,
+// Signals that can be requested with a StateQuery. Bits of StateQuery::signals.
+enum DriveQuerySignal : uint32_t {
+  kQueryJointStates = 1 << 0,  // pos, vel, cur
+  kQueryReferences = 1 << 1,   // pref, vref, cref, lcur, cart_pref, ff
+  kQueryIMU = 1 << 2,          // yaw, pitch, roll and their rates
+  kQueryMetrics = 1 << 3,      // total electrical and mechanical power,
+                               // dropped PrintStatus lines and telemetry
+                               // packets
+  kQueryMode = 1 << 4,         // control mode, activations, max current,
+                               // leg modes, playing motion
+  kQueryFault = 1 << 5,        // last recorded fault
+  kQueryMemory = 1 << 6,       // stack peak, RAM regions, largest objects
+};
+
+// Reasons for the drive to enter DriveControlMode::kError.
+enum class DriveFaultCode : uint8_t {
+  kNone,
+  kPosition,
+  kVelocity,
+  kCurrent,
+  kHomingPosition,
+  kInvalidActuator,
+  kStreamTimeout,  // no current frame within the stream timeout
+};
+
+// Most recent fault, kept until the next one so it can be queried after the
+// fact.
+struct DriveFault {
+  DriveFaultCode code = DriveFaultCode::kNone;
+  int8_t actuator = -1;
+  float value = 0.0;
+  uint32_t time_millis = 0;
+};
+
+// Actuator readings captured once per control tick, in the output frame.
+struct DriveSnapshot {
+  uint32_t time_millis = 0;
+  uint32_t time_micros = 0;
+  ActuatorPositionVector positions = {};
+  ActuatorVelocityVector velocities = {};
+  ActuatorCurrentVector currents = {};
+  // Raw rotor angle, 0..8191 per rotor revolution.
+  std::array<int32_t, 12> rotor_counts = {};
+  // [W], electrical power drawn by each motor and mechanical power at its
+  // rotor. Negative while braking.
+  std::array<float, 12> electrical_power = {};
+  std::array<float, 12> mechanical_power = {};
 };
 
 // Makes it easier to pass options to the PrintStatus function
@@ -23,6 +74,7 @@ struct DrivePrintOptions {
   uint32_t print_delay_micros = 10000;
   uint32_t header_delay_millis = 10000;
   bool time = true;
+  bool imu = true;
   bool positions = true;
   bool velocities = true;
   bool currents = true;
@@ -33,12 +85,28 @@ struct DrivePrintOptions {
   char delimiter = '\t';
 };
 
-const uint8_t kNumDriveSystemDebugValues = 1 + 6 + 7*12;
+// One DebugData row: the scalar signals, then the per-actuator signals
+// actuator by actuator, e.g. p[0] v[0] ... Il[0] p[1] ...
+const uint8_t kNumDriveSystemDebugValues =
+    kNumDriveScalarSignals + 12 * kNumDriveActuatorSignals;
+
+// Schema of every signal in DriveSignals.h, in DebugData order.
+extern const DriveSignalInfo kDriveSignals[];
+extern const uint8_t kNumDriveSignals;
+
+// Write the DebugData columns of the signals in signal_mask to columns, in
+// row order, and return how many there are (at most
+// kNumDriveSystemDebugValues).
+uint8_t DebugDataColumns(uint32_t signal_mask, uint8_t *columns);
+
+// Size of the stack buffer PrintStatus formats a line into.
+const size_t kMaxStatusLineLength = 1536;
 
 // Class for controlling the 12 (no more and no less) actuators on Pupper
 class DriveSystem {
  public:
   static const size_t kNumActuators = 12;
+  static constexpr float kMaxMotionSpeed = 4.0;
   static constexpr uint8_t kNumActuatorsPerBus = kNumActuators / 2;
 
  private:
@@ -68,6 +136,9 @@ class DriveSystem {
   // torque.
   ActuatorActivations active_mask_;
 
+  // Laws of the four legs in kPerLegControl.
+  LegControlModes leg_modes_;
+
   // Maximum current for current control and PD mode.
   float max_current_;
   // Maximum commandable current before system triggers a fault. Different
@@ -80,9 +151,37 @@ class DriveSystem {
   // Max velocity before system errors out.
   float fault_velocity_;
 
+  DriveFault last_fault_;
+
+  // Readings from the start of the latest Update().
+  DriveSnapshot snapshot_;
+
+  // Status lines skipped because the serial buffer was full.
+  uint32_t dropped_status_lines_;
+
+  // What the status formats print, built from the print options by
+  // UpdateStatusColumns() only when they or the active actuators change:
+  // the selected signals, scalars first, and the DebugData columns of the
+  // selected signals on active actuators with how to format each.
+  uint32_t status_signal_mask_;
+  bool status_columns_valid_;
+  uint8_t status_signals_[kNumDriveScalarSignals + kNumDriveActuatorSignals];
+  uint8_t num_status_signals_;
+  uint8_t num_status_scalars_;
+  uint8_t status_columns_[kNumDriveSystemDebugValues];
+  void (*status_formatters_[kNumDriveSystemDebugValues])(RowFormatter &,
+                                                         DriveSignalValue);
+  uint8_t num_status_columns_;
+
+  void UpdateStatusColumns(DrivePrintOptions options);
+  // Every DebugData value, in DebugData order.
+  void WriteSignalValues(DriveSignalValue *values);
+
   // Constants defining the robot geometry.
   LegParameters leg_parameters_;
   HipLayoutParameters hip_layout_parameters_;
+  // HipPosition() of each leg.
+  std::array<BLA::Matrix<3>, 4> hip_positions_;
 
   // Important direction multipliers
   std::array<float, 12> direction_multipliers_; /* */
@@ -113,7 +212,14 @@ class DriveSystem {
   // Angular velocity in radians/timestep for homing
   float homing_velocity = 0.0005;
   float current_limit_;
-  bool just_homed_;
+  // Eases from the homed pose to the initial positions, see
+  // HomingTransition().
+  Task homing_transition_;
+
+  // Motion primitive playback, see PlayMotion(). motion_id_ is -1 when none
+  // is playing.
+  Task motion_;
+  int8_t motion_id_;
 
   // Axes grouped into different phases of the homing sequence
   std::array<int, 4> knee_axes_;
@@ -125,14 +231,141 @@ class DriveSystem {
   // Soft joint limit for the maximum knee angle
   float knee_soft_limit;
 
+  // Cogging compensation added in CommandCurrents() while enabled.
+  CoggingCompensation cogging_;
+  bool cogging_enabled_;
+  // Where calibrated tables are saved, if anywhere.
+  LogStorage *cogging_storage_;
+  Task cogging_calibration_;
+
+  // Host current streaming (StreamCurrents()).
+  bool streaming_;
+  uint32_t stream_timeout_micros_;
+  uint32_t last_stream_frame_micros_;
+  uint32_t last_state_frame_micros_;
+  uint32_t host_latency_micros_;
+  uint16_t stream_timeouts_;
+
+  // Per-joint energy integrated from every snapshot.
+  EnergyMeter energy_;
+  bool energy_window_done_;
+
+  // Answers kQueryMemory, if set.
+  const MemoryBudget *memory_budget_;
+  // Reported with kQueryMetrics, if set.
+  const uint32_t *dropped_packets_;
+  // Heap of the msgpack reply documents.
+  JsonHeapCounter json_heap_;
+
+  // Controllers of the drive modes, see DriveModes.h. Update() steps the one
+  // of control_mode_.
+  struct IdleController : DriveModeController<IdleController> {
+    static constexpr DriveControlMode kMode = DriveControlMode::kIdle;
+    void Step(DriveSystem &drive);
+  };
+
+  struct ErrorController : DriveModeController<ErrorController> {
+    static constexpr DriveControlMode kMode = DriveControlMode::kError;
+    void Step(DriveSystem &drive);
+  };
+
+  // Zeroes the axes from the homed pose, then eases to the initial positions
+  // in position control within the same tick.
+  struct HomingController : DriveModeController<HomingController> {
+    static constexpr DriveControlMode kMode = DriveControlMode::kHoming;
+    void OnEnter(DriveSystem &drive);
+    void Step(DriveSystem &drive);
+    // Raw position of each axis in the homed pose, relative to its zero.
+    ActuatorPositionVector homed_offsets;
+    // Initial positions, constrained to [-pi, pi].
+    ActuatorPositionVector targets;
+  };
+
+  struct PositionController : DriveModeController<PositionController> {
+    static constexpr DriveControlMode kMode =
+        DriveControlMode::kPositionControl;
+    void Step(DriveSystem &drive);
+  };
+
+  struct CartesianController : DriveModeController<CartesianController> {
+    static constexpr DriveControlMode kMode =
+        DriveControlMode::kCartesianPositionControl;
+    void Step(DriveSystem &drive);
+  };
+
+  struct CurrentController : DriveModeController<CurrentController> {
+    static constexpr DriveControlMode kMode = DriveControlMode::kCurrentControl;
+    void Step(DriveSystem &drive);
+  };
+
+  struct CoggingController : DriveModeController<CoggingController> {
+    static constexpr DriveControlMode kMode =
+        DriveControlMode::kCoggingCalibration;
+    void Step(DriveSystem &drive);
+  };
+
+  struct PerLegController : DriveModeController<PerLegController> {
+    static constexpr DriveControlMode kMode = DriveControlMode::kPerLegControl;
+    void Step(DriveSystem &drive);
+  };
+
+  DriveModeSet<IdleController, ErrorController, HomingController,
+               PositionController, CartesianController, CurrentController,
+               CoggingController, PerLegController>
+      modes_;
+
   // Initialize the two CAN buses
   void InitializeDrive();
 
+  // Interpolate from the current positions to position_reference_ over a few
+  // seconds, commanding PD currents each tick. Stepped from Update().
+  Task HomingTransition();
+
+  // Sets the joint references from the primitive every tick until it ends.
+  Task MotionPlayback(const MotionPrimitive &primitive, float speed);
+
+  // Cancel a playing primitive and clear the velocity references it set.
+  void StopMotion();
+
+  // Sweep each active axis over two rotor revolutions in both directions
+  // while holding the others, build its cogging table and save the tables.
+  // Stepped from Update() in kCoggingCalibration mode.
+  Task CoggingCalibration();
+
+  // Read every actuator once into snapshot_.
+  void UpdateSnapshot();
+
   // Returns enum corresponding to which side the leg is on
   RobotSide LegSide(uint8_t leg_index);
 
   BLA::Matrix<3> LegFeedForwardForce(uint8_t leg_index);
 
+  // Record a fault for later queries.
+  void RecordFault(DriveFaultCode code, int8_t actuator, float value);
+
+  // Switch the drive to mode, running the mode's OnEnter() if it was not
+  // already in it.
+  void EnterMode(DriveControlMode mode);
+
+  // Switch the whole drive to mode, unless per-leg control is active.
+  void SelectMode(DriveControlMode mode);
+
+  // Cartesian impedance law for one leg, in [A].
+  BLA::Matrix<3> CartesianLegCurrents(uint8_t leg_index);
+
+  // True if any of the three motors of the leg is active in mask.
+  static bool LegActive(const ActuatorActivations &mask, uint8_t leg_index);
+
+  // active_mask_, with the motors of idle legs cleared in per-leg control.
+  ActuatorActivations OutputMask() const;
+
+  // Idle the drive and record a fault if the host current stream has gone
+  // quiet. Returns true if it did.
+  bool CheckStreamTimeout();
+
+  // Write a document as a 0x45 0x45 <length> <msgpack> <CR LF> frame.
+  void WriteMsgPackFrame(const JsonDocument &doc);
+
  public:
   // Construct drive system and initialize CAN buses.
   // Set position and current-control references to zero.
@@ -145,9 +378,23 @@ class DriveSystem {
   void SetupIMU(int filter_frequency);
   void UpdateIMU();
 
-  // Calculate motor torques for cartesian position control
+  // Calculate motor torques for cartesian position control. Legs without an
+  // active motor are skipped and get 0 A.
   BLA::Matrix<12> CartesianPositionControl();
 
+  // Run each leg with its own law. While per-leg control is active the
+  // position, cartesian and current setters only update their references
+  // instead of switching the whole drive; SetIdle() ends it.
+  void SetLegModes(const LegControlModes &modes);
+
+  LegControlModes LegModes() const { return leg_modes_; }
+
+  // Currents for the given leg modes, without commanding them. Idle legs and
+  // legs without an active motor cost nothing, and the joint law skips
+  // inactive motors.
+  ActuatorCurrentVector LegControlCurrents(const LegControlModes &modes,
+                                           const ActuatorActivations &mask);
+
   // Check for messages on the CAN bus and run callbacks.
   void CheckForCANMessages();
 
@@ -157,6 +404,24 @@ class DriveSystem {
   // Go into idle mode, which sends 0A to all motors.
   void SetIdle();
 
+  // True in idle and error mode, when the motors are not being controlled.
+  bool IsIdle() const;
+
+  // Load the cogging tables from storage and save future calibrations there.
+  // Returns false if no valid table was found.
+  bool LoadCoggingTable(LogStorage &storage);
+
+  // Hold every axis where it is and measure the cogging of each active axis
+  // in turn (about 8 s per axis). The legs must be free to move 10 degrees
+  // either way and the max current must be set. Ends in position control.
+  void StartCoggingCalibration();
+
+  // Add the cogging compensation to every current command. Ignored until a
+  // table is loaded or calibrated.
+  void SetCoggingCompensation(bool enabled);
+
+  const CoggingCompensation &Cogging() const { return cogging_; }
+
   // Home all axes. 
   void ExecuteHomingSequence();
 
@@ -181,9 +446,19 @@ class DriveSystem {
   // When all joing angles are zero.
   void SetDefaultCartesianPositions();
 
-  // Sets the positions for all twelve actuators.
+  // Sets the positions for all twelve actuators. Stops a motion primitive.
   void SetJointPositions(ActuatorPositionVector pos);
 
+  // Play a motion primitive from the current pose in joint position control,
+  // with time scaled by speed (0 < speed <= kMaxMotionSpeed). The drive holds
+  // the last pose when it ends. Legs in per-leg control follow it only if
+  // they are in joint position mode. Returns false for an unknown id or
+  // speed, or if no task frame was free.
+  bool PlayMotion(uint8_t id, float speed);
+
+  // Id of the primitive playing, -1 if none.
+  int8_t PlayingMotion() const { return motion_id_; }
+
   // Set position gains all actuators
   void SetPositionKp(float kp);
   void SetPositionKd(float kd);
@@ -212,6 +487,42 @@ class DriveSystem {
   // Set current target for actuator i.
   void SetCurrent(uint8_t i, float target_current);
 
+  // Set all 12 current references from a host stream. The watchdog idles the
+  // drive if the next frame does not arrive within the stream timeout.
+  void StreamCurrents(const ActuatorCurrentVector &currents);
+
+  // 0 disables the watchdog.
+  void SetStreamTimeout(uint32_t timeout_micros);
+
+  // Write the state from the latest Update() as one binary frame for
+  // lockstep host control, little-endian except for the big-endian length:
+  //   0x47 0x47, uint16 length (bytes that follow)
+  //   uint32 seq                 echoed from the current frame
+  //   uint32 micros              time of the state reading
+  //   uint32 host_latency_micros previous state frame -> this current frame
+  //   uint8  mode, uint8 fault code, uint16 stream timeouts so far
+  //   float  positions[12], velocities[12], currents[12]
+  void WriteStreamState(uint32_t seq);
+
+  // Clear the energy totals and average the power over windows of the given
+  // length. 0 keeps the totals running without windows.
+  void SetEnergyWindow(uint32_t window_micros);
+
+  // True if the latest Update() completed an energy window.
+  bool EnergyWindowCompleted() const { return energy_window_done_; }
+
+  // Write the energy accounting as one binary frame, little-endian except
+  // for the big-endian length:
+  //   0x48 0x48, uint16 length (bytes that follow)
+  //   uint32 micros              time of the latest snapshot
+  //   uint32 window_micros       length of the last completed window
+  //   float  window electrical power[12], window mechanical power[12] [W]
+  //   float  consumed[12], regenerated[12] [J] electrical, since the reset
+  //   float  positive work[12], negative work[12] [J] mechanical
+  void WriteEnergyFrame();
+
+  const EnergyMeter &Energy() const { return energy_; }
+
   // Set current level that would trigger a fault.
   void SetFaultCurrent(float fault_current);
 
@@ -282,12 +593,49 @@ class DriveSystem {
   // Return the cartesian reference velocity for leg i.
   BLA::Matrix<3> LegCartesianVelocityReference(uint8_t i);
 
+  // Returns the most recent fault.
+  DriveFault LastFault();
+
   void PrintMsgPackStatus(DrivePrintOptions options);
-  // Print drive information to screen
+
+  // Reply to a StateQuery with a single msgpack frame holding the requested
+  // signals and the query id under "qid".
+  void PrintMsgPackQuery(StateQuery query);
+
+  // RAM breakdown reported for kQueryMemory.
+  void SetMemoryBudget(const MemoryBudget *budget);
+
+  // Count of dropped telemetry packets reported for kQueryMetrics.
+  void SetDroppedPackets(const uint32_t *dropped_packets);
+
+  // Heap held by the msgpack reply documents.
+  const JsonHeapCounter &JsonHeap() const { return json_heap_; }
+
+  // Print drive information to screen. The line is formatted into a stack
+  // buffer and written in one go, or dropped if it does not fit in the
+  // serial transmit buffer.
   void PrintStatus(DrivePrintOptions options);
 
+  // Format the PrintStatus line into row.
+  void FormatStatus(DrivePrintOptions options, RowFormatter &row);
+
+  // Number of PrintStatus lines dropped so far.
+  uint32_t DroppedStatusLines();
+
   // Print a header for the messages
   void PrintHeader(DrivePrintOptions options);
 
+  // Send the signal schema (kDriveSignals) as a msgpack frame so the host can
+  // decode status frames and DebugData rows.
+  void PrintMsgPackSchema();
+
+  // Returns the readings taken at the start of the latest Update().
+  const DriveSnapshot &Snapshot();
+
   BLA::Matrix<kNumDriveSystemDebugValues> DebugData();
+
+  // Write the DebugData values selected by signal_mask (bit s selects
+  // kDriveSignals[s]) straight into a logger row. Unselected columns are left
+  // untouched. Rows shorter than kNumDriveSystemDebugValues are ignored.
+  void WriteDebugRow(LogRow row, uint32_t signal_mask = kAllDriveSignals);
 };
\ No newline at end of file
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <utility>
+
+#include "Platform.h"
+
+// Forward-mode automatic differentiation. A Dual carries a value and its
+// partial derivatives with respect to N inputs, and every operation applies
+// the chain rule to them.
+//
+// Which inputs a value depends on is part of its type: bit i of Mask is set
+// if derivative i can be nonzero. Operations combine the masks at compile
+// time and only compute the derivatives in them, so an expression over
+// Duals inlines to straight-line code that skips the structural zeros, like
+// a hand-expanded derivative. Derivatives outside the mask are zero.
+//
+// The value type may itself be a Dual: Dual<Dual<float, 1>, 3> holds the
+// derivatives with respect to three inputs and, nested, their derivatives
+// along a direction, i.e. second derivatives.
+//
+// Only the operations that the kinematics need are defined: +, -, * and
+// SinCos().
+template <class T, int N, uint32_t Mask = (1u << N) - 1>
+struct Dual {
+  T v;
+  T d[N];
+
+  static constexpr bool Has(int i) { return (Mask >> i) & 1; }
+
+  Dual() {}
+  // A constant: every derivative is zero.
+  Dual(float value) : v(value) {
+    for (int i = 0; i < N; i++) d[i] = T(0.0f);
+  }
+};
+
+template <class F, int... I>
+inline void ForEachDerivative(F f, std::integer_sequence<int, I...>) {
+  (f(std::integral_constant<int, I>()), ...);
+}
+
+// Call f(std::integral_constant<int, i>()) for i = 0 to N - 1, unrolled at
+// compile time so that the masks can be tested with if constexpr.
+template <int N, class F>
+inline void ForEachDerivative(F f) {
+  ForEachDerivative(f, std::make_integer_sequence<int, N>());
+}
+
+// Input number Index of N, with the given value.
+template <int Index, int N, class T>
+inline Dual<T, N, 1u << Index> DualVariable(const T &value) {
+  Dual<T, N, 1u << Index> x(0.0f);
+  x.v = value;
+  x.d[Index] = T(1.0f);
+  return x;
+}
+
+template <class T, int N, uint32_t M>
+inline T Derivative(const Dual<T, N, M> &x, int i) {
+  return Dual<T, N, M>::Has(i) ? x.d[i] : T(0.0f);
+}
+
+inline void SinCos(float x, float &s, float &c) {
+  s = sinf(x);
+  c = cosf(x);
+}
+
+inline void SinCos(double x, double &s, double &c) {
+  s = sin(x);
+  c = cos(x);
+}
+
+template <class T, int N, uint32_t M>
+inline void SinCos(const Dual<T, N, M> &x, Dual<T, N, M> &s,
+                   Dual<T, N, M> &c) {
+  SinCos(x.v, s.v, c.v);
+  ForEachDerivative<N>([&](auto i) {
+    if constexpr (Dual<T, N, M>::Has(decltype(i)::value)) {
+      s.d[i] = c.v * x.d[i];
+      c.d[i] = -(s.v * x.d[i]);
+    } else {
+      s.d[i] = c.d[i] = T(0.0f);
+    }
+  });
+}
+
+template <class T, int N, uint32_t A, uint32_t B>
+inline Dual<T, N, A | B> operator+(const Dual<T, N, A> &a,
+                                   const Dual<T, N, B> &b) {
+  Dual<T, N, A | B> r;
+  r.v = a.v + b.v;
+  ForEachDerivative<N>([&](auto i) {
+    constexpr bool in_a = Dual<T, N, A>::Has(decltype(i)::value);
+    constexpr bool in_b = Dual<T, N, B>::Has(decltype(i)::value);
+    if constexpr (in_a && in_b) {
+      r.d[i] = a.d[i] + b.d[i];
+    } else if constexpr (in_a) {
+      r.d[i] = a.d[i];
+    } else if constexpr (in_b) {
+      r.d[i] = b.d[i];
+    } else {
+      r.d[i] = T(0.0f);
+    }
+  });
+  return r;
+}
+
+template <class T, int N, uint32_t M>
+inline Dual<T, N, M> operator-(const Dual<T, N, M> &a) {
+  Dual<T, N, M> r;
+  r.v = -a.v;
+  ForEachDerivative<N>([&](auto i) {
+    if constexpr (Dual<T, N, M>::Has(decltype(i)::value)) {
+      r.d[i] = -a.d[i];
+    } else {
+      r.d[i] = T(0.0f);
+    }
+  });
+  return r;
+}
+
+template <class T, int N, uint32_t A, uint32_t B>
+inline Dual<T, N, A | B> operator-(const Dual<T, N, A> &a,
+                                   const Dual<T, N, B> &b) {
+  return a + -b;
+}
+
+template <class T, int N, uint32_t A, uint32_t B>
+inline Dual<T, N, A | B> operator*(const Dual<T, N, A> &a,
+                                   const Dual<T, N, B> &b) {
+  Dual<T, N, A | B> r;
+  r.v = a.v * b.v;
+  ForEachDerivative<N>([&](auto i) {
+    constexpr bool in_a = Dual<T, N, A>::Has(decltype(i)::value);
+    constexpr bool in_b = Dual<T, N, B>::Has(decltype(i)::value);
+    if constexpr (in_a && in_b) {
+      r.d[i] = a.v * b.d[i] + a.d[i] * b.v;
+    } else if constexpr (in_a) {
+      r.d[i] = a.d[i] * b.v;
+    } else if constexpr (in_b) {
+      r.d[i] = a.v * b.d[i];
+    } else {
+      r.d[i] = T(0.0f);
+    }
+  });
+  return r;
+}
+
+// Products with constants skip the derivatives of the constant.
+template <class T, int N, uint32_t M>
+inline Dual<T, N, M> operator*(float a, const Dual<T, N, M> &b) {
+  Dual<T, N, M> r;
+  r.v = a * b.v;
+  ForEachDerivative<N>([&](auto i) {
+    if constexpr (Dual<T, N, M>::Has(decltype(i)::value)) {
+      r.d[i] = a * b.d[i];
+    } else {
+      r.d[i] = T(0.0f);
+    }
+  });
+  return r;
+}
+
+template <class T, int N, uint32_t M>
+inline Dual<T, N, M> operator*(const Dual<T, N, M> &a, float b) {
+  return b * a;
+}
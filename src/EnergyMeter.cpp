@@ -0,0 +1,67 @@
+#include "EnergyMeter.h"
+
+EnergyMeter::EnergyMeter(uint32_t window_micros) { Reset(window_micros); }
+
+void EnergyMeter::Reset(uint32_t window_micros) {
+  window_micros_ = window_micros;
+  started_ = false;
+  last_micros_ = 0;
+  electrical_power_.fill(0.0f);
+  mechanical_power_.fill(0.0f);
+  totals_.consumed.fill(0.0);
+  totals_.regenerated.fill(0.0);
+  totals_.positive_work.fill(0.0);
+  totals_.negative_work.fill(0.0);
+  window_elapsed_ = 0;
+  window_electrical_.fill(0.0f);
+  window_mechanical_.fill(0.0f);
+  last_window_.duration_micros = 0;
+  last_window_.electrical_power.fill(0.0f);
+  last_window_.mechanical_power.fill(0.0f);
+}
+
+bool EnergyMeter::Update(
+    uint32_t time_micros,
+    const std::array<float, kNumJoints> &electrical_power,
+    const std::array<float, kNumJoints> &mechanical_power) {
+  uint32_t dt_micros = time_micros - last_micros_;
+  bool integrate = started_ && dt_micros <= kMaxGapMicros;
+  started_ = true;
+  last_micros_ = time_micros;
+  if (integrate) {
+    float dt = dt_micros * 1e-6f;
+    for (size_t i = 0; i < kNumJoints; i++) {
+      float electrical = electrical_power_[i] * dt;
+      float mechanical = mechanical_power_[i] * dt;
+      if (electrical >= 0.0f) {
+        totals_.consumed[i] += electrical;
+      } else {
+        totals_.regenerated[i] -= electrical;
+      }
+      if (mechanical >= 0.0f) {
+        totals_.positive_work[i] += mechanical;
+      } else {
+        totals_.negative_work[i] -= mechanical;
+      }
+      window_electrical_[i] += electrical;
+      window_mechanical_[i] += mechanical;
+    }
+    window_elapsed_ += dt_micros;
+  }
+  electrical_power_ = electrical_power;
+  mechanical_power_ = mechanical_power;
+
+  if (window_micros_ == 0 || window_elapsed_ < window_micros_) {
+    return false;
+  }
+  float scale = 1e6f / window_elapsed_;
+  last_window_.duration_micros = window_elapsed_;
+  for (size_t i = 0; i < kNumJoints; i++) {
+    last_window_.electrical_power[i] = window_electrical_[i] * scale;
+    last_window_.mechanical_power[i] = window_mechanical_[i] * scale;
+  }
+  window_elapsed_ = 0;
+  window_electrical_.fill(0.0f);
+  window_mechanical_.fill(0.0f);
+  return true;
+}
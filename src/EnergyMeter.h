@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+
+#include "Platform.h"
+
+// Integrates the electrical and mechanical power of every joint over time,
+// once per control tick from the DriveSnapshot, so that energy and cost of
+// transport come from the full-rate data instead of low-rate telemetry.
+//
+// Per joint it keeps four running totals [J]:
+//   consumed      electrical energy drawn from the bus (power > 0)
+//   regenerated   electrical energy returned to the bus (power < 0)
+//   positive_work mechanical work done by the joint
+//   negative_work mechanical work absorbed by the joint (braking)
+// and the average electrical and mechanical power [W] over the last
+// completed window. The power held since the previous tick is integrated
+// (rectangle rule); gaps longer than kMaxGapMicros, e.g. while the loop was
+// blocked, are skipped rather than extrapolated.
+class EnergyMeter {
+ public:
+  static const size_t kNumJoints = 12;
+  static const uint32_t kMaxGapMicros = 100000;
+
+  struct Totals {
+    std::array<double, kNumJoints> consumed;
+    std::array<double, kNumJoints> regenerated;
+    std::array<double, kNumJoints> positive_work;
+    std::array<double, kNumJoints> negative_work;
+  };
+
+  struct Window {
+    uint32_t duration_micros;
+    std::array<float, kNumJoints> electrical_power;
+    std::array<float, kNumJoints> mechanical_power;
+  };
+
+  explicit EnergyMeter(uint32_t window_micros = 1000000);
+
+  // Clears the totals and starts a new window of the given length.
+  void Reset(uint32_t window_micros);
+
+  // Returns true when the call completed a window.
+  bool Update(uint32_t time_micros,
+              const std::array<float, kNumJoints> &electrical_power,
+              const std::array<float, kNumJoints> &mechanical_power);
+
+  const Totals &GetTotals() const { return totals_; }
+  const Window &LastWindow() const { return last_window_; }
+  uint32_t WindowMicros() const { return window_micros_; }
+
+ private:
+  uint32_t window_micros_;
+  bool started_;
+  uint32_t last_micros_;
+  std::array<float, kNumJoints> electrical_power_;
+  std::array<float, kNumJoints> mechanical_power_;
+
+  Totals totals_;
+  uint32_t window_elapsed_;
+  std::array<float, kNumJoints> window_electrical_;  // [J]
+  std::array<float, kNumJoints> window_mechanical_;  // [J]
+  Window last_window_;
+};
@@ -0,0 +1,346 @@
+#include "FlashLogSink.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "LogCodec.h"
+#include "Utils.h"
+
+namespace {
+const uint32_t kSectorMagic = 0x32474c50;  // "PLG2"
+const uint16_t kUnwritten = 0xffff;
+}  // namespace
+
+FlashLogSink::FlashLogSink()
+    : storage_(nullptr),
+      num_columns_(0),
+      tag_(0),
+      rows_per_chunk_(0),
+      active_(0),
+      active_rows_(0),
+      pending_rows_(0),
+      ready_(false),
+      head_sector_(0),
+      head_sequence_(0),
+      write_offset_(0),
+      erased_ahead_(0),
+      erasing_(false),
+      erase_sector_(0),
+      erase_count_(0),
+      stats_() {}
+
+bool FlashLogSink::ReadSectorHeader(uint32_t sector, SectorHeader &header) {
+  if (!storage_->Read(sector * storage_->SectorSize(), &header,
+                      sizeof(header))) {
+    return false;
+  }
+  return header.magic == kSectorMagic &&
+         header.crc == Utils::Crc32(&header, offsetof(SectorHeader, crc));
+}
+
+bool FlashLogSink::Begin(LogStorage &storage) {
+  storage_ = &storage;
+  ready_ = false;
+  // On the robot a reset ends the erase in progress and the sector is erased
+  // again below; on the host a re-Begin waits it out.
+  while (erasing_ && storage.EraseBusy()) {
+  }
+  erasing_ = false;
+  if (storage.NumSectors() < 2 ||
+      storage.SectorSize() < sizeof(SectorHeader) + sizeof(RecordHeader) +
+                                 LogCodecMaxEncodedSize(kStagingBytes)) {
+    return false;
+  }
+
+  // Resume after the newest sector. Its tail may hold a torn record, so it
+  // is treated as full.
+  bool found = false;
+  for (uint32_t sector = 0; sector < storage.NumSectors(); sector++) {
+    SectorHeader header;
+    if (ReadSectorHeader(sector, header) &&
+        (!found || header.sequence > head_sequence_)) {
+      found = true;
+      head_sector_ = sector;
+      head_sequence_ = header.sequence;
+    }
+  }
+  if (!found) {
+    head_sector_ = storage.NumSectors() - 1;
+    head_sequence_ = 0;
+  }
+  write_offset_ = storage.SectorSize();
+  // Sectors erased ahead before a reset can be used without an erase.
+  erased_ahead_ = 0;
+  while (erased_ahead_ < EraseWindow() &&
+         IsBlank((head_sector_ + 1 + erased_ahead_) % storage.NumSectors())) {
+    erased_ahead_++;
+  }
+  active_ = 0;
+  active_rows_ = 0;
+  pending_rows_ = 0;
+  ready_ = true;
+  return true;
+}
+
+bool FlashLogSink::SetRowFormat(uint32_t num_columns, uint32_t tag) {
+  active_rows_ = 0;
+  pending_rows_ = 0;
+  rows_per_chunk_ = 0;
+  if (num_columns == 0 || num_columns > kMaxColumns) {
+    return false;
+  }
+  num_columns_ = num_columns;
+  tag_ = tag;
+  rows_per_chunk_ = kStagingBytes / (num_columns * sizeof(float));
+  if (rows_per_chunk_ > 255) {
+    rows_per_chunk_ = 255;
+  }
+  return true;
+}
+
+bool FlashLogSink::Append(const float *row) {
+  if (!ready_ || rows_per_chunk_ == 0) {
+    return false;
+  }
+  if (active_rows_ == rows_per_chunk_) {
+    if (pending_rows_ > 0) {
+      stats_.dropped_rows++;
+      return false;
+    }
+    pending_rows_ = active_rows_;
+    active_ ^= 1;
+    active_rows_ = 0;
+  }
+  memcpy(&staging_[active_][active_rows_ * num_columns_], row,
+         num_columns_ * sizeof(float));
+  active_rows_++;
+  return true;
+}
+
+bool FlashLogSink::IsBlank(uint32_t sector) {
+  uint32_t words[64];
+  uint32_t base = sector * storage_->SectorSize();
+  for (uint32_t offset = 0; offset < storage_->SectorSize();
+       offset += sizeof(words)) {
+    if (!storage_->Read(base + offset, words, sizeof(words))) {
+      return false;
+    }
+    for (uint32_t i = 0; i < 64; i++) {
+      bool erase_count_word =
+          offset == 0 && i == offsetof(SectorHeader, erase_count) / 4;
+      if (words[i] != 0xffffffff && !erase_count_word) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool FlashLogSink::StartErase(uint32_t sector) {
+  // Sectors erased ahead before a reset are still blank; skip the erase.
+  if (IsBlank(sector)) {
+    erased_ahead_++;
+    return true;
+  }
+  // Carry the erase count over from the old header. It is programmed on its
+  // own once the erase is done, so it survives even if the sector is never
+  // opened.
+  SectorHeader old_header;
+  if (!storage_->Read(sector * storage_->SectorSize(), &old_header,
+                      sizeof(old_header))) {
+    return false;
+  }
+  erase_count_ =
+      (old_header.erase_count == 0xffffffff ? 0 : old_header.erase_count) + 1;
+  erase_sector_ = sector;
+  if (!storage_->StartErase(sector)) {
+    return false;
+  }
+  erasing_ = true;
+  return true;
+}
+
+void FlashLogSink::FinishErase() {
+  erasing_ = false;
+  if (erase_count_ > stats_.max_erase_count) {
+    stats_.max_erase_count = erase_count_;
+  }
+  // Only the erase count is written now; the magic and sequence are
+  // programmed when the sector is opened.
+  if (storage_->Program(erase_sector_ * storage_->SectorSize() +
+                            offsetof(SectorHeader, erase_count),
+                        &erase_count_, sizeof(erase_count_))) {
+    erased_ahead_++;
+  }
+}
+
+void FlashLogSink::WaitForErase() {
+  if (erasing_) {
+    while (storage_->EraseBusy()) {
+    }
+    FinishErase();
+  }
+}
+
+bool FlashLogSink::OpenNextSector() {
+  if (erased_ahead_ == 0) {
+    return false;
+  }
+  uint32_t sector = (head_sector_ + 1) % storage_->NumSectors();
+  uint32_t offset = sector * storage_->SectorSize();
+  SectorHeader header;
+  if (!storage_->Read(offset, &header, sizeof(header))) {
+    return false;
+  }
+  header.magic = kSectorMagic;
+  header.sequence = head_sequence_ + 1;
+  header.crc = Utils::Crc32(&header, offsetof(SectorHeader, crc));
+  if (!storage_->Program(offset, &header, sizeof(header))) {
+    return false;
+  }
+  head_sector_ = sector;
+  head_sequence_ = header.sequence;
+  write_offset_ = sizeof(SectorHeader);
+  erased_ahead_--;
+  return true;
+}
+
+bool FlashLogSink::WriteChunk(uint32_t payload_size, uint32_t num_rows) {
+  uint32_t record_size = sizeof(RecordHeader) + payload_size;
+  if (write_offset_ + record_size > storage_->SectorSize() &&
+      !OpenNextSector()) {
+    return false;
+  }
+  if (write_offset_ + record_size > storage_->SectorSize()) {
+    return false;
+  }
+  RecordHeader header;
+  header.payload_size = payload_size;
+  header.num_rows = num_rows;
+  header.reserved = 0;
+  header.num_columns = num_columns_;
+  header.reserved2 = 0;
+  header.tag = tag_;
+  header.crc = Utils::Crc32(&header, offsetof(RecordHeader, crc));
+  header.crc = Utils::Crc32(encoded_, payload_size, header.crc);
+
+  // Payload first, so that a reset in between leaves an unwritten header
+  // rather than a header pointing at garbage.
+  uint32_t offset = head_sector_ * storage_->SectorSize() + write_offset_;
+  if (!storage_->Program(offset + sizeof(header), encoded_, payload_size) ||
+      !storage_->Program(offset, &header, sizeof(header))) {
+    return false;
+  }
+  write_offset_ += record_size;
+  stats_.chunks_written++;
+  stats_.bytes_written += record_size;
+  stats_.raw_bytes += num_rows * num_columns_ * sizeof(float);
+  return true;
+}
+
+void FlashLogSink::Service() {
+  if (!ready_) {
+    return;
+  }
+  if (erasing_) {
+    // The flash can be neither read nor programmed until the erase is done.
+    if (!storage_->EraseBusy()) {
+      FinishErase();
+    }
+    return;
+  }
+  if (pending_rows_ > 0) {
+    // Encode first, so the chunk goes in the head sector whenever its coded
+    // size fits there.
+    size_t payload_size =
+        LogCodecEncode(staging_[active_ ^ 1], pending_rows_, num_columns_,
+                       encoded_, sizeof(encoded_));
+    bool need_sector = write_offset_ + sizeof(RecordHeader) + payload_size >
+                       storage_->SectorSize();
+    if (payload_size == 0 || !need_sector || erased_ahead_ > 0) {
+      if (payload_size == 0 || !WriteChunk(payload_size, pending_rows_)) {
+        stats_.dropped_rows += pending_rows_;
+      }
+      pending_rows_ = 0;
+      return;
+    }
+    // Otherwise the chunk waits for the erase started below.
+  }
+  if (erased_ahead_ < EraseWindow()) {
+    StartErase((head_sector_ + 1 + erased_ahead_) % storage_->NumSectors());
+  }
+}
+
+void FlashLogSink::Flush() {
+  if (!ready_) {
+    return;
+  }
+  // Drain the pending buffer, then queue and drain the partial one. Writing
+  // a chunk takes at most one erase plus the write itself.
+  for (int pass = 0; pass < 2; pass++) {
+    for (int attempt = 0; pending_rows_ > 0 && attempt < 2; attempt++) {
+      WaitForErase();
+      Service();
+    }
+    if (pending_rows_ > 0) {
+      stats_.dropped_rows += pending_rows_;
+      pending_rows_ = 0;
+    }
+    if (active_rows_ > 0) {
+      pending_rows_ = active_rows_;
+      active_ ^= 1;
+      active_rows_ = 0;
+    }
+  }
+}
+
+uint32_t FlashLogSink::ReadAll(RowCallback fn, void *context) {
+  if (!ready_) {
+    return 0;
+  }
+  WaitForErase();
+  active_rows_ = 0;
+  pending_rows_ = 0;
+
+  // Oldest sector first: walk the ring starting after the newest one.
+  uint32_t num_rows = 0;
+  uint32_t sector_size = storage_->SectorSize();
+  for (uint32_t n = 1; n <= storage_->NumSectors(); n++) {
+    uint32_t sector = (head_sector_ + n) % storage_->NumSectors();
+    SectorHeader sector_header;
+    if (!ReadSectorHeader(sector, sector_header) ||
+        sector_header.sequence > head_sequence_) {
+      continue;
+    }
+    uint32_t offset = sizeof(SectorHeader);
+    while (offset + sizeof(RecordHeader) <= sector_size) {
+      RecordHeader header;
+      uint32_t base = sector * sector_size + offset;
+      if (!storage_->Read(base, &header, sizeof(header)) ||
+          header.payload_size == kUnwritten ||
+          offset + sizeof(header) + header.payload_size > sector_size ||
+          header.num_columns == 0 ||
+          header.num_rows * header.num_columns * sizeof(float) >
+              kStagingBytes ||
+          !storage_->Read(base + sizeof(header), encoded_,
+                          header.payload_size)) {
+        break;
+      }
+      uint32_t crc = Utils::Crc32(&header, offsetof(RecordHeader, crc));
+      crc = Utils::Crc32(encoded_, header.payload_size, crc);
+      uint32_t *rows = staging_[0];
+      if (crc != header.crc ||
+          !LogCodecDecode(encoded_, header.payload_size, header.num_rows,
+                          header.num_columns, rows)) {
+        break;
+      }
+      for (uint32_t r = 0; r < header.num_rows; r++) {
+        fn(reinterpret_cast<const float *>(&rows[r * header.num_columns]),
+           header.num_columns, header.tag, context);
+      }
+      num_rows += header.num_rows;
+      offset += sizeof(header) + header.payload_size;
+    }
+  }
+  return num_rows;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "LogStorage.h"
+#include "Platform.h"
+
+// Persistent log in a ring of flash sectors. Rows are staged in RAM from the
+// control tick with Append(), and Service(), called from the background part
+// of loop(), compresses full chunks with the LogCodec and programs them into
+// the current sector. Sectors are used strictly in order, so every sector is
+// erased equally often, and each one carries its erase count.
+//
+// Service() keeps kEraseAhead sectors ahead of the write position erased
+// with LogStorage::StartErase(), which runs in the background, so the head
+// keeps moving over the oldest sectors during a run and the rest of the ring
+// always holds the newest rows. Nothing is written while an erase is busy;
+// the rows wait in the staging buffers and are only dropped if both fill up.
+//
+// Rows can have any width up to kMaxColumns, set with SetRowFormat(), and
+// every record carries its width and a tag saying what the columns are, so
+// logging fewer columns gives a longer history in the same sectors.
+//
+// Sector layout:
+//   SectorHeader {magic, sequence, erase_count, crc}
+//   records: RecordHeader {payload_size, num_rows, num_columns, tag, crc}
+//            payload
+//   0xff up to the end of the sector
+//
+// The sector with the highest sequence number is the newest. A reset can
+// leave a half-written record at the end of the newest sector; its CRC fails
+// and reading stops there. After Begin() logging always resumes in a fresh
+// sector.
+class FlashLogSink {
+ public:
+  // Largest raw chunk. It codes to about 1.3 KB, so a 4 KB sector holds
+  // about three chunks; chunks of a whole sector would leave most of each
+  // sector empty.
+  static const uint32_t kStagingBytes = 2016;
+  static const uint32_t kMaxColumns = kStagingBytes / sizeof(float);
+  // Sectors kept erased ahead of the write position. Erasing is several
+  // times faster than the fastest logging fills sectors, so two leave room
+  // for the odd slow erase.
+  static const uint32_t kEraseAhead = 2;
+
+  typedef void (*RowCallback)(const float *row, uint32_t num_columns,
+                              uint32_t tag, void *context);
+
+  struct Stats {
+    uint32_t chunks_written;
+    uint32_t bytes_written;   // after compression, including headers
+    uint32_t raw_bytes;       // before compression
+    uint32_t dropped_rows;    // both buffers full, or a write failed
+    uint32_t max_erase_count;
+  };
+
+ private:
+  struct SectorHeader {
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t erase_count;
+    uint32_t crc;
+  };
+
+  struct RecordHeader {
+    uint16_t payload_size;
+    uint8_t num_rows;
+    uint8_t reserved;
+    uint16_t num_columns;
+    uint16_t reserved2;
+    uint32_t tag;
+    uint32_t crc;
+  };
+
+  LogStorage *storage_;
+  uint32_t num_columns_;
+  uint32_t tag_;
+  uint32_t rows_per_chunk_;
+
+  // Double buffered staging: the tick fills active_, Service() drains the
+  // other one once pending_rows_ is set.
+  uint32_t staging_[2][kStagingBytes / sizeof(uint32_t)];
+  uint8_t active_;
+  uint32_t active_rows_;
+  uint32_t pending_rows_;
+  uint8_t encoded_[kStagingBytes + kStagingBytes / 128 + 16];
+
+  bool ready_;
+  uint32_t head_sector_;
+  uint32_t head_sequence_;
+  uint32_t write_offset_;  // within the head sector, == SectorSize() if full
+  uint32_t erased_ahead_;
+  // The background erase in progress and the erase count to give it.
+  bool erasing_;
+  uint32_t erase_sector_;
+  uint32_t erase_count_;
+  Stats stats_;
+
+  bool ReadSectorHeader(uint32_t sector, SectorHeader &header);
+  bool IsBlank(uint32_t sector);
+  uint32_t EraseWindow() const {
+    uint32_t half = storage_->NumSectors() / 2;
+    return half < kEraseAhead ? half : kEraseAhead;
+  }
+  bool StartErase(uint32_t sector);
+  void FinishErase();
+  void WaitForErase();
+  bool OpenNextSector();
+  // Program the chunk coded in encoded_, opening the next sector if needed.
+  bool WriteChunk(uint32_t payload_size, uint32_t num_rows);
+
+ public:
+  FlashLogSink();
+
+  // Scan the storage for the newest sector. Returns false if the storage is
+  // unusable.
+  bool Begin(LogStorage &storage);
+
+  // Take rows of num_columns floats from now on, stored with the given tag.
+  // Discards the staged rows, so Flush() first. Returns false, and takes no
+  // rows, if num_columns is 0 or over kMaxColumns.
+  bool SetRowFormat(uint32_t num_columns, uint32_t tag);
+
+  // Copy one row into the staging buffer. Cheap enough for the control tick.
+  // Returns false if the row had to be dropped.
+  bool Append(const float *row);
+
+  // Write a pending chunk, or else start erasing the next sector ahead of the
+  // write position, overwriting the oldest rows. Does at most one flash
+  // operation per call and returns at once while an erase is busy. Call from
+  // loop() outside the control tick.
+  void Service();
+
+  // Queue the partially filled buffer and write everything out, waiting for
+  // an erase on the way if needed.
+  void Flush();
+
+  // Call fn for every stored row, oldest first, with the width and tag it
+  // was written with. Uses the staging buffers, so anything not yet written
+  // is discarded. Returns the number of rows.
+  uint32_t ReadAll(RowCallback fn, void *context);
+
+  bool Ready() const { return ready_; }
+  uint32_t NumColumns() const { return num_columns_; }
+  const Stats &GetStats() const { return stats_; }
+};
@@ -0,0 +1,52 @@
+#include "JsonHeapCounter.h"
+
+#include <stdlib.h>
+
+namespace {
+
+// JsonHeapCounter blocks start with their size, padded to keep the data
+// 8-byte aligned.
+const size_t kBlockHeader = 8;
+
+}  // namespace
+
+void *JsonHeapCounter::allocate(size_t size) {
+  uint8_t *block = static_cast<uint8_t *>(malloc(size + kBlockHeader));
+  if (block == nullptr) {
+    return nullptr;
+  }
+  *reinterpret_cast<size_t *>(block) = size;
+  Count(0, size);
+  return block + kBlockHeader;
+}
+
+void JsonHeapCounter::deallocate(void *pointer) {
+  if (pointer == nullptr) {
+    return;
+  }
+  uint8_t *block = static_cast<uint8_t *>(pointer) - kBlockHeader;
+  Count(*reinterpret_cast<size_t *>(block), 0);
+  free(block);
+}
+
+void *JsonHeapCounter::reallocate(void *pointer, size_t new_size) {
+  if (pointer == nullptr) {
+    return allocate(new_size);
+  }
+  uint8_t *block = static_cast<uint8_t *>(pointer) - kBlockHeader;
+  size_t old_size = *reinterpret_cast<size_t *>(block);
+  block = static_cast<uint8_t *>(realloc(block, new_size + kBlockHeader));
+  if (block == nullptr) {
+    return nullptr;
+  }
+  *reinterpret_cast<size_t *>(block) = new_size;
+  Count(old_size, new_size);
+  return block + kBlockHeader;
+}
+
+void JsonHeapCounter::Count(size_t old_size, size_t new_size) {
+  bytes_ = bytes_ - old_size + new_size;
+  if (bytes_ > peak_bytes_) {
+    peak_bytes_ = bytes_;
+  }
+}
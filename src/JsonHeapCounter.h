@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// ArduinoJson allocator that counts the heap its documents hold. In
+// ArduinoJson 7 every JsonDocument, StaticJsonDocument<N> included, keeps its
+// data on the heap and sizeof() only covers the handle, so documents are
+// budgeted by constructing them with a counter: JsonDocument doc(&counter).
+class JsonHeapCounter : public ArduinoJson::Allocator {
+ public:
+  void *allocate(size_t size) override;
+  void deallocate(void *pointer) override;
+  void *reallocate(void *pointer, size_t new_size) override;
+
+  // Heap held by the documents now and at most since boot, in bytes.
+  uint32_t Bytes() const { return bytes_; }
+  uint32_t PeakBytes() const { return peak_bytes_; }
+
+ private:
+  void Count(size_t old_size, size_t new_size);
+
+  uint32_t bytes_ = 0;
+  uint32_t peak_bytes_ = 0;
+};
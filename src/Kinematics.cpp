@@ -35,7 +35,9 @@ BLA::Matrix<3> HipPosition(HipLayoutParameters hip_layout_params, uint8_t i) {
               hip_layout_params.z_offset};
     }
     default: {
+#ifdef ARDUINO
         Serial.println("Error: Invalid leg index for hip position function."); 
+#endif
         return {0, 0, 0};
     }
   }
@@ -47,52 +49,66 @@ BLA::Matrix<3, 3> RotateX(float theta) {
 
 BLA::Matrix<3> ForwardKinematics(BLA::Matrix<3> joint_angles,
                                  LegParameters leg_params, uint8_t leg_index) {
-  float l1 = leg_params.thigh_length;
-  float l2 = leg_params.shank_length;
-
-  float alpha = joint_angles(0);
-  float theta = joint_angles(1);
-  float phi = joint_angles(2);
-
-  float px = -l1 * sin(theta) - l2 * sin(theta + phi);
-  float py = HipOffset(leg_params, leg_index);
-  float pz = -l1 * cos(theta) - l2 * cos(theta + phi);
-
-  BLA::Matrix<3> tilted_frame_coordinates = {px, py, pz};
-  BLA::Matrix<3> cartesian_coordinates =
-      RotateX(alpha) * tilted_frame_coordinates;
-  return cartesian_coordinates;
+  auto foot = FootPosition(joint_angles(0), joint_angles(1), joint_angles(2),
+                           leg_params, leg_index);
+  return {foot.x, foot.y, foot.z};
 }
 
 /*
 Calculate the leg jacobian for a given configuration, leg parameters, and leg
-side.
+side, by differentiating FootPosition() with the joint angles as dual numbers.
 
 joint_angles: 3-vector of joint angles. Order is {abduction, thigh, knee}
 leg_parameters: LegParameters for the leg
-side: RobotSide of the leg
+leg_index: leg 0 to 3, for the side of the hip offset
 */
 BLA::Matrix<3, 3> LegJacobian(BLA::Matrix<3> joint_angles,
                               LegParameters leg_params, uint8_t leg_index) {
-  float l1 = leg_params.thigh_length;
-  float l2 = leg_params.shank_length;
+  auto foot = FootPosition(DualVariable<0, 3>(joint_angles(0)),
+                           DualVariable<1, 3>(joint_angles(1)),
+                           DualVariable<2, 3>(joint_angles(2)), leg_params,
+                           leg_index);
 
-  float alpha = joint_angles(0);
-  float theta = joint_angles(1);
-  float phi = joint_angles(2);
+  BLA::Matrix<3, 3> jac;
+  for (uint8_t j = 0; j < 3; j++) {
+    jac(0, j) = Derivative(foot.x, j);
+    jac(1, j) = Derivative(foot.y, j);
+    jac(2, j) = Derivative(foot.z, j);
+  }
+  return jac;
+}
 
-  float px = -l1 * sin(theta) - l2 * sin(theta + phi);
-  float py = HipOffset(leg_params, leg_index);
-  float pz = -l1 * cos(theta) - l2 * cos(theta + phi);
+// The joint angles are differentiated twice: the outer duals give the
+// jacobian, the inner ones the derivative of everything along the joint
+// velocities, i.e. in time. The inner derivative of each jacobian entry is
+// then an entry of dJ/dt.
+void LegJacobianAndBias(BLA::Matrix<3> joint_angles,
+                        BLA::Matrix<3> joint_velocities,
+                        LegParameters leg_params, uint8_t leg_index,
+                        BLA::Matrix<3, 3> &jacobian,
+                        BLA::Matrix<3> &jacobian_dot_velocity) {
+  Dual<float, 1> angles[3];
+  for (uint8_t j = 0; j < 3; j++) {
+    angles[j].v = joint_angles(j);
+    angles[j].d[0] = joint_velocities(j);
+  }
+  auto foot = FootPosition(DualVariable<0, 3>(angles[0]),
+                           DualVariable<1, 3>(angles[1]),
+                           DualVariable<2, 3>(angles[2]), leg_params,
+                           leg_index);
 
-  BLA::Matrix<3, 3> jac = {0,
-                           pz,
-                           -l2 * cos(theta + phi),
-                           -py * sin(alpha) - pz * cos(alpha),
-                           sin(alpha) * px,
-                           -l2 * sin(alpha) * sin(theta + phi),
-                           py * cos(alpha) - pz * sin(alpha),
-                           -px * cos(alpha),
-                           l2 * cos(alpha) * sin(theta + phi)};
-  return jac;
+  Dual<float, 1> rows[3][3];
+  for (uint8_t j = 0; j < 3; j++) {
+    rows[0][j] = Derivative(foot.x, j);
+    rows[1][j] = Derivative(foot.y, j);
+    rows[2][j] = Derivative(foot.z, j);
+  }
+  for (uint8_t i = 0; i < 3; i++) {
+    float bias = 0;
+    for (uint8_t j = 0; j < 3; j++) {
+      jacobian(i, j) = rows[i][j].v;
+      bias += rows[i][j].d[0] * joint_velocities(j);
+    }
+    jacobian_dot_velocity(i) = bias;
+  }
 }
@@ -1,9 +1,11 @@
 // Cartesian PD Control
 #pragma once
 
-#include <Arduino.h>
 #include <BasicLinearAlgebra.h>
 
+#include "Dual.h"
+#include "Platform.h"
+
 struct LegParameters {
   float thigh_length = 0.08;
   float shank_length = 0.11;
@@ -26,10 +28,54 @@ BLA::Matrix<3> HipPosition(HipLayoutParameters hip_layoout_params, uint8_t i);
 // Return a rotation matrix around x-axis
 BLA::Matrix<3, 3> RotateX(float theta);
 
+// Result of FootPosition(). x does not depend on the abduction, so with
+// dual numbers it has a different type than y and z.
+template <class X, class YZ>
+struct FootPoint {
+  X x;
+  YZ y;
+  YZ z;
+};
+
+// The leg geometry, written once for any scalar types with +, -, * and
+// SinCos(): float for ForwardKinematics(), the dual numbers of Dual.h for its
+// derivatives. The angles are abduction, thigh and knee.
+template <class Alpha, class Theta, class Phi>
+auto FootPosition(const Alpha &alpha, const Theta &theta, const Phi &phi,
+                  LegParameters leg_params, uint8_t leg_index) {
+  float l1 = leg_params.thigh_length;
+  float l2 = leg_params.shank_length;
+  float py = HipOffset(leg_params, leg_index);
+
+  Alpha sin_alpha, cos_alpha;
+  Theta sin_theta, cos_theta;
+  auto knee = theta + phi;
+  decltype(knee) sin_knee, cos_knee;
+  SinCos(alpha, sin_alpha, cos_alpha);
+  SinCos(theta, sin_theta, cos_theta);
+  SinCos(knee, sin_knee, cos_knee);
+
+  // Foot in the frame tilted by the abduction, then RotateX(alpha).
+  auto px = -l1 * sin_theta - l2 * sin_knee;
+  auto pz = -l1 * cos_theta - l2 * cos_knee;
+  auto y = cos_alpha * py - sin_alpha * pz;
+  auto z = sin_alpha * py + cos_alpha * pz;
+  return FootPoint<decltype(px), decltype(y)>{px, y, z};
+}
+
 // Return the hip-relative cartesian coordaintes of a foot given its leg's joint angle
 BLA::Matrix<3> ForwardKinematics(BLA::Matrix<3> joint_angles,
                              LegParameters leg_params, uint8_t leg_index);
 
-// Return the velocity jacobian of the specified leg
+// Return the velocity jacobian of the specified leg, differentiated from
+// FootPosition().
 BLA::Matrix<3, 3> LegJacobian(BLA::Matrix<3> joint_angles,
                               LegParameters leg_params, uint8_t leg_index);
+
+// The jacobian and its time derivative times the joint velocities, i.e. the
+// foot acceleration at zero joint acceleration.
+void LegJacobianAndBias(BLA::Matrix<3> joint_angles,
+                        BLA::Matrix<3> joint_velocities,
+                        LegParameters leg_params, uint8_t leg_index,
+                        BLA::Matrix<3, 3> &jacobian,
+                        BLA::Matrix<3> &jacobian_dot_velocity);
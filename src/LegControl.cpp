@@ -0,0 +1,38 @@
+#include "LegControl.h"
+
+#include "Utils.h"
+
+BLA::Matrix<3> CartesianLegControl(BLA::Matrix<3> joint_angles,
+                                   BLA::Matrix<3> joint_velocities,
+                                   BLA::Matrix<3> reference_position,
+                                   BLA::Matrix<3> reference_velocity,
+                                   BLA::Matrix<3> feedforward_force,
+                                   PDGains3x3 gains, KneeSoftLimit knee_limit,
+                                   float max_current, LegParameters leg_params,
+                                   uint8_t leg_index) {
+  BLA::Matrix<3, 3> jac = LegJacobian(joint_angles, leg_params, leg_index);
+
+  auto measured_position =
+      ForwardKinematics(joint_angles, leg_params, leg_index);
+  auto measured_velocity = jac * joint_velocities;
+
+  auto cartesian_forces =
+      PDControl3(measured_position, measured_velocity, reference_position,
+                 reference_velocity, gains) +
+      feedforward_force;
+  float knee_angle = joint_angles(2);
+  float knee_constraint_torque =
+      (knee_angle > knee_limit.angle)
+          ? knee_limit.kp * (knee_limit.angle - knee_angle)
+          : 0.0;
+  BLA::Matrix<3> joint_torques = ~jac * cartesian_forces;
+
+  // Ensures that the direction of the force is preserved when motors
+  // saturate
+  float norm = Utils::InfinityNorm3(joint_torques);
+  if (norm > max_current) {
+    joint_torques = joint_torques * max_current / norm;
+  }
+  joint_torques(2) += knee_constraint_torque;
+  return joint_torques;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <BasicLinearAlgebra.h>
+
+#include "Kinematics.h"
+#include "PID.h"
+#include "Platform.h"
+
+// Soft joint limit on the knee, applied as a one-sided spring on top of the
+// cartesian law.
+struct KneeSoftLimit {
+  float angle;  // [rad]
+  float kp;     // [A/rad]
+};
+
+// Per-leg cartesian impedance law used by DriveSystem::CartesianPositionControl.
+// Positions are relative to the hip. Returns the joint currents in [A] for
+// {abduction, hip, knee}. The jacobian-transpose torques are scaled down
+// together when any of them exceeds max_current so the force direction is
+// preserved.
+BLA::Matrix<3> CartesianLegControl(BLA::Matrix<3> joint_angles,
+                                   BLA::Matrix<3> joint_velocities,
+                                   BLA::Matrix<3> reference_position,
+                                   BLA::Matrix<3> reference_velocity,
+                                   BLA::Matrix<3> feedforward_force,
+                                   PDGains3x3 gains, KneeSoftLimit knee_limit,
+                                   float max_current, LegParameters leg_params,
+                                   uint8_t leg_index);
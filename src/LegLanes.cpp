@@ -0,0 +1,142 @@
+#include "LegLanes.h"
+
+namespace {
+
+LegLanes Broadcast(float x) { return LegLanes{x, x, x, x}; }
+
+LegLanes Abs(LegLanes x) { return x < 0.0f ? -x : x; }
+
+LegLanes Max(LegLanes a, LegLanes b) { return a > b ? a : b; }
+
+// sinf/cosf after Cephes: reduce to [-pi/4, pi/4] in three steps of pi/4
+// and pick the sine or cosine polynomial by octant.
+const float kFourOverPi = 1.27323954473516f;
+const float kPiOver4Part1 = 0.78515625f;
+const float kPiOver4Part2 = 2.4187564849853515625e-4f;
+const float kPiOver4Part3 = 3.77489497744594108e-8f;
+const float kSin1 = -1.9515295891e-4f;
+const float kSin2 = 8.3321608736e-3f;
+const float kSin3 = -1.6666654611e-1f;
+const float kCos1 = 2.443315711809948e-5f;
+const float kCos2 = -1.388731625493765e-3f;
+const float kCos3 = 4.166664568298827e-2f;
+
+}  // namespace
+
+LegLanes3 ToLegLanes(const std::array<float, 12> &v) {
+  LegLanes3 lanes;
+  for (int j = 0; j < 3; j++) {
+    lanes[j] = LegLanes{v[j], v[3 + j], v[6 + j], v[9 + j]};
+  }
+  return lanes;
+}
+
+std::array<float, 12> FromLegLanes(const LegLanes3 &lanes) {
+  std::array<float, 12> v;
+  for (int leg = 0; leg < 4; leg++) {
+    for (int j = 0; j < 3; j++) {
+      v[3 * leg + j] = lanes[j][leg];
+    }
+  }
+  return v;
+}
+
+void SinCos(LegLanes x, LegLanes &s, LegLanes &c) {
+  LegLaneMask negative = x < 0.0f;
+  x = Abs(x);
+  // Octant, rounded up to even so that the remainder is centred on 0.
+  LegLaneMask octant = __builtin_convertvector(x * kFourOverPi, LegLaneMask);
+  octant = (octant + 1) & ~1;
+  LegLanes y = __builtin_convertvector(octant, LegLanes);
+  x = ((x - y * kPiOver4Part1) - y * kPiOver4Part2) - y * kPiOver4Part3;
+
+  LegLanes z = x * x;
+  LegLanes cos_poly =
+      ((kCos1 * z + kCos2) * z + kCos3) * z * z - 0.5f * z + 1.0f;
+  LegLanes sin_poly = ((kSin1 * z + kSin2) * z + kSin3) * z * x + x;
+
+  LegLaneMask swap = (octant & 2) != 0;
+  s = swap ? cos_poly : sin_poly;
+  c = swap ? sin_poly : cos_poly;
+  LegLaneMask sin_negative = negative ^ ((octant & 4) != 0);
+  LegLaneMask cos_negative = ((octant - 2) & 4) == 0;
+  s = sin_negative ? -s : s;
+  c = cos_negative ? -c : c;
+}
+
+LegLanes3 CartesianLegControlLanes(const LegLanes3 &joint_angles,
+                                   const LegLanes3 &joint_velocities,
+                                   const LegLanes3 &reference_position,
+                                   const LegLanes3 &reference_velocity,
+                                   const LegLanes3 &feedforward_force,
+                                   const PDGains3x3 &gains,
+                                   KneeSoftLimit knee_limit, float max_current,
+                                   LegParameters leg_params) {
+  float l1 = leg_params.thigh_length;
+  float l2 = leg_params.shank_length;
+  LegLanes alpha = joint_angles[0];
+  LegLanes theta = joint_angles[1];
+  LegLanes phi = joint_angles[2];
+
+  LegLanes sin_alpha, cos_alpha, sin_theta, cos_theta, sin_knee, cos_knee;
+  SinCos(alpha, sin_alpha, cos_alpha);
+  SinCos(theta, sin_theta, cos_theta);
+  SinCos(theta + phi, sin_knee, cos_knee);
+
+  LegLanes px = -l1 * sin_theta - l2 * sin_knee;
+  LegLanes py = {HipOffset(leg_params, 0), HipOffset(leg_params, 1),
+                 HipOffset(leg_params, 2), HipOffset(leg_params, 3)};
+  LegLanes pz = -l1 * cos_theta - l2 * cos_knee;
+
+  // ForwardKinematics(): RotateX(alpha) * {px, py, pz}.
+  LegLanes3 position = {px, cos_alpha * py - sin_alpha * pz,
+                        sin_alpha * py + cos_alpha * pz};
+
+  // LegJacobian(), row-major.
+  LegLanes jac[3][3] = {
+      {Broadcast(0.0f), pz, -l2 * cos_knee},
+      {-py * sin_alpha - pz * cos_alpha, sin_alpha * px,
+       -l2 * sin_alpha * sin_knee},
+      {py * cos_alpha - pz * sin_alpha, -px * cos_alpha,
+       l2 * cos_alpha * sin_knee},
+  };
+
+  LegLanes3 velocity;
+  for (int i = 0; i < 3; i++) {
+    velocity[i] = jac[i][0] * joint_velocities[0] +
+                  jac[i][1] * joint_velocities[1] +
+                  jac[i][2] * joint_velocities[2];
+  }
+
+  LegLanes3 position_error;
+  LegLanes3 velocity_error;
+  for (int i = 0; i < 3; i++) {
+    position_error[i] = reference_position[i] - position[i];
+    velocity_error[i] = reference_velocity[i] - velocity[i];
+  }
+  LegLanes3 force;
+  for (int i = 0; i < 3; i++) {
+    force[i] = feedforward_force[i];
+    for (int j = 0; j < 3; j++) {
+      force[i] += gains.kp(i, j) * position_error[j] +
+                  gains.kd(i, j) * velocity_error[j];
+    }
+  }
+
+  LegLanes3 torque;
+  for (int j = 0; j < 3; j++) {
+    torque[j] = jac[0][j] * force[0] + jac[1][j] * force[1] +
+                jac[2][j] * force[2];
+  }
+
+  // Scale all three down together to keep the force direction.
+  LegLanes norm = Max(Max(Abs(torque[0]), Abs(torque[1])), Abs(torque[2]));
+  LegLanes scale = norm > max_current ? max_current / norm : Broadcast(1.0f);
+  LegLanes knee_torque = phi > knee_limit.angle
+                             ? knee_limit.kp * (knee_limit.angle - phi)
+                             : Broadcast(0.0f);
+  torque[0] *= scale;
+  torque[1] *= scale;
+  torque[2] = torque[2] * scale + knee_torque;
+  return torque;
+}
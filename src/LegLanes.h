@@ -0,0 +1,42 @@
+#pragma once
+
+#include <BasicLinearAlgebra.h>
+
+#include <array>
+
+#include "Kinematics.h"
+#include "LegControl.h"
+#include "PID.h"
+#include "Platform.h"
+
+// The cartesian law of LegControl.h for all four legs at once, transposed so
+// that every scalar of the per-leg math (alpha, theta, phi, px, pz, each
+// Jacobian entry, each force) is one vector with a lane per leg. The lanes
+// are GCC vector extensions: SSE on x86 hosts and NEON on ARMv8 hosts. The
+// Cortex-M7 has no float SIMD, so on the Teensy every operation is lowered
+// to four scalar ones; what remains there is straight-line code without
+// branches or per-leg calls.
+typedef float LegLanes __attribute__((vector_size(16)));
+typedef int32_t LegLaneMask __attribute__((vector_size(16)));
+
+// Three per-leg quantities, indexed by joint or axis: lanes[j][leg].
+typedef std::array<LegLanes, 3> LegLanes3;
+
+// {v[j], v[3 + j], v[6 + j], v[9 + j]} for j = 0..2, from a 12-vector in the
+// drive's leg-major order, and back.
+LegLanes3 ToLegLanes(const std::array<float, 12> &v);
+std::array<float, 12> FromLegLanes(const LegLanes3 &lanes);
+
+// Sine and cosine of every lane, within 2 ulp of sinf/cosf for |x| < 8192.
+void SinCos(LegLanes x, LegLanes &s, LegLanes &c);
+
+// CartesianLegControl() for legs 0 to 3. Positions are relative to each
+// leg's hip.
+LegLanes3 CartesianLegControlLanes(const LegLanes3 &joint_angles,
+                                   const LegLanes3 &joint_velocities,
+                                   const LegLanes3 &reference_position,
+                                   const LegLanes3 &reference_velocity,
+                                   const LegLanes3 &feedforward_force,
+                                   const PDGains3x3 &gains,
+                                   KneeSoftLimit knee_limit, float max_current,
+                                   LegParameters leg_params);
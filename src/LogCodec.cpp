@@ -0,0 +1,105 @@
+#include "LogCodec.h"
+
+#include <string.h>
+
+namespace {
+
+const uint8_t kZeroRunFlag = 0x80;
+const uint32_t kMaxRun = 128;
+
+// Byte k of the XOR-delta stream.
+inline uint8_t DeltaByte(const uint8_t *raw, size_t k, size_t row_bytes) {
+  return k < row_bytes ? raw[k] : raw[k] ^ raw[k - row_bytes];
+}
+
+}  // namespace
+
+void LogCodecXorRow(uint32_t *row, const uint32_t *previous,
+                    uint32_t num_columns) {
+  for (uint32_t c = 0; c < num_columns; c++) {
+    row[c] ^= previous[c];
+  }
+}
+
+size_t LogCodecMaxEncodedSize(size_t raw_size) {
+  return raw_size + (raw_size + kMaxRun - 1) / kMaxRun;
+}
+
+size_t LogCodecEncode(const uint32_t *rows, uint32_t num_rows,
+                      uint32_t num_columns, uint8_t *out, size_t capacity) {
+  const uint8_t *raw = reinterpret_cast<const uint8_t *>(rows);
+  const size_t row_bytes = num_columns * sizeof(uint32_t);
+  const size_t total = num_rows * row_bytes;
+  size_t k = 0;
+  size_t n = 0;
+  while (k < total) {
+    if (DeltaByte(raw, k, row_bytes) == 0) {
+      uint32_t run = 1;
+      while (run < kMaxRun && k + run < total &&
+             DeltaByte(raw, k + run, row_bytes) == 0) {
+        run++;
+      }
+      if (n + 1 > capacity) {
+        return 0;
+      }
+      out[n++] = kZeroRunFlag | (run - 1);
+      k += run;
+    } else {
+      // Literal run up to the next pair of zero bytes; a lone zero is cheaper
+      // to keep inside the literal.
+      uint32_t run = 1;
+      while (run < kMaxRun && k + run < total) {
+        bool zero_pair = DeltaByte(raw, k + run, row_bytes) == 0 &&
+                         (k + run + 1 >= total ||
+                          DeltaByte(raw, k + run + 1, row_bytes) == 0);
+        if (zero_pair) {
+          break;
+        }
+        run++;
+      }
+      if (n + 1 + run > capacity) {
+        return 0;
+      }
+      out[n++] = run - 1;
+      for (uint32_t i = 0; i < run; i++) {
+        out[n++] = DeltaByte(raw, k + i, row_bytes);
+      }
+      k += run;
+    }
+  }
+  return n;
+}
+
+bool LogCodecDecode(const uint8_t *in, size_t size, uint32_t num_rows,
+                    uint32_t num_columns, uint32_t *rows) {
+  uint8_t *raw = reinterpret_cast<uint8_t *>(rows);
+  const size_t row_bytes = num_columns * sizeof(uint32_t);
+  const size_t total = num_rows * row_bytes;
+  size_t k = 0;
+  size_t i = 0;
+  while (i < size) {
+    uint8_t control = in[i++];
+    uint32_t run = (control & ~kZeroRunFlag) + 1;
+    if (k + run > total) {
+      return false;
+    }
+    if (control & kZeroRunFlag) {
+      memset(raw + k, 0, run);
+    } else {
+      if (i + run > size) {
+        return false;
+      }
+      memcpy(raw + k, in + i, run);
+      i += run;
+    }
+    k += run;
+  }
+  if (k != total) {
+    return false;
+  }
+  for (uint32_t row = 1; row < num_rows; row++) {
+    LogCodecXorRow(rows + row * num_columns, rows + (row - 1) * num_columns,
+                   num_columns);
+  }
+  return true;
+}
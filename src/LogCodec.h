@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Platform.h"
+
+// Lightweight row codec for log chunks. Every row of 32-bit values is XORed
+// with the row before it (the first row with zeros), which turns slowly
+// varying and constant columns into mostly zero bytes. That byte stream is
+// then coded as runs:
+//   0b1nnnnnnn          n + 1 zero bytes
+//   0b0nnnnnnn <bytes>  n + 1 literal bytes
+// so the output is at most 1/128 larger than the input.
+
+// The row transform on its own, for coders that take rows one at a time:
+// XOR each of the num_columns values of row with the same column of
+// previous. Applied to a row and the raw row before it, it gives the delta;
+// applied to a delta and the decoded row before it, it gives the row back.
+void LogCodecXorRow(uint32_t *row, const uint32_t *previous,
+                    uint32_t num_columns);
+
+// Upper bound of the encoded size of raw_size input bytes.
+size_t LogCodecMaxEncodedSize(size_t raw_size);
+
+// Encode num_rows rows of num_columns values. Returns the number of bytes
+// written to out, or 0 if capacity was too small.
+size_t LogCodecEncode(const uint32_t *rows, uint32_t num_rows,
+                      uint32_t num_columns, uint8_t *out, size_t capacity);
+
+// Decode into num_rows x num_columns values. Returns false if the input is
+// malformed or does not hold exactly that many values.
+bool LogCodecDecode(const uint8_t *in, size_t size, uint32_t num_rows,
+                    uint32_t num_columns, uint32_t *rows);
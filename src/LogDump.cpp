@@ -0,0 +1,172 @@
+#include "LogDump.h"
+
+#include <math.h>
+
+#include "LogCodec.h"
+
+namespace {
+// Steps of a quantized value. Values that are not finite become 0.
+int64_t QuantizedSteps(float value) {
+  return isfinite(value)
+             ? llround(static_cast<double>(value) * kLogDumpQuantizeScale)
+             : 0;
+}
+
+// Difference of two rows' steps, saturated to 32 bits, interleaving
+// negative and positive values (0, -1, 1, -2, ...) so small ones of either
+// sign leave the upper bytes zero.
+uint32_t ZigzagDelta(int64_t steps, int64_t previous) {
+  int64_t delta = steps - previous;
+  delta = delta > INT32_MAX ? INT32_MAX : delta < INT32_MIN ? INT32_MIN : delta;
+  return static_cast<uint32_t>(delta) << 1 ^
+         static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+}
+
+int32_t UnzigzagDelta(uint32_t word) {
+  return static_cast<int32_t>(word >> 1 ^ (0u - (word & 1)));
+}
+}  // namespace
+
+LogDumpEncoder::LogDumpEncoder()
+    : out_(nullptr),
+      columns_(nullptr),
+      num_columns_(0),
+      quantize_(false),
+      first_row_(true),
+      packet_size_(0),
+      raw_bytes_(0),
+      coded_bytes_(0),
+      begin_micros_(0) {}
+
+void LogDumpEncoder::Begin(Print &out, uint32_t num_rows,
+                           const uint8_t *columns, uint16_t num_columns,
+                           bool quantize, uint32_t now_micros) {
+  out_ = &out;
+  columns_ = columns;
+  num_columns_ =
+      num_columns < kLogDumpMaxColumns ? num_columns : kLogDumpMaxColumns;
+  quantize_ = quantize;
+  first_row_ = true;
+  memset(previous_steps_, 0, sizeof(previous_steps_));
+  lzss_.Reset();
+  packet_size_ = 0;
+  raw_bytes_ = 0;
+  coded_bytes_ = 0;
+  begin_micros_ = now_micros;
+
+  // The column list only fits with row columns, at most 256.
+  uint8_t payload[kLogDumpBeginSize + 256];
+  memcpy(payload, &num_rows, 4);
+  memcpy(payload + 4, &num_columns_, 2);
+  payload[6] = LzssEncoder::kWindowBits;
+  payload[7] = LzssEncoder::kLengthBits;
+  payload[8] = (quantize ? kQuantized : 0) | (columns ? kColumnList : 0);
+  size_t size = kLogDumpBeginSize;
+  if (columns) {
+    memcpy(payload + size, columns, num_columns_);
+    size += num_columns_;
+  }
+  WriteFrame(LogDumpFrameType::kBegin, payload, size);
+}
+
+void LogDumpEncoder::AddRow(const float *values) {
+  size_t row_bytes = 4 * num_columns_;
+  uint32_t delta[kLogDumpMaxColumns];
+  for (uint16_t c = 0; c < num_columns_; c++) {
+    memcpy(&delta[c], &values[columns_ ? columns_[c] : c], 4);
+  }
+  if (!quantize_) {
+    // delta becomes the XOR of the two rows and previous_ this row.
+    LogCodecXorRow(delta, previous_, num_columns_);
+    LogCodecXorRow(previous_, delta, num_columns_);
+  } else {
+    for (uint16_t c = 0; c < num_columns_; c++) {
+      int64_t steps = QuantizedSteps(values[columns_ ? columns_[c] : c]);
+      if (!first_row_) {
+        delta[c] = ZigzagDelta(steps, previous_steps_[c]);
+      }
+      previous_steps_[c] = steps;
+    }
+  }
+  first_row_ = false;
+  for (uint16_t c = 0; c < num_columns_; c++) {
+    for (uint8_t plane = 0; plane < 4; plane++) {
+      planes_[plane * num_columns_ + c] = delta[c] >> (24 - 8 * plane);
+    }
+  }
+  raw_bytes_ += row_bytes;
+  Append(coded_, lzss_.Write(planes_, row_bytes, coded_));
+}
+
+void LogDumpEncoder::End(uint32_t now_micros) {
+  Append(coded_, lzss_.Finish(coded_));
+  if (packet_size_ > 0) {
+    WriteFrame(LogDumpFrameType::kData, packet_, packet_size_);
+    packet_size_ = 0;
+  }
+  uint32_t micros = now_micros - begin_micros_;
+  uint8_t payload[12];
+  memcpy(payload, &raw_bytes_, 4);
+  memcpy(payload + 4, &coded_bytes_, 4);
+  memcpy(payload + 8, &micros, 4);
+  WriteFrame(LogDumpFrameType::kEnd, payload, sizeof(payload));
+}
+
+void LogDumpEncoder::Append(const uint8_t *data, size_t size) {
+  coded_bytes_ += size;
+  while (size > 0) {
+    size_t count = kPacketCapacity - packet_size_;
+    count = size < count ? size : count;
+    memcpy(packet_ + packet_size_, data, count);
+    packet_size_ += count;
+    data += count;
+    size -= count;
+    if (packet_size_ == kPacketCapacity) {
+      WriteFrame(LogDumpFrameType::kData, packet_, packet_size_);
+      packet_size_ = 0;
+    }
+  }
+}
+
+void LogDumpEncoder::WriteFrame(LogDumpFrameType type, const uint8_t *payload,
+                                size_t size) {
+  uint16_t length = size + 1;
+  uint8_t header[kLogDumpHeaderSize] = {kLogDumpMarker, kLogDumpMarker,
+                                        static_cast<uint8_t>(length >> 8),
+                                        static_cast<uint8_t>(length & 0xff),
+                                        static_cast<uint8_t>(type)};
+  out_->write(header, sizeof(header));
+  out_->write(payload, size);
+}
+
+void LogDumpDecodeRows(const uint8_t *planes, uint32_t num_rows,
+                       uint16_t num_columns, bool quantized,
+                       uint32_t *values) {
+  int64_t steps[kLogDumpMaxColumns];
+  for (uint32_t row = 0; row < num_rows; row++) {
+    const uint8_t *in = planes + row * 4 * num_columns;
+    uint32_t *out = values + row * num_columns;
+    for (uint16_t c = 0; c < num_columns; c++) {
+      out[c] = 0;
+      for (uint8_t plane = 0; plane < 4; plane++) {
+        out[c] |= static_cast<uint32_t>(in[plane * num_columns + c])
+                  << (24 - 8 * plane);
+      }
+    }
+    if (row == 0) {
+      for (uint16_t c = 0; quantized && c < num_columns; c++) {
+        float value;
+        memcpy(&value, &out[c], 4);
+        steps[c] = QuantizedSteps(value);
+      }
+    } else if (quantized) {
+      for (uint16_t c = 0; c < num_columns; c++) {
+        steps[c] += UnzigzagDelta(out[c]);
+        float value = static_cast<float>(steps[c] / kLogDumpQuantizeScale);
+        memcpy(&out[c], &value, 4);
+      }
+    } else {
+      LogCodecXorRow(out, out - num_columns, num_columns);
+    }
+  }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Lzss.h"
+#include "Platform.h"
+
+// Compressed binary dump of the DataLogger rows.
+//
+// Only the selected columns of each row are sent, e.g. the logged ones.
+// Rows are coded one at a time into 32-bit words, one per column, in one of
+// two formats:
+//   exact      every value's bits XORed with the same column of the row
+//              before (the first row with zeros) by LogCodecXorRow()
+//   quantized  lossy: values rounded to kLogDumpQuantizeScale steps, the
+//              status line's precision, and sent as the zigzag coded
+//              difference from the same column of the row before. The first
+//              row is sent exact. Noisy low mantissa bits no longer reach
+//              the stream, so it compresses several times better.
+// The words are split into byte planes, the most significant byte of every
+// column first, so slowly varying signals leave long runs of zeros in the
+// upper planes. The planes go through the LzssEncoder.
+//
+// Frames (integers little-endian, except the frame length which is
+// big-endian like the msgpack status frames):
+//   0x49 0x49  start bytes
+//   uint16     length of what follows
+//   uint8      type, then by type
+//     0 begin  uint32 num_rows, uint16 num_columns, uint8 window_bits,
+//              uint8 length_bits, uint8 flags (LogDumpFlags), then with
+//              kColumnList the row index of each column as uint8
+//     1 data   the next bytes of the LZSS stream
+//     2 end    uint32 raw_bytes, uint32 coded_bytes, uint32 micros
+// raw_bytes is 4 * num_rows * num_columns, coded_bytes the LZSS stream and
+// micros the time from the begin frame to the end frame.
+
+const uint8_t kLogDumpMarker = 0x49;
+// Enough for the min, mean and max of every DebugData column in a
+// TieredLogger envelope row.
+const uint32_t kLogDumpMaxColumns = 288;
+// A data frame fills one high-speed USB packet.
+const uint32_t kLogDumpFrameSize = 512;
+const uint32_t kLogDumpHeaderSize = 5;  // start bytes, length, type
+const uint32_t kLogDumpBeginSize = 9;   // begin payload before the columns
+// Quantized values are multiples of 1 / kLogDumpQuantizeScale.
+const float kLogDumpQuantizeScale = 100.0f;
+
+enum class LogDumpFrameType : uint8_t { kBegin, kData, kEnd };
+
+enum LogDumpFlags : uint8_t { kQuantized = 1, kColumnList = 2 };
+
+class LogDumpEncoder {
+ public:
+  LogDumpEncoder();
+
+  // Write the begin frame of a dump of num_rows rows to out. Each row sends
+  // num_columns values: columns[k] of the row for the k-th, or the first
+  // num_columns if columns is null. columns must stay valid until End().
+  // quantize selects the lossy format.
+  void Begin(Print &out, uint32_t num_rows, const uint8_t *columns,
+             uint16_t num_columns, bool quantize, uint32_t now_micros);
+
+  // Code the next row. Writes data frames as they fill up.
+  void AddRow(const float *values);
+
+  // Flush the stream and write the end frame.
+  void End(uint32_t now_micros);
+
+  uint32_t RawBytes() const { return raw_bytes_; }
+  uint32_t CodedBytes() const { return coded_bytes_; }
+
+ private:
+  void Append(const uint8_t *data, size_t size);
+  void WriteFrame(LogDumpFrameType type, const uint8_t *payload,
+                  size_t size);
+
+  static const uint32_t kPacketCapacity =
+      kLogDumpFrameSize - kLogDumpHeaderSize;
+  static const uint32_t kRowBytes = 4 * kLogDumpMaxColumns;
+
+  LzssEncoder lzss_;
+  Print *out_;
+  const uint8_t *columns_;
+  uint16_t num_columns_;
+  bool quantize_;
+  bool first_row_;
+  // The previous row: its bits, or quantized its steps.
+  union {
+    uint32_t previous_[kLogDumpMaxColumns];
+    int64_t previous_steps_[kLogDumpMaxColumns];
+  };
+  uint8_t planes_[kRowBytes];
+  uint8_t coded_[LzssEncoder::MaxOutput(kRowBytes)];
+  uint8_t packet_[kPacketCapacity];
+  uint32_t packet_size_;
+  uint32_t raw_bytes_;
+  uint32_t coded_bytes_;
+  uint32_t begin_micros_;
+};
+
+// Undo the row transform: planes holds num_rows rows of byte planes as
+// the LZSS stream decodes to, values receives the bits of the rows' floats.
+void LogDumpDecodeRows(const uint8_t *planes, uint32_t num_rows,
+                       uint16_t num_columns, bool quantized,
+                       uint32_t *values);
@@ -0,0 +1,251 @@
+#include "LogStorage.h"
+
+#include <string.h>
+
+#if defined(ARDUINO) && defined(__IMXRT1062__)
+// Flash routines from the Teensy core's EEPROM emulation. They run from RAM
+// and keep interrupts off while the flash is busy.
+extern "C" {
+void eepromemu_flash_write(void *addr, const void *data, uint32_t len);
+void eepromemu_flash_erase_sector(void *addr);
+extern unsigned long _flashimagelen;
+}
+
+namespace {
+// End of the usable program flash on the Teensy 4.0 (2 MB minus the EEPROM
+// emulation sectors), the same limit LittleFS_Program uses.
+const uint32_t kFlashBase = 0x60000000;
+const uint32_t kFlashEnd = kFlashBase + 0x1F0000;
+
+// Serial NOR flash commands, issued with FlexSPI IP commands from LUT
+// sequence 15 the same way the core's EEPROM emulation does.
+const uint32_t kWriteEnable = 0x06;
+const uint32_t kReadStatus = 0x05;
+const uint32_t kSectorErase = 0x20;
+const uint32_t kStatusBusy = 0x01;
+
+uint32_t LutInstruction(uint32_t opcode, uint32_t operand) {
+  return FLEXSPI_LUT_INSTRUCTION(opcode, FLEXSPI_LUT_NUM_PADS_1, operand);
+}
+
+// Load a one or two instruction sequence and run it. Returns once the
+// controller has sent it, not when the flash is done. Interrupts must be off.
+void RunIpCommand(uint32_t instructions, uint32_t address, uint32_t ipcr1) {
+  FLEXSPI_LUTKEY = FLEXSPI_LUTKEY_VALUE;
+  FLEXSPI_LUTCR = FLEXSPI_LUTCR_UNLOCK;
+  FLEXSPI_LUT60 = instructions;
+  FLEXSPI_LUT61 = 0;
+  FLEXSPI_LUT62 = 0;
+  FLEXSPI_LUT63 = 0;
+  FLEXSPI_IPCR0 = address;
+  FLEXSPI_IPCR1 = FLEXSPI_IPCR1_ISEQID(15) | ipcr1;
+  FLEXSPI_IPCMD = FLEXSPI_IPCMD_TRG;
+  while (!(FLEXSPI_INTR & FLEXSPI_INTR_IPCMDDONE)) {
+  }
+  FLEXSPI_INTR = FLEXSPI_INTR_IPCMDDONE;
+}
+}  // namespace
+
+bool ProgramFlashStorage::erasing_ = false;
+uint8_t *ProgramFlashStorage::erase_address_ = nullptr;
+
+ProgramFlashStorage::ProgramFlashStorage() : base_(nullptr), num_sectors_(0) {}
+
+bool ProgramFlashStorage::Begin(uint32_t size, uint32_t end_offset) {
+  size = size / kSectorSize * kSectorSize;
+  end_offset = end_offset / kSectorSize * kSectorSize;
+  uint32_t start = kFlashEnd - end_offset - size;
+  if (size == 0 || size + end_offset > kFlashEnd - kFlashBase ||
+      start < kFlashBase + (uint32_t)&_flashimagelen) {
+    return false;
+  }
+  base_ = reinterpret_cast<uint8_t *>(start);
+  num_sectors_ = size / kSectorSize;
+  return true;
+}
+
+bool ProgramFlashStorage::Erase(uint32_t sector) {
+  if (sector >= num_sectors_) {
+    return false;
+  }
+  WaitForErase();
+  eepromemu_flash_erase_sector(base_ + sector * kSectorSize);
+  return true;
+}
+
+bool ProgramFlashStorage::StartErase(uint32_t sector) {
+  if (sector >= num_sectors_) {
+    return false;
+  }
+  WaitForErase();
+  uint8_t *address = base_ + sector * kSectorSize;
+  uint32_t flash_offset = reinterpret_cast<uint32_t>(address) & 0x00FFF000;
+  __disable_irq();
+  RunIpCommand(LutInstruction(FLEXSPI_LUT_OPCODE_CMD_SDR, kWriteEnable),
+               flash_offset, 0);
+  arm_dcache_delete(address, kSectorSize);
+  RunIpCommand(LutInstruction(FLEXSPI_LUT_OPCODE_CMD_SDR, kSectorErase) |
+                   LutInstruction(FLEXSPI_LUT_OPCODE_RADDR_SDR, 24) << 16,
+               flash_offset, 0);
+  erasing_ = true;
+  erase_address_ = address;
+  __enable_irq();
+  return true;
+}
+
+bool ProgramFlashStorage::EraseBusy() { return PollErase(); }
+
+bool ProgramFlashStorage::PollErase() {
+  if (!erasing_) {
+    return false;
+  }
+  __disable_irq();
+  FLEXSPI_IPRXFCR = FLEXSPI_IPRXFCR_CLRIPRXF;
+  RunIpCommand(LutInstruction(FLEXSPI_LUT_OPCODE_CMD_SDR, kReadStatus) |
+                   LutInstruction(FLEXSPI_LUT_OPCODE_READ_SDR, 1) << 16,
+               0, FLEXSPI_IPCR1_IDATSZ(1));
+  uint8_t status = *(volatile uint8_t *)&FLEXSPI_RFDR0;
+  if (!(status & kStatusBusy)) {
+    // Drop anything fetched from the sector while it was being erased.
+    FLEXSPI_MCR0 = FLEXSPI_MCR0 | FLEXSPI_MCR0_SWRESET;
+    while (FLEXSPI_MCR0 & FLEXSPI_MCR0_SWRESET) {
+    }
+    arm_dcache_delete(erase_address_, kSectorSize);
+    erasing_ = false;
+  }
+  __enable_irq();
+  return erasing_;
+}
+
+void ProgramFlashStorage::WaitForErase() {
+  while (PollErase()) {
+  }
+}
+
+bool ProgramFlashStorage::Program(uint32_t offset, const void *data,
+                                  uint32_t size) {
+  if (offset + size > num_sectors_ * kSectorSize) {
+    return false;
+  }
+  WaitForErase();
+  eepromemu_flash_write(base_ + offset, data, size);
+  return true;
+}
+
+bool ProgramFlashStorage::Read(uint32_t offset, void *data, uint32_t size) {
+  if (offset + size > num_sectors_ * kSectorSize) {
+    return false;
+  }
+  // The flash is memory mapped; the write routines invalidate the cache.
+  WaitForErase();
+  memcpy(data, base_ + offset, size);
+  return true;
+}
+#endif
+
+#ifndef ARDUINO
+FileLogStorage::FileLogStorage(uint32_t sector_size, uint32_t num_sectors)
+    : file_(nullptr),
+      sector_size_(sector_size),
+      num_sectors_(num_sectors),
+      erase_latency_(0),
+      busy_polls_(0),
+      stalls_(0) {}
+
+FileLogStorage::~FileLogStorage() {
+  if (file_) {
+    fclose(file_);
+  }
+}
+
+bool FileLogStorage::Open(const char *path, bool create) {
+  file_ = fopen(path, "r+b");
+  if (file_ || !create) {
+    return file_ != nullptr;
+  }
+  file_ = fopen(path, "w+b");
+  if (!file_) {
+    return false;
+  }
+  for (uint32_t sector = 0; sector < num_sectors_; sector++) {
+    if (!Erase(sector)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void FileLogStorage::Stall() {
+  if (busy_polls_ > 0) {
+    busy_polls_ = 0;
+    stalls_++;
+  }
+}
+
+bool FileLogStorage::StartErase(uint32_t sector) {
+  if (!Erase(sector)) {
+    return false;
+  }
+  busy_polls_ = erase_latency_;
+  return true;
+}
+
+bool FileLogStorage::EraseBusy() {
+  if (busy_polls_ == 0) {
+    return false;
+  }
+  busy_polls_--;
+  return true;
+}
+
+bool FileLogStorage::Erase(uint32_t sector) {
+  if (!file_ || sector >= num_sectors_) {
+    return false;
+  }
+  Stall();
+  uint8_t erased[256];
+  memset(erased, 0xff, sizeof(erased));
+  fseek(file_, (long)sector * sector_size_, SEEK_SET);
+  for (uint32_t written = 0; written < sector_size_; written += sizeof(erased)) {
+    uint32_t n = sector_size_ - written < sizeof(erased) ? sector_size_ - written
+                                                          : sizeof(erased);
+    if (fwrite(erased, 1, n, file_) != n) {
+      return false;
+    }
+  }
+  return fflush(file_) == 0;
+}
+
+bool FileLogStorage::Program(uint32_t offset, const void *data, uint32_t size) {
+  if (!file_ || offset + size > num_sectors_ * sector_size_) {
+    return false;
+  }
+  Stall();
+  // NOR flash can only clear bits.
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  uint8_t current[256];
+  for (uint32_t done = 0; done < size; done += sizeof(current)) {
+    uint32_t n = size - done < sizeof(current) ? size - done : sizeof(current);
+    if (!Read(offset + done, current, n)) {
+      return false;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      current[i] &= bytes[done + i];
+    }
+    fseek(file_, offset + done, SEEK_SET);
+    if (fwrite(current, 1, n, file_) != n) {
+      return false;
+    }
+  }
+  return fflush(file_) == 0;
+}
+
+bool FileLogStorage::Read(uint32_t offset, void *data, uint32_t size) {
+  if (!file_ || offset + size > num_sectors_ * sector_size_) {
+    return false;
+  }
+  Stall();
+  fseek(file_, offset, SEEK_SET);
+  return fread(data, 1, size, file_) == size;
+}
+#endif
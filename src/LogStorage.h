@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Platform.h"
+
+// Sector-erasable storage with NOR flash semantics: Erase() sets a whole
+// sector to 0xff and Program() can only clear bits. Offsets are in bytes from
+// the start of the storage.
+class LogStorage {
+ public:
+  virtual ~LogStorage() {}
+
+  virtual uint32_t SectorSize() const = 0;
+  virtual uint32_t NumSectors() const = 0;
+
+  virtual bool Erase(uint32_t sector) = 0;
+  virtual bool Program(uint32_t offset, const void *data, uint32_t size) = 0;
+  virtual bool Read(uint32_t offset, void *data, uint32_t size) = 0;
+
+  // Start erasing a sector and return without waiting for it. EraseBusy()
+  // polls it; Erase(), Program() and Read() wait until it is done. Storage
+  // that cannot erase in the background erases here and is never busy.
+  virtual bool StartErase(uint32_t sector) { return Erase(sector); }
+  virtual bool EraseBusy() { return false; }
+};
+
+#if defined(ARDUINO) && defined(__IMXRT1062__)
+// The top of the Teensy 4 program flash, below the EEPROM emulation area.
+// Begin() fails if the firmware image reaches into the region.
+//
+// StartErase() issues the erase to the flash chip and returns; the CPU keeps
+// running from RAM while the chip erases for tens of ms. Nothing may read the
+// flash through the memory map meanwhile (FLASHMEM code, PROGMEM data), so
+// the firmware keeps both out of the paths that run during a motion. All
+// regions share the one chip, so a background erase blocks every instance.
+class ProgramFlashStorage : public LogStorage {
+ private:
+  uint8_t *base_;
+  uint32_t num_sectors_;
+
+  static bool erasing_;
+  static uint8_t *erase_address_;
+
+  // Read the flash status; clears erasing_ once the erase is done.
+  static bool PollErase();
+  static void WaitForErase();
+
+ public:
+  static const uint32_t kSectorSize = 4096;
+
+  ProgramFlashStorage();
+
+  // Reserve size bytes (a multiple of kSectorSize) ending end_offset bytes
+  // below the top of the usable flash. Regions must not overlap.
+  bool Begin(uint32_t size, uint32_t end_offset = 0);
+
+  uint32_t SectorSize() const override { return kSectorSize; }
+  uint32_t NumSectors() const override { return num_sectors_; }
+
+  bool Erase(uint32_t sector) override;
+  bool Program(uint32_t offset, const void *data, uint32_t size) override;
+  bool Read(uint32_t offset, void *data, uint32_t size) override;
+  bool StartErase(uint32_t sector) override;
+  bool EraseBusy() override;
+};
+#endif
+
+#ifndef ARDUINO
+#include <cstdio>
+
+// Host stand-in for ProgramFlashStorage backed by an image file, so the log
+// code and flash images read back from a robot can be used natively.
+class FileLogStorage : public LogStorage {
+ private:
+  FILE *file_;
+  uint32_t sector_size_;
+  uint32_t num_sectors_;
+  uint32_t erase_latency_;
+  uint32_t busy_polls_;
+  uint32_t stalls_;
+
+  void Stall();
+
+ public:
+  FileLogStorage(uint32_t sector_size, uint32_t num_sectors);
+  ~FileLogStorage();
+
+  // Open an existing image. If it does not exist, create an erased one when
+  // create is set and fail otherwise.
+  bool Open(const char *path, bool create);
+
+  uint32_t SectorSize() const override { return sector_size_; }
+  uint32_t NumSectors() const override { return num_sectors_; }
+
+  bool Erase(uint32_t sector) override;
+  bool Program(uint32_t offset, const void *data, uint32_t size) override;
+  bool Read(uint32_t offset, void *data, uint32_t size) override;
+  bool StartErase(uint32_t sector) override;
+  bool EraseBusy() override;
+
+  // Make StartErase() report busy for the next polls calls of EraseBusy(),
+  // as the flash does for the duration of an erase.
+  void SetEraseLatency(uint32_t polls) { erase_latency_ = polls; }
+  // Erase(), Program() and Read() calls that had to wait for an erase.
+  uint32_t Stalls() const { return stalls_; }
+};
+#endif
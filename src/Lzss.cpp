@@ -0,0 +1,155 @@
+#include "Lzss.h"
+
+LzssEncoder::LzssEncoder() { Reset(); }
+
+void LzssEncoder::Reset() {
+  memset(head_, 0, sizeof(head_));
+  memset(link_, 0, sizeof(link_));
+  pos_ = 0;
+  fill_ = 0;
+  bits_ = 0;
+  num_bits_ = 0;
+}
+
+uint32_t LzssEncoder::Hash(uint32_t position) const {
+  uint32_t key = At(position) << 16 | At(position + 1) << 8 |
+                 At(position + 2);
+  return (key * 2654435761u) >> (32 - kHashBits);
+}
+
+void LzssEncoder::Insert(uint32_t position) {
+  if (position + kMinMatch > fill_) {
+    return;
+  }
+  uint32_t &head = head_[Hash(position)];
+  link_[position & (kWindowSize - 1)] = head;
+  head = position + 1;
+}
+
+void LzssEncoder::PutBits(uint32_t value, uint8_t count, uint8_t *out,
+                          size_t &n) {
+  bits_ = bits_ << count | (value & ((1u << count) - 1));
+  num_bits_ += count;
+  while (num_bits_ >= 8) {
+    num_bits_ -= 8;
+    out[n++] = bits_ >> num_bits_;
+  }
+}
+
+size_t LzssEncoder::Encode(uint32_t min_lookahead, uint8_t *out) {
+  size_t n = 0;
+  while (fill_ - pos_ >= min_lookahead && pos_ < fill_) {
+    uint32_t lookahead = fill_ - pos_;
+    uint32_t max_length = lookahead < kMaxMatch ? lookahead : kMaxMatch;
+    uint32_t best_length = 0;
+    uint32_t best_distance = 0;
+    if (max_length >= kMinMatch) {
+      uint32_t candidate = head_[Hash(pos_)];
+      for (uint32_t chain = 0; chain < kMaxChain && candidate != 0; chain++) {
+        uint32_t start = candidate - 1;
+        uint32_t distance = pos_ - start;
+        // Links of positions that fell out of the window have been reused.
+        if (start >= pos_ || distance > kWindowSize) {
+          break;
+        }
+        uint32_t length = 0;
+        while (length < max_length && At(start + length) == At(pos_ + length)) {
+          length++;
+        }
+        if (length > best_length) {
+          best_length = length;
+          best_distance = distance;
+          if (length == max_length) {
+            break;
+          }
+        }
+        candidate = link_[start & (kWindowSize - 1)];
+      }
+    }
+    if (best_length >= kMinMatch) {
+      PutBits(0, 1, out, n);
+      PutBits(best_distance - 1, kWindowBits, out, n);
+      PutBits(best_length - kMinMatch, kLengthBits, out, n);
+      for (uint32_t i = 0; i < best_length; i++) {
+        Insert(pos_ + i);
+      }
+      pos_ += best_length;
+    } else {
+      PutBits(1 << 8 | At(pos_), 9, out, n);
+      Insert(pos_);
+      pos_++;
+    }
+  }
+  return n;
+}
+
+size_t LzssEncoder::Write(const uint8_t *in, size_t size, uint8_t *out) {
+  size_t n = 0;
+  while (size > 0) {
+    // Keep the window behind pos_ and the lookahead in the ring.
+    uint32_t kept = (pos_ < kWindowSize ? pos_ : kWindowSize) + fill_ - pos_;
+    uint32_t space = kRingSize - kept;
+    uint32_t count = size < space ? size : space;
+    for (uint32_t i = 0; i < count; i++) {
+      ring_[(fill_ + i) & (kRingSize - 1)] = in[i];
+    }
+    fill_ += count;
+    in += count;
+    size -= count;
+    n += Encode(kMaxMatch, out + n);
+  }
+  return n;
+}
+
+size_t LzssEncoder::Finish(uint8_t *out) {
+  size_t n = Encode(1, out);
+  if (num_bits_ > 0) {
+    PutBits(0, 8 - num_bits_, out, n);
+  }
+  return n;
+}
+
+bool LzssDecode(const uint8_t *in, size_t size, uint8_t *out,
+                size_t out_size) {
+  size_t bit = 0;
+  auto read = [&](uint8_t count, uint32_t &value) {
+    if (bit + count > 8 * size) {
+      return false;
+    }
+    value = 0;
+    for (uint8_t i = 0; i < count; i++, bit++) {
+      value = value << 1 | (in[bit / 8] >> (7 - bit % 8) & 1);
+    }
+    return true;
+  };
+  size_t n = 0;
+  while (n < out_size) {
+    uint32_t flag;
+    uint32_t value;
+    if (!read(1, flag)) {
+      return false;
+    }
+    if (flag) {
+      if (!read(8, value)) {
+        return false;
+      }
+      out[n++] = value;
+      continue;
+    }
+    uint32_t distance;
+    uint32_t length;
+    if (!read(LzssEncoder::kWindowBits, distance) ||
+        !read(LzssEncoder::kLengthBits, length)) {
+      return false;
+    }
+    distance += 1;
+    length += LzssEncoder::kMinMatch;
+    if (distance > n || length > out_size - n) {
+      return false;
+    }
+    for (uint32_t i = 0; i < length; i++, n++) {
+      out[n] = out[n - distance];
+    }
+  }
+  return true;
+}
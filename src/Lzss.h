@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Platform.h"
+
+// Streaming LZSS coder in the style of heatshrink, with all of its state in
+// fixed buffers so it can run on the Teensy a few hundred bytes at a time.
+//
+// The output is a bit stream, most significant bit first:
+//   1 <8 bits>                          one literal byte
+//   0 <kWindowBits> <kLengthBits>       copy length bytes from distance back
+// with distance - 1 and length - kMinMatch stored. The last byte is padded
+// with zeros, so the decoder has to know how many bytes to produce.
+//
+// Matches are found through hash chains over 3-byte prefixes, followed at
+// most kMaxChain links deep. State: a 2 KB ring of recent input, 8 KB of
+// chain heads and links.
+class LzssEncoder {
+ public:
+  static const uint8_t kWindowBits = 10;  // 1 KB window
+  static const uint8_t kLengthBits = 6;
+  static const uint32_t kWindowSize = 1 << kWindowBits;
+  static const uint32_t kMinMatch = 3;
+  static const uint32_t kMaxMatch = kMinMatch + (1 << kLengthBits) - 1;
+  static const uint32_t kMaxChain = 16;
+
+  // Upper bound of the bytes one Write() of size bytes or a Finish() can
+  // produce.
+  static constexpr size_t MaxOutput(size_t size) {
+    return (9 * (size + kMaxMatch)) / 8 + 2;
+  }
+
+  LzssEncoder();
+
+  // Start a new stream.
+  void Reset();
+
+  // Code size bytes. Up to kMaxMatch - 1 of them are held back until more
+  // input or Finish() comes. Returns the number of bytes written to out,
+  // which must hold MaxOutput(size).
+  size_t Write(const uint8_t *in, size_t size, uint8_t *out);
+
+  // Code what is held back and pad the last byte.
+  size_t Finish(uint8_t *out);
+
+ private:
+  static const uint32_t kRingSize = 2 * kWindowSize;
+  static const uint32_t kHashBits = 10;
+
+  // Code the byte at pos_, as a literal or as the start of a match, while at
+  // least min_lookahead bytes are buffered.
+  size_t Encode(uint32_t min_lookahead, uint8_t *out);
+  uint32_t Hash(uint32_t position) const;
+  void Insert(uint32_t position);
+  uint8_t At(uint32_t position) const {
+    return ring_[position & (kRingSize - 1)];
+  }
+  void PutBits(uint32_t value, uint8_t count, uint8_t *out, size_t &n);
+
+  uint8_t ring_[kRingSize];
+  // Positions are counted from Reset() and stored plus one, 0 for none.
+  uint32_t head_[1 << kHashBits];
+  uint32_t link_[kWindowSize];
+  uint32_t pos_;   // next byte to code
+  uint32_t fill_;  // bytes received
+  uint32_t bits_;
+  uint8_t num_bits_;
+};
+
+// Decode an LZSS stream into exactly out_size bytes. Returns false if the
+// stream ends early or refers back past the start.
+bool LzssDecode(const uint8_t *in, size_t size, uint8_t *out,
+                size_t out_size);
@@ -0,0 +1,130 @@
+#include "MemoryBudget.h"
+
+// Section boundaries from the Teensy 4 linker script (imxrt1062.ld).
+extern "C" {
+extern unsigned long _stext;
+extern unsigned long _etext;
+extern unsigned long _sdata;
+extern unsigned long _ebss;
+extern unsigned long _estack;
+extern unsigned long _heap_start;
+extern unsigned long _heap_end;
+extern unsigned long _itcm_block_count;
+extern char *__brkval;
+}
+
+namespace {
+
+const uint32_t kStackPaint = 0x5a5a5a5a;
+// Left unpainted below the stack pointer of the painting function.
+const uint32_t kPaintMargin = 256;
+const uint32_t kRam2Start = 0x20200000;
+const uint32_t kRam2Size = 512 * 1024;
+const uint32_t kRam1Size = 512 * 1024;
+
+uint32_t Address(const void *p) {
+  return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(p));
+}
+
+const uint32_t *Words(unsigned long *symbol) {
+  return reinterpret_cast<const uint32_t *>(symbol);
+}
+
+uint32_t StackPointer() {
+  uint32_t sp;
+  asm volatile("mov %0, sp" : "=r"(sp));
+  return sp;
+}
+
+}  // namespace
+
+void PaintStack() {
+  // volatile so that the stores are not turned into a memset call, whose
+  // own frame would sit in the area being painted.
+  volatile uint32_t *word = reinterpret_cast<volatile uint32_t *>(&_ebss);
+  volatile uint32_t *end = reinterpret_cast<volatile uint32_t *>(
+      static_cast<uintptr_t>(StackPointer() - kPaintMargin));
+  while (word < end) {
+    *word++ = kStackPaint;
+  }
+}
+
+StackUsage MeasureStack() {
+  const uint32_t *word = Words(&_ebss);
+  const uint32_t *top = Words(&_estack);
+  while (word < top && *word == kStackPaint) {
+    word++;
+  }
+  StackUsage usage;
+  usage.size = Address(top) - Address(&_ebss);
+  usage.peak = Address(top) - Address(word);
+  usage.current = Address(top) - StackPointer();
+  return usage;
+}
+
+RamRegions MeasureRamRegions() {
+  RamRegions regions;
+  // _itcm_block_count is an absolute symbol: its address is the value.
+  regions.itcm_size = Address(&_itcm_block_count) * 32 * 1024;
+  regions.itcm_used = Address(&_etext) - Address(&_stext);
+  regions.dtcm_size = kRam1Size - regions.itcm_size;
+  regions.dtcm_static = Address(&_ebss) - Address(&_sdata);
+  regions.ram2_size = kRam2Size;
+  regions.ram2_static = Address(&_heap_start) - kRam2Start;
+  regions.heap_size = Address(&_heap_end) - Address(&_heap_start);
+  regions.heap_used = Address(__brkval) - Address(&_heap_start);
+  return regions;
+}
+
+void MemoryBudget::Add(const char *name, uint32_t bytes) {
+  if (num_entries_ == kMaxEntries) {
+    return;
+  }
+  // Keep the entries sorted, largest first.
+  size_t i = num_entries_++;
+  while (i > 0 && entries_[i - 1].bytes < bytes) {
+    entries_[i] = entries_[i - 1];
+    i--;
+  }
+  entries_[i] = {name, bytes};
+}
+
+void MemoryBudget::AddHeap(const char *name, const JsonHeapCounter &counter) {
+  if (num_heap_entries_ < kMaxHeapEntries) {
+    heap_entries_[num_heap_entries_++] = {name, &counter};
+  }
+}
+
+void MemoryBudget::Report(JsonDocument &doc) const {
+  StackUsage stack = MeasureStack();
+  JsonArray stack_usage = doc["stack"].to<JsonArray>();
+  stack_usage.add(stack.size);
+  stack_usage.add(stack.peak);
+  stack_usage.add(stack.current);
+
+  RamRegions ram = MeasureRamRegions();
+  JsonArray regions = doc["ram"].to<JsonArray>();
+  regions.add(ram.itcm_size);
+  regions.add(ram.itcm_used);
+  regions.add(ram.dtcm_size);
+  regions.add(ram.dtcm_static);
+  regions.add(ram.ram2_size);
+  regions.add(ram.ram2_static);
+  regions.add(ram.heap_size);
+  regions.add(ram.heap_used);
+
+  JsonArray objects = doc["objs"].to<JsonArray>();
+  for (size_t i = 0; i < num_entries_; i++) {
+    JsonArray entry = objects.add<JsonArray>();
+    entry.add(entries_[i].name);
+    entry.add(entries_[i].bytes);
+  }
+
+  JsonArray heap = doc["heap"].to<JsonArray>();
+  for (size_t i = 0; i < num_heap_entries_; i++) {
+    JsonArray entry = heap.add<JsonArray>();
+    entry.add(heap_entries_[i].name);
+    entry.add(heap_entries_[i].counter->Bytes());
+    entry.add(heap_entries_[i].counter->PeakBytes());
+  }
+}
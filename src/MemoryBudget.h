@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "JsonHeapCounter.h"
+
+// RAM use of the firmware on the Teensy 4.0.
+//
+// RAM1 (512 KB) is split at boot into ITCM for code and DTCM for data: the
+// initialised data and bss sit at the bottom of DTCM and the stack grows
+// down from the top towards them. loop() and every interrupt handler run on
+// this one stack (the core never switches to the process stack), so the
+// stack peak below includes the deepest nesting of ISRs that occurred on top
+// of loop(). RAM2 (512 KB) holds the DMAMEM buffers, e.g. the USB serial
+// buffers of the core, and above them the malloc heap.
+//
+// PaintStack() fills the free stack with a pattern at boot; the peak is the
+// lowest address at which the pattern was overwritten.
+
+struct StackUsage {
+  uint32_t size;     // [bytes] between the end of bss and the top of DTCM
+  uint32_t peak;     // [bytes] deepest use since PaintStack()
+  uint32_t current;  // [bytes] at the time of the call
+};
+
+struct RamRegions {
+  uint32_t itcm_size;
+  uint32_t itcm_used;  // code placed in ITCM (everything not FLASHMEM)
+  uint32_t dtcm_size;
+  uint32_t dtcm_static;  // data + bss
+  uint32_t ram2_size;
+  uint32_t ram2_static;  // DMAMEM
+  uint32_t heap_size;
+  uint32_t heap_used;
+};
+
+// Fill the unused stack with a pattern. Call first thing in setup().
+void PaintStack();
+
+StackUsage MeasureStack();
+
+RamRegions MeasureRamRegions();
+
+// Static breakdown of the largest RAM consumers, registered by name and
+// size at startup, e.g. budget.AddObject("logger", logger), and the heap
+// held by the JSON documents.
+class MemoryBudget {
+ public:
+  static const size_t kMaxEntries = 16;
+  static const size_t kMaxHeapEntries = 4;
+
+  struct Entry {
+    const char *name;
+    uint32_t bytes;
+  };
+
+  void Add(const char *name, uint32_t bytes);
+
+  template <class T>
+  void AddObject(const char *name, const T &object) {
+    Add(name, sizeof(object));
+  }
+
+  // Report the heap held by the documents built with counter.
+  void AddHeap(const char *name, const JsonHeapCounter &counter);
+
+  size_t NumEntries() const { return num_entries_; }
+  const Entry &GetEntry(size_t i) const { return entries_[i]; }
+
+  // Adds "stack", "ram", "objs" and "heap" to a query reply:
+  //   stack: [size, peak, current]
+  //   ram: [itcm size, itcm used, dtcm size, dtcm static, ram2 size,
+  //         ram2 static, heap size, heap used]
+  //   objs: [[name, bytes], ...] largest first, static
+  //   heap: [[name, bytes, peak bytes], ...] JSON documents
+  void Report(JsonDocument &doc) const;
+
+ private:
+  struct HeapEntry {
+    const char *name;
+    const JsonHeapCounter *counter;
+  };
+
+  Entry entries_[kMaxEntries];
+  size_t num_entries_ = 0;
+  HeapEntry heap_entries_[kMaxHeapEntries];
+  size_t num_heap_entries_ = 0;
+};
@@ -0,0 +1,149 @@
+#include "MotionPrimitives.h"
+
+namespace {
+
+// One leg's pose, with abduction positive outward.
+struct LegPose {
+  float abduction;
+  float hip;
+  float knee;
+};
+
+struct KeyPose {
+  uint16_t time_millis;
+  LegPose front;
+  LegPose rear;
+};
+
+constexpr int16_t Quantize(float value, float scale) {
+  return static_cast<int16_t>(value * scale + (value >= 0 ? 0.5f : -0.5f));
+}
+
+constexpr std::array<float, kMotionJoints> Joints(const KeyPose &pose) {
+  std::array<float, kMotionJoints> joints = {};
+  for (size_t leg = 0; leg < 4; leg++) {
+    const LegPose &leg_pose = leg < 2 ? pose.front : pose.rear;
+    float side = leg % 2 == 0 ? -1.0f : 1.0f;
+    joints[3 * leg] = side * leg_pose.abduction;
+    joints[3 * leg + 1] = leg_pose.hip;
+    joints[3 * leg + 2] = leg_pose.knee;
+  }
+  return joints;
+}
+
+template <size_t N>
+constexpr std::array<MotionKnot, N> Spline(
+    const std::array<KeyPose, N> &poses) {
+  std::array<MotionKnot, N> knots = {};
+  for (size_t k = 0; k < N; k++) {
+    std::array<float, kMotionJoints> joints = Joints(poses[k]);
+    knots[k].time_millis = poses[k].time_millis;
+    for (size_t j = 0; j < kMotionJoints; j++) {
+      float slope = 0.0f;
+      if (k > 0 && k + 1 < N) {
+        float span = (poses[k + 1].time_millis - poses[k - 1].time_millis) *
+                     0.001f;
+        slope = (Joints(poses[k + 1])[j] - Joints(poses[k - 1])[j]) / span;
+      }
+      knots[k].position[j] = Quantize(joints[j], kMotionPositionScale);
+      knots[k].velocity[j] = Quantize(slope, kMotionVelocityScale);
+    }
+  }
+  return knots;
+}
+
+constexpr LegPose kStanding = {0.0f, 0.55f, -1.1f};
+constexpr LegPose kFolded = {0.0f, 1.2f, -2.4f};
+constexpr LegPose kSplayedFolded = {0.35f, 1.2f, -2.4f};
+
+constexpr std::array<MotionKnot, 1> kStandKnots =
+    Spline<1>({{{1500, kStanding, kStanding}}});
+
+constexpr std::array<MotionKnot, 1> kSitKnots =
+    Spline<1>({{{1500, kStanding, kFolded}}});
+
+constexpr std::array<MotionKnot, 1> kLieDownKnots =
+    Spline<1>({{{2000, kFolded, kFolded}}});
+
+// From any pose, e.g. after a fall: gather the legs out to the side, bring
+// them under the body and push up.
+constexpr std::array<MotionKnot, 3> kRecoverKnots =
+    Spline<3>({{{800, kSplayedFolded, kSplayedFolded},
+                {1600, kFolded, kFolded},
+                {3000, kStanding, kStanding}}});
+
+const MotionPrimitive kPrimitives[kNumMotionPrimitives] = {
+    {"stand", kStandKnots.data(), kStandKnots.size()},
+    {"sit", kSitKnots.data(), kSitKnots.size()},
+    {"lie_down", kLieDownKnots.data(), kLieDownKnots.size()},
+    {"recover", kRecoverKnots.data(), kRecoverKnots.size()},
+};
+
+}  // namespace
+
+const MotionPrimitive *GetMotionPrimitive(uint8_t id) {
+  return id < kNumMotionPrimitives ? &kPrimitives[id] : nullptr;
+}
+
+void MotionPlayer::Start(const MotionPrimitive &primitive,
+                         const std::array<float, kMotionJoints> &start,
+                         float speed) {
+  primitive_ = &primitive;
+  start_ = start;
+  speed_ = speed;
+}
+
+uint32_t MotionPlayer::DurationMicros() const {
+  if (primitive_ == nullptr || primitive_->num_knots == 0) {
+    return 0;
+  }
+  return primitive_->knots[primitive_->num_knots - 1].time_millis * 1000.0f /
+         speed_;
+}
+
+bool MotionPlayer::Sample(uint32_t elapsed_micros,
+                          std::array<float, kMotionJoints> &position,
+                          std::array<float, kMotionJoints> &velocity) const {
+  const MotionKnot *knots = primitive_->knots;
+  uint8_t num_knots = primitive_->num_knots;
+  float t = elapsed_micros * 1e-6f * speed_;  // [s] on the primitive's clock
+
+  // Segment k runs from knot k - 1 to knot k; knot -1 is the start pose.
+  uint8_t k = 0;
+  while (k < num_knots && t >= knots[k].time_millis * 0.001f) {
+    k++;
+  }
+  if (k == num_knots) {
+    for (size_t j = 0; j < kMotionJoints; j++) {
+      position[j] = knots[num_knots - 1].position[j] / kMotionPositionScale;
+      velocity[j] = 0.0f;
+    }
+    return false;
+  }
+
+  float t0 = k > 0 ? knots[k - 1].time_millis * 0.001f : 0.0f;
+  float h = knots[k].time_millis * 0.001f - t0;
+  float u = (t - t0) / h;
+  float u2 = u * u;
+  float u3 = u2 * u;
+  // Hermite basis and its derivative with respect to u.
+  float h00 = 2 * u3 - 3 * u2 + 1;
+  float h10 = u3 - 2 * u2 + u;
+  float h01 = -2 * u3 + 3 * u2;
+  float h11 = u3 - u2;
+  float d00 = 6 * u2 - 6 * u;
+  float d10 = 3 * u2 - 4 * u + 1;
+  float d01 = -6 * u2 + 6 * u;
+  float d11 = 3 * u2 - 2 * u;
+  for (size_t j = 0; j < kMotionJoints; j++) {
+    float p0 = k > 0 ? knots[k - 1].position[j] / kMotionPositionScale
+                     : start_[j];
+    float m0 = k > 0 ? knots[k - 1].velocity[j] / kMotionVelocityScale * h
+                     : 0.0f;
+    float p1 = knots[k].position[j] / kMotionPositionScale;
+    float m1 = knots[k].velocity[j] / kMotionVelocityScale * h;
+    position[j] = h00 * p0 + h10 * m0 + h01 * p1 + h11 * m1;
+    velocity[j] = (d00 * p0 + d10 * m0 + d01 * p1 + d11 * m1) / h * speed_;
+  }
+  return true;
+}
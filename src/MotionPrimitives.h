@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+
+#include "Platform.h"
+
+// Library of joint-space motions (stand up, sit, lie down, recover) that the
+// device plays back on its own at the control rate, so that routine
+// transitions take one command instead of a stream of setpoints.
+//
+// A primitive is a cubic Hermite spline through a few knots. Each knot holds
+// its time and, per joint, the position and the slope, quantised to int16
+// (1/4096 rad and 1/1024 rad/s), 50 bytes per knot. The tables are built at
+// compile time and stay in RAM, not program flash: the flash log erases
+// program flash in the background while they play, and nothing may read it
+// meanwhile (see ProgramFlashStorage). Playback starts from the measured pose
+// at rest: the spline runs from there to the first knot, through the others,
+// and holds the last one. Slopes are zero at the first and last knot and
+// Catmull-Rom in between.
+//
+// Joint angles are in the drive's output frame after homing, per leg
+// {abduction, hip, knee}. Abduction is given outward and mirrored for the
+// right legs (0 and 2), which abduct towards negative angles.
+
+const size_t kMotionJoints = 12;
+const float kMotionPositionScale = 4096.0f;  // LSB per rad
+const float kMotionVelocityScale = 1024.0f;  // LSB per rad/s
+
+struct MotionKnot {
+  uint16_t time_millis;  // since the start of the primitive
+  int16_t position[kMotionJoints];
+  int16_t velocity[kMotionJoints];
+};
+
+struct MotionPrimitive {
+  const char *name;
+  const MotionKnot *knots;
+  uint8_t num_knots;
+};
+
+enum class MotionId : uint8_t {
+  kStand,
+  kSit,
+  kLieDown,
+  kRecover,
+};
+const uint8_t kNumMotionPrimitives = 4;
+
+// nullptr for an unknown id.
+const MotionPrimitive *GetMotionPrimitive(uint8_t id);
+
+// Samples a primitive against time.
+class MotionPlayer {
+ public:
+  // Play primitive from the pose start. speed scales time: 2 plays it in
+  // half the time.
+  void Start(const MotionPrimitive &primitive,
+             const std::array<float, kMotionJoints> &start, float speed);
+
+  // The reference at elapsed_micros since Start(). Returns false once the
+  // primitive has ended, with the last pose and zero velocity.
+  bool Sample(uint32_t elapsed_micros,
+              std::array<float, kMotionJoints> &position,
+              std::array<float, kMotionJoints> &velocity) const;
+
+  uint32_t DurationMicros() const;
+
+ private:
+  const MotionPrimitive *primitive_ = nullptr;
+  std::array<float, kMotionJoints> start_ = {};
+  float speed_ = 1.0f;
+};
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <BasicLinearAlgebra.h>
+#ifdef ARDUINO
 #include <Streaming.h>
+#endif
 
 struct PDGains {
     float kp;
@@ -15,7 +17,9 @@ struct PDGains3x3 {
 
 void PD(float &torque_command, float measurement_pos, float measurement_vel,
         float reference_pos, float reference_vel, PDGains gains);
+#ifdef ARDUINO
 Print &operator<<(Print &stream, const PDGains &gains);
+#endif
 BLA::Matrix<3> PDControl3(BLA::Matrix<3> measured_position,
                           BLA::Matrix<3> measured_velocity,
                           BLA::Matrix<3> reference_position,
@@ -0,0 +1,36 @@
+#pragma once
+
+// The control laws, kinematics and containers only need a handful of things
+// from the Arduino core. This header provides them on the host as well so the
+// native tools in tools/ can compile the same sources as the firmware.
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+using std::abs;
+
+// Byte sink of the Arduino core, for the code that streams to Serial.
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) { return write(&b, 1); }
+  virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+  // Bytes that can be written without blocking; 0 if unknown, as on the
+  // Arduino core.
+  virtual int availableForWrite() { return 0; }
+};
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+// Program flash placement on the Teensy; plain constant data on the host.
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#endif
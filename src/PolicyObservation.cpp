@@ -0,0 +1,97 @@
+#include "PolicyObservation.h"
+
+PolicyObservation::PolicyObservation()
+    : num_features_(0),
+      history_(0),
+      decimation_(1),
+      clip_(INFINITY),
+      ticks_(0),
+      steps_(0),
+      oldest_(0),
+      micros_(0) {}
+
+bool PolicyObservation::Configure(const uint8_t *columns,
+                                  uint32_t num_features, uint8_t history,
+                                  uint16_t decimation) {
+  num_features_ = 0;
+  if (num_features == 0 || num_features > kPolicyMaxFeatures ||
+      history == 0 || decimation == 0 ||
+      num_features * history > kPolicyMaxValues) {
+    return false;
+  }
+  memcpy(columns_, columns, num_features);
+  history_ = history;
+  decimation_ = decimation;
+  for (uint32_t i = 0; i < num_features; i++) {
+    scale_[i] = 1.0f / decimation;
+    offset_[i] = 0.0f;
+    sum_[i] = 0.0f;
+  }
+  ticks_ = 0;
+  steps_ = 0;
+  oldest_ = 0;
+  num_features_ = num_features;
+  return true;
+}
+
+void PolicyObservation::SetNormalization(uint32_t start, const float *mean,
+                                         const float *std, uint32_t count) {
+  for (uint32_t i = 0; i < count && start + i < num_features_; i++) {
+    float inverse_std = std[i] > 0.0f ? 1.0f / std[i] : 1.0f;
+    scale_[start + i] = inverse_std / decimation_;
+    offset_[start + i] = -mean[i] * inverse_std;
+  }
+}
+
+void PolicyObservation::SetClip(float clip) {
+  clip_ = clip > 0.0f ? clip : INFINITY;
+}
+
+bool PolicyObservation::AddTick(const float *row, uint32_t now_micros) {
+  for (uint32_t i = 0; i < num_features_; i++) {
+    sum_[i] += row[columns_[i]];
+  }
+  if (num_features_ == 0 || ++ticks_ < decimation_) {
+    return false;
+  }
+  ticks_ = 0;
+  // The newest step goes in the oldest slot and its copy one history later.
+  float *step = ring_ + oldest_ * num_features_;
+  float *copy = step + history_ * num_features_;
+  for (uint32_t i = 0; i < num_features_; i++) {
+    float value = sum_[i] * scale_[i] + offset_[i];
+    value = value < -clip_ ? -clip_ : value;
+    value = value > clip_ ? clip_ : value;
+    step[i] = value;
+    copy[i] = value;
+    sum_[i] = 0.0f;
+  }
+  if (steps_ == 0) {
+    for (uint32_t slot = 1; slot < 2u * history_; slot++) {
+      memcpy(ring_ + slot * num_features_, step, 4 * num_features_);
+    }
+  }
+  oldest_ = oldest_ + 1 < history_ ? oldest_ + 1 : 0;
+  steps_++;
+  micros_ = now_micros;
+  return true;
+}
+
+const float *PolicyObservation::Observation() const {
+  return ring_ + oldest_ * num_features_;
+}
+
+void PolicyObservation::WriteFrame(Print &out) const {
+  uint16_t length = kPolicyFrameHeaderSize - 4 + 4 * Size();
+  uint16_t num_features = num_features_;
+  uint8_t header[kPolicyFrameHeaderSize] = {
+      kPolicyFrameMarker, kPolicyFrameMarker,
+      static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length & 0xff)};
+  memcpy(header + 4, &micros_, 4);
+  memcpy(header + 8, &steps_, 4);
+  header[12] = history_;
+  header[13] = 0;
+  memcpy(header + 14, &num_features, 2);
+  out.write(header, sizeof(header));
+  out.write(reinterpret_cast<const uint8_t *>(Observation()), 4 * Size());
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Platform.h"
+
+// Observation history for a learned policy, built from the DebugData row of
+// every control tick.
+//
+// Each policy step averages the selected columns over decimation ticks (a
+// box filter, so signals faster than the policy rate are attenuated rather
+// than aliased), normalises them to (x - mean) / std, clips them to +-clip
+// and pushes them into a ring of the last history steps. The average,
+// normalisation and clip are one multiply-add and two compares per value
+// once per step; a tick costs one add per value.
+//
+// Every step is written twice into a ring of twice the history, so the
+// stacked observation, oldest step first, is always contiguous: an inference
+// engine can read Observation() in place, and WriteFrame() sends it without
+// a copy. Until history steps have been taken the older steps repeat the
+// first one.
+//
+// Frame (integers little-endian, except the frame length which is
+// big-endian like the msgpack status frames):
+//   0x4A 0x4A  start bytes
+//   uint16     length of what follows
+//   uint32     micros of the last tick of the newest step
+//   uint32     steps since Configure()
+//   uint8      history, uint8 reserved (0), uint16 num_features
+//   float      values[history * num_features], oldest step first
+
+const uint8_t kPolicyFrameMarker = 0x4A;
+const uint32_t kPolicyFrameHeaderSize = 16;
+// Every DebugData column.
+const uint32_t kPolicyMaxFeatures = 96;
+// Values in a stacked observation, about 2 KB.
+const uint32_t kPolicyMaxValues = 512;
+
+class PolicyObservation {
+ public:
+  PolicyObservation();
+
+  // Observe the given columns of the rows passed to AddTick(), one step
+  // every decimation ticks, stacking the last history steps. Resets the
+  // history and the normalisation. Returns false, and observes nothing, if
+  // the observation would not fit in kPolicyMaxValues or a count is 0.
+  bool Configure(const uint8_t *columns, uint32_t num_features,
+                 uint8_t history, uint16_t decimation);
+
+  // Normalise features start to start + count - 1 with the given means and
+  // standard deviations. A std <= 0 leaves the feature unscaled.
+  void SetNormalization(uint32_t start, const float *mean, const float *std,
+                        uint32_t count);
+
+  // Clip normalised values to [-clip, clip], 0 to not clip.
+  void SetClip(float clip);
+
+  // Add the DebugData row of one control tick. Returns true if it completed
+  // a step, after which Observation() holds the new stack.
+  bool AddTick(const float *row, uint32_t now_micros);
+
+  bool Enabled() const { return num_features_ > 0; }
+
+  // The last history steps of num_features values, oldest first.
+  const float *Observation() const;
+  uint32_t Size() const { return history_ * num_features_; }
+  uint32_t NumFeatures() const { return num_features_; }
+  uint32_t Steps() const { return steps_; }
+
+  // Write the observation as one 0x4A 0x4A frame.
+  void WriteFrame(Print &out) const;
+
+ private:
+  uint8_t columns_[kPolicyMaxFeatures];
+  uint32_t num_features_;
+  uint8_t history_;
+  uint16_t decimation_;
+  // Normalisation with the average folded in: value = sum * scale + offset.
+  float scale_[kPolicyMaxFeatures];
+  float offset_[kPolicyMaxFeatures];
+  float clip_;
+  float sum_[kPolicyMaxFeatures];
+  uint16_t ticks_;
+  uint32_t steps_;
+  // Ring slot of the oldest step.
+  uint8_t oldest_;
+  uint32_t micros_;
+  float ring_[2 * kPolicyMaxValues];
+};
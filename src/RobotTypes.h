@@ -10,6 +10,55 @@ typedef std::array<float, 12> ActuatorVelocityVector;
 typedef std::array<float, 12> ActuatorCurrentVector;
 typedef std::array<bool, 12> ActuatorActivations;
 
+// One-shot request for a subset of the drive state. signals is a bitmask of
+// DriveQuerySignal values, id is echoed back in the reply.
+struct StateQuery {
+  uint32_t id;
+  uint32_t signals;
+};
+
+// Control law of one leg in DriveControlMode::kPerLegControl.
+enum class LegControlMode : uint8_t {
+  kIdle,               // 0 A
+  kJointPosition,      // joint PD on the joint position references
+  kCartesianPosition,  // cartesian impedance on the cartesian references
+  kCurrent,            // the current references as they are
+};
+const uint8_t kNumLegControlModes = 4;
+typedef std::array<LegControlMode, 4> LegControlModes;
+
+// Request to play a motion primitive, see MotionPrimitives.h.
+struct MotionCommand {
+  uint8_t id;
+  float speed;  // time scale, 1 as recorded
+};
+
+// Observation history for a policy, see PolicyObservation.h. signals is a
+// signal mask like the log mask, 0 stops the observations.
+struct PolicyCommand {
+  uint32_t signals;
+  uint8_t history;
+  uint16_t decimation;  // control ticks per policy step
+  float clip;           // 0 to not clip
+};
+
+// Normalisation statistics for the policy features start to start + count
+// - 1. They are sent a few at a time to fit in a command.
+const uint8_t kPolicyNormalizationChunk = 8;
+struct PolicyNormalization {
+  uint8_t start;
+  uint8_t count;
+  std::array<float, kPolicyNormalizationChunk> mean;
+  std::array<float, kPolicyNormalizationChunk> stddev;
+};
+
+// One frame of a host current stream: 12 currents in amps and a sequence
+// number that is echoed in the lockstep state frame.
+struct CurrentFrame {
+  uint32_t seq;
+  ActuatorCurrentVector currents;
+};
+
 template <class T, unsigned int SIZE>
 Print &operator<<(Print &stream, const std::array<T, SIZE> &vec) {
   for (auto e : vec) {
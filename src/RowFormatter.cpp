@@ -0,0 +1,76 @@
+#include "RowFormatter.h"
+
+namespace {
+const int32_t kDecimalScales[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+}
+
+RowFormatter::RowFormatter(char *buffer, size_t capacity, char delimiter)
+    : buffer_(buffer),
+      capacity_(capacity),
+      length_(0),
+      delimiter_(delimiter),
+      overflowed_(false) {}
+
+void RowFormatter::Append(char c) {
+  if (length_ < capacity_) {
+    buffer_[length_++] = c;
+  } else {
+    overflowed_ = true;
+  }
+}
+
+void RowFormatter::AppendDigits(uint32_t value, uint8_t min_digits) {
+  char digits[10];
+  uint8_t n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0 || n < min_digits);
+  while (n > 0) {
+    Append(digits[--n]);
+  }
+}
+
+void RowFormatter::AddFixed(float value, uint8_t decimals) {
+  if (decimals > 6) {
+    decimals = 6;
+  }
+  float scaled = value * kDecimalScales[decimals];
+  // Also catches NaN, for which every comparison is false.
+  if (!(scaled < 2147483647.0f && scaled > -2147483647.0f)) {
+    Append('o');
+    Append('v');
+    Append('f');
+    Append(delimiter_);
+    return;
+  }
+  int32_t fixed = (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+  uint32_t magnitude = fixed < 0 ? -(uint32_t)fixed : fixed;
+  if (fixed < 0) {
+    Append('-');
+  }
+  uint32_t scale = kDecimalScales[decimals];
+  AppendDigits(magnitude / scale, 1);
+  if (decimals > 0) {
+    Append('.');
+    AppendDigits(magnitude % scale, decimals);
+  }
+  Append(delimiter_);
+}
+
+void RowFormatter::AddUnsigned(uint32_t value) {
+  AppendDigits(value, 1);
+  Append(delimiter_);
+}
+
+void RowFormatter::AddChar(char c) { Append(c); }
+
+void RowFormatter::EndLine() {
+  Append('\r');
+  Append('\n');
+}
+
+void RowFormatter::Clear() {
+  length_ = 0;
+  overflowed_ = false;
+}
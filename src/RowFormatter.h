@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Platform.h"
+
+// Builds a delimited text row in a caller-provided buffer. Floats are printed
+// with a fixed number of decimals by scaling to an integer and emitting the
+// digits directly, which is much cheaper than Print::print(float, digits).
+// Values that do not fit in an int32 after scaling are printed as "ovf".
+class RowFormatter {
+ private:
+  char *buffer_;
+  size_t capacity_;
+  size_t length_;
+  char delimiter_;
+  bool overflowed_;
+
+  void Append(char c);
+  void AppendDigits(uint32_t value, uint8_t min_digits);
+
+ public:
+  RowFormatter(char *buffer, size_t capacity, char delimiter);
+
+  // Append value with the given number of decimals (at most 6) followed by
+  // the delimiter.
+  void AddFixed(float value, uint8_t decimals = 2);
+
+  // Append an unsigned integer followed by the delimiter.
+  void AddUnsigned(uint32_t value);
+
+  // Append a single character.
+  void AddChar(char c);
+
+  // Append "\r\n".
+  void EndLine();
+
+  // Discard the contents.
+  void Clear();
+
+  const char *Data() const { return buffer_; }
+  size_t Length() const { return length_; }
+
+  // True if anything was dropped because the buffer was full.
+  bool Overflowed() const { return overflowed_; }
+};
@@ -0,0 +1,151 @@
+#include "Task.h"
+
+#include <utility>
+
+namespace {
+// Aligned like memory from operator new, which the frames assume.
+alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) uint8_t
+    frames[TaskFramePool::kNumFrames][TaskFramePool::kFrameSize];
+bool frame_used[TaskFramePool::kNumFrames];
+uint32_t failed_allocations = 0;
+}  // namespace
+
+void *TaskFramePool::Allocate(size_t size) {
+  if (size <= kFrameSize) {
+    for (uint32_t i = 0; i < kNumFrames; i++) {
+      if (!frame_used[i]) {
+        frame_used[i] = true;
+        return frames[i];
+      }
+    }
+  }
+  failed_allocations++;
+  return nullptr;
+}
+
+void TaskFramePool::Free(void *frame) {
+  for (uint32_t i = 0; i < kNumFrames; i++) {
+    if (frame == frames[i]) {
+      frame_used[i] = false;
+      return;
+    }
+  }
+}
+
+uint32_t TaskFramePool::FramesInUse() {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < kNumFrames; i++) {
+    count += frame_used[i];
+  }
+  return count;
+}
+
+uint32_t TaskFramePool::FailedAllocations() { return failed_allocations; }
+
+Task &Task::operator=(Task &&other) {
+  if (this != &other) {
+    if (handle_) {
+      handle_.destroy();
+    }
+    handle_ = other.handle_;
+    other.handle_ = nullptr;
+  }
+  return *this;
+}
+
+Task::~Task() {
+  if (handle_) {
+    handle_.destroy();
+  }
+}
+
+void Task::Resume() {
+  if (!Done()) {
+    handle_.resume();
+  }
+}
+
+uint32_t Task::SleepMicros() const {
+  return handle_ ? handle_.promise().sleep_micros : 0;
+}
+
+TaskRunner::TaskRunner(Clock clock, uint32_t budget_micros)
+    : slots_(),
+      clock_(clock),
+      budget_micros_(budget_micros),
+      next_id_(1),
+      next_slot_(0),
+      stats_() {}
+
+uint32_t TaskRunner::Start(Task task) {
+  if (task.Done()) {
+    return kNoTask;
+  }
+  for (uint32_t i = 0; i < kMaxTasks; i++) {
+    Slot &slot = slots_[i];
+    if (slot.task.Done()) {
+      slot.task = std::move(task);
+      slot.id = next_id_++;
+      if (next_id_ == kNoTask) {
+        next_id_++;
+      }
+      slot.wake_micros = clock_();
+      return slot.id;
+    }
+  }
+  return kNoTask;
+}
+
+void TaskRunner::Cancel(uint32_t id) {
+  for (Slot &slot : slots_) {
+    if (slot.id == id && !slot.task.Done()) {
+      slot.task = Task();
+    }
+  }
+}
+
+bool TaskRunner::Running(uint32_t id) const {
+  for (const Slot &slot : slots_) {
+    if (slot.id == id && !slot.task.Done()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskRunner::Run() {
+  uint32_t start = clock_();
+  bool resumed = false;
+  for (uint32_t n = 0; n < kMaxTasks; n++) {
+    uint32_t index = (next_slot_ + n) % kMaxTasks;
+    Slot &slot = slots_[index];
+    uint32_t now = clock_();
+    if (slot.task.Done() || (int32_t)(now - slot.wake_micros) < 0) {
+      continue;
+    }
+    if (resumed && now - start >= budget_micros_) {
+      // Out of time; this task goes first next time.
+      stats_.deferred++;
+      next_slot_ = index;
+      return;
+    }
+    slot.task.Resume();
+    uint32_t end = clock_();
+    uint32_t elapsed = end - now;
+    resumed = true;
+    stats_.resumes++;
+    if (elapsed > stats_.max_resume_micros) {
+      stats_.max_resume_micros = elapsed;
+    }
+    if (elapsed > budget_micros_) {
+      stats_.overruns++;
+    }
+    if (slot.task.Done()) {
+      // Free the frame right away rather than when the slot is reused.
+      slot.task = Task();
+    } else {
+      slot.wake_micros = now + slot.task.SleepMicros();
+    }
+  }
+  next_slot_ = (next_slot_ + 1) % kMaxTasks;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <coroutine>
+
+#include "Platform.h"
+
+// Cooperative tasks for operations that span many control ticks (homing
+// transitions, log dumps, calibration). A task is a coroutine returning Task
+// that is written as straight-line code and suspends with
+//
+//   co_await NextTick();        // resume on the next Resume()/Run()
+//   co_await SleepFor(micros);  // resume once the time has passed
+//
+// Everything between two co_awaits runs in one go, so each step must fit in
+// the tick's time budget. Frames come from TaskFramePool, never the heap. If
+// the pool is exhausted the coroutine is not created and the returned Task is
+// empty (Done() is true), so callers fall back to doing nothing.
+//
+// A task can be resumed directly with Resume(), which is how DriveSystem
+// steps the tasks tied to its own Update(), or handed to a TaskRunner.
+
+// Fixed pool of coroutine frames.
+class TaskFramePool {
+ public:
+  static const uint32_t kFrameSize = 1024;
+  static const uint32_t kNumFrames = 8;
+
+  // Returns nullptr if size is too large or no frame is free.
+  static void *Allocate(size_t size);
+  static void Free(void *frame);
+
+  static uint32_t FramesInUse();
+  static uint32_t FailedAllocations();
+};
+
+class Task {
+ public:
+  struct promise_type {
+    // Set by the awaitable the task is suspended on.
+    uint32_t sleep_micros = 0;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    static Task get_return_object_on_allocation_failure() { return Task(); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() {}
+
+    static void *operator new(size_t size) noexcept {
+      return TaskFramePool::Allocate(size);
+    }
+    static void operator delete(void *frame) { TaskFramePool::Free(frame); }
+  };
+  typedef std::coroutine_handle<promise_type> Handle;
+
+  Task() : handle_(nullptr) {}
+  Task(Task &&other) : handle_(other.handle_) { other.handle_ = nullptr; }
+  Task &operator=(Task &&other);
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task();
+
+  // Run the task up to its next co_await. Does nothing once it is done.
+  void Resume();
+
+  // True for finished and empty tasks.
+  bool Done() const { return !handle_ || handle_.done(); }
+
+  // Time the task asked to sleep at its last suspension, 0 for NextTick.
+  uint32_t SleepMicros() const;
+
+ private:
+  explicit Task(Handle handle) : handle_(handle) {}
+  Handle handle_;
+};
+
+struct NextTick {
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(Task::Handle handle) const noexcept {
+    handle.promise().sleep_micros = 0;
+  }
+  void await_resume() const noexcept {}
+};
+
+struct SleepFor {
+  uint32_t duration_micros;
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(Task::Handle handle) const noexcept {
+    handle.promise().sleep_micros = duration_micros;
+  }
+  void await_resume() const noexcept {}
+};
+
+// Runs a handful of background tasks from loop(). Each Run() resumes every
+// task that is due at most once, round-robin, and stops early once the
+// budget is spent; the remaining tasks go first on the next call.
+class TaskRunner {
+ public:
+  static const uint32_t kMaxTasks = 8;
+  // Returned by Start() when the task could not be started.
+  static const uint32_t kNoTask = 0;
+
+  typedef uint32_t (*Clock)();
+
+  struct Stats {
+    uint32_t resumes;
+    uint32_t max_resume_micros;
+    uint32_t overruns;  // single resumes longer than the budget
+    uint32_t deferred;  // due tasks pushed to the next Run()
+  };
+
+ private:
+  struct Slot {
+    Task task;
+    uint32_t id;
+    uint32_t wake_micros;
+  };
+
+  Slot slots_[kMaxTasks];
+  Clock clock_;
+  uint32_t budget_micros_;
+  uint32_t next_id_;
+  uint32_t next_slot_;
+  Stats stats_;
+
+ public:
+  // clock returns microseconds; the firmware passes micros.
+  TaskRunner(Clock clock, uint32_t budget_micros);
+
+  // Take over a task. It first runs on the next Run(). Returns an id for
+  // Running() and Cancel(), or kNoTask if the task is empty or all slots are
+  // taken.
+  uint32_t Start(Task task);
+
+  // Destroy the task at its current suspension point.
+  void Cancel(uint32_t id);
+
+  bool Running(uint32_t id) const;
+
+  void Run();
+
+  const Stats &GetStats() const { return stats_; }
+};
@@ -0,0 +1,143 @@
+#pragma once
+#include "Platform.h"
+
+// USB bulk packet sizes. The Teensy 4 enumerates at high speed.
+const uint32_t kUsbFullSpeedPacketSize = 64;
+const uint32_t kUsbHighSpeedPacketSize = 512;
+
+// Collects consecutive per-tick samples of NUM_VALUES floats into one packet
+// and writes it with a single call, so every control tick can be streamed
+// without per-sample framing overhead.
+//
+// Packet layout (integers little-endian, except the frame length which is
+// big-endian like the msgpack status frames):
+//   0x46 0x46                 start bytes
+//   uint16 length             number of bytes that follow
+//   uint32 base_micros        timestamp of the first sample
+//   uint8  num_samples
+//   uint8  reserved (0)
+//   uint16 num_values
+//   num_samples x {uint16 dt_micros, float values[num_values]}
+//   zero padding up to a multiple of ALIGNMENT bytes
+//
+// dt_micros is relative to base_micros. A packet is written when the next
+// sample would not fit, or from Poll() once the oldest sample is older than
+// the latency deadline. A packet that does not fit in the output's transmit
+// buffer is dropped and counted rather than block the control loop.
+template <uint32_t PACKET_SIZE, uint32_t NUM_VALUES,
+          uint32_t ALIGNMENT = kUsbHighSpeedPacketSize>
+class TelemetryBatcher {
+  static_assert(PACKET_SIZE % ALIGNMENT == 0,
+                "Packet size must be a multiple of the USB packet size");
+
+ public:
+  static const uint32_t kHeaderSize = 12;
+  static const uint32_t kSampleSize = 2 + 4 * NUM_VALUES;
+  static const uint32_t kSamplesPerPacket =
+      (PACKET_SIZE - kHeaderSize) / kSampleSize;
+  static_assert(kSamplesPerPacket > 0, "Packet too small for one sample");
+  static_assert(kSamplesPerPacket < 256, "Sample count must fit in a byte");
+
+ private:
+  uint8_t buffer_[PACKET_SIZE];
+  uint32_t num_samples_;
+  uint32_t base_micros_;
+  uint32_t max_latency_micros_;
+  uint32_t packets_sent_;
+  uint32_t dropped_packets_;
+  Print *out_;
+
+  void WriteHeader(uint32_t payload_size);
+
+ public:
+  // max_latency_micros must stay below 65535 so that the sample offsets fit.
+  TelemetryBatcher(Print &out, uint32_t max_latency_micros = 20000);
+
+  // Append one sample. Sends the pending packet first if it is full or if the
+  // sample is too far from the packet's base timestamp.
+  void AddSample(uint32_t timestamp_micros, const float *values);
+
+  // Sends the pending packet once the latency deadline has passed.
+  void Poll(uint32_t now_micros);
+
+  // Sends whatever is pending.
+  void Flush();
+
+  void SetMaxLatency(uint32_t max_latency_micros);
+  uint32_t PacketsSent() const { return packets_sent_; }
+  const uint32_t &DroppedPackets() const { return dropped_packets_; }
+};
+
+template <uint32_t PACKET_SIZE, uint32_t NUM_VALUES, uint32_t ALIGNMENT>
+TelemetryBatcher<PACKET_SIZE, NUM_VALUES, ALIGNMENT>::TelemetryBatcher(
+    Print &out, uint32_t max_latency_micros)
+    : num_samples_(0),
+      base_micros_(0),
+      max_latency_micros_(max_latency_micros),
+      packets_sent_(0),
+      dropped_packets_(0),
+      out_(&out) {}
+
+template <uint32_t PACKET_SIZE, uint32_t NUM_VALUES, uint32_t ALIGNMENT>
+void TelemetryBatcher<PACKET_SIZE, NUM_VALUES, ALIGNMENT>::SetMaxLatency(
+    uint32_t max_latency_micros) {
+  max_latency_micros_ = max_latency_micros;
+}
+
+template <uint32_t PACKET_SIZE, uint32_t NUM_VALUES, uint32_t ALIGNMENT>
+void TelemetryBatcher<PACKET_SIZE, NUM_VALUES, ALIGNMENT>::AddSample(
+    uint32_t timestamp_micros, const float *values) {
+  if (num_samples_ > 0 &&
+      (num_samples_ == kSamplesPerPacket ||
+       timestamp_micros - base_micros_ > 0xffff)) {
+    Flush();
+  }
+  if (num_samples_ == 0) {
+    base_micros_ = timestamp_micros;
+  }
+  uint8_t *sample = buffer_ + kHeaderSize + num_samples_ * kSampleSize;
+  uint16_t dt = timestamp_micros - base_micros_;
+  memcpy(sample, &dt, sizeof(dt));
+  memcpy(sample + 2, values, 4 * NUM_VALUES);
+  num_samples_++;
+}
+
+template <uint32_t PACKET_SIZE, uint32_t NUM_VALUES, uint32_t ALIGNMENT>
+void TelemetryBatcher<PACKET_SIZE, NUM_VALUES, ALIGNMENT>::Poll(
+    uint32_t now_micros) {
+  if (num_samples_ > 0 && now_micros - base_micros_ >= max_latency_micros_) {
+    Flush();
+  }
+}
+
+template <uint32_t PACKET_SIZE, uint32_t NUM_VALUES, uint32_t ALIGNMENT>
+void TelemetryBatcher<PACKET_SIZE, NUM_VALUES, ALIGNMENT>::WriteHeader(
+    uint32_t payload_size) {
+  buffer_[0] = 0x46;
+  buffer_[1] = 0x46;
+  buffer_[2] = payload_size >> 8 & 0xff;
+  buffer_[3] = payload_size & 0xff;
+  memcpy(buffer_ + 4, &base_micros_, 4);
+  buffer_[8] = num_samples_;
+  buffer_[9] = 0;
+  uint16_t num_values = NUM_VALUES;
+  memcpy(buffer_ + 10, &num_values, 2);
+}
+
+template <uint32_t PACKET_SIZE, uint32_t NUM_VALUES, uint32_t ALIGNMENT>
+void TelemetryBatcher<PACKET_SIZE, NUM_VALUES, ALIGNMENT>::Flush() {
+  if (num_samples_ == 0) {
+    return;
+  }
+  uint32_t used = kHeaderSize + num_samples_ * kSampleSize;
+  uint32_t padded = (used + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+  memset(buffer_ + used, 0, padded - used);
+  if (out_->availableForWrite() < static_cast<int>(padded)) {
+    dropped_packets_++;
+  } else {
+    WriteHeader(padded - 4);
+    out_->write(buffer_, padded);
+    packets_sent_++;
+  }
+  num_samples_ = 0;
+}
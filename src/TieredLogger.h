@@ -0,0 +1,237 @@
+#pragma once
+
+#include "DataLogger.h"
+
+// Logger with a full-rate window for the most recent rows and, before it, a
+// longer history at lower resolution: a ring of envelopes of every
+// kDecimation rows and a ring of envelopes of every kDecimation^2 rows. An
+// envelope holds the min, mean and max of each column over its rows.
+//
+// Rows are read by level: 0 is the full-rate DataLogger, 1 and 2 the
+// envelope rings. An envelope row is min, mean, max of the first enveloped
+// column, then of the second, and so on.
+//
+// The envelope rings hold TIER1_FLOATS and TIER2_FLOATS values whatever the
+// columns, so enveloping fewer columns (SetTierColumns()) gives a longer
+// history in the same memory. They are passed in rather than members, so
+// they can be placed apart from the full-rate rows, e.g. in DMAMEM.
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+class TieredLogger {
+ public:
+  static const uint8_t kNumLevels = 3;
+  static const uint32_t kDecimation = 10;
+
+  TieredLogger(float *tier1_data, float *tier2_data);
+
+  // Claim the next full-rate row. Fill it in place, then call EndRow().
+  LogRow BeginRow();
+
+  // Fold the row from BeginRow() into the envelopes.
+  void EndRow();
+
+  // Zero every row and empty the envelope rings.
+  void Clear();
+
+  // Envelope only these columns of the full-rate rows, e.g. the ones being
+  // logged. Clears the logger.
+  void SetTierColumns(const uint8_t *columns, uint32_t num_columns);
+
+  // Rows held at the given level, values per row, and the n-th oldest row.
+  // The full-rate level always holds LOG_SIZE rows.
+  uint32_t NumRows(uint8_t level) const;
+  uint32_t RowSize(uint8_t level) const;
+  const float *Row(uint8_t level, uint32_t n);
+
+  // Print the n-th oldest row of a level as comma separated text.
+  void PrintRow(Print &serial, uint8_t level, uint32_t n);
+
+ private:
+  struct Tier {
+    float *data;
+    uint32_t capacity;  // rows
+    uint32_t write_index;
+    uint32_t num_rows;
+    // Envelope of the rows since the last one was written.
+    uint32_t samples;
+    float min[NUM_ATTRIBUTES];
+    float sum[NUM_ATTRIBUTES];
+    float max[NUM_ATTRIBUTES];
+  };
+
+  // Add one envelope (a single row has min = mean = max) to tier t. Every
+  // kDecimation of them close an envelope row of t, which is added to the
+  // tier above.
+  void Add(uint8_t t, const float *min, const float *mean, const float *max,
+           uint32_t stride);
+  void ResetTiers();
+
+  DataLogger<LOG_SIZE, NUM_ATTRIBUTES> full_;
+  float *row_;
+  uint8_t columns_[NUM_ATTRIBUTES];
+  uint32_t num_columns_;
+  Tier tiers_[kNumLevels - 1];
+};
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+             TIER2_FLOATS>::TieredLogger(float *tier1_data,
+                                         float *tier2_data)
+    : row_(nullptr), num_columns_(NUM_ATTRIBUTES) {
+  for (uint32_t i = 0; i < NUM_ATTRIBUTES; i++) {
+    columns_[i] = i;
+  }
+  tiers_[0].data = tier1_data;
+  tiers_[1].data = tier2_data;
+  ResetTiers();
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+LogRow TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+                    TIER2_FLOATS>::BeginRow() {
+  LogRow row = full_.BeginRow();
+  row_ = row.values;
+  return row;
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+void TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+                  TIER2_FLOATS>::EndRow() {
+  if (row_ == nullptr) {
+    return;
+  }
+  float values[NUM_ATTRIBUTES];
+  for (uint32_t i = 0; i < num_columns_; i++) {
+    values[i] = row_[columns_[i]];
+  }
+  Add(0, values, values, values, 1);
+  row_ = nullptr;
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+void TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS, TIER2_FLOATS>::Add(
+    uint8_t t, const float *min, const float *mean, const float *max,
+    uint32_t stride) {
+  Tier &tier = tiers_[t];
+  for (uint32_t i = 0; i < num_columns_; i++) {
+    uint32_t k = i * stride;
+    if (tier.samples == 0) {
+      tier.min[i] = min[k];
+      tier.sum[i] = mean[k];
+      tier.max[i] = max[k];
+    } else {
+      tier.min[i] = min[k] < tier.min[i] ? min[k] : tier.min[i];
+      tier.sum[i] += mean[k];
+      tier.max[i] = max[k] > tier.max[i] ? max[k] : tier.max[i];
+    }
+  }
+  tier.samples++;
+  if (tier.samples < kDecimation) {
+    return;
+  }
+  tier.samples = 0;
+  if (tier.capacity == 0) {
+    return;
+  }
+  float *out = tier.data + tier.write_index * 3 * num_columns_;
+  for (uint32_t i = 0; i < num_columns_; i++) {
+    out[3 * i] = tier.min[i];
+    out[3 * i + 1] = tier.sum[i] / kDecimation;
+    out[3 * i + 2] = tier.max[i];
+  }
+  tier.write_index = (tier.write_index + 1) % tier.capacity;
+  if (tier.num_rows < tier.capacity) {
+    tier.num_rows++;
+  }
+  if (t + 1 < kNumLevels - 1) {
+    Add(t + 1, out, out + 1, out + 2, 3);
+  }
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+void TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+                  TIER2_FLOATS>::Clear() {
+  full_.Clear();
+  row_ = nullptr;
+  ResetTiers();
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+void TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+                  TIER2_FLOATS>::SetTierColumns(const uint8_t *columns,
+                                                uint32_t num_columns) {
+  num_columns_ = 0;
+  for (uint32_t i = 0; i < num_columns; i++) {
+    if (columns[i] < NUM_ATTRIBUTES && num_columns_ < NUM_ATTRIBUTES) {
+      columns_[num_columns_++] = columns[i];
+    }
+  }
+  Clear();
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+void TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+                  TIER2_FLOATS>::ResetTiers() {
+  const uint32_t floats[kNumLevels - 1] = {TIER1_FLOATS, TIER2_FLOATS};
+  for (uint8_t t = 0; t < kNumLevels - 1; t++) {
+    tiers_[t].capacity =
+        num_columns_ > 0 ? floats[t] / (3 * num_columns_) : 0;
+    tiers_[t].write_index = 0;
+    tiers_[t].num_rows = 0;
+    tiers_[t].samples = 0;
+  }
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+uint32_t TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+                      TIER2_FLOATS>::NumRows(uint8_t level) const {
+  if (level == 0) {
+    return LOG_SIZE;
+  }
+  return level < kNumLevels ? tiers_[level - 1].num_rows : 0;
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+uint32_t TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+                      TIER2_FLOATS>::RowSize(uint8_t level) const {
+  return level == 0 ? NUM_ATTRIBUTES : 3 * num_columns_;
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+const float *TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+                          TIER2_FLOATS>::Row(uint8_t level, uint32_t n) {
+  if (level == 0) {
+    return full_.Row(n);
+  }
+  const Tier &tier = tiers_[level - 1];
+  uint32_t oldest = (tier.write_index + tier.capacity - tier.num_rows) %
+                    tier.capacity;
+  return tier.data + ((oldest + n) % tier.capacity) * 3 * num_columns_;
+}
+
+template <uint32_t LOG_SIZE, uint32_t NUM_ATTRIBUTES, uint32_t TIER1_FLOATS,
+          uint32_t TIER2_FLOATS>
+void TieredLogger<LOG_SIZE, NUM_ATTRIBUTES, TIER1_FLOATS,
+                  TIER2_FLOATS>::PrintRow(Print &serial, uint8_t level,
+                                          uint32_t n) {
+  if (level == 0) {
+    full_.PrintRow(serial, n);
+    return;
+  }
+  const float *row = Row(level, n);
+  for (uint32_t i = 0; i < RowSize(level); i++) {
+    serial.print(row[i]);
+    serial.print(",");
+  }
+  serial.println();
+}
@@ -110,6 +110,25 @@ BLA::Matrix<N> Utils::ArrayToVector(std::array<float, UN> arr) {
   return out;
 }
 
+/*
+CRC-32 (IEEE 802.3, as used by zlib) of size bytes. Pass the previous result
+as crc to continue a running checksum.
+*/
+uint32_t Utils::Crc32(const void *data, size_t size, uint32_t crc) {
+  // Nibble table: small enough to keep in flash, fast enough for log chunks.
+  static const uint32_t kTable[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+      0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+      0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++) {
+    crc = kTable[(crc ^ bytes[i]) & 0x0f] ^ (crc >> 4);
+    crc = kTable[(crc ^ (bytes[i] >> 4)) & 0x0f] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
 template float Utils::Maximum(const std::array<float, 12> &array);
 template float Utils::Minimum(const std::array<float, 12> &array);
 template std::array<float, 12> Utils::Constrain(std::array<float, 12> array,
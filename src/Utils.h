@@ -4,6 +4,8 @@
 
 #include <array>
 
+#include "Platform.h"
+
 class Utils {
  public:
   template <typename T, size_t N>
@@ -41,5 +43,11 @@ class Utils {
 
   template <int N, size_t UN>
   static BLA::Matrix<N> ArrayToVector(std::array<float, UN> arr);
+
+  /*
+  CRC-32 (IEEE 802.3, as used by zlib) of size bytes. Pass the previous result
+  as crc to continue a running checksum.
+  */
+  static uint32_t Crc32(const void *data, size_t size, uint32_t crc = 0);
 };
 
@@ -3,8 +3,17 @@
 #include <CommandInterpreter.h>
 #include <Streaming.h>
 
+#include "Benchmarks.h"
 #include "DataLogger.h"
 #include "DriveSystem.h"
+#include "FlashLogSink.h"
+#include "LogDump.h"
+#include "LogStorage.h"
+#include "MemoryBudget.h"
+#include "PolicyObservation.h"
+#include "Task.h"
+#include "TelemetryBatcher.h"
+#include "TieredLogger.h"
 #include "Utils.h"
 
 ////////////////////// CONFIG ///////////////////////
@@ -12,6 +21,13 @@ const int PRINT_DELAY = 10000;       // micros, 100hz
 const int HEADER_DELAY = 5000;   // millis
 const int CONTROL_DELAY = 1000;  // micros
 const int IMU_DELAY = 5000; // micros
+const uint32_t BATCH_LATENCY = 20000;  // micros
+const int FLASH_LOG_DELAY = 10000;     // micros, 100hz
+const uint32_t FLASH_LOG_SIZE = 256 * 1024;  // bytes of program flash
+// Two sectors at the top of the flash, above the flash log.
+const uint32_t COGGING_TABLE_SIZE = 2 * ProgramFlashStorage::kSectorSize;
+const uint32_t TASK_BUDGET = 200;      // micros per loop() for background tasks
+const uint32_t DUMP_ROWS_PER_STEP = 4;
 constexpr int IMU_FILTER_FREQUENCY = 1000000 / IMU_DELAY; // Hz
 const float MAX_TORQUE = 2.0;
 PDGains DEFAULT_GAINS = {8.0, 2.0};
@@ -21,9 +37,55 @@ const bool ECHO_COMMANDS = true;
 
 DriveSystem drive;
 
+// 1 s at full rate in RAM1, then min/mean/max envelopes at 100 Hz and 10 Hz
+// in RAM2 (312 KB). Each level is sized to span 10x the level below when
+// logging time and joint positions ({"log": 0x81}, 13 columns): 1 s, 10 s
+// and 100 s. With every signal logged (91 columns) the envelopes span 1.4 s
+// and 14 s.
 const uint32_t kLogSize = 1000;
-const uint32_t kNumAttributes = 1 + 6 + 7 * 12;
-DataLogger<kLogSize, kNumAttributes> logger;
+const uint32_t kNumAttributes = kNumDriveSystemDebugValues;
+const uint32_t kLogSizedColumns = 1 + DriveSystem::kNumActuators;
+const uint32_t kLogTier1Floats = 3 * kLogSizedColumns * kLogSize;
+const uint32_t kLogTier2Floats = kLogTier1Floats;
+DMAMEM float log_tier1[kLogTier1Floats];
+DMAMEM float log_tier2[kLogTier2Floats];
+TieredLogger<kLogSize, kNumAttributes, kLogTier1Floats, kLogTier2Floats>
+    logger(log_tier1, log_tier2);
+// Work buffers of the compressed log dump.
+LogDumpEncoder log_dump;
+
+// Every control tick, 11 samples per 4 KB packet.
+const uint32_t kTelemetryPacketSize = 8 * kUsbHighSpeedPacketSize;
+TelemetryBatcher<kTelemetryPacketSize, kNumAttributes> batcher(Serial,
+                                                               BATCH_LATENCY);
+
+// Persistent log of DebugData rows at 100 Hz that survives resets. Written
+// from loop() outside the control tick; see FlashLogSink.h. It holds the
+// columns of its own signal mask, independent of the RAM logger's.
+// Sectors are erased in the background as it goes, in motion too, so it
+// always holds the newest (flash_log_tool simulate, synthetic rows):
+//   every signal, 91 columns:                 930 rows, 9.3 s
+//   time, positions, currents, 25 columns:   3540 rows, 35 s
+//   time and positions, 13 columns:          6900 rows, 69 s
+ProgramFlashStorage flash_storage;
+FlashLogSink flash_log;
+uint8_t flash_log_columns[kNumAttributes];
+uint8_t flash_log_num_columns = 0;
+uint32_t flash_log_mask = 0;
+
+ProgramFlashStorage cogging_storage;
+
+// Long-running operations that should not block the control loop.
+TaskRunner tasks(micros, TASK_BUDGET);
+uint32_t log_dump_task = TaskRunner::kNoTask;
+
+// Observations for a learned policy, sent at the policy rate.
+static_assert(kNumAttributes <= kPolicyMaxFeatures,
+              "Policy observations cannot hold every DebugData column");
+PolicyObservation policy;
+
+// Largest RAM consumers, reported with {"query": 64}.
+MemoryBudget memory_budget;
 
 // Example json message with default start and stop characters: <{"kp":2.0}>
 // use_msgpack: true, use default arguments for the rest
@@ -34,11 +96,89 @@ long last_command_ts;
 long last_imu_ts;
 long last_print_ts;
 long last_header_ts;
+long last_flash_log_ts;
 
 bool print_debug_info = true;
 bool print_header_periodically = false;
+bool batch_telemetry = false;
+// Signals written to the logger every control tick, 0 to pause.
+uint32_t log_mask = 0;
+// Signals the logger's rows hold, kept while logging is paused, and their
+// columns.
+uint32_t logger_mask = 0;
+uint8_t logger_columns[kNumAttributes];
+uint8_t logger_num_columns = 0;
+bool flash_logging = false;
+// Lockstep current streaming: answer each current frame with the state from
+// the control tick that applied it.
+bool lockstep = false;
+bool state_reply_pending = false;
+uint32_t state_reply_seq = 0;
+// Send an energy frame at the end of every energy window.
+bool energy_reporting = false;
+// Signals observed by the policy, 0 when off.
+uint32_t policy_mask = 0;
+
+// Log these signals to flash from now on.
+void SetFlashLogSignals(uint32_t signal_mask) {
+  flash_log_mask = signal_mask;
+  flash_log.Flush();
+  flash_log_num_columns = DebugDataColumns(signal_mask, flash_log_columns);
+  flash_log.SetRowFormat(flash_log_num_columns, signal_mask);
+}
+
+// Print a row of the flash log, after a "Signals: <mask>" line whenever the
+// logged signals change. context points to the mask of the previous row.
+void PrintFlashLogRow(const float *row, uint32_t num_columns,
+                      uint32_t signal_mask, void *context) {
+  uint32_t *last_signal_mask = static_cast<uint32_t *>(context);
+  if (signal_mask != *last_signal_mask) {
+    Serial << "Signals: " << signal_mask << endl;
+    *last_signal_mask = signal_mask;
+  }
+  for (uint32_t i = 0; i < num_columns; i++) {
+    Serial.print(row[i], 4);
+    Serial.print(',');
+  }
+  Serial.println();
+}
+
+// Print a level of the logger a few rows at a time. Logging pauses while
+// this runs so the rows do not shift under it.
+Task DumpLog(uint8_t level) {
+  uint32_t num_rows = logger.NumRows(level);
+  for (uint32_t n = 0; n < num_rows; n++) {
+    logger.PrintRow(Serial, level, n);
+    if (n % DUMP_ROWS_PER_STEP == DUMP_ROWS_PER_STEP - 1) {
+      co_await NextTick();
+    }
+  }
+}
+
+// Same as DumpLog() in the compressed frames of LogDump.h. {"bench": 8}
+// compares the cost per row of both.
+Task DumpLogCompressed(uint8_t level, bool quantize) {
+  uint32_t num_rows = logger.NumRows(level);
+  // Full-rate rows send only the logged columns; the envelope rows only
+  // hold those.
+  if (level == 0 && logger_mask) {
+    log_dump.Begin(Serial, num_rows, logger_columns, logger_num_columns,
+                   quantize, micros());
+  } else {
+    log_dump.Begin(Serial, num_rows, nullptr, logger.RowSize(level),
+                   quantize, micros());
+  }
+  for (uint32_t n = 0; n < num_rows; n++) {
+    log_dump.AddRow(logger.Row(level, n));
+    if (n % DUMP_ROWS_PER_STEP == DUMP_ROWS_PER_STEP - 1) {
+      co_await NextTick();
+    }
+  }
+  log_dump.End(micros());
+}
 
 void setup(void) {
+  PaintStack();
   Serial.begin(500000);
   pinMode(13, OUTPUT);
 
@@ -52,6 +192,35 @@ void setup(void) {
 
   drive.SetupIMU(IMU_FILTER_FREQUENCY);
 
+  if (!cogging_storage.Begin(COGGING_TABLE_SIZE) ||
+      !drive.LoadCoggingTable(cogging_storage)) {
+    Serial << "No cogging table" << endl;
+  }
+  if (!flash_storage.Begin(FLASH_LOG_SIZE, COGGING_TABLE_SIZE) ||
+      !flash_log.Begin(flash_storage)) {
+    Serial << "Flash log unavailable" << endl;
+  }
+  SetFlashLogSignals(kAllDriveSignals);
+
+  memory_budget.AddObject("logger", logger);
+  memory_budget.Add("log_tiers", sizeof(log_tier1) + sizeof(log_tier2));
+  memory_budget.AddObject("log_dump", log_dump);
+  memory_budget.AddObject("drive", drive);
+  memory_budget.AddObject("batcher", batcher);
+  // The serial input buffer; the command document is on the heap.
+  memory_budget.AddObject("interpreter", interpreter);
+  memory_budget.AddObject("flash_log", flash_log);
+  memory_budget.AddObject("tasks", tasks);
+  memory_budget.AddObject("policy", policy);
+  memory_budget.Add("task_frames",
+                    TaskFramePool::kNumFrames * TaskFramePool::kFrameSize);
+  // Transient, on the stack.
+  memory_budget.Add("status_line", kMaxStatusLineLength);
+  memory_budget.AddHeap("json_command", interpreter.JsonHeap());
+  memory_budget.AddHeap("json_reply", drive.JsonHeap());
+  drive.SetMemoryBudget(&memory_budget);
+  drive.SetDroppedPackets(&batcher.DroppedPackets());
+
   last_command_ts = micros();
   last_print_ts = micros();
   last_header_ts = millis();
@@ -100,6 +269,82 @@ void loop() {
   CheckResult r = interpreter.CheckForMessages();
   if (r.flag == CheckResultFlag::kNewCommand) {
     // Serial << "Got new command." << endl;
+    if (r.new_current_frame) {
+      // Not echoed: frames arrive every control tick.
+      CurrentFrame frame = interpreter.LatestCurrentFrame();
+      drive.StreamCurrents(frame.currents);
+      state_reply_pending = lockstep;
+      state_reply_seq = frame.seq;
+    }
+    if (r.new_lockstep) {
+      lockstep = interpreter.LatestLockstep();
+      if (ECHO_COMMANDS) {
+        Serial << "Lockstep: " << lockstep << endl;
+      }
+    }
+    if (r.new_stream_timeout) {
+      drive.SetStreamTimeout(interpreter.LatestStreamTimeout());
+      if (ECHO_COMMANDS) {
+        Serial << "Stream timeout: " << interpreter.LatestStreamTimeout()
+               << endl;
+      }
+    }
+    if (r.new_energy_window) {
+      drive.SetEnergyWindow(interpreter.LatestEnergyWindow());
+      energy_reporting = interpreter.LatestEnergyWindow() > 0;
+      if (ECHO_COMMANDS) {
+        Serial << "Energy window: " << interpreter.LatestEnergyWindow()
+               << endl;
+      }
+    }
+    if (r.new_leg_modes) {
+      drive.SetLegModes(interpreter.LatestLegModes());
+      if (ECHO_COMMANDS) {
+        Serial << "Leg modes: ";
+        for (LegControlMode mode : interpreter.LatestLegModes()) {
+          Serial << static_cast<uint8_t>(mode) << " ";
+        }
+        Serial << endl;
+      }
+    }
+    if (r.new_motion) {
+      MotionCommand motion = interpreter.LatestMotion();
+      bool started = drive.PlayMotion(motion.id, motion.speed);
+      if (!started) {
+        Serial << "Could not play motion " << motion.id << endl;
+      } else if (ECHO_COMMANDS) {
+        Serial << "Motion: " << motion.id << " speed: " << motion.speed
+               << endl;
+      }
+    }
+    if (r.new_policy) {
+      PolicyCommand command = interpreter.LatestPolicy();
+      uint8_t columns[kNumAttributes];
+      uint8_t num_columns = DebugDataColumns(command.signals, columns);
+      policy_mask = 0;
+      if (command.signals == 0) {
+        if (ECHO_COMMANDS) {
+          Serial << "Policy observations off" << endl;
+        }
+      } else if (!policy.Configure(columns, num_columns, command.history,
+                                   command.decimation)) {
+        Serial << "Policy observation too large: " << num_columns << " x "
+               << command.history << endl;
+      } else {
+        policy.SetClip(command.clip);
+        policy_mask = command.signals;
+        if (ECHO_COMMANDS) {
+          Serial << "Policy: " << num_columns << " features x "
+                 << command.history << " every " << command.decimation
+                 << " ticks" << endl;
+        }
+      }
+    }
+    if (r.new_policy_normalization) {
+      PolicyNormalization norm = interpreter.LatestPolicyNormalization();
+      policy.SetNormalization(norm.start, norm.mean.data(), norm.stddev.data(),
+                              norm.count);
+    }
     if (r.new_position) {
       drive.SetJointPositions(interpreter.LatestPositionCommand());
       if (ECHO_COMMANDS) {
@@ -189,6 +434,78 @@ void loop() {
     if (r.new_debug) {
       print_debug_info = interpreter.LatestDebug();
     }
+    if (r.new_batch) {
+      batch_telemetry = interpreter.LatestBatch();
+      if (!batch_telemetry) {
+        batcher.Flush();
+      }
+    }
+    if (r.new_log_mask) {
+      // 0 only pauses logging, so the rows stay there to dump. The tiers
+      // are cleared only when other signals are logged.
+      uint32_t mask = interpreter.LatestLogMask();
+      if (mask && mask != logger_mask) {
+        // The rows are cleared, so a dump of them in progress is moot.
+        tasks.Cancel(log_dump_task);
+        logger_num_columns = DebugDataColumns(mask, logger_columns);
+        logger.SetTierColumns(logger_columns, logger_num_columns);
+        logger_mask = mask;
+      }
+      log_mask = mask;
+      if (ECHO_COMMANDS) {
+        Serial << "Log mask: " << log_mask << endl;
+      }
+    }
+    if (r.do_dump_log && !tasks.Running(log_dump_task) &&
+        interpreter.LatestDumpLogLevel() < logger.kNumLevels) {
+      uint8_t level = interpreter.LatestDumpLogLevel();
+      log_dump_task = tasks.Start(
+          interpreter.LatestDumpLogCompressed()
+              ? DumpLogCompressed(level, interpreter.LatestDumpLogQuantized())
+              : DumpLog(level));
+    }
+    if (r.new_flash_log) {
+      uint32_t mask = interpreter.LatestFlashLogMask()
+                          ? interpreter.LatestFlashLogMask()
+                          : kAllDriveSignals;
+      if (mask != flash_log_mask) {
+        SetFlashLogSignals(mask);
+      }
+      flash_logging = interpreter.LatestFlashLog() && flash_log.Ready();
+      if (!flash_logging) {
+        flash_log.Flush();
+      }
+      if (ECHO_COMMANDS) {
+        Serial << "Flash log: " << flash_logging << endl;
+      }
+    }
+    if (r.do_dump_flash_log) {
+      flash_log.Flush();
+      uint32_t last_signal_mask = 0;
+      flash_log.ReadAll(PrintFlashLogRow, &last_signal_mask);
+    }
+    if (r.new_cogging) {
+      drive.SetCoggingCompensation(interpreter.LatestCogging());
+      if (ECHO_COMMANDS) {
+        Serial << "Cogging compensation: " << interpreter.LatestCogging()
+               << endl;
+      }
+    }
+    if (r.do_cogging_calibration) {
+      drive.StartCoggingCalibration();
+      if (ECHO_COMMANDS) {
+        Serial << "Calibrating cogging." << endl;
+      }
+    }
+    if (r.do_schema) {
+      drive.PrintMsgPackSchema();
+    }
+    if (r.do_benchmark) {
+      RunBenchmark(interpreter.LatestBenchmark(), drive, Serial);
+    }
+    if (r.new_query) {
+      drive.PrintMsgPackQuery(interpreter.LatestQuery());
+    }
   }
   
   if (micros() - last_imu_ts >= IMU_DELAY) {
@@ -199,6 +516,47 @@ void loop() {
   if (micros() - last_command_ts >= CONTROL_DELAY) {
     drive.Update();
     last_command_ts = micros();
+    if (state_reply_pending) {
+      drive.WriteStreamState(state_reply_seq);
+      state_reply_pending = false;
+    }
+    if (energy_reporting && drive.EnergyWindowCompleted()) {
+      drive.WriteEnergyFrame();
+    }
+    if (policy_mask) {
+      float row[kNumAttributes];
+      drive.WriteDebugRow({row, kNumAttributes}, policy_mask);
+      if (policy.AddTick(row, last_command_ts)) {
+        // An on-device policy would run on policy.Observation() here.
+        policy.WriteFrame(Serial);
+      }
+    }
+    if (log_mask && !tasks.Running(log_dump_task)) {
+      drive.WriteDebugRow(logger.BeginRow(), log_mask);
+      logger.EndRow();
+    }
+    if (batch_telemetry) {
+      auto sample = drive.DebugData();
+      batcher.AddSample(last_command_ts, &sample(0));
+    }
+    if (flash_logging && last_command_ts - last_flash_log_ts >= FLASH_LOG_DELAY) {
+      float row[kNumAttributes];
+      drive.WriteDebugRow({row, kNumAttributes});
+      // Columns are in row order, so they can be packed in place.
+      for (uint8_t i = 0; i < flash_log_num_columns; i++) {
+        row[i] = row[flash_log_columns[i]];
+      }
+      flash_log.Append(row);
+      last_flash_log_ts = last_command_ts;
+    }
+  }
+  tasks.Run();
+  if (flash_logging) {
+    // Erases run in the background; Service() only polls them.
+    flash_log.Service();
+  }
+  if (batch_telemetry) {
+    batcher.Poll(micros());
   }
 
   if (print_debug_info) {
@@ -2,6 +2,8 @@ import msgpack
 import serial
 import numpy as np
 import glob
+import struct
+import time
 
 
 def pack_serialized(bytes_array, start=0x00):
@@ -13,6 +15,24 @@ def pack_dict(dict, start=0x00):
     full_array = pack_serialized(raw, start)
     return full_array
 
+def read_state_frame(ser):
+    """Read one 0x47 0x47 lockstep state frame (see DriveSystem::WriteStreamState)."""
+    ser.read_until(b"\x47\x47")
+    (length,) = struct.unpack(">H", ser.read(2))
+    payload = ser.read(length)
+    seq, ts, host_latency, mode, fault, timeouts = struct.unpack_from("<IIIBBH", payload)
+    values = np.frombuffer(payload[16:], dtype="<f4").reshape(3, 12)
+    return seq, ts, host_latency, values
+
+def read_energy_frame(ser):
+    """Read one 0x48 0x48 energy frame (see DriveSystem::WriteEnergyFrame)."""
+    ser.read_until(b"\x48\x48")
+    (length,) = struct.unpack(">H", ser.read(2))
+    payload = ser.read(length)
+    ts, window_micros = struct.unpack_from("<II", payload)
+    values = np.frombuffer(payload[8:], dtype="<f4").reshape(6, 12)
+    return ts, window_micros, values
+
 # Pretty sure this glob pattern only works on mac, otherwise you'll need to change it to correctly find the Teensy.
 serial_port = glob.glob("/dev/tty.usbmodem*")[0]
 with serial.Serial(serial_port, timeout=0.2) as ser:
@@ -43,6 +63,89 @@ with serial.Serial(serial_port, timeout=0.2) as ser:
         # If I want weight/4 = 4.4N per leg, then command 17.6 ?????? Seems like a lot
         # ser.write(pack_dict({"ff_force": [0.0, 0.0, -17.6, 0.0, 0.0, -17.6, 0.0, 0.0, -17.6, 0.0, 0.0, -17.6]}))
 
+        # Use this command to request a single state reply instead of streaming.
+        # Bits: 1 joint states, 2 references, 4 IMU, 8 power and
+        # "dropped_lines" and "dropped_packets" (status lines and batched
+        # telemetry packets dropped for a full serial buffer),
+        # 16 mode, 32 fault,
+        # 64 memory ("stack": [size, peak, current], "ram": region sizes and
+        # use, "objs": largest static RAM consumers, "heap": [name, bytes,
+        # peak] of the JSON documents).
+        # The reply is a 0x45 0x45 framed msgpack map with "qid" set to "id".
+        # ser.write(pack_dict({"query": 1 | 16 | 32, "id": 7}))
+
+        # Use this command to get the signal schema: a 0x45 0x45 framed msgpack
+        # map with "row" (values per DebugData row) and "schema", a list of
+        # [key, label, type (0 float, 1 uint32), scale, count] in row order.
+        # ser.write(pack_dict({"schema": True}))
+
+        # Use this command to log every control tick on the device. The value is
+        # a signal mask (bit s selects schema entry s); 0 pauses logging and keeps
+        # the rows, another mask starts over.
+        # Dump the log as text with {"dump_log": True}, or compressed with
+        # {"dump_log": True, "compress": True}: 0x49 0x49 framed, decode it
+        # with tools/LogDumpTool. Only the logged columns are sent; add
+        # "quantize": True to round them to 0.01 for a several times smaller
+        # dump. The last 1 s is kept at full rate; add
+        # "level": 1 or 2 for the min, mean, max of each logged column at
+        # 100 Hz and 10 Hz over the last 10 s and 100 s (with time and joint
+        # positions logged, 0x81; fewer with more signals).
+        # ser.write(pack_dict({"log": 0x3fff}))
+
+        # Log DebugData rows at 100 Hz to program flash: every signal, or
+        # the "signals" mask given (kept until the next one). The log survives
+        # resets; print it with {"dump_flash_log": True}.
+        # ser.write(pack_dict({"flash_log": True, "signals": 0x81}))
+
+        # Measure the motors' cogging (about 8 s per active axis, legs free to
+        # move 10 degrees each way, max current set), then apply it.
+        # ser.write(pack_dict({"calibrate_cogging": True}))
+        # ser.write(pack_dict({"cogging": True}))
+
+        # Drive the motors with currents from a host controller. Each frame is
+        # 12 currents in mA; the drive idles if frames stop for stream_timeout
+        # micros. In lockstep the device answers every frame with the state
+        # from the tick that applied it.
+        # ser.write(pack_dict({"stream_timeout": 10000, "lockstep": True}))
+        # for seq in range(1000):
+        #     start = time.perf_counter()
+        #     ser.write(pack_dict({"cur": [0] * 12, "seq": seq}))
+        #     reply_seq, ts, host_latency, (pos, vel, cur) = read_state_frame(ser)
+        #     rtt = time.perf_counter() - start
+        #     print(reply_seq, f"rtt {rtt * 1e6:.0f} us, host {host_latency} us")
+
+        # Report per-joint energy once per window (micros). Rows: window
+        # electrical and mechanical power [W], then consumed, regenerated,
+        # positive and negative work [J] since the command.
+        # ser.write(pack_dict({"energy": 1000000}))
+        # ts, window_micros, (elec, mech, used, regen, work, braking) = read_energy_frame(ser)
+        # print(f"{elec.sum():.1f} W, efficiency {work.sum() / max(used.sum(), 1e-6):.2f}")
+
+        # Run each leg with its own law: 0 idle, 1 joint PD, 2 cartesian,
+        # 3 current. "pos", "cart_pos" and "cur" then only update the
+        # references; {"idle": True} ends per-leg control.
+        # ser.write(pack_dict({"leg_modes": [2, 2, 1, 0]}))
+
+        # Play a motion primitive stored on the device from the current pose:
+        # 0 stand, 1 sit, 2 lie down, 3 recover. speed scales time (2 = twice
+        # as fast). A {"query": 16} reply has "motion": -1 once it ends.
+        # ser.write(pack_dict({"motion": 0, "speed": 1.0}))
+
+        # Observations for a learned policy: the signals in the mask, averaged
+        # over "decimation" control ticks, normalised, clipped to +-"clip" and
+        # stacked "history" steps deep, oldest first. One 0x4A 0x4A frame per
+        # step (layout in src/PolicyObservation.h, decode with
+        # tools/PolicyObservation). Here the IMU, joint states and last
+        # commanded currents (the last actions), 42 features, at 50 Hz. Set
+        # the statistics after the policy, up to 8 features per command, in
+        # DebugData row order.
+        # ser.write(pack_dict({"policy": 0x7e | 0x3 << 7 | 1 << 13, "history": 3, "decimation": 20, "clip": 5.0}))
+        # ser.write(pack_dict({"policy_norm": 0, "mean": [0.0] * 8, "std": [1.0] * 8}))
+
+        # Use this command to stream every control tick in batched 0x46 0x46
+        # packets (layout documented in src/TelemetryBatcher.h).
+        # ser.write(pack_dict({"batch": True}))
+
         ser.flush()
         while True:
             # Robot must be sending non-msgpack debug messages for this to work
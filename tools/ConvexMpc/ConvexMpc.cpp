@@ -0,0 +1,352 @@
+// Convex MPC locomotion controller on the host. Plans ground reaction forces
+// for a trot with a single rigid body model (SrbModel.h, MpcSolver.h) and
+// streams them to the robot as ff_force together with cart_pos foot targets.
+//
+// Usage:
+//   convex_mpc [--port /dev/ttyACM0] [--duration S] [--rate HZ]
+//              [--stream-rate HZ] [--horizon N] [--dt S] [--rho R]
+//              [--vx M/S] [--vy M/S] [--yaw-rate RAD/S] [--link-delay US]
+//
+// Without --port it runs against SimulatedDevice, which decodes the same
+// frames and integrates the rigid body at the firmware control rate, and
+// exits non-zero if the body falls. With --port the robot must already be in
+// cartesian mode with the cart_kp/cart_kd gains set (see
+// test/msgpack_test.py). The firmware does not estimate the body state, so
+// on hardware the controller runs on its own prediction.
+//
+// Three threads: the solver samples the state, builds and solves the QP at
+// --rate and hands the plan over through an SpscRing; the streamer sends the
+// plan step for the current time at --stream-rate; the simulated device runs
+// the plant. At the end it prints the solve time distribution, the
+// end-to-end latency (state sample to command applied on the device, or to
+// the serial write on hardware) and the tracking error.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "DeviceLink.h"
+#include "MpcSolver.h"
+#include "Planner.h"
+#include "RingBuffer.h"
+#include "SrbModel.h"
+
+namespace {
+
+const double kWarmup = 0.5;        // [s] not counted in the tracking error
+const double kFallenHeight = 0.05;  // [m]
+
+struct Config {
+  const char *port = nullptr;
+  double duration = 5.0;
+  double rate = 200.0;
+  double stream_rate = 1000.0;
+  size_t horizon = 12;
+  double dt = 0.025;
+  double rho = 0.05;
+  double vx = 0.2;
+  double vy = 0.0;
+  double yaw_rate = 0.0;
+  uint32_t link_delay = 1000;
+};
+
+struct SolverStats {
+  std::vector<uint32_t> solve_micros;
+  std::vector<uint32_t> iterations;
+  uint32_t converged = 0;
+  uint32_t failed = 0;
+  uint32_t dropped_plans = 0;
+  // Tracking error sums over the samples after kWarmup.
+  uint32_t samples = 0;
+  double velocity_error = 0.0;
+  double yaw_rate_error = 0.0;
+  double height_error = 0.0;
+  double tilt_error = 0.0;
+  double min_height = 1.0;
+};
+
+struct StreamStats {
+  uint32_t frames = 0;
+  uint32_t failed = 0;
+  std::vector<uint32_t> latency_micros;  // sample -> write, hardware only
+};
+
+void PrintUsage() {
+  fprintf(stderr,
+          "usage: convex_mpc [--port PATH] [--duration S] [--rate HZ]"
+          " [--stream-rate HZ]\n"
+          "                  [--horizon N] [--dt S] [--rho R] [--vx M/S]"
+          " [--vy M/S]\n"
+          "                  [--yaw-rate RAD/S] [--link-delay US]\n");
+}
+
+bool ParseArgs(int argc, char **argv, Config &config) {
+  for (int i = 1; i < argc; i++) {
+    const char *flag = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (!strcmp(flag, "--port")) {
+      config.port = value;
+    } else if (!strcmp(flag, "--duration")) {
+      config.duration = atof(value);
+    } else if (!strcmp(flag, "--rate")) {
+      config.rate = atof(value);
+    } else if (!strcmp(flag, "--stream-rate")) {
+      config.stream_rate = atof(value);
+    } else if (!strcmp(flag, "--horizon")) {
+      config.horizon = atoi(value);
+    } else if (!strcmp(flag, "--dt")) {
+      config.dt = atof(value);
+    } else if (!strcmp(flag, "--rho")) {
+      config.rho = atof(value);
+    } else if (!strcmp(flag, "--vx")) {
+      config.vx = atof(value);
+    } else if (!strcmp(flag, "--vy")) {
+      config.vy = atof(value);
+    } else if (!strcmp(flag, "--yaw-rate")) {
+      config.yaw_rate = atof(value);
+    } else if (!strcmp(flag, "--link-delay")) {
+      config.link_delay = atoi(value);
+    } else {
+      fprintf(stderr, "Invalid argument: %s %s\n", flag, value);
+      return false;
+    }
+  }
+  if (config.horizon < 2 || config.horizon > kMaxHorizon || config.rate <= 0 ||
+      config.stream_rate <= 0 || config.dt <= 0) {
+    fprintf(stderr, "Invalid horizon, rate or dt\n");
+    return false;
+  }
+  return true;
+}
+
+SrbState StandingState(const SrbParameters &params) {
+  SrbState x = SrbState::Zero();
+  x(kPosZ) = params.standing_height;
+  x(kGravity) = kGravityAcceleration;
+  return x;
+}
+
+// Sleeps until the next multiple of period_micros after *next.
+void WaitNext(uint64_t &next, uint64_t period_micros) {
+  next += period_micros;
+  uint64_t now = NowMicros();
+  if (next > now) {
+    std::this_thread::sleep_for(std::chrono::microseconds(next - now));
+  } else {
+    next = now;  // overran, don't try to catch up
+  }
+}
+
+void SolverLoop(const Config &config, const SrbParameters &params,
+                DeviceLink &device, SpscRing<Plan, 4> &plans,
+                uint64_t start_micros, const std::atomic<bool> &running,
+                SolverStats &stats) {
+  Gait gait;
+  Planner planner(params, gait, config.horizon, config.dt);
+  planner.SetCommand(config.vx, config.vy, config.yaw_rate);
+  MpcSolver solver(params, MpcWeights(), config.horizon, config.rho);
+  MpcProblem problem;
+  static Plan plan;
+
+  SrbState x = StandingState(params);
+  planner.Reset(x);
+  bool have_plan = false;
+  uint64_t period = 1e6 / config.rate;
+  uint64_t next = NowMicros();
+  while (running) {
+    uint64_t sample_micros;
+    if (!device.Sample(x, sample_micros)) {
+      // Open loop: take the state the last plan predicted for now.
+      sample_micros = NowMicros();
+      if (have_plan) {
+        size_t step = std::min<size_t>(
+            (sample_micros - plan.sample_micros) * 1e-6 / config.dt + 0.5,
+            config.horizon);
+        x = solver.Predicted(step);
+      }
+    }
+    double time = (sample_micros - start_micros) * 1e-6;
+
+    uint64_t solve_start = NowMicros();
+    planner.Build(x, time, problem);
+    MpcSolver::Result result = solver.Solve(problem);
+    if (result.iterations == 0) {
+      stats.failed++;
+    } else {
+      planner.FillPlan(solver, plan);
+      plan.sample_micros = sample_micros;
+      have_plan = true;
+      if (!plans.Push(plan)) {
+        stats.dropped_plans++;
+      }
+    }
+    stats.solve_micros.push_back(NowMicros() - solve_start);
+    stats.iterations.push_back(result.iterations);
+    stats.converged += result.converged;
+
+    if (time > kWarmup) {
+      double velocity[3];
+      planner.CommandedVelocity(x(kYaw), velocity);
+      stats.samples++;
+      stats.velocity_error += std::pow(x(kVelX) - velocity[0], 2) +
+                              std::pow(x(kVelY) - velocity[1], 2);
+      stats.yaw_rate_error += std::pow(x(kOmegaZ) - planner.YawRate(), 2);
+      stats.height_error += std::pow(x(kPosZ) - params.standing_height, 2);
+      stats.tilt_error += x(kRoll) * x(kRoll) + x(kPitch) * x(kPitch);
+    }
+    stats.min_height = std::min(stats.min_height, x(kPosZ));
+
+    WaitNext(next, period);
+  }
+}
+
+void StreamLoop(const Config &config, DeviceLink &device,
+                SpscRing<Plan, 4> &plans, bool simulated,
+                const std::atomic<bool> &running, StreamStats &stats) {
+  static Plan plan;
+  bool have_plan = false;
+  uint64_t period = 1e6 / config.stream_rate;
+  uint64_t next = NowMicros();
+  CommandFrame frame;
+  LegCommand command;
+  while (running) {
+    while (plans.Pop(plan)) {
+      have_plan = true;
+    }
+    if (have_plan) {
+      // Step of the plan for now, with the foot targets interpolated between
+      // steps. Past the horizon the last step holds.
+      uint64_t now = NowMicros();
+      double steps = (now - plan.sample_micros) * 1e-6 / plan.dt;
+      size_t step = std::min<size_t>(steps, plan.steps - 1);
+      double s = std::min(steps - step, 1.0);
+      const LegCommand &a = plan.commands[step];
+      const LegCommand &b = plan.commands[step + 1];
+      for (size_t i = 0; i < 12; i++) {
+        command.ff_force[i] = a.ff_force[i];
+        command.cart_pos[i] = a.cart_pos[i] + (b.cart_pos[i] - a.cart_pos[i]) * s;
+      }
+      EncodeCommand(command, frame);
+      frame.sample_micros = plan.sample_micros;
+      frame.send_micros = NowMicros();
+      if (device.Send(frame)) {
+        stats.frames++;
+        if (!simulated) {
+          stats.latency_micros.push_back(NowMicros() - frame.sample_micros);
+        }
+      } else {
+        stats.failed++;
+      }
+    }
+    WaitNext(next, period);
+  }
+}
+
+void PrintDistribution(const char *name, std::vector<uint32_t> values) {
+  if (values.empty()) {
+    printf("%s: no samples\n", name);
+    return;
+  }
+  std::sort(values.begin(), values.end());
+  auto percentile = [&values](double p) {
+    return values[std::min<size_t>(p * values.size(), values.size() - 1)];
+  };
+  printf("%s [us]: p50 %u, p90 %u, p99 %u, max %u (%zu samples)\n", name,
+         percentile(0.5), percentile(0.9), percentile(0.99), values.back(),
+         values.size());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Config config;
+  if (!ParseArgs(argc, argv, config)) {
+    PrintUsage();
+    return 1;
+  }
+
+  SrbParameters params;
+  SerialLink serial;
+  SimulatedDevice simulated(params, config.link_delay);
+  DeviceLink *device = &simulated;
+  if (config.port) {
+    if (!serial.Open(config.port)) {
+      return 1;
+    }
+    device = &serial;
+  } else {
+    simulated.Start(StandingState(params));
+  }
+
+  static SpscRing<Plan, 4> plans;
+  std::atomic<bool> running(true);
+  SolverStats solver_stats;
+  StreamStats stream_stats;
+  uint64_t start_micros = NowMicros();
+  std::thread solver_thread(SolverLoop, std::cref(config), std::cref(params),
+                            std::ref(*device), std::ref(plans), start_micros,
+                            std::cref(running), std::ref(solver_stats));
+  std::thread stream_thread(StreamLoop, std::cref(config), std::ref(*device),
+                            std::ref(plans), config.port == nullptr,
+                            std::cref(running), std::ref(stream_stats));
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(config.duration));
+  running = false;
+  solver_thread.join();
+  stream_thread.join();
+  double elapsed = (NowMicros() - start_micros) * 1e-6;
+  if (!config.port) {
+    simulated.Stop();
+  }
+
+  size_t solves = solver_stats.solve_micros.size();
+  uint64_t iterations = 0;
+  uint32_t max_iterations = 0;
+  for (uint32_t n : solver_stats.iterations) {
+    iterations += n;
+    max_iterations = std::max(max_iterations, n);
+  }
+  printf("solver: %.1f Hz, %zu solves, %.1f%% converged, iterations mean "
+         "%.1f max %u, %u failed, %u plans dropped\n",
+         solves / elapsed, solves,
+         solves ? 100.0 * solver_stats.converged / solves : 0.0,
+         solves ? double(iterations) / solves : 0.0, max_iterations,
+         solver_stats.failed, solver_stats.dropped_plans);
+  PrintDistribution("solve time", solver_stats.solve_micros);
+  printf("stream: %.1f Hz, %u frames, %u failed sends\n",
+         stream_stats.frames / elapsed, stream_stats.frames,
+         stream_stats.failed);
+  if (config.port) {
+    PrintDistribution("latency sample -> serial write",
+                      stream_stats.latency_micros);
+    return 0;
+  }
+
+  const SimulatedDevice::Stats &device_stats = simulated.GetStats();
+  printf("device: %u frames applied, %u decode errors\n", device_stats.frames,
+         device_stats.decode_errors);
+  PrintDistribution("latency sample -> applied", device_stats.latency_micros);
+  if (solver_stats.samples > 0) {
+    double n = solver_stats.samples;
+    printf("tracking rms: velocity %.3f m/s, yaw rate %.3f rad/s, height "
+           "%.4f m, tilt %.4f rad\n",
+           std::sqrt(solver_stats.velocity_error / n),
+           std::sqrt(solver_stats.yaw_rate_error / n),
+           std::sqrt(solver_stats.height_error / n),
+           std::sqrt(solver_stats.tilt_error / n));
+  }
+  if (solver_stats.min_height < kFallenHeight) {
+    printf("FAIL: body fell to %.3f m\n", solver_stats.min_height);
+    return 1;
+  }
+  return 0;
+}
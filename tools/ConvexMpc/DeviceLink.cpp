@@ -0,0 +1,262 @@
+#include "DeviceLink.h"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char *kForceKey = "ff_force";
+const char *kPositionKey = "cart_pos";
+
+uint8_t *PutKey(uint8_t *out, const char *key) {
+  size_t length = strlen(key);
+  *out++ = 0xa0 | length;  // fixstr
+  memcpy(out, key, length);
+  return out + length;
+}
+
+uint8_t *PutFloats(uint8_t *out, const float values[12]) {
+  *out++ = 0x90 | 12;  // fixarray
+  for (size_t i = 0; i < 12; i++) {
+    uint32_t bits;
+    memcpy(&bits, &values[i], sizeof(bits));
+    *out++ = 0xca;  // float32, big endian
+    *out++ = bits >> 24;
+    *out++ = bits >> 16;
+    *out++ = bits >> 8;
+    *out++ = bits;
+  }
+  return out;
+}
+
+bool GetFloats(const uint8_t *&in, const uint8_t *end, float values[12]) {
+  if (in >= end || *in++ != (0x90 | 12)) {
+    return false;
+  }
+  for (size_t i = 0; i < 12; i++) {
+    if (end - in < 5 || *in++ != 0xca) {
+      return false;
+    }
+    uint32_t bits = uint32_t(in[0]) << 24 | uint32_t(in[1]) << 16 |
+                    uint32_t(in[2]) << 8 | in[3];
+    memcpy(&values[i], &bits, sizeof(bits));
+    in += 4;
+  }
+  return true;
+}
+
+}  // namespace
+
+uint64_t NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void EncodeCommand(const LegCommand &command, CommandFrame &frame) {
+  uint8_t *out = frame.bytes + 2;
+  *out++ = 0x80 | 2;  // fixmap
+  out = PutKey(out, kForceKey);
+  out = PutFloats(out, command.ff_force);
+  out = PutKey(out, kPositionKey);
+  out = PutFloats(out, command.cart_pos);
+  frame.size = out - frame.bytes;
+  frame.bytes[0] = 0x00;
+  frame.bytes[1] = frame.size - 2;
+}
+
+bool DecodeCommand(const uint8_t *bytes, size_t size, LegCommand &command) {
+  if (size < 3 || bytes[0] != 0x00 || bytes[1] != size - 2) {
+    return false;
+  }
+  const uint8_t *in = bytes + 2;
+  const uint8_t *end = bytes + size;
+  if ((*in & 0xf0) != 0x80) {
+    return false;
+  }
+  size_t entries = *in++ & 0x0f;
+  bool force = false;
+  bool position = false;
+  for (size_t e = 0; e < entries; e++) {
+    if (in >= end || (*in & 0xe0) != 0xa0) {
+      return false;
+    }
+    size_t length = *in++ & 0x1f;
+    if (size_t(end - in) < length) {
+      return false;
+    }
+    const char *key = reinterpret_cast<const char *>(in);
+    in += length;
+    if (length == strlen(kForceKey) && !memcmp(key, kForceKey, length)) {
+      force = GetFloats(in, end, command.ff_force);
+      if (!force) {
+        return false;
+      }
+    } else if (length == strlen(kPositionKey) &&
+               !memcmp(key, kPositionKey, length)) {
+      position = GetFloats(in, end, command.cart_pos);
+      if (!position) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  return force && position && in == end;
+}
+
+SerialLink::~SerialLink() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool SerialLink::Open(const char *path) {
+  fd_ = open(path, O_RDWR | O_NOCTTY);
+  if (fd_ < 0) {
+    perror(path);
+    return false;
+  }
+  termios tty;
+  if (tcgetattr(fd_, &tty) != 0) {
+    perror("tcgetattr");
+    return false;
+  }
+  // USB serial ignores the baud rate; raw mode keeps the binary frames
+  // intact.
+  cfmakeraw(&tty);
+  cfsetspeed(&tty, B500000);
+  if (tcsetattr(fd_, TCSANOW, &tty) != 0) {
+    perror("tcsetattr");
+    return false;
+  }
+  return true;
+}
+
+bool SerialLink::Send(const CommandFrame &frame) {
+  size_t written = 0;
+  while (written < frame.size) {
+    ssize_t n = write(fd_, frame.bytes + written, frame.size - written);
+    if (n <= 0) {
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+SimulatedDevice::SimulatedDevice(const SrbParameters &params,
+                                 uint32_t link_delay_micros,
+                                 uint32_t tick_micros)
+    : params_(params),
+      link_delay_micros_(link_delay_micros),
+      tick_micros_(tick_micros),
+      running_(false),
+      state_(SrbState::Zero()),
+      state_micros_(0),
+      stats_() {}
+
+SimulatedDevice::~SimulatedDevice() { Stop(); }
+
+void SimulatedDevice::Start(const SrbState &initial) {
+  state_ = initial;
+  state_micros_ = NowMicros();
+  running_ = true;
+  thread_ = std::thread(&SimulatedDevice::Run, this, initial);
+}
+
+void SimulatedDevice::Stop() {
+  running_ = false;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool SimulatedDevice::Send(const CommandFrame &frame) {
+  return link_.Push(frame);
+}
+
+bool SimulatedDevice::Sample(SrbState &state, uint64_t &sample_micros) {
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  state = state_;
+  sample_micros = state_micros_;
+  return true;
+}
+
+void SimulatedDevice::Run(SrbState state) {
+  const double dt = tick_micros_ * 1e-6;
+  LegCommand command = {};
+  bool planted[kNumLegs] = {};
+  double feet[kNumLegs][3] = {};
+  uint64_t next_tick = NowMicros();
+
+  while (running_) {
+    uint64_t now = NowMicros();
+    if (now < next_tick) {
+      std::this_thread::sleep_for(std::chrono::microseconds(next_tick - now));
+      continue;
+    }
+    next_tick += tick_micros_;
+
+    // Deliver the frames that have crossed the link by now; the newest one
+    // wins, like the firmware's one command per key per loop().
+    for (;;) {
+      auto span = link_.Peek(1);
+      if (span.size == 0 ||
+          span.data->send_micros + link_delay_micros_ > now) {
+        break;
+      }
+      if (DecodeCommand(span.data->bytes, span.data->size, command)) {
+        stats_.frames++;
+        stats_.latency_micros.push_back(now - span.data->sample_micros);
+      } else {
+        stats_.decode_errors++;
+      }
+      link_.Release(1);
+    }
+
+    Mat<3, 3> r = BodyRotation(state(kRoll), state(kPitch), state(kYaw));
+    SrbInput forces = SrbInput::Zero();
+    double offsets[kNumLegs][3] = {};
+    for (size_t leg = 0; leg < kNumLegs; leg++) {
+      Vec<3> body_force;
+      Vec<3> body_foot;
+      for (size_t i = 0; i < 3; i++) {
+        body_force(i) = command.ff_force[3 * leg + i] * params_.force_per_unit;
+        body_foot(i) = command.cart_pos[3 * leg + i];
+      }
+      double magnitude = std::sqrt(body_force(0) * body_force(0) +
+                                   body_force(1) * body_force(1) +
+                                   body_force(2) * body_force(2));
+      if (magnitude < 1e-3) {
+        planted[leg] = false;
+        continue;
+      }
+      if (!planted[leg]) {
+        Vec<3> world_foot = r * body_foot;
+        for (size_t i = 0; i < 3; i++) {
+          feet[leg][i] = state(kPosX + i) + world_foot(i);
+        }
+        planted[leg] = true;
+      }
+      // ff_force is the foot pushing on the ground; the ground pushes back.
+      Vec<3> world_force = r * body_force;
+      for (size_t i = 0; i < 3; i++) {
+        forces(3 * leg + i) = -world_force(i);
+        offsets[leg][i] = feet[leg][i] - state(kPosX + i);
+      }
+    }
+
+    SrbSimulate(params_, state, offsets, forces, dt);
+
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    state_ = state;
+    state_micros_ = now;
+  }
+}
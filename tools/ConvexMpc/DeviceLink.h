@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.h"
+#include "SrbModel.h"
+
+// The firmware's command frames: 0x00, payload length, msgpack map (see
+// CommandInterpreter.h and test/msgpack_test.py). The MPC streams
+//   {"ff_force": [12 float32], "cart_pos": [12 float32]}
+// which is 141 bytes of payload.
+const size_t kMaxCommandFrame = 160;
+
+struct CommandFrame {
+  // Host time of the state sample the command was computed from. Not sent;
+  // used by the simulated device to measure end-to-end latency.
+  uint64_t sample_micros;
+  uint64_t send_micros;
+  uint32_t size;
+  uint8_t bytes[kMaxCommandFrame];
+};
+
+// Body-frame foot forces (force of the foot on the ground, in firmware
+// ff_force units) and body-frame foot positions [m], in firmware leg order.
+struct LegCommand {
+  float ff_force[12];
+  float cart_pos[12];
+};
+
+uint64_t NowMicros();
+
+void EncodeCommand(const LegCommand &command, CommandFrame &frame);
+
+// Minimal msgpack reader for the frames above: a map of float32 arrays.
+// Returns false on anything else.
+bool DecodeCommand(const uint8_t *bytes, size_t size, LegCommand &command);
+
+class DeviceLink {
+ public:
+  virtual ~DeviceLink() {}
+  virtual bool Send(const CommandFrame &frame) = 0;
+  // Latest measured body state. Returns false if the device has none, in
+  // which case the caller runs on its own prediction.
+  virtual bool Sample(SrbState &state, uint64_t &sample_micros) = 0;
+};
+
+// The robot over USB serial. The firmware does not estimate the body state
+// (the IMU update is disabled in main.cpp), so Sample() always fails.
+class SerialLink : public DeviceLink {
+ public:
+  SerialLink() : fd_(-1) {}
+  ~SerialLink();
+  bool Open(const char *path);
+  bool Send(const CommandFrame &frame) override;
+  bool Sample(SrbState &, uint64_t &) override { return false; }
+
+ private:
+  int fd_;
+};
+
+// Stand-in for the robot: decodes the same frames, turns ff_force back into
+// ground reaction forces on the feet that carry load and integrates
+// SrbSimulate() at the firmware control rate. A foot is planted where
+// cart_pos puts it when its force becomes non-zero and stays there until the
+// force drops to zero again. Frames arrive link_delay_micros after they are
+// sent and take effect on the next control tick.
+class SimulatedDevice : public DeviceLink {
+ public:
+  struct Stats {
+    uint32_t frames;
+    uint32_t decode_errors;
+    std::vector<uint32_t> latency_micros;  // sample -> applied
+  };
+
+  SimulatedDevice(const SrbParameters &params, uint32_t link_delay_micros,
+                  uint32_t tick_micros = 1000);
+  ~SimulatedDevice();
+
+  void Start(const SrbState &initial);
+  void Stop();
+
+  bool Send(const CommandFrame &frame) override;
+  bool Sample(SrbState &state, uint64_t &sample_micros) override;
+
+  // Valid after Stop().
+  const Stats &GetStats() const { return stats_; }
+
+ private:
+  SrbParameters params_;
+  uint32_t link_delay_micros_;
+  uint32_t tick_micros_;
+  SpscRing<CommandFrame, 64> link_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+
+  std::mutex state_mutex_;
+  SrbState state_;
+  uint64_t state_micros_;
+
+  Stats stats_;
+
+  void Run(SrbState state);
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+// Small fixed-size dense matrices for the MPC. The problem is a handful of
+// 13x13 and 13x12 blocks per horizon step, so plain arrays on the stack beat
+// any general sparse or dynamic library here; the sparsity is exploited by
+// the Riccati recursion in MpcSolver instead.
+template <size_t R, size_t C>
+struct Mat {
+  double v[R][C];
+
+  static Mat Zero() {
+    Mat m;
+    for (size_t i = 0; i < R; i++) {
+      for (size_t j = 0; j < C; j++) {
+        m.v[i][j] = 0.0;
+      }
+    }
+    return m;
+  }
+
+  static Mat Identity() {
+    Mat m = Zero();
+    for (size_t i = 0; i < R && i < C; i++) {
+      m.v[i][i] = 1.0;
+    }
+    return m;
+  }
+
+  double &operator()(size_t i, size_t j = 0) { return v[i][j]; }
+  double operator()(size_t i, size_t j = 0) const { return v[i][j]; }
+
+  Mat<C, R> Transpose() const {
+    Mat<C, R> t;
+    for (size_t i = 0; i < R; i++) {
+      for (size_t j = 0; j < C; j++) {
+        t.v[j][i] = v[i][j];
+      }
+    }
+    return t;
+  }
+
+  Mat &operator+=(const Mat &o) {
+    for (size_t i = 0; i < R; i++) {
+      for (size_t j = 0; j < C; j++) {
+        v[i][j] += o.v[i][j];
+      }
+    }
+    return *this;
+  }
+
+  Mat &operator-=(const Mat &o) {
+    for (size_t i = 0; i < R; i++) {
+      for (size_t j = 0; j < C; j++) {
+        v[i][j] -= o.v[i][j];
+      }
+    }
+    return *this;
+  }
+
+  Mat &operator*=(double s) {
+    for (size_t i = 0; i < R; i++) {
+      for (size_t j = 0; j < C; j++) {
+        v[i][j] *= s;
+      }
+    }
+    return *this;
+  }
+};
+
+template <size_t N>
+using Vec = Mat<N, 1>;
+
+template <size_t R, size_t C>
+Mat<R, C> operator+(Mat<R, C> a, const Mat<R, C> &b) {
+  return a += b;
+}
+
+template <size_t R, size_t C>
+Mat<R, C> operator-(Mat<R, C> a, const Mat<R, C> &b) {
+  return a -= b;
+}
+
+template <size_t R, size_t C>
+Mat<R, C> operator*(Mat<R, C> a, double s) {
+  return a *= s;
+}
+
+template <size_t R, size_t K, size_t C>
+Mat<R, C> operator*(const Mat<R, K> &a, const Mat<K, C> &b) {
+  Mat<R, C> m = Mat<R, C>::Zero();
+  for (size_t i = 0; i < R; i++) {
+    for (size_t k = 0; k < K; k++) {
+      double a_ik = a.v[i][k];
+      if (a_ik == 0.0) {
+        continue;
+      }
+      for (size_t j = 0; j < C; j++) {
+        m.v[i][j] += a_ik * b.v[k][j];
+      }
+    }
+  }
+  return m;
+}
+
+// a' * b without forming the transpose.
+template <size_t K, size_t R, size_t C>
+Mat<R, C> TransposeTimes(const Mat<K, R> &a, const Mat<K, C> &b) {
+  Mat<R, C> m = Mat<R, C>::Zero();
+  for (size_t k = 0; k < K; k++) {
+    for (size_t i = 0; i < R; i++) {
+      double a_ki = a.v[k][i];
+      if (a_ki == 0.0) {
+        continue;
+      }
+      for (size_t j = 0; j < C; j++) {
+        m.v[i][j] += a_ki * b.v[k][j];
+      }
+    }
+  }
+  return m;
+}
+
+// In-place Cholesky factor L (lower) of a symmetric positive definite matrix.
+// Returns false if the matrix is not positive definite.
+template <size_t N>
+bool Cholesky(Mat<N, N> &a) {
+  for (size_t j = 0; j < N; j++) {
+    double d = a.v[j][j];
+    for (size_t k = 0; k < j; k++) {
+      d -= a.v[j][k] * a.v[j][k];
+    }
+    if (d <= 0.0) {
+      return false;
+    }
+    d = std::sqrt(d);
+    a.v[j][j] = d;
+    for (size_t i = j + 1; i < N; i++) {
+      double s = a.v[i][j];
+      for (size_t k = 0; k < j; k++) {
+        s -= a.v[i][k] * a.v[j][k];
+      }
+      a.v[i][j] = s / d;
+    }
+    for (size_t i = 0; i < j; i++) {
+      a.v[i][j] = 0.0;
+    }
+  }
+  return true;
+}
+
+// Solve (L L') X = B for X, with L from Cholesky().
+template <size_t N, size_t C>
+Mat<N, C> CholeskySolve(const Mat<N, N> &l, Mat<N, C> b) {
+  for (size_t c = 0; c < C; c++) {
+    for (size_t i = 0; i < N; i++) {
+      double s = b.v[i][c];
+      for (size_t k = 0; k < i; k++) {
+        s -= l.v[i][k] * b.v[k][c];
+      }
+      b.v[i][c] = s / l.v[i][i];
+    }
+    for (size_t i = N; i-- > 0;) {
+      double s = b.v[i][c];
+      for (size_t k = i + 1; k < N; k++) {
+        s -= l.v[k][i] * b.v[k][c];
+      }
+      b.v[i][c] = s / l.v[i][i];
+    }
+  }
+  return b;
+}
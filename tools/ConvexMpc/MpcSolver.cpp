@@ -0,0 +1,177 @@
+#include "MpcSolver.h"
+
+#include <algorithm>
+#include <cmath>
+
+MpcSolver::MpcSolver(const SrbParameters &params, const MpcWeights &weights,
+                     size_t horizon, double rho, int max_iterations,
+                     double tolerance)
+    : params_(params),
+      horizon_(horizon),
+      rho_(rho),
+      max_iterations_(max_iterations),
+      tolerance_(tolerance),
+      q_(Mat<kSrbStateSize, kSrbStateSize>::Zero()),
+      r_(weights.force),
+      h_factor_(horizon),
+      gain_(horizon),
+      forces_(horizon),
+      split_(horizon),
+      dual_(horizon),
+      feedforward_(horizon),
+      previous_split_(horizon),
+      states_(horizon + 1),
+      warm_(false) {
+  for (size_t i = 0; i < kSrbStateSize; i++) {
+    q_(i, i) = weights.state[i];
+  }
+}
+
+void MpcSolver::Reset() { warm_ = false; }
+
+bool MpcSolver::Factorize(const MpcProblem &problem) {
+  Mat<kSrbStateSize, kSrbStateSize> p = q_;
+  for (size_t k = horizon_; k-- > 0;) {
+    const auto &a = problem.a[k];
+    const auto &b = problem.b[k];
+    Mat<kSrbStateSize, kSrbInputSize> pb = p * b;
+    Mat<kSrbInputSize, kSrbInputSize> h = TransposeTimes(b, pb);
+    for (size_t i = 0; i < kSrbInputSize; i++) {
+      h(i, i) += r_ + rho_;
+    }
+    Mat<kSrbInputSize, kSrbStateSize> g = TransposeTimes(pb, a);
+    if (!Cholesky(h)) {
+      return false;
+    }
+    h_factor_[k] = h;
+    gain_[k] = CholeskySolve(h, g) * -1.0;
+    // P = Q + A'PA + G'K
+    p = q_ + TransposeTimes(a, p * a) + TransposeTimes(g, gain_[k]);
+  }
+  return true;
+}
+
+void MpcSolver::SolveLq(const MpcProblem &problem) {
+  // Backward pass for the affine terms. The force cost picks up the ADMM
+  // penalty rho/2 |f - (z - u)|^2.
+  Vec<kSrbStateSize> p = (q_ * problem.reference[horizon_]) * -1.0;
+  for (size_t k = horizon_; k-- > 0;) {
+    SrbInput h = TransposeTimes(problem.b[k], p) - (split_[k] - dual_[k]) * rho_;
+    feedforward_[k] = CholeskySolve(h_factor_[k], h) * -1.0;
+    // p = q + A'p + K'h
+    Vec<kSrbStateSize> next = TransposeTimes(problem.a[k], p) +
+                              TransposeTimes(gain_[k], h);
+    if (k > 0) {
+      next -= q_ * problem.reference[k];
+    }
+    p = next;
+  }
+
+  // Forward rollout.
+  states_[0] = problem.initial;
+  for (size_t k = 0; k < horizon_; k++) {
+    forces_[k] = gain_[k] * states_[k] + feedforward_[k];
+    states_[k + 1] = problem.a[k] * states_[k] + problem.b[k] * forces_[k];
+  }
+}
+
+void MpcSolver::Project(const std::array<bool, kNumLegs> &stance,
+                        SrbInput &f) const {
+  const double mu = params_.friction;
+  const double f_max = params_.max_normal_force;
+  for (size_t leg = 0; leg < kNumLegs; leg++) {
+    double &fx = f(3 * leg);
+    double &fy = f(3 * leg + 1);
+    double &fz = f(3 * leg + 2);
+    if (!stance[leg]) {
+      fx = fy = fz = 0.0;
+      continue;
+    }
+    // Work in the (s, t) plane: s = |(fx, fy)|, t = fz. The feasible set is
+    // s <= mu t, t <= f_max.
+    double s = std::sqrt(fx * fx + fy * fy);
+    double t = fz;
+    double s_new = s;
+    double t_new = t;
+    if (s > mu * t) {
+      double c = (mu * s + t) / (1.0 + mu * mu);
+      if (c <= 0.0) {
+        fx = fy = fz = 0.0;
+        continue;
+      }
+      s_new = mu * c;
+      t_new = c;
+    }
+    if (t_new > f_max) {
+      if (s <= mu * f_max) {
+        s_new = s;
+      } else {
+        s_new = mu * f_max;
+      }
+      t_new = f_max;
+    }
+    double scale = s > 1e-12 ? s_new / s : 0.0;
+    fx *= scale;
+    fy *= scale;
+    fz = t_new;
+  }
+}
+
+MpcSolver::Result MpcSolver::Solve(const MpcProblem &problem) {
+  Result result = {};
+  if (!Factorize(problem)) {
+    warm_ = false;
+    return result;
+  }
+
+  if (warm_) {
+    // Shift the previous solution by one step.
+    for (size_t k = 0; k + 1 < horizon_; k++) {
+      split_[k] = split_[k + 1];
+      dual_[k] = dual_[k + 1];
+    }
+  } else {
+    // Start from the weight shared between the feet on the ground.
+    for (size_t k = 0; k < horizon_; k++) {
+      size_t feet = std::count(problem.stance[k].begin(),
+                               problem.stance[k].end(), true);
+      split_[k] = SrbInput::Zero();
+      dual_[k] = SrbInput::Zero();
+      for (size_t leg = 0; leg < kNumLegs && feet > 0; leg++) {
+        if (problem.stance[k][leg]) {
+          split_[k](3 * leg + 2) = -params_.mass * kGravityAcceleration / feet;
+        }
+      }
+    }
+  }
+
+  for (int iteration = 1; iteration <= max_iterations_; iteration++) {
+    SolveLq(problem);
+    double primal = 0.0;
+    double dual = 0.0;
+    for (size_t k = 0; k < horizon_; k++) {
+      previous_split_[k] = split_[k];
+      SrbInput z = forces_[k] + dual_[k];
+      Project(problem.stance[k], z);
+      split_[k] = z;
+      for (size_t i = 0; i < kSrbInputSize; i++) {
+        double r = forces_[k](i) - z(i);
+        dual_[k](i) += r;
+        primal = std::max(primal, std::fabs(r));
+        dual = std::max(dual,
+                        rho_ * std::fabs(z(i) - previous_split_[k](i)));
+      }
+    }
+    result.iterations = iteration;
+    result.primal_residual = primal;
+    result.dual_residual = dual;
+    if (primal < tolerance_ && dual < tolerance_) {
+      result.converged = true;
+      break;
+    }
+  }
+
+  warm_ = true;
+  result.forces = split_[0];
+  return result;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "SrbModel.h"
+
+// Convex MPC over the single rigid body model:
+//
+//   min  sum_k 1/2 |x_k+1 - ref_k+1|^2_Q + 1/2 |f_k|^2_R
+//   s.t. x_k+1 = A_k x_k + B_k f_k
+//        f_k,leg in the friction cone with 0 <= f_z <= max_normal_force
+//        f_k,leg = 0 for legs in swing
+//
+// The QP is sparse: every constraint couples only neighbouring steps. It is
+// solved with ADMM, splitting the forces from their constraint sets. The
+// equality-constrained step of each iteration is an LQ problem, solved by a
+// Riccati recursion whose factorisation is computed once per solve (it only
+// depends on rho), so an iteration is one backward and one forward pass,
+// O(N) in the horizon. The projections onto the truncated cones are closed
+// form. Each solve is warm-started from the previous solution shifted by one
+// step.
+struct MpcWeights {
+  double state[kSrbStateSize] = {5,  5,  10,  1,   1,   50,  0.1,
+                                 0.1, 0.3, 2,  2,   1,   0};
+  double force = 1e-4;
+};
+
+struct MpcProblem {
+  SrbState initial;
+  // Horizon + 1 reference states; ref[0] is ignored.
+  std::vector<SrbState> reference;
+  std::vector<Mat<kSrbStateSize, kSrbStateSize>> a;
+  std::vector<Mat<kSrbStateSize, kSrbInputSize>> b;
+  std::vector<std::array<bool, kNumLegs>> stance;
+};
+
+class MpcSolver {
+ public:
+  struct Result {
+    SrbInput forces;  // first step, feasible
+    int iterations;
+    double primal_residual;
+    double dual_residual;
+    bool converged;
+  };
+
+  MpcSolver(const SrbParameters &params, const MpcWeights &weights,
+            size_t horizon, double rho = 0.05, int max_iterations = 200,
+            double tolerance = 1e-2);
+
+  size_t Horizon() const { return horizon_; }
+
+  Result Solve(const MpcProblem &problem);
+
+  // Solution of the last Solve(): feasible forces for step k < Horizon()
+  // and the states they lead to, k <= Horizon().
+  const SrbInput &Force(size_t k) const { return split_[k]; }
+  const SrbState &Predicted(size_t k) const { return states_[k]; }
+
+  // Forget the warm start, e.g. after the robot was repositioned.
+  void Reset();
+
+ private:
+  SrbParameters params_;
+  size_t horizon_;
+  double rho_;
+  int max_iterations_;
+  double tolerance_;
+  Mat<kSrbStateSize, kSrbStateSize> q_;
+  double r_;
+
+  // Riccati factorisation, per step.
+  std::vector<Mat<kSrbInputSize, kSrbInputSize>> h_factor_;
+  std::vector<Mat<kSrbInputSize, kSrbStateSize>> gain_;
+  // ADMM iterates, per step.
+  std::vector<SrbInput> forces_;
+  std::vector<SrbInput> split_;
+  std::vector<SrbInput> dual_;
+  std::vector<SrbInput> feedforward_;
+  std::vector<SrbInput> previous_split_;
+  std::vector<SrbState> states_;
+  bool warm_;
+
+  bool Factorize(const MpcProblem &problem);
+  void SolveLq(const MpcProblem &problem);
+  void Project(const std::array<bool, kNumLegs> &stance, SrbInput &f) const;
+};
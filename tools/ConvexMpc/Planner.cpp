@@ -0,0 +1,180 @@
+#include "Planner.h"
+
+#include <algorithm>
+#include <cmath>
+
+Planner::Planner(const SrbParameters &params, const Gait &gait,
+                 size_t horizon, double dt)
+    : params_(params),
+      gait_(gait),
+      horizon_(std::min(horizon, kMaxHorizon)),
+      dt_(dt),
+      vx_(0.0),
+      vy_(0.0),
+      yaw_rate_(0.0),
+      swing_height_(0.04),
+      time_(0.0) {
+  Reset(SrbState::Zero());
+}
+
+void Planner::SetCommand(double vx, double vy, double yaw_rate) {
+  vx_ = vx;
+  vy_ = vy;
+  yaw_rate_ = yaw_rate;
+}
+
+void Planner::CommandedVelocity(double yaw, double velocity[3]) const {
+  velocity[0] = std::cos(yaw) * vx_ - std::sin(yaw) * vy_;
+  velocity[1] = std::sin(yaw) * vx_ + std::cos(yaw) * vy_;
+  velocity[2] = 0.0;
+}
+
+void Planner::Reset(const SrbState &x) {
+  Mat<3, 3> r = BodyRotation(0.0, 0.0, x(kYaw));
+  for (size_t leg = 0; leg < kNumLegs; leg++) {
+    double nominal[3];
+    NominalFoot(params_, leg, nominal);
+    for (size_t i = 0; i < 2; i++) {
+      foothold_[leg][i] =
+          x(kPosX + i) + r(i, 0) * nominal[0] + r(i, 1) * nominal[1];
+      liftoff_[leg][i] = foothold_[leg][i];
+    }
+    foothold_[leg][2] = liftoff_[leg][2] = 0.0;
+    stance_[leg] = true;
+  }
+}
+
+void Planner::PredictFoothold(const SrbState &x, size_t leg, double delay,
+                              double foot[3]) const {
+  double velocity[3];
+  CommandedVelocity(x(kYaw), velocity);
+  double yaw = x(kYaw) + yaw_rate_ * delay;
+  double nominal[3];
+  NominalFoot(params_, leg, nominal);
+  double stance_time = gait_.duty * gait_.period;
+  // Capture point style correction for the velocity error.
+  double gain = 0.5 * std::sqrt(params_.standing_height / -kGravityAcceleration);
+  for (size_t i = 0; i < 2; i++) {
+    double hip = i == 0 ? std::cos(yaw) * nominal[0] - std::sin(yaw) * nominal[1]
+                        : std::sin(yaw) * nominal[0] + std::cos(yaw) * nominal[1];
+    foot[i] = x(kPosX + i) + velocity[i] * (delay + 0.5 * stance_time) + hip +
+              gain * (x(kVelX + i) - velocity[i]);
+  }
+  foot[2] = 0.0;
+}
+
+void Planner::FootAt(const SrbState &x, size_t leg, double time,
+                     double foot[3]) const {
+  double period = gait_.period;
+  double duty = gait_.duty;
+  // The touchdown that foothold_ refers to.
+  double known_touchdown =
+      stance_[leg] ? time_
+                   : time_ + (1.0 - gait_.Phase(leg, time_)) * period;
+  double phase = gait_.Phase(leg, time);
+  if (phase < duty) {
+    double touchdown = time - phase * period;
+    if (touchdown <= known_touchdown + 1e-9) {
+      std::copy(foothold_[leg], foothold_[leg] + 3, foot);
+    } else {
+      PredictFoothold(x, leg, touchdown - time_, foot);
+    }
+    return;
+  }
+
+  double liftoff = time - (phase - duty) * period;
+  double touchdown = liftoff + (1.0 - duty) * period;
+  const double *start = liftoff <= time_ ? liftoff_[leg] : foothold_[leg];
+  double target[3];
+  if (touchdown <= known_touchdown + 1e-9) {
+    std::copy(foothold_[leg], foothold_[leg] + 3, target);
+  } else {
+    PredictFoothold(x, leg, touchdown - time_, target);
+  }
+  double s = (phase - duty) / (1.0 - duty);
+  for (size_t i = 0; i < 3; i++) {
+    foot[i] = start[i] + (target[i] - start[i]) * s;
+  }
+  foot[2] += swing_height_ * std::sin(M_PI * s);
+}
+
+void Planner::Build(const SrbState &x, double time, MpcProblem &problem) {
+  time_ = time;
+  for (size_t leg = 0; leg < kNumLegs; leg++) {
+    bool stance = gait_.InStance(leg, time);
+    if (stance_[leg] && !stance) {
+      std::copy(foothold_[leg], foothold_[leg] + 3, liftoff_[leg]);
+    }
+    if (!stance) {
+      double delay = (1.0 - gait_.Phase(leg, time)) * gait_.period;
+      PredictFoothold(x, leg, delay, foothold_[leg]);
+    }
+    stance_[leg] = stance;
+  }
+
+  double velocity[3];
+  CommandedVelocity(x(kYaw), velocity);
+  problem.initial = x;
+  problem.initial(kGravity) = kGravityAcceleration;
+  problem.reference.resize(horizon_ + 1);
+  problem.a.resize(horizon_);
+  problem.b.resize(horizon_);
+  problem.stance.resize(horizon_);
+  for (size_t k = 0; k <= horizon_; k++) {
+    double t = k * dt_;
+    SrbState &reference = problem.reference[k];
+    reference = SrbState::Zero();
+    reference(kYaw) = x(kYaw) + yaw_rate_ * t;
+    for (size_t i = 0; i < 2; i++) {
+      reference(kPosX + i) = x(kPosX + i) + velocity[i] * t;
+      reference(kVelX + i) = velocity[i];
+    }
+    reference(kPosZ) = params_.standing_height;
+    reference(kOmegaZ) = yaw_rate_;
+    reference(kGravity) = kGravityAcceleration;
+    for (size_t leg = 0; leg < kNumLegs; leg++) {
+      FootAt(x, leg, time + t, feet_[k][leg]);
+    }
+    if (k == horizon_) {
+      break;
+    }
+
+    // Contacts and lever arms at the middle of the step.
+    double offsets[kNumLegs][3];
+    for (size_t leg = 0; leg < kNumLegs; leg++) {
+      double foot[3];
+      FootAt(x, leg, time + t + 0.5 * dt_, foot);
+      for (size_t i = 0; i < 3; i++) {
+        offsets[leg][i] = foot[i] - reference(kPosX + i);
+      }
+      problem.stance[k][leg] = gait_.InStance(leg, time + t + 0.5 * dt_);
+    }
+    SrbDiscreteDynamics(params_, reference(kYaw), offsets, dt_, problem.a[k],
+                        problem.b[k]);
+  }
+}
+
+void Planner::FillPlan(const MpcSolver &solver, Plan &plan) const {
+  plan.dt = dt_;
+  plan.steps = horizon_;
+  for (size_t k = 0; k <= horizon_; k++) {
+    const SrbState &x = solver.Predicted(k);
+    Mat<3, 3> r = BodyRotation(x(kRoll), x(kPitch), x(kYaw));
+    const SrbInput &f = solver.Force(std::min(k, horizon_ - 1));
+    LegCommand &command = plan.commands[k];
+    for (size_t leg = 0; leg < kNumLegs; leg++) {
+      Vec<3> force;
+      Vec<3> foot;
+      for (size_t i = 0; i < 3; i++) {
+        force(i) = f(3 * leg + i);
+        foot(i) = feet_[k][leg][i] - x(kPosX + i);
+      }
+      Vec<3> body_force = TransposeTimes(r, force);
+      Vec<3> body_foot = TransposeTimes(r, foot);
+      for (size_t i = 0; i < 3; i++) {
+        command.ff_force[3 * leg + i] = -body_force(i) / params_.force_per_unit;
+        command.cart_pos[3 * leg + i] = body_foot(i);
+      }
+    }
+  }
+}
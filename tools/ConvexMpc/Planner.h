@@ -0,0 +1,68 @@
+#pragma once
+
+#include "DeviceLink.h"
+#include "MpcSolver.h"
+
+const size_t kMaxHorizon = 32;
+
+// What the solver thread hands to the streaming thread: one leg command per
+// MPC step, starting at the state sample. Trivially copyable so that it can
+// go through SpscRing.
+struct Plan {
+  uint64_t sample_micros;
+  double dt;
+  uint32_t steps;
+  LegCommand commands[kMaxHorizon + 1];
+};
+
+// Builds the MPC problem for a trot at a commanded body velocity: reference
+// trajectory, contact schedule from the gait, and footholds. Stance feet stay
+// where they touched down; swing feet land at a Raibert-style foothold under
+// the hip, half a stance ahead. The ground is z = 0. Not thread safe; owned
+// by the solver thread.
+class Planner {
+ public:
+  Planner(const SrbParameters &params, const Gait &gait, size_t horizon,
+          double dt);
+
+  // Body-frame velocity command.
+  void SetCommand(double vx, double vy, double yaw_rate);
+
+  // Footholds under the hips of a robot standing at x.
+  void Reset(const SrbState &x);
+
+  // x sampled at time [s] on the gait clock.
+  void Build(const SrbState &x, double time, MpcProblem &problem);
+
+  // Converts the solution into firmware commands: ff_force is the foot force
+  // on the ground in the body frame, cart_pos the body-frame foot target.
+  void FillPlan(const MpcSolver &solver, Plan &plan) const;
+
+  // Commanded world-frame velocity and yaw rate for a body at yaw.
+  void CommandedVelocity(double yaw, double velocity[3]) const;
+  double YawRate() const { return yaw_rate_; }
+
+ private:
+  SrbParameters params_;
+  Gait gait_;
+  size_t horizon_;
+  double dt_;
+  double vx_;
+  double vy_;
+  double yaw_rate_;
+  double swing_height_;
+
+  double foothold_[kNumLegs][3];  // current stance, or next touchdown
+  double liftoff_[kNumLegs][3];   // where the current swing started
+  bool stance_[kNumLegs];
+
+  // Built with the problem, consumed by FillPlan().
+  double time_;
+  double feet_[kMaxHorizon + 1][kNumLegs][3];  // world
+
+  void PredictFoothold(const SrbState &x, size_t leg, double delay,
+                       double foot[3]) const;
+  // World position of the foot at time on the current plan.
+  void FootAt(const SrbState &x, size_t leg, double time,
+              double foot[3]) const;
+};
@@ -0,0 +1,149 @@
+#include "SrbModel.h"
+
+#include <cmath>
+
+namespace {
+
+// World-frame inverse inertia R diag(1 / inertia) R'.
+Mat<3, 3> InverseInertia(const SrbParameters &params, const Mat<3, 3> &r) {
+  Mat<3, 3> scaled = r;
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      scaled.v[i][j] /= params.inertia[j];
+    }
+  }
+  return scaled * r.Transpose();
+}
+
+Mat<3, 3> Skew(const double p[3]) {
+  Mat<3, 3> s = Mat<3, 3>::Zero();
+  s(0, 1) = -p[2];
+  s(0, 2) = p[1];
+  s(1, 0) = p[2];
+  s(1, 2) = -p[0];
+  s(2, 0) = -p[1];
+  s(2, 1) = p[0];
+  return s;
+}
+
+Mat<3, 3> RotationZ(double yaw) {
+  Mat<3, 3> r = Mat<3, 3>::Identity();
+  r(0, 0) = std::cos(yaw);
+  r(0, 1) = -std::sin(yaw);
+  r(1, 0) = std::sin(yaw);
+  r(1, 1) = std::cos(yaw);
+  return r;
+}
+
+}  // namespace
+
+Mat<3, 3> BodyRotation(double roll, double pitch, double yaw) {
+  Mat<3, 3> ry = Mat<3, 3>::Identity();
+  ry(0, 0) = std::cos(pitch);
+  ry(0, 2) = std::sin(pitch);
+  ry(2, 0) = -std::sin(pitch);
+  ry(2, 2) = std::cos(pitch);
+  Mat<3, 3> rx = Mat<3, 3>::Identity();
+  rx(1, 1) = std::cos(roll);
+  rx(1, 2) = -std::sin(roll);
+  rx(2, 1) = std::sin(roll);
+  rx(2, 2) = std::cos(roll);
+  return RotationZ(yaw) * ry * rx;
+}
+
+void NominalFoot(const SrbParameters &params, size_t leg, double foot[3]) {
+  foot[0] = leg < 2 ? params.foot_x : -params.foot_x;
+  foot[1] = leg % 2 == 0 ? -params.foot_y : params.foot_y;
+  foot[2] = -params.standing_height;
+}
+
+void SrbDiscreteDynamics(const SrbParameters &params, double yaw,
+                         const double foot_offsets[kNumLegs][3], double dt,
+                         Mat<kSrbStateSize, kSrbStateSize> &a,
+                         Mat<kSrbStateSize, kSrbInputSize> &b) {
+  Mat<3, 3> rz = RotationZ(yaw);
+  a = Mat<kSrbStateSize, kSrbStateSize>::Identity();
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      // Euler angle rates from world angular velocity: Rz' omega.
+      a(kRoll + i, kOmegaX + j) = rz(j, i) * dt;
+    }
+    a(kPosX + i, kVelX + i) = dt;
+  }
+  a(kVelZ, kGravity) = dt;
+
+  Mat<3, 3> inverse_inertia = InverseInertia(params, rz);
+  b = Mat<kSrbStateSize, kSrbInputSize>::Zero();
+  for (size_t leg = 0; leg < kNumLegs; leg++) {
+    Mat<3, 3> torque = inverse_inertia * Skew(foot_offsets[leg]);
+    for (size_t i = 0; i < 3; i++) {
+      for (size_t j = 0; j < 3; j++) {
+        b(kOmegaX + i, 3 * leg + j) = torque(i, j) * dt;
+      }
+      b(kVelX + i, 3 * leg + i) = dt / params.mass;
+    }
+  }
+}
+
+void SrbSimulate(const SrbParameters &params, SrbState &x,
+                 const double foot_offsets[kNumLegs][3], const SrbInput &forces,
+                 double dt) {
+  Mat<3, 3> r = BodyRotation(x(kRoll), x(kPitch), x(kYaw));
+  Mat<3, 3> inverse_inertia = InverseInertia(params, r);
+
+  Vec<3> torque = Vec<3>::Zero();
+  Vec<3> force = Vec<3>::Zero();
+  for (size_t leg = 0; leg < kNumLegs; leg++) {
+    Vec<3> f;
+    for (size_t i = 0; i < 3; i++) {
+      f(i) = forces(3 * leg + i);
+      force(i) += f(i);
+    }
+    torque += Skew(foot_offsets[leg]) * f;
+  }
+
+  // Gyroscopic term omega x (I omega), with I = R diag(inertia) R'.
+  Vec<3> omega;
+  for (size_t i = 0; i < 3; i++) {
+    omega(i) = x(kOmegaX + i);
+  }
+  Vec<3> body_omega = TransposeTimes(r, omega);
+  for (size_t i = 0; i < 3; i++) {
+    body_omega(i) *= params.inertia[i];
+  }
+  Vec<3> momentum = r * body_omega;
+  double w[3] = {omega(0), omega(1), omega(2)};
+  torque -= Skew(w) * momentum;
+
+  // Semi-implicit Euler: velocities first, then positions and angles.
+  Vec<3> angular_acceleration = inverse_inertia * torque;
+  for (size_t i = 0; i < 3; i++) {
+    x(kOmegaX + i) += angular_acceleration(i) * dt;
+    x(kVelX + i) += force(i) / params.mass * dt;
+  }
+  x(kVelZ) += kGravityAcceleration * dt;
+  for (size_t i = 0; i < 3; i++) {
+    x(kPosX + i) += x(kVelX + i) * dt;
+  }
+
+  // ZYX Euler angle rates from the world-frame angular velocity.
+  double cy = std::cos(x(kYaw));
+  double sy = std::sin(x(kYaw));
+  double cp = std::cos(x(kPitch));
+  double sp = std::sin(x(kPitch));
+  double wx = x(kOmegaX);
+  double wy = x(kOmegaX + 1);
+  double wz = x(kOmegaZ);
+  double roll_rate = (cy * wx + sy * wy) / cp;
+  double pitch_rate = -sy * wx + cy * wy;
+  double yaw_rate = wz + sp * roll_rate;
+  x(kRoll) += roll_rate * dt;
+  x(kPitch) += pitch_rate * dt;
+  x(kYaw) += yaw_rate * dt;
+  x(kGravity) = kGravityAcceleration;
+}
+
+double Gait::Phase(size_t leg, double time) const {
+  double phase = time / period + offsets[leg];
+  return phase - std::floor(phase);
+}
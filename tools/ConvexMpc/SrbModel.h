@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Matrix.h"
+
+// Single rigid body model of the robot for the MPC: massless legs, all the
+// mass in the body, and ground reaction forces at the feet as inputs.
+//
+// State (13): roll, pitch, yaw, position (3), angular velocity (3, world
+// frame), linear velocity (3, world frame), and gravity as a constant state
+// so that the dynamics stay linear: x' = A x + B f.
+// Input (12): ground reaction force on the body at each foot, world frame,
+// in firmware leg order (front right, front left, back right, back left).
+
+const size_t kSrbStateSize = 13;
+const size_t kSrbInputSize = 12;
+const size_t kNumLegs = 4;
+const double kGravityAcceleration = -9.81;  // [m/s^2] along world z
+
+typedef Vec<kSrbStateSize> SrbState;
+typedef Vec<kSrbInputSize> SrbInput;
+
+enum SrbIndex {
+  kRoll = 0,
+  kPitch = 1,
+  kYaw = 2,
+  kPosX = 3,
+  kPosY = 4,
+  kPosZ = 5,
+  kOmegaX = 6,
+  kOmegaZ = 8,
+  kVelX = 9,
+  kVelY = 10,
+  kVelZ = 11,
+  kGravity = 12,
+};
+
+struct SrbParameters {
+  double mass = 2.0;                               // [kg]
+  double inertia[3] = {0.003, 0.0156, 0.0174};     // [kg m^2] body frame
+  double friction = 0.6;
+  double max_normal_force = 30.0;                  // [N] per foot
+  double standing_height = 0.14;                   // [m]
+  // Nominal foot positions in the body frame, as in the cart_pos example in
+  // test/msgpack_test.py.
+  double foot_x = 0.1;                             // [m]
+  double foot_y = 0.07;                            // [m]
+  // The firmware's ff_force is in current units: 10 A ~ 2.5 Nm at the
+  // output, see test/msgpack_test.py. Newtons per ff_force unit.
+  double force_per_unit = 0.25;
+};
+
+// Body to world rotation for ZYX (yaw, pitch, roll) Euler angles.
+Mat<3, 3> BodyRotation(double roll, double pitch, double yaw);
+
+// Nominal body-frame position of a foot (z is -standing_height).
+void NominalFoot(const SrbParameters &params, size_t leg, double foot[3]);
+
+// Discrete dynamics for one step of length dt with the body at the given
+// yaw and the feet at foot_offsets (world-aligned, relative to the centre of
+// mass). Uses the usual small roll and pitch approximation.
+void SrbDiscreteDynamics(const SrbParameters &params, double yaw,
+                         const double foot_offsets[kNumLegs][3], double dt,
+                         Mat<kSrbStateSize, kSrbStateSize> &a,
+                         Mat<kSrbStateSize, kSrbInputSize> &b);
+
+// Nonlinear rigid body step for the simulated device, with full rotation and
+// gyroscopic terms. forces are world frame.
+void SrbSimulate(const SrbParameters &params, SrbState &x,
+                 const double foot_offsets[kNumLegs][3], const SrbInput &forces,
+                 double dt);
+
+// Trot: diagonal pairs alternate, each foot on the ground for duty of the
+// period.
+struct Gait {
+  double period = 0.3;  // [s]
+  double duty = 0.5;
+  double offsets[kNumLegs] = {0.0, 0.5, 0.5, 0.0};
+
+  // Phase of the leg in [0, 1); stance is [0, duty).
+  double Phase(size_t leg, double time) const;
+  bool InStance(size_t leg, double time) const {
+    return Phase(leg, time) < duty;
+  }
+};
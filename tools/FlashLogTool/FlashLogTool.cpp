@@ -0,0 +1,193 @@
+// Host front end for FlashLogSink on a file-backed flash image.
+//
+//   flash_log_tool read <image>
+//       Print every stored row of an existing image, oldest first, as comma
+//       separated text with a "Signals: <mask>" line wherever the logged
+//       signals change, the same as {"dump_flash_log": true} prints on the
+//       robot. The firmware has no raw image dump, so the images are the ones
+//       simulate writes.
+//   flash_log_tool simulate <image> <num_columns> <num_rows> [resets]
+//                           [seconds]
+//       Log synthetic rows at 100 Hz through the same code the firmware
+//       runs, with erases that stay busy for a while as on the flash, and
+//       optional resets (re-Begin without Flush) spread over the run. After
+//       every reset, and at the end, read the image back and check that every
+//       row matches the one written, bit for bit, in order, up to the newest
+//       one written, that the rows missing in between are no more than the
+//       resets and drops account for, and that at least the last seconds of
+//       rows before the reset are there. Also checks that the log never
+//       touched the flash while an erase was busy.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "FlashLogSink.h"
+#include "LogStorage.h"
+
+namespace {
+
+// Same geometry as the firmware: 64 x 4 KB sectors of program flash.
+const uint32_t kSectorSize = 4096;
+const uint32_t kNumSectors = 64;
+
+// A sector erase takes about 45 ms and the firmware services the log many
+// times per 10 ms row; the simulation services it twice per row, so an erase
+// stays busy for 9 polls.
+const uint32_t kErasePolls = 9;
+const uint32_t kRowsPerSecond = 100;
+
+void PrintRow(const float *row, uint32_t num_columns, uint32_t tag,
+              void *context) {
+  uint32_t *last_tag = static_cast<uint32_t *>(context);
+  if (tag != *last_tag) {
+    printf("Signals: %u\n", tag);
+    *last_tag = tag;
+  }
+  for (uint32_t i = 0; i < num_columns; i++) {
+    printf("%g,", row[i]);
+  }
+  printf("\n");
+}
+
+// Row index, slow sines and a few zeroed columns.
+void SyntheticRow(uint32_t n, std::vector<float> &row) {
+  row[0] = n;
+  for (uint32_t i = 1; i < row.size(); i++) {
+    row[i] = i % 7 >= 4 ? 0.0f : sinf(0.001f * n * i) * i;
+  }
+}
+
+struct CheckContext {
+  std::vector<float> expected;
+  uint32_t num_rows = 0;
+  uint32_t out_of_order = 0;
+  uint32_t mismatched = 0;
+  float first_index = -1;
+  float last_index = -1;
+};
+
+void CheckRow(const float *row, uint32_t num_columns, uint32_t,
+              void *context) {
+  CheckContext *check = static_cast<CheckContext *>(context);
+  if (row[0] <= check->last_index) {
+    check->out_of_order++;
+  }
+  SyntheticRow(static_cast<uint32_t>(row[0]), check->expected);
+  if (num_columns != check->expected.size() ||
+      memcmp(row, check->expected.data(), num_columns * sizeof(float))) {
+    check->mismatched++;
+  }
+  if (check->num_rows == 0) {
+    check->first_index = row[0];
+  }
+  check->last_index = row[0];
+  check->num_rows++;
+}
+
+// Read the log back and check it against the rows up to newest, of which
+// at most lost_rows may be missing at the end. Returns true if it passes.
+bool CheckReadBack(FlashLogSink &sink, uint32_t num_columns, uint32_t newest,
+                   uint32_t lost_rows, uint32_t allowed_missing,
+                   uint32_t history_rows) {
+  CheckContext check;
+  check.expected.resize(num_columns);
+  sink.ReadAll(CheckRow, &check);
+  uint32_t missing =
+      check.num_rows ? check.last_index - check.first_index + 1 - check.num_rows
+                     : newest + 1;
+  uint32_t history = check.num_rows ? newest + 1 - check.first_index : 0;
+  printf("read back %u rows (%.0f to %.0f, %.1f s), missing %u, out of order "
+         "%u, mismatched %u\n",
+         check.num_rows, check.first_index, check.last_index,
+         (double)history / kRowsPerSecond, missing, check.out_of_order,
+         check.mismatched);
+  return check.num_rows > 0 && check.out_of_order == 0 &&
+         check.mismatched == 0 && missing <= allowed_missing &&
+         check.last_index + lost_rows >= newest &&
+         history >= std::min(history_rows, newest + 1);
+}
+
+int Simulate(const char *path, uint32_t num_columns, uint32_t num_rows,
+             uint32_t resets, uint32_t seconds) {
+  FileLogStorage storage(kSectorSize, kNumSectors);
+  if (!storage.Open(path, true)) {
+    fprintf(stderr, "Could not open %s\n", path);
+    return 1;
+  }
+  storage.SetEraseLatency(kErasePolls);
+  FlashLogSink sink;
+  if (!sink.Begin(storage) || !sink.SetRowFormat(num_columns, 0)) {
+    fprintf(stderr, "Could not start the log\n");
+    return 1;
+  }
+  // A reset loses the rows still staged: at most two chunks.
+  uint32_t rows_per_chunk = FlashLogSink::kStagingBytes / (num_columns * 4);
+  rows_per_chunk = rows_per_chunk > 255 ? 255 : rows_per_chunk;
+  uint32_t history_rows = seconds * kRowsPerSecond;
+  const FlashLogSink::Stats &stats = sink.GetStats();
+
+  bool ok = true;
+  std::vector<float> row(num_columns, 0.0f);
+  uint32_t reset_every = resets ? num_rows / (resets + 1) : 0;
+  uint32_t num_resets = 0;
+  for (uint32_t n = 0; n < num_rows; n++) {
+    SyntheticRow(n, row);
+    sink.Append(row.data());
+    // The firmware services several times per tick, in motion or not.
+    sink.Service();
+    sink.Service();
+    if (reset_every && n > 0 && n % reset_every == 0) {
+      num_resets++;
+      sink.Begin(storage);
+      sink.SetRowFormat(num_columns, 0);
+      printf("reset after row %u: ", n);
+      ok &= CheckReadBack(
+          sink, num_columns, n, 2 * rows_per_chunk,
+          stats.dropped_rows + 2 * rows_per_chunk * num_resets, history_rows);
+    }
+  }
+  sink.Flush();
+
+  printf("end: ");
+  ok &= CheckReadBack(sink, num_columns, num_rows - 1, 0,
+                      stats.dropped_rows + 2 * rows_per_chunk * resets,
+                      history_rows);
+  printf("chunks %u, raw %u B, stored %u B (ratio %.2f)\n",
+         stats.chunks_written, stats.raw_bytes, stats.bytes_written,
+         stats.bytes_written ? (double)stats.raw_bytes / stats.bytes_written
+                             : 0.0);
+  printf("dropped rows %u, max erase count %u, flash accesses during an "
+         "erase %u\n",
+         stats.dropped_rows, stats.max_erase_count, storage.Stalls());
+  return ok && storage.Stalls() == 0 ? 0 : 1;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc >= 3 && !strcmp(argv[1], "read")) {
+    FileLogStorage storage(kSectorSize, kNumSectors);
+    FlashLogSink sink;
+    if (!storage.Open(argv[2], false) || !sink.Begin(storage)) {
+      fprintf(stderr, "Could not read %s\n", argv[2]);
+      return 1;
+    }
+    uint32_t last_tag = 0xffffffff;
+    sink.ReadAll(PrintRow, &last_tag);
+    return 0;
+  }
+  if (argc >= 5 && !strcmp(argv[1], "simulate")) {
+    return Simulate(argv[2], atoi(argv[3]), atoi(argv[4]),
+                    argc >= 6 ? atoi(argv[5]) : 0,
+                    argc >= 7 ? atoi(argv[6]) : 0);
+  }
+  fprintf(stderr,
+          "usage: flash_log_tool read <image>\n"
+          "       flash_log_tool simulate <image> <num_columns> <num_rows> "
+          "[resets] [seconds]\n");
+  return 1;
+}
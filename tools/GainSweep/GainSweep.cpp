@@ -0,0 +1,432 @@
+// Offline gain and parameter sweep for the joint PD and cartesian control
+// laws. Runs the firmware's PD() and CartesianLegControl() against LegPlant at
+// the firmware control rate, over a grid or a random sample of parameters,
+// and prints the candidates ranked by tracking error.
+//
+// Usage:
+//   gain_sweep [--mode joint|cartesian] [--grid N | --samples N] [--seed S]
+//              [--kp lo:hi] [--kd lo:hi] [--knee-limit lo:hi]
+//              [--max-current lo:hi] [--knee-kp KP] [--threads T] [--top K]
+//              [--sort rms|overshoot|peak] [--csv path]
+//
+// Joint mode gains are in [A/rad] and [A s/rad], cartesian gains are the
+// diagonal of SetCartesianKp3x3/SetCartesianKd3x3 in [A/m] and [A s/m].
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Kinematics.h"
+#include "LegControl.h"
+#include "LegPlant.h"
+#include "PID.h"
+#include "Utils.h"
+#include "../common/WorkStealingPool.h"
+
+namespace {
+
+const float kControlPeriod = 0.001;  // [s], CONTROL_DELAY in main.cpp
+const int kPlantSubsteps = 4;
+const float kStepDuration = 0.5;   // [s] step response window
+const float kTrackDuration = 1.0;  // [s] sinusoid tracking window
+const float kTrackFrequency = 2.0;  // [Hz]
+
+enum class SweepMode { kJoint, kCartesian };
+enum class SortKey { kRms, kOvershoot, kPeak };
+
+struct Range {
+  float lo;
+  float hi;
+};
+
+struct SweepConfig {
+  SweepMode mode = SweepMode::kJoint;
+  Range kp = {2.0, 20.0};
+  Range kd = {0.1, 4.0};
+  Range knee_limit = {-PI / 6, -PI / 6};
+  Range max_current = {1.0, 6.0};
+  float knee_kp = 8.0;  // DEFAULT_GAINS.kp
+  int grid = 12;
+  int samples = 0;  // > 0 selects random sampling
+  unsigned seed = 1;
+  size_t threads = 0;
+  size_t top = 20;
+  SortKey sort = SortKey::kRms;
+  const char *csv_path = nullptr;
+};
+
+struct SweepPoint {
+  float kp;
+  float kd;
+  float knee_limit;
+  float max_current;
+};
+
+struct SweepResult {
+  SweepPoint point;
+  float rms_error;     // [rad] or [m]
+  float overshoot;     // [%] of the step size
+  float peak_current;  // [A]
+  float saturation;    // [%] of ticks with any joint at max_current
+  bool faulted;
+};
+
+// Same saturation and fault check as DriveSystem::CommandCurrents().
+BLA::Matrix<3> ApplyCurrentLimits(BLA::Matrix<3> currents, float max_current,
+                                  float fault_current, bool &saturated,
+                                  bool &faulted) {
+  saturated = false;
+  for (int j = 0; j < 3; j++) {
+    if (currents(j) >= max_current || currents(j) <= -max_current) {
+      saturated = true;
+    }
+    currents(j) = std::min(std::max(currents(j), -max_current), max_current);
+    if (abs(currents(j)) > fault_current) {
+      faulted = true;
+    }
+  }
+  return currents;
+}
+
+struct Metrics {
+  double squared_error = 0;
+  long samples = 0;
+  float overshoot = 0;
+  float peak_current = 0;
+  long saturated_ticks = 0;
+  long ticks = 0;
+  bool faulted = false;
+
+  SweepResult Finish(SweepPoint point) const {
+    SweepResult r;
+    r.point = point;
+    r.rms_error = samples ? sqrt(squared_error / samples) : 0;
+    r.overshoot = 100.0 * overshoot;
+    r.peak_current = peak_current;
+    r.saturation = ticks ? 100.0 * saturated_ticks / ticks : 0;
+    r.faulted = faulted;
+    return r;
+  }
+};
+
+void RecordCurrents(Metrics &m, BLA::Matrix<3> currents, bool saturated) {
+  m.peak_current = std::max(m.peak_current, Utils::InfinityNorm3(currents));
+  m.saturated_ticks += saturated;
+  m.ticks++;
+}
+
+SweepResult EvaluateJoint(SweepPoint point, const LegPlantParameters &plant_params) {
+  LegPlant plant(plant_params);
+  PDGains gains = {point.kp, point.kd};
+  BLA::Matrix<3> start = {0.0, 0.5, -1.0};
+  BLA::Matrix<3> target = {0.3, 0.9, -1.5};
+  plant.Reset(start);
+
+  Metrics m;
+  int num_ticks = (kStepDuration + kTrackDuration) / kControlPeriod;
+  for (int tick = 0; tick < num_ticks && !m.faulted; tick++) {
+    float t = tick * kControlPeriod;
+    BLA::Matrix<3> reference = target;
+    BLA::Matrix<3> reference_velocity = {0, 0, 0};
+    if (t >= kStepDuration) {
+      float w = 2 * PI * kTrackFrequency;
+      float phase = w * (t - kStepDuration);
+      for (int j = 0; j < 3; j++) {
+        reference(j) += 0.1 * sin(phase);
+        reference_velocity(j) = 0.1 * w * cos(phase);
+      }
+    }
+
+    BLA::Matrix<3> position = plant.Position();
+    BLA::Matrix<3> velocity = plant.Velocity();
+    BLA::Matrix<3> currents;
+    for (int j = 0; j < 3; j++) {
+      PD(currents(j), position(j), velocity(j), reference(j),
+         reference_velocity(j), gains);
+      float error = reference(j) - position(j);
+      m.squared_error += error * error;
+      m.samples++;
+      if (t < kStepDuration) {
+        float step = target(j) - start(j);
+        m.overshoot = std::max(m.overshoot, (position(j) - target(j)) / step);
+      }
+    }
+    bool saturated;
+    currents = ApplyCurrentLimits(currents, point.max_current,
+                                  plant.FaultCurrent(), saturated, m.faulted);
+    RecordCurrents(m, currents, saturated);
+    for (int s = 0; s < kPlantSubsteps; s++) {
+      plant.Step(currents, kControlPeriod / kPlantSubsteps);
+    }
+  }
+  return m.Finish(point);
+}
+
+SweepResult EvaluateCartesian(SweepPoint point, float knee_kp,
+                              const LegPlantParameters &plant_params) {
+  const uint8_t leg_index = 0;
+  LegParameters leg_params;
+  LegPlant plant(plant_params);
+
+  PDGains3x3 gains;
+  gains.kp = Utils::DiagonalMatrix3x3({point.kp, point.kp, point.kp});
+  gains.kd = Utils::DiagonalMatrix3x3({point.kd, point.kd, point.kd});
+  KneeSoftLimit knee_limit = {point.knee_limit, knee_kp};
+  BLA::Matrix<3> no_force = {0, 0, 0};
+
+  BLA::Matrix<3> start_angles = {0.0, 0.5, -1.0};
+  BLA::Matrix<3> start = ForwardKinematics(start_angles, leg_params, leg_index);
+  BLA::Matrix<3> step = {0.03, 0.0, 0.03};
+  BLA::Matrix<3> target = start + step;
+  float step_norm = Utils::InfinityNorm3(step);
+  plant.Reset(start_angles);
+
+  Metrics m;
+  int num_ticks = (kStepDuration + kTrackDuration) / kControlPeriod;
+  for (int tick = 0; tick < num_ticks && !m.faulted; tick++) {
+    float t = tick * kControlPeriod;
+    BLA::Matrix<3> reference = target;
+    BLA::Matrix<3> reference_velocity = {0, 0, 0};
+    if (t >= kStepDuration) {
+      float w = 2 * PI * kTrackFrequency;
+      float phase = w * (t - kStepDuration);
+      reference(2) += 0.01 * sin(phase);
+      reference_velocity(2) = 0.01 * w * cos(phase);
+    }
+
+    BLA::Matrix<3> angles = plant.Position();
+    BLA::Matrix<3> currents = CartesianLegControl(
+        angles, plant.Velocity(), reference, reference_velocity, no_force,
+        gains, knee_limit, point.max_current, leg_params, leg_index);
+
+    BLA::Matrix<3> error =
+        reference - ForwardKinematics(angles, leg_params, leg_index);
+    for (int j = 0; j < 3; j++) {
+      m.squared_error += error(j) * error(j);
+    }
+    m.samples++;
+    if (t < kStepDuration) {
+      // Overshoot along the step direction.
+      float along = 0;
+      for (int j = 0; j < 3; j++) {
+        along += -error(j) * step(j);
+      }
+      m.overshoot = std::max(m.overshoot, along / (step_norm * step_norm));
+    }
+
+    bool saturated;
+    currents = ApplyCurrentLimits(currents, point.max_current,
+                                  plant.FaultCurrent(), saturated, m.faulted);
+    RecordCurrents(m, currents, saturated);
+    for (int s = 0; s < kPlantSubsteps; s++) {
+      plant.Step(currents, kControlPeriod / kPlantSubsteps);
+    }
+  }
+  return m.Finish(point);
+}
+
+float Lerp(Range r, int i, int n) {
+  if (n <= 1 || r.lo == r.hi) {
+    return r.lo;
+  }
+  return r.lo + (r.hi - r.lo) * i / (n - 1);
+}
+
+int GridSize(Range r, int n) { return r.lo == r.hi ? 1 : n; }
+
+std::vector<SweepPoint> MakePoints(const SweepConfig &config) {
+  std::vector<SweepPoint> points;
+  if (config.samples > 0) {
+    std::mt19937 rng(config.seed);
+    std::uniform_real_distribution<float> unit(0.0, 1.0);
+    auto sample = [&](Range r) { return r.lo + (r.hi - r.lo) * unit(rng); };
+    for (int i = 0; i < config.samples; i++) {
+      points.push_back({sample(config.kp), sample(config.kd),
+                        sample(config.knee_limit),
+                        sample(config.max_current)});
+    }
+    return points;
+  }
+  int n_kp = GridSize(config.kp, config.grid);
+  int n_kd = GridSize(config.kd, config.grid);
+  int n_knee = GridSize(config.knee_limit, config.grid);
+  int n_cur = GridSize(config.max_current, config.grid);
+  for (int a = 0; a < n_kp; a++) {
+    for (int b = 0; b < n_kd; b++) {
+      for (int c = 0; c < n_knee; c++) {
+        for (int d = 0; d < n_cur; d++) {
+          points.push_back({Lerp(config.kp, a, n_kp), Lerp(config.kd, b, n_kd),
+                            Lerp(config.knee_limit, c, n_knee),
+                            Lerp(config.max_current, d, n_cur)});
+        }
+      }
+    }
+  }
+  return points;
+}
+
+float SortValue(const SweepResult &r, SortKey key) {
+  switch (key) {
+    case SortKey::kOvershoot:
+      return r.overshoot;
+    case SortKey::kPeak:
+      return r.peak_current;
+    case SortKey::kRms:
+    default:
+      return r.rms_error;
+  }
+}
+
+bool ParseRange(const char *arg, Range &range) {
+  const char *colon = strchr(arg, ':');
+  range.lo = atof(arg);
+  range.hi = colon ? atof(colon + 1) : range.lo;
+  return range.lo <= range.hi;
+}
+
+void PrintUsage() {
+  fprintf(stderr,
+          "usage: gain_sweep [--mode joint|cartesian] [--grid N | --samples N]"
+          " [--seed S]\n"
+          "                  [--kp lo:hi] [--kd lo:hi] [--knee-limit lo:hi]"
+          " [--max-current lo:hi]\n"
+          "                  [--knee-kp KP] [--threads T] [--top K]"
+          " [--sort rms|overshoot|peak] [--csv path]\n");
+}
+
+bool ParseArgs(int argc, char **argv, SweepConfig &config) {
+  // Mode first so that its defaults can be overridden by the range flags.
+  for (int i = 1; i + 1 < argc; i++) {
+    if (!strcmp(argv[i], "--mode") && !strcmp(argv[i + 1], "cartesian")) {
+      config.mode = SweepMode::kCartesian;
+      config.kp = {500.0, 8000.0};
+      config.kd = {10.0, 200.0};
+      config.knee_limit = {-0.8, -0.2};
+      config.max_current = {2.0, 6.0};
+      config.grid = 10;
+    }
+  }
+  for (int i = 1; i < argc; i++) {
+    const char *flag = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    bool ok = true;
+    if (!strcmp(flag, "--mode")) {
+      ok = !strcmp(value, "joint") || !strcmp(value, "cartesian");
+    } else if (!strcmp(flag, "--kp")) {
+      ok = ParseRange(value, config.kp);
+    } else if (!strcmp(flag, "--kd")) {
+      ok = ParseRange(value, config.kd);
+    } else if (!strcmp(flag, "--knee-limit")) {
+      ok = ParseRange(value, config.knee_limit);
+    } else if (!strcmp(flag, "--max-current")) {
+      ok = ParseRange(value, config.max_current);
+    } else if (!strcmp(flag, "--knee-kp")) {
+      config.knee_kp = atof(value);
+    } else if (!strcmp(flag, "--grid")) {
+      config.grid = atoi(value);
+    } else if (!strcmp(flag, "--samples")) {
+      config.samples = atoi(value);
+    } else if (!strcmp(flag, "--seed")) {
+      config.seed = atoi(value);
+    } else if (!strcmp(flag, "--threads")) {
+      config.threads = atoi(value);
+    } else if (!strcmp(flag, "--top")) {
+      config.top = atoi(value);
+    } else if (!strcmp(flag, "--csv")) {
+      config.csv_path = value;
+    } else if (!strcmp(flag, "--sort")) {
+      if (!strcmp(value, "rms")) {
+        config.sort = SortKey::kRms;
+      } else if (!strcmp(value, "overshoot")) {
+        config.sort = SortKey::kOvershoot;
+      } else if (!strcmp(value, "peak")) {
+        config.sort = SortKey::kPeak;
+      } else {
+        ok = false;
+      }
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      fprintf(stderr, "Invalid argument: %s %s\n", flag, value);
+      return false;
+    }
+  }
+  return config.grid > 0 && config.samples >= 0;
+}
+
+void PrintRow(FILE *out, const char *fmt, size_t rank, const SweepResult &r) {
+  fprintf(out, fmt, rank, r.point.kp, r.point.kd, r.point.knee_limit,
+          r.point.max_current, r.rms_error, r.overshoot, r.peak_current,
+          r.saturation, r.faulted ? "FAULT" : "");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  SweepConfig config;
+  if (!ParseArgs(argc, argv, config)) {
+    PrintUsage();
+    return 1;
+  }
+  LegPlantParameters plant_params;
+  std::vector<SweepPoint> points = MakePoints(config);
+  std::vector<SweepResult> results(points.size());
+
+  auto start = std::chrono::steady_clock::now();
+  WorkStealingPool pool(config.threads);
+  pool.ParallelFor(0, points.size(), 16, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      results[i] = config.mode == SweepMode::kJoint
+                       ? EvaluateJoint(points[i], plant_params)
+                       : EvaluateCartesian(points[i], config.knee_kp,
+                                           plant_params);
+    }
+  });
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  std::sort(results.begin(), results.end(),
+            [&](const SweepResult &a, const SweepResult &b) {
+              if (a.faulted != b.faulted) {
+                return b.faulted;
+              }
+              return SortValue(a, config.sort) < SortValue(b, config.sort);
+            });
+
+  bool joint = config.mode == SweepMode::kJoint;
+  printf("%zu %s evaluations on %zu threads in %.2f s (%zu steals)\n",
+         results.size(), joint ? "joint" : "cartesian", pool.NumThreads(),
+         seconds, pool.Steals());
+  printf("%4s %9s %9s %7s %7s %10s %9s %7s %6s\n", "rank", "kp", "kd", "knee",
+         "max_I", joint ? "rms[rad]" : "rms[m]", "overshoot", "peak_I",
+         "sat%");
+  for (size_t i = 0; i < results.size() && i < config.top; i++) {
+    PrintRow(stdout, "%4zu %9.2f %9.3f %7.3f %7.2f %10.5f %8.1f%% %7.2f %5.1f%% %s\n",
+             i + 1, results[i]);
+  }
+
+  if (config.csv_path) {
+    FILE *csv = fopen(config.csv_path, "w");
+    if (!csv) {
+      fprintf(stderr, "Could not open %s\n", config.csv_path);
+      return 1;
+    }
+    fprintf(csv, "rank,kp,kd,knee_limit,max_current,rms_error,overshoot,"
+                 "peak_current,saturation,fault\n");
+    for (size_t i = 0; i < results.size(); i++) {
+      PrintRow(csv, "%zu,%g,%g,%g,%g,%g,%g,%g,%g,%s\n", i + 1, results[i]);
+    }
+    fclose(csv);
+  }
+  return 0;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <BasicLinearAlgebra.h>
+
+// Rigid single-leg plant for offline tuning. Each joint is modelled as an
+// inertia with viscous friction driven by the commanded current through the
+// actuator torque constant. The ESC and CAN round trip are lumped into a
+// one-tick delay between the command and the applied current.
+struct LegPlantParameters {
+  float torque_constant = 0.25;  // [Nm/A] at the output shaft
+  float inertia[3] = {0.003, 0.002, 0.001};  // [kg m^2] abduction, hip, knee
+  float viscous_friction = 0.01;  // [Nm s/rad]
+  float fault_current = 10.0;     // [A], same default as DriveSystem
+};
+
+class LegPlant {
+ private:
+  LegPlantParameters params_;
+  BLA::Matrix<3> position_;
+  BLA::Matrix<3> velocity_;
+  BLA::Matrix<3> applied_current_;
+
+ public:
+  explicit LegPlant(LegPlantParameters params) : params_(params) {
+    position_.Fill(0.0);
+    velocity_.Fill(0.0);
+    applied_current_.Fill(0.0);
+  }
+
+  void Reset(BLA::Matrix<3> position) {
+    position_ = position;
+    velocity_.Fill(0.0);
+    applied_current_.Fill(0.0);
+  }
+
+  // Advance by dt [s] with semi-implicit Euler. The command takes effect on
+  // the next step.
+  void Step(BLA::Matrix<3> current_command, float dt) {
+    for (int j = 0; j < 3; j++) {
+      float torque = params_.torque_constant * applied_current_(j) -
+                     params_.viscous_friction * velocity_(j);
+      velocity_(j) += torque / params_.inertia[j] * dt;
+      position_(j) += velocity_(j) * dt;
+    }
+    applied_current_ = current_command;
+  }
+
+  BLA::Matrix<3> Position() const { return position_; }
+  BLA::Matrix<3> Velocity() const { return velocity_; }
+  float FaultCurrent() const { return params_.fault_current; }
+};
@@ -0,0 +1,261 @@
+// Check and benchmark of the leg jacobians differentiated from FootPosition()
+// (src/Kinematics.h, dual numbers from src/Dual.h) against the hand-derived
+// jacobian they replaced.
+//
+//   leg_jacobian [cases] [seed]
+//
+// Draws random joint angles and velocities over the robot's working range
+// and compares, for every leg:
+//   - ForwardKinematics() with the former RotateX(alpha) * {px, py, pz},
+//   - LegJacobian() with the hand-derived expression,
+//   - LegJacobianAndBias() with the hand-derived jacobian and a central
+//     difference of it along the joint velocities for dJ/dt * qdot,
+//   - FootPosition() differentiated in double precision with the
+//     hand-derived jacobian in double, which separates a geometry mismatch
+//     from float rounding.
+// Then times the hand-derived and the differentiated jacobian. Exits
+// non-zero on a mismatch.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Kinematics.h"
+
+namespace {
+
+const float kPositionTolerance = 1e-6;  // [m]
+const float kJacobianTolerance = 1e-6;  // [m/rad]
+const float kBiasTolerance = 1e-6;      // relative to (l1 + l2) |qdot|_1^2
+const double kExactTolerance = 1e-14;
+const int kBenchRounds = 20;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Case {
+  float angles[3];
+  float velocities[3];
+  uint8_t leg;
+};
+
+// The former ForwardKinematics() and LegJacobian().
+template <class T>
+void HandForwardKinematics(const T q[3], const LegParameters &leg_params,
+                           uint8_t leg, T p[3]) {
+  T l1 = leg_params.thigh_length;
+  T l2 = leg_params.shank_length;
+  T px = -l1 * std::sin(q[1]) - l2 * std::sin(q[1] + q[2]);
+  T py = HipOffset(leg_params, leg);
+  T pz = -l1 * std::cos(q[1]) - l2 * std::cos(q[1] + q[2]);
+  p[0] = px;
+  p[1] = std::cos(q[0]) * py - std::sin(q[0]) * pz;
+  p[2] = std::sin(q[0]) * py + std::cos(q[0]) * pz;
+}
+
+template <class T>
+void HandJacobian(const T q[3], const LegParameters &leg_params, uint8_t leg,
+                  T jac[9]) {
+  T l1 = leg_params.thigh_length;
+  T l2 = leg_params.shank_length;
+  T alpha = q[0];
+  T theta = q[1];
+  T phi = q[2];
+  T px = -l1 * std::sin(theta) - l2 * std::sin(theta + phi);
+  T py = HipOffset(leg_params, leg);
+  T pz = -l1 * std::cos(theta) - l2 * std::cos(theta + phi);
+  jac[0] = 0;
+  jac[1] = pz;
+  jac[2] = -l2 * std::cos(theta + phi);
+  jac[3] = -py * std::sin(alpha) - pz * std::cos(alpha);
+  jac[4] = std::sin(alpha) * px;
+  jac[5] = -l2 * std::sin(alpha) * std::sin(theta + phi);
+  jac[6] = py * std::cos(alpha) - pz * std::sin(alpha);
+  jac[7] = -px * std::cos(alpha);
+  jac[8] = l2 * std::cos(alpha) * std::sin(theta + phi);
+}
+
+// The former LegJacobian() as the firmware calls it: out of line, returning
+// a matrix.
+__attribute__((noinline)) BLA::Matrix<3, 3> HandLegJacobian(
+    BLA::Matrix<3> joint_angles, LegParameters leg_params, uint8_t leg) {
+  float q[3] = {joint_angles(0), joint_angles(1), joint_angles(2)};
+  BLA::Matrix<3, 3> jac;
+  HandJacobian(q, leg_params, leg, &jac(0, 0));
+  return jac;
+}
+
+// dJ/dt * qdot from a central difference of the hand-derived jacobian.
+void HandBias(const Case &c, const LegParameters &leg_params,
+              double bias[3]) {
+  const double h = 1e-6;
+  double plus[3], minus[3], jac_plus[9], jac_minus[9];
+  for (int j = 0; j < 3; j++) {
+    plus[j] = c.angles[j] + h * c.velocities[j];
+    minus[j] = c.angles[j] - h * c.velocities[j];
+  }
+  HandJacobian(plus, leg_params, c.leg, jac_plus);
+  HandJacobian(minus, leg_params, c.leg, jac_minus);
+  for (int i = 0; i < 3; i++) {
+    bias[i] = 0;
+    for (int j = 0; j < 3; j++) {
+      bias[i] += (jac_plus[3 * i + j] - jac_minus[3 * i + j]) / (2 * h) *
+                 c.velocities[j];
+    }
+  }
+}
+
+Case RandomCase(std::mt19937 &random) {
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  Case c;
+  c.angles[0] = 0.5f * unit(random);
+  c.angles[1] = 1.5f * unit(random);
+  c.angles[2] = -1.5f + 1.5f * unit(random);
+  for (int j = 0; j < 3; j++) {
+    c.velocities[j] = 20.0f * unit(random);
+  }
+  c.leg = random() % 4;
+  return c;
+}
+
+BLA::Matrix<3> Angles(const Case &c) {
+  return {c.angles[0], c.angles[1], c.angles[2]};
+}
+
+struct Errors {
+  float position = 0;
+  float jacobian = 0;
+  float bias = 0;
+  double exact = 0;
+};
+
+void Update(float &worst, double error) {
+  if (!(error <= worst)) worst = error;
+}
+
+Errors Check(const std::vector<Case> &cases,
+             const LegParameters &leg_params) {
+  Errors errors;
+  for (const Case &c : cases) {
+    double q[3] = {c.angles[0], c.angles[1], c.angles[2]};
+    double position[3], jac[9], bias[3];
+    HandForwardKinematics(q, leg_params, c.leg, position);
+    HandJacobian(q, leg_params, c.leg, jac);
+    HandBias(c, leg_params, bias);
+    // Size of the terms of dJ/dt * qdot, which can cancel out.
+    double speed = std::abs(c.velocities[0]) + std::abs(c.velocities[1]) +
+                   std::abs(c.velocities[2]);
+    double bias_scale =
+        (leg_params.thigh_length + leg_params.shank_length) * speed * speed +
+        1e-3;
+
+    BLA::Matrix<3> p = ForwardKinematics(Angles(c), leg_params, c.leg);
+    BLA::Matrix<3, 3> ad = LegJacobian(Angles(c), leg_params, c.leg);
+    BLA::Matrix<3, 3> ad_jac;
+    BLA::Matrix<3> ad_bias;
+    LegJacobianAndBias(Angles(c),
+                       {c.velocities[0], c.velocities[1], c.velocities[2]},
+                       leg_params, c.leg, ad_jac, ad_bias);
+
+    auto foot = FootPosition(DualVariable<0, 3>(q[0]), DualVariable<1, 3>(q[1]),
+                             DualVariable<2, 3>(q[2]), leg_params, c.leg);
+    double exact_jac[9];
+    for (int j = 0; j < 3; j++) {
+      exact_jac[j] = Derivative(foot.x, j);
+      exact_jac[3 + j] = Derivative(foot.y, j);
+      exact_jac[6 + j] = Derivative(foot.z, j);
+    }
+
+    for (int i = 0; i < 3; i++) {
+      Update(errors.position, std::abs(p(i) - position[i]));
+      Update(errors.bias, std::abs(ad_bias(i) - bias[i]) / bias_scale);
+      for (int j = 0; j < 3; j++) {
+        Update(errors.jacobian, std::abs(ad(i, j) - jac[3 * i + j]));
+        Update(errors.jacobian, std::abs(ad_jac(i, j) - jac[3 * i + j]));
+        double exact = std::abs(exact_jac[3 * i + j] - jac[3 * i + j]);
+        if (!(exact <= errors.exact)) errors.exact = exact;
+      }
+    }
+  }
+  return errors;
+}
+
+float Sum(const float *values, int count) {
+  float sum = 0;
+  for (int i = 0; i < count; i++) sum += values[i];
+  return sum;
+}
+
+// Nanoseconds per call over all cases. Every entry is summed into sink so
+// that none of them is optimised away.
+template <class F>
+double Time(const std::vector<Case> &cases, F jacobian, float &sink) {
+  Clock::time_point start = Clock::now();
+  for (int round = 0; round < kBenchRounds; round++) {
+    for (const Case &c : cases) {
+      sink += jacobian(c);
+    }
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  return seconds * 1e9 / (kBenchRounds * cases.size());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t num_cases = argc > 1 ? atoi(argv[1]) : 100000;
+  uint32_t seed = argc > 2 ? atoi(argv[2]) : 1;
+  LegParameters leg_params;
+  std::mt19937 random(seed);
+  std::vector<Case> cases;
+  for (size_t i = 0; i < num_cases; i++) {
+    cases.push_back(RandomCase(random));
+  }
+
+  Errors errors = Check(cases, leg_params);
+  printf("%zu cases, max difference from the hand-derived kinematics:\n",
+         cases.size());
+  printf("  position %.2e m, jacobian %.2e, dJ/dt*qdot %.2e, "
+         "jacobian in double %.2e\n",
+         errors.position, errors.jacobian, errors.bias, errors.exact);
+  int status = 0;
+  if (!(errors.position <= kPositionTolerance &&
+        errors.jacobian <= kJacobianTolerance &&
+        errors.bias <= kBiasTolerance && errors.exact <= kExactTolerance)) {
+    printf("FAIL: the differentiated kinematics disagree\n");
+    status = 1;
+  }
+
+  float sink = 0.0f;
+  double hand = Time(
+      cases,
+      [&](const Case &c) {
+        BLA::Matrix<3, 3> jac = HandLegJacobian(Angles(c), leg_params, c.leg);
+        return Sum(&jac(0, 0), 9);
+      },
+      sink);
+  double dual = Time(
+      cases,
+      [&](const Case &c) {
+        BLA::Matrix<3, 3> jac = LegJacobian(Angles(c), leg_params, c.leg);
+        return Sum(&jac(0, 0), 9);
+      },
+      sink);
+  double with_bias = Time(
+      cases,
+      [&](const Case &c) {
+        BLA::Matrix<3, 3> jac;
+        BLA::Matrix<3> bias;
+        LegJacobianAndBias(Angles(c),
+                           {c.velocities[0], c.velocities[1], c.velocities[2]},
+                           leg_params, c.leg, jac, bias);
+        return Sum(&jac(0, 0), 9) + Sum(&bias(0), 3);
+      },
+      sink);
+  printf("[ns/call] hand-derived jacobian %.1f, dual numbers %.1f, "
+         "with dJ/dt*qdot %.1f (%d)\n",
+         hand, dual, with_bias, sink > 0);
+  return status;
+}
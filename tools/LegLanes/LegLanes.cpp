@@ -0,0 +1,205 @@
+// Equivalence test and benchmark of the leg-as-lane cartesian law
+// (src/LegLanes.h) against the per-leg loop of
+// DriveSystem::CartesianPositionControl().
+//
+//   leg_lanes [cases] [seed]
+//
+// Draws random joint states, references, feed-forward forces, gains and
+// limits over the robot's working range, runs both formulations and reports
+// the largest difference in the joint currents, including cases that
+// saturate the current limit or hit the knee soft limit. SinCos() is checked
+// against sinf/cosf separately. Then times both over the same inputs. Exits
+// non-zero if the formulations disagree.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Kinematics.h"
+#include "LegControl.h"
+#include "LegLanes.h"
+#include "PID.h"
+
+namespace {
+
+const float kCurrentTolerance = 1e-4;  // [A]
+const float kTrigTolerance = 2e-7;
+const int kBenchRounds = 20;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Case {
+  std::array<float, 12> joint_angles;
+  std::array<float, 12> joint_velocities;
+  std::array<float, 12> reference_position;  // hip-relative
+  std::array<float, 12> reference_velocity;
+  std::array<float, 12> feedforward_force;
+  PDGains3x3 gains;
+  KneeSoftLimit knee_limit;
+  float max_current;
+};
+
+const char *VectorUnit() {
+#if defined(__AVX__)
+  return "AVX";
+#elif defined(__SSE2__)
+  return "SSE2";
+#elif defined(__ARM_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
+
+Case RandomCase(std::mt19937 &random, const LegParameters &leg_params) {
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> fraction(0.0f, 1.0f);
+  Case c;
+  for (int leg = 0; leg < 4; leg++) {
+    float alpha = 0.5f * unit(random);
+    float theta = 1.5f * unit(random);
+    float phi = -1.5f + 1.5f * unit(random);
+    c.joint_angles[3 * leg] = alpha;
+    c.joint_angles[3 * leg + 1] = theta;
+    c.joint_angles[3 * leg + 2] = phi;
+    BLA::Matrix<3> foot =
+        ForwardKinematics({alpha, theta, phi}, leg_params, leg);
+    for (int j = 0; j < 3; j++) {
+      c.joint_velocities[3 * leg + j] = 20.0f * unit(random);
+      c.reference_position[3 * leg + j] = foot(j) + 0.03f * unit(random);
+      c.reference_velocity[3 * leg + j] = 0.5f * unit(random);
+      c.feedforward_force[3 * leg + j] = 2.0f * unit(random);
+    }
+  }
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      float diagonal = i == j ? 1.0f : 0.1f;
+      c.gains.kp(i, j) = diagonal * 5000.0f * fraction(random);
+      c.gains.kd(i, j) = diagonal * 100.0f * fraction(random);
+    }
+  }
+  c.knee_limit = {-1.5f + unit(random), 10.0f * fraction(random)};
+  c.max_current = 0.5f + 7.5f * fraction(random);
+  return c;
+}
+
+std::array<float, 12> PerLeg(const Case &c, const LegParameters &leg_params) {
+  std::array<float, 12> currents;
+  for (int leg = 0; leg < 4; leg++) {
+    auto leg_vector = [leg](const std::array<float, 12> &v) {
+      return BLA::Matrix<3>{v[3 * leg], v[3 * leg + 1], v[3 * leg + 2]};
+    };
+    BLA::Matrix<3> torques = CartesianLegControl(
+        leg_vector(c.joint_angles), leg_vector(c.joint_velocities),
+        leg_vector(c.reference_position), leg_vector(c.reference_velocity),
+        leg_vector(c.feedforward_force), c.gains, c.knee_limit, c.max_current,
+        leg_params, leg);
+    for (int j = 0; j < 3; j++) {
+      currents[3 * leg + j] = torques(j);
+    }
+  }
+  return currents;
+}
+
+std::array<float, 12> Lanes(const Case &c, const LegParameters &leg_params) {
+  return FromLegLanes(CartesianLegControlLanes(
+      ToLegLanes(c.joint_angles), ToLegLanes(c.joint_velocities),
+      ToLegLanes(c.reference_position), ToLegLanes(c.reference_velocity),
+      ToLegLanes(c.feedforward_force), c.gains, c.knee_limit, c.max_current,
+      leg_params));
+}
+
+float CheckSinCos() {
+  float worst = 0.0f;
+  for (int i = -200000; i <= 200000; i += 4) {
+    float x = i * 1e-4f;
+    LegLanes xs = {x, -x, x + 2e-5f, 0.5f * x};
+    LegLanes s, c;
+    SinCos(xs, s, c);
+    for (int lane = 0; lane < 4; lane++) {
+      worst = std::max(worst, std::abs(s[lane] - sinf(xs[lane])));
+      worst = std::max(worst, std::abs(c[lane] - cosf(xs[lane])));
+    }
+  }
+  return worst;
+}
+
+// Nanoseconds per call over all cases.
+template <class F>
+double Time(const std::vector<Case> &cases, F law, float &sink) {
+  Clock::time_point start = Clock::now();
+  for (int round = 0; round < kBenchRounds; round++) {
+    for (const Case &c : cases) {
+      sink += law(c)[round % 12];
+    }
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  return seconds * 1e9 / (kBenchRounds * cases.size());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  size_t num_cases = argc > 1 ? atoi(argv[1]) : 100000;
+  uint32_t seed = argc > 2 ? atoi(argv[2]) : 1;
+  LegParameters leg_params;
+  std::mt19937 random(seed);
+  std::vector<Case> cases;
+  for (size_t i = 0; i < num_cases; i++) {
+    cases.push_back(RandomCase(random, leg_params));
+  }
+
+  int status = 0;
+  float trig_error = CheckSinCos();
+  printf("SinCos max error vs sinf/cosf: %.2e\n", trig_error);
+  if (trig_error > kTrigTolerance) {
+    printf("FAIL: SinCos differs by more than %.0e\n", kTrigTolerance);
+    status = 1;
+  }
+
+  float worst = 0.0f;
+  size_t worst_case = 0;
+  size_t saturated = 0;
+  size_t knee_limited = 0;
+  for (size_t i = 0; i < cases.size(); i++) {
+    std::array<float, 12> expected = PerLeg(cases[i], leg_params);
+    std::array<float, 12> actual = Lanes(cases[i], leg_params);
+    for (int k = 0; k < 12; k++) {
+      float error = std::abs(actual[k] - expected[k]);
+      if (!(error <= worst)) {
+        worst = error;
+        worst_case = i;
+      }
+    }
+    const KneeSoftLimit &knee = cases[i].knee_limit;
+    for (int leg = 0; leg < 4; leg++) {
+      float phi = cases[i].joint_angles[3 * leg + 2];
+      float knee_torque = phi > knee.angle ? knee.kp * (knee.angle - phi) : 0;
+      float norm = std::max(std::max(std::abs(expected[3 * leg]),
+                                     std::abs(expected[3 * leg + 1])),
+                            std::abs(expected[3 * leg + 2] - knee_torque));
+      saturated += norm >= cases[i].max_current * 0.999f;
+      knee_limited += phi > knee.angle;
+    }
+  }
+  printf("%zu cases, %zu legs saturated, %zu knee limited\n", cases.size(),
+         saturated, knee_limited);
+  printf("max current difference: %.2e A (case %zu)\n", worst, worst_case);
+  if (!(worst <= kCurrentTolerance)) {
+    printf("FAIL: formulations differ by more than %.0e A\n",
+           kCurrentTolerance);
+    status = 1;
+  }
+
+  float sink = 0.0f;
+  double per_leg = Time(
+      cases, [&](const Case &c) { return PerLeg(c, leg_params); }, sink);
+  double lanes = Time(
+      cases, [&](const Case &c) { return Lanes(c, leg_params); }, sink);
+  printf("per-leg loop: %.1f ns/tick, lanes (%s): %.1f ns/tick, %.2fx (%d)\n",
+         per_leg, VectorUnit(), lanes, per_leg / lanes, sink > 0);
+  return status;
+}
@@ -0,0 +1,355 @@
+// Host side of the compressed log dump ({"dump_log": true, "compress": true},
+// see LogDump.h).
+//
+//   log_dump_tool decode <capture> [out.csv]
+//       Find the dumps in a serial capture, decompress them and print the
+//       rows, oldest first, as comma separated text to out.csv or stdout,
+//       with the row columns sent listed in the report. Bytes outside the
+//       0x49 0x49 frames (status lines, other frames) are skipped. Reports
+//       the compression ratio against the raw rows and the dump time
+//       measured on the device, from the end frame.
+//   log_dump_tool bench [rows] [signal_mask] [quantize]
+//       Log synthetic rows like the DataLogger does with the given signal
+//       mask (default all), dump the logged columns through the same code
+//       the firmware runs, exact or with quantize set quantized, decode the
+//       result and compare it: bit for bit, or within half a quantization
+//       step. Reports the size of the raw rows, the compressed dump and the
+//       text dump, and exits non-zero on a mismatch. The time a dump takes on
+//       the robot is in the end frame of a real dump, and per row in
+//       {"bench": 8}.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "DriveSignals.h"
+#include "LogDump.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t kNumColumns =
+    kNumDriveScalarSignals + 12 * kNumDriveActuatorSignals;
+
+class VectorPrint : public Print {
+ public:
+  size_t write(const uint8_t *buffer, size_t size) override {
+    bytes.insert(bytes.end(), buffer, buffer + size);
+    return size;
+  }
+  std::vector<uint8_t> bytes;
+};
+
+struct Dump {
+  uint32_t num_rows = 0;
+  uint16_t num_columns = 0;
+  bool quantized = false;
+  std::vector<uint8_t> columns;  // row index of each column, if sent
+  bool complete = false;
+  uint32_t raw_bytes = 0;
+  uint32_t coded_bytes = 0;
+  uint32_t micros = 0;
+  size_t frame_bytes = 0;
+  std::vector<uint8_t> coded;
+  std::vector<uint32_t> values;  // num_rows x num_columns, bits of floats
+};
+
+uint32_t Read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, 4);
+  return value;
+}
+
+// Collect the frames of every dump in data. A begin frame starts a dump,
+// data frames extend the newest one and an end frame closes it.
+std::vector<Dump> FindDumps(const uint8_t *data, size_t size) {
+  std::vector<Dump> dumps;
+  size_t i = 0;
+  while (i + kLogDumpHeaderSize <= size) {
+    if (data[i] != kLogDumpMarker || data[i + 1] != kLogDumpMarker) {
+      i++;
+      continue;
+    }
+    uint16_t length = data[i + 2] << 8 | data[i + 3];
+    uint8_t type = data[i + 4];
+    const uint8_t *payload = data + i + kLogDumpHeaderSize;
+    size_t payload_size = length - 1;
+    bool open = !dumps.empty() && !dumps.back().complete;
+    bool valid =
+        length >= 1 && length <= kLogDumpFrameSize - 4 &&
+        i + 4 + length <= size &&
+        ((type == static_cast<uint8_t>(LogDumpFrameType::kBegin) &&
+          payload_size >= kLogDumpBeginSize) ||
+         (type == static_cast<uint8_t>(LogDumpFrameType::kData) && open) ||
+         (type == static_cast<uint8_t>(LogDumpFrameType::kEnd) && open &&
+          payload_size == 12));
+    if (!valid) {
+      i++;
+      continue;
+    }
+    if (type == static_cast<uint8_t>(LogDumpFrameType::kBegin)) {
+      if (payload[6] != LzssEncoder::kWindowBits ||
+          payload[7] != LzssEncoder::kLengthBits) {
+        fprintf(stderr, "Dump at byte %zu uses another LZSS format\n", i);
+        i++;
+        continue;
+      }
+      uint16_t num_columns;
+      memcpy(&num_columns, payload + 4, 2);
+      uint8_t flags = payload[8];
+      size_t list_size = flags & kColumnList ? num_columns : 0;
+      if (payload_size != kLogDumpBeginSize + list_size) {
+        i++;
+        continue;
+      }
+      dumps.emplace_back();
+      dumps.back().num_rows = Read32(payload);
+      dumps.back().num_columns = num_columns;
+      dumps.back().quantized = flags & kQuantized;
+      dumps.back().columns.assign(payload + kLogDumpBeginSize,
+                                  payload + kLogDumpBeginSize + list_size);
+    } else if (type == static_cast<uint8_t>(LogDumpFrameType::kData)) {
+      dumps.back().coded.insert(dumps.back().coded.end(), payload,
+                                payload + payload_size);
+    } else {
+      dumps.back().raw_bytes = Read32(payload);
+      dumps.back().coded_bytes = Read32(payload + 4);
+      dumps.back().micros = Read32(payload + 8);
+      dumps.back().complete = true;
+    }
+    dumps.back().frame_bytes += 4 + length;
+    i += 4 + length;
+  }
+  return dumps;
+}
+
+bool Decompress(Dump &dump) {
+  size_t num_values = static_cast<size_t>(dump.num_rows) * dump.num_columns;
+  if (!dump.complete || dump.coded.size() != dump.coded_bytes ||
+      dump.raw_bytes != 4 * num_values) {
+    return false;
+  }
+  std::vector<uint8_t> planes(4 * num_values);
+  if (!LzssDecode(dump.coded.data(), dump.coded.size(), planes.data(),
+                  planes.size())) {
+    return false;
+  }
+  dump.values.resize(num_values);
+  LogDumpDecodeRows(planes.data(), dump.num_rows, dump.num_columns,
+                    dump.quantized, dump.values.data());
+  return true;
+}
+
+float Value(const Dump &dump, size_t index) {
+  float value;
+  memcpy(&value, &dump.values[index], 4);
+  return value;
+}
+
+// Bytes of the same rows as DataLogger::PrintRow() prints them.
+size_t TextBytes(const Dump &dump) {
+  size_t bytes = 0;
+  char text[64];
+  for (size_t i = 0; i < dump.values.size(); i++) {
+    bytes += snprintf(text, sizeof(text), "%.2f,", Value(dump, i));
+  }
+  return bytes + 2 * dump.num_rows;
+}
+
+void PrintSizes(FILE *out, const Dump &dump) {
+  size_t text = TextBytes(dump);
+  fprintf(out,
+          "%u rows x %u values%s: raw %u B, compressed %zu B with framing "
+          "(%.2f x smaller than raw); text dump %zu B\n",
+          dump.num_rows, dump.num_columns,
+          dump.quantized ? " quantized" : "", dump.raw_bytes,
+          dump.frame_bytes, (double)dump.raw_bytes / dump.frame_bytes, text);
+}
+
+int Decode(const char *path, const char *csv_path) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    fprintf(stderr, "Could not open %s\n", path);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[1 << 16];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    data.insert(data.end(), buffer, buffer + count);
+  }
+  fclose(in);
+
+  FILE *out = csv_path ? fopen(csv_path, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "Could not create %s\n", csv_path);
+    return 1;
+  }
+  std::vector<Dump> dumps = FindDumps(data.data(), data.size());
+  int failed = 0;
+  for (size_t d = 0; d < dumps.size(); d++) {
+    Dump &dump = dumps[d];
+    if (!Decompress(dump)) {
+      fprintf(stderr, "dump %zu: incomplete or corrupt\n", d);
+      failed++;
+      continue;
+    }
+    for (uint32_t row = 0; row < dump.num_rows; row++) {
+      for (uint16_t c = 0; c < dump.num_columns; c++) {
+        fprintf(out, "%g,", Value(dump, row * dump.num_columns + c));
+      }
+      fprintf(out, "\n");
+    }
+    // Keep the report off the rows when they go to stdout.
+    FILE *report = csv_path ? stdout : stderr;
+    fprintf(report, "dump %zu: device time %.3f s, ", d, dump.micros * 1e-6);
+    PrintSizes(report, dump);
+    if (!dump.columns.empty()) {
+      fprintf(report, "  row columns:");
+      for (uint8_t column : dump.columns) {
+        fprintf(report, " %u", column);
+      }
+      fprintf(report, "\n");
+    }
+  }
+  if (csv_path) {
+    fclose(out);
+  }
+  if (dumps.empty()) {
+    fprintf(stderr, "No dumps in %s\n", path);
+    return 1;
+  }
+  return failed > 0;
+}
+
+// Rows like a robot trotting in place: quantised encoder positions and
+// currents, noisy IMU rates, smooth references. Columns outside the mask
+// stay zero, as in the DataLogger.
+void SynthesizeRow(uint32_t n, uint32_t signal_mask, std::mt19937 &random,
+                   float *row) {
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  const float kEncoderStep = 2 * M_PI / 8192 / 36;
+  const float kCurrentStep = 0.001f;
+  float t = n * 0.001f;
+  float scalars[kNumDriveScalarSignals] = {
+      static_cast<float>(n),
+      0.01f * sinf(0.2f * t),
+      0.05f * sinf(2 * M_PI * 2 * t),
+      0.02f * cosf(2 * M_PI * 2 * t),
+      0.01f * noise(random),
+      0.3f * cosf(2 * M_PI * 2 * t) + 0.01f * noise(random),
+      0.1f * sinf(2 * M_PI * 2 * t) + 0.01f * noise(random)};
+  for (uint8_t s = 0; s < kNumDriveScalarSignals; s++) {
+    if (signal_mask & 1u << s) row[s] = scalars[s];
+  }
+  for (uint8_t i = 0; i < 12; i++) {
+    float phase = 2 * M_PI * 2 * t + (i / 3 % 2) * M_PI;
+    float amplitude = i % 3 == 0 ? 0.05f : 0.4f;
+    float pref = amplitude * sinf(phase);
+    float vref = amplitude * 2 * M_PI * 2 * cosf(phase);
+    float pos = roundf((pref + 0.002f * noise(random)) / kEncoderStep) *
+                kEncoderStep;
+    float vel = roundf((vref + 0.05f * noise(random)) * 100) / 100;
+    float cref = 8.0f * (pref - pos) + 2.0f * (vref - vel);
+    float lcur = roundf(cref / kCurrentStep) * kCurrentStep;
+    float cur = roundf((lcur + 0.02f * noise(random)) / kCurrentStep) *
+                kCurrentStep;
+    float actuator[kNumDriveActuatorSignals] = {pos, vel, cur, pref,
+                                                vref, cref, lcur};
+    for (uint8_t s = 0; s < kNumDriveActuatorSignals; s++) {
+      if (signal_mask & 1u << (kNumDriveScalarSignals + s)) {
+        row[kNumDriveScalarSignals + i * kNumDriveActuatorSignals + s] =
+            actuator[s];
+      }
+    }
+  }
+}
+
+// The columns of the signals in signal_mask, in row order, as
+// DebugDataColumns() gives them.
+std::vector<uint8_t> LoggedColumns(uint32_t signal_mask) {
+  std::vector<uint8_t> columns;
+  for (uint8_t c = 0; c < kNumColumns; c++) {
+    uint8_t signal = c < kNumDriveScalarSignals
+                         ? c
+                         : kNumDriveScalarSignals +
+                               (c - kNumDriveScalarSignals) %
+                                   kNumDriveActuatorSignals;
+    if (signal_mask & 1u << signal) {
+      columns.push_back(c);
+    }
+  }
+  return columns;
+}
+
+int Bench(uint32_t num_rows, uint32_t signal_mask, bool quantize) {
+  std::mt19937 random(1);
+  std::vector<float> rows(static_cast<size_t>(num_rows) * kNumColumns, 0.0f);
+  for (uint32_t n = 0; n < num_rows; n++) {
+    SynthesizeRow(n, signal_mask, random, &rows[n * kNumColumns]);
+  }
+  std::vector<uint8_t> columns = LoggedColumns(signal_mask);
+
+  static LogDumpEncoder encoder;
+  VectorPrint capture;
+  Clock::time_point start = Clock::now();
+  encoder.Begin(capture, num_rows, columns.data(), columns.size(), quantize,
+                0);
+  for (uint32_t n = 0; n < num_rows; n++) {
+    encoder.AddRow(&rows[n * kNumColumns]);
+  }
+  encoder.End(0);
+  double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::vector<Dump> dumps = FindDumps(capture.bytes.data(),
+                                      capture.bytes.size());
+  if (dumps.size() != 1 || !Decompress(dumps[0])) {
+    fprintf(stderr, "The dump does not decode\n");
+    return 1;
+  }
+  // Rounding to a step is off by at most half a step, plus the float
+  // rounding of the decoded value.
+  uint32_t mismatches = 0;
+  float max_error = 0;
+  for (uint32_t n = 0; n < num_rows; n++) {
+    for (size_t k = 0; k < columns.size(); k++) {
+      float value = rows[n * kNumColumns + columns[k]];
+      size_t index = n * columns.size() + k;
+      uint32_t bits;
+      memcpy(&bits, &value, 4);
+      float error = fabsf(Value(dumps[0], index) - value);
+      max_error = std::max(max_error, error);
+      mismatches += quantize ? error > 0.5f / kLogDumpQuantizeScale +
+                                           fabsf(value) * 1e-6f
+                             : bits != dumps[0].values[index];
+    }
+  }
+  PrintSizes(stdout, dumps[0]);
+  printf("host encoder %.1f MB/s of rows, max error %g, mismatches %u\n",
+         encoder.RawBytes() / seconds * 1e-6, max_error, mismatches);
+  return mismatches > 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc >= 3 && !strcmp(argv[1], "decode")) {
+    return Decode(argv[2], argc >= 4 ? argv[3] : nullptr);
+  }
+  if (argc >= 2 && !strcmp(argv[1], "bench")) {
+    return Bench(argc >= 3 ? atoi(argv[2]) : 1000,
+                 argc >= 4 ? strtoul(argv[3], nullptr, 0) : kAllDriveSignals,
+                 argc >= 5 && atoi(argv[4]));
+  }
+  fprintf(stderr,
+          "usage: log_dump_tool decode <capture> [out.csv]\n"
+          "       log_dump_tool bench [rows] [signal_mask] [quantize]\n");
+  return 1;
+}
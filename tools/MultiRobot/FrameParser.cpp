@@ -0,0 +1,41 @@
+#include "FrameParser.h"
+
+namespace {
+
+bool IsStartByte(uint8_t b) {
+  return b == 0x45 || b == 0x46 || b == 0x47 || b == 0x48;
+}
+
+}  // namespace
+
+void FrameParser::Append(const uint8_t *data, size_t size) {
+  buffer_.erase(buffer_.begin(), buffer_.begin() + position_);
+  position_ = 0;
+  buffer_.insert(buffer_.end(), data, data + size);
+}
+
+bool FrameParser::Next(Frame &frame) {
+  while (buffer_.size() - position_ >= 4) {
+    const uint8_t *p = buffer_.data() + position_;
+    if (!IsStartByte(p[0]) || p[1] != p[0]) {
+      position_++;
+      skipped_++;
+      continue;
+    }
+    uint16_t size = p[2] << 8 | p[3];
+    if (size > kMaxPayload) {
+      position_++;
+      skipped_++;
+      continue;
+    }
+    if (buffer_.size() - position_ < 4u + size) {
+      return false;
+    }
+    frame.type = p[0];
+    frame.payload = p + 4;
+    frame.size = size;
+    position_ += 4 + size;
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits the byte stream from the firmware into its binary frames:
+//   0x45 0x45 msgpack status (DriveSystem::WriteMsgPackFrame)
+//   0x46 0x46 batched telemetry (TelemetryBatcher.h)
+//   0x47 0x47 lockstep state (DriveSystem::WriteStreamState)
+//   0x48 0x48 energy accounting (DriveSystem::WriteEnergyFrame)
+// each followed by a big-endian uint16 length. Anything else, such as the
+// printed status lines and the CR LF after msgpack frames, is skipped.
+class FrameParser {
+ public:
+  static const size_t kMaxPayload = 8192;
+
+  struct Frame {
+    uint8_t type;  // 0x45 to 0x48
+    const uint8_t *payload;
+    uint16_t size;
+  };
+
+  void Append(const uint8_t *data, size_t size);
+
+  // Next complete frame, valid until the next Append().
+  bool Next(Frame &frame);
+
+  uint64_t SkippedBytes() const { return skipped_; }
+
+ private:
+  std::vector<uint8_t> buffer_;
+  size_t position_ = 0;
+  uint64_t skipped_ = 0;
+};
@@ -0,0 +1,303 @@
+#include "HostRuntime.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Payload layout of a 0x46 packet after the start bytes and length, see
+// TelemetryBatcher.h.
+const size_t kTelemetryHeaderSize = 8;
+const size_t kReadSize = 16384;
+
+uint32_t ReadU32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+}
+
+uint16_t ReadU16(const uint8_t *p) { return p[0] | p[1] << 8; }
+
+}  // namespace
+
+uint64_t HostMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+int64_t ClockSync::Extend(uint32_t device_micros) const {
+  if (!started_) {
+    return device_micros;
+  }
+  return last_extended_ + int32_t(device_micros - last_device_);
+}
+
+void ClockSync::Observe(uint32_t device_micros, uint64_t host_micros) {
+  int64_t device = Extend(device_micros);
+  if (!started_ || device > last_extended_) {
+    last_device_ = device_micros;
+    last_extended_ = device;
+    started_ = true;
+  }
+  int64_t difference = int64_t(host_micros) - device;
+  if (window_start_ == 0) {
+    window_start_ = host_micros;
+  }
+  if (difference < window_min_) {
+    window_min_ = difference;
+    window_min_device_ = device;
+  }
+  if (host_micros - window_start_ < window_micros_) {
+    return;
+  }
+  if (windows_ > 0 && window_min_device_ > offset_device_) {
+    double slope = double(window_min_ - offset_) /
+                   double(window_min_device_ - offset_device_);
+    // The window minima jitter by the sample period; smooth the drift.
+    slope_ = windows_ == 1 ? slope : 0.8 * slope_ + 0.2 * slope;
+  }
+  offset_ = window_min_;
+  offset_device_ = window_min_device_;
+  windows_++;
+  window_min_ = INT64_MAX;
+  window_start_ = host_micros;
+}
+
+uint64_t ClockSync::ToHost(uint32_t device_micros) const {
+  int64_t device = Extend(device_micros);
+  if (windows_ == 0) {
+    return device + window_min_;
+  }
+  return device + offset_ + int64_t(slope_ * (device - offset_device_));
+}
+
+Device::~Device() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+void Device::HandleTelemetry(const FrameParser::Frame &frame, uint64_t now) {
+  if (frame.size < kTelemetryHeaderSize) {
+    return;
+  }
+  uint32_t base = ReadU32(frame.payload);
+  uint8_t num_samples = frame.payload[4];
+  uint16_t num_values = ReadU16(frame.payload + 6);
+  size_t sample_size = 2 + 4 * num_values;
+  if (num_samples == 0 ||
+      kTelemetryHeaderSize + num_samples * sample_size > frame.size) {
+    return;
+  }
+  stats_.telemetry_frames++;
+
+  // The last sample was taken just before the packet went out.
+  const uint8_t *last =
+      frame.payload + kTelemetryHeaderSize + (num_samples - 1) * sample_size;
+  clock_.Observe(base + ReadU16(last), now);
+
+  TelemetrySample sample;
+  sample.received_micros = now;
+  sample.num_values = std::min<size_t>(num_values, kMaxTelemetryValues);
+  for (uint8_t s = 0; s < num_samples; s++) {
+    const uint8_t *p = frame.payload + kTelemetryHeaderSize + s * sample_size;
+    sample.device_micros = base + ReadU16(p);
+    sample.host_micros = clock_.ToHost(sample.device_micros);
+    memcpy(sample.values, p + 2, 4 * sample.num_values);
+    stats_.samples++;
+    if (!telemetry_.Push(sample)) {
+      stats_.dropped_samples++;
+    }
+  }
+}
+
+HostRuntime::HostRuntime() : running_(false), loop_stats_() {
+  wake_pipe_[0] = wake_pipe_[1] = -1;
+}
+
+HostRuntime::~HostRuntime() {
+  Stop();
+  for (int fd : wake_pipe_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+bool HostRuntime::AddDevice(const char *path) {
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) {
+    perror(path);
+    return false;
+  }
+  termios tty;
+  if (tcgetattr(fd, &tty) == 0) {
+    cfmakeraw(&tty);
+    tcsetattr(fd, TCSANOW, &tty);
+  }
+  devices_.emplace_back(new Device(path, fd));
+  return true;
+}
+
+bool HostRuntime::Start() {
+  if (pipe(wake_pipe_) != 0) {
+    perror("pipe");
+    return false;
+  }
+  fcntl(wake_pipe_[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake_pipe_[1], F_SETFL, O_NONBLOCK);
+  running_ = true;
+  thread_ = std::thread(&HostRuntime::Run, this);
+  return true;
+}
+
+void HostRuntime::Stop() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  running_ = false;
+  uint8_t b = 0;
+  (void)!write(wake_pipe_[1], &b, 1);
+  thread_.join();
+}
+
+bool HostRuntime::Queue(int32_t device, const uint8_t *frame, size_t size,
+                        uint64_t at_micros) {
+  if (size > kMaxCommandSize) {
+    return false;
+  }
+  Command command;
+  command.device = device;
+  command.size = size;
+  command.at_micros = at_micros;
+  memcpy(command.bytes, frame, size);
+  if (!commands_.Push(command)) {
+    return false;
+  }
+  uint8_t b = 0;
+  (void)!write(wake_pipe_[1], &b, 1);
+  return true;
+}
+
+bool HostRuntime::Send(size_t device, const uint8_t *frame, size_t size,
+                       uint64_t at_micros) {
+  return device < devices_.size() && Queue(device, frame, size, at_micros);
+}
+
+bool HostRuntime::Broadcast(const uint8_t *frame, size_t size,
+                            uint64_t at_micros) {
+  return Queue(-1, frame, size, at_micros);
+}
+
+void HostRuntime::Write(const Command &command, uint64_t now) {
+  size_t first = command.device < 0 ? 0 : command.device;
+  size_t end = command.device < 0 ? devices_.size() : first + 1;
+  for (size_t i = first; i < end; i++) {
+    Device &device = *devices_[i];
+    if (write(device.fd_, command.bytes, command.size) !=
+        ssize_t(command.size)) {
+      device.stats_.write_errors++;
+    }
+  }
+  loop_stats_.commands++;
+  if (command.device < 0) {
+    loop_stats_.broadcasts++;
+    loop_stats_.broadcast_skew_micros.push_back(HostMicros() - now);
+  }
+}
+
+void HostRuntime::Run() {
+  std::vector<pollfd> fds(devices_.size() + 1);
+  fds[0] = {wake_pipe_[0], POLLIN, 0};
+  for (size_t i = 0; i < devices_.size(); i++) {
+    fds[i + 1] = {devices_[i]->fd_, POLLIN, 0};
+  }
+  std::vector<Command> pending;
+  static uint8_t buffer[kReadSize];
+
+  while (running_) {
+    // Write what is due, then sleep until the next deadline or input. poll()
+    // only has millisecond resolution, so the last millisecond before a
+    // scheduled command is spun.
+    uint64_t now = HostMicros();
+    int timeout = -1;
+    for (size_t i = 0; i < pending.size();) {
+      if (pending[i].at_micros <= now) {
+        Write(pending[i], now);
+        pending.erase(pending.begin() + i);
+        continue;
+      }
+      uint64_t wait = pending[i].at_micros - now;
+      int wait_ms = wait < 1000 ? 0 : wait / 1000;
+      timeout = timeout < 0 ? wait_ms : std::min(timeout, wait_ms);
+      i++;
+    }
+
+    if (poll(fds.data(), fds.size(), timeout) < 0) {
+      continue;
+    }
+    loop_stats_.wakeups++;
+    now = HostMicros();
+
+    if (fds[0].revents & POLLIN) {
+      while (read(wake_pipe_[0], buffer, sizeof(buffer)) > 0) {
+      }
+      Command command;
+      while (commands_.Pop(command)) {
+        pending.push_back(command);
+      }
+    }
+
+    for (size_t i = 0; i < devices_.size(); i++) {
+      if (!(fds[i + 1].revents & POLLIN)) {
+        continue;
+      }
+      Device &device = *devices_[i];
+      ssize_t n;
+      while ((n = read(device.fd_, buffer, sizeof(buffer))) > 0) {
+        device.stats_.bytes += n;
+        device.parser_.Append(buffer, n);
+        FrameParser::Frame frame;
+        while (device.parser_.Next(frame)) {
+          switch (frame.type) {
+            case 0x45:
+              device.stats_.msgpack_frames++;
+              break;
+            case 0x46:
+              device.HandleTelemetry(frame, now);
+              break;
+            case 0x47:
+              device.stats_.state_frames++;
+              break;
+            case 0x48:
+              device.stats_.energy_frames++;
+              break;
+          }
+        }
+      }
+    }
+  }
+
+  timespec cpu;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+  loop_stats_.cpu_micros = cpu.tv_sec * 1000000ull + cpu.tv_nsec / 1000;
+}
+
+size_t EncodeBoolCommand(const char *key, bool value, uint8_t *out) {
+  size_t length = strlen(key);
+  out[2] = 0x81;  // fixmap, one entry
+  out[3] = 0xa0 | length;
+  memcpy(out + 4, key, length);
+  out[4 + length] = value ? 0xc3 : 0xc2;
+  size_t size = 5 + length;
+  out[0] = 0x00;
+  out[1] = size - 2;
+  return size;
+}
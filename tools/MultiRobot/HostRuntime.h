@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DriveSignals.h"
+#include "FrameParser.h"
+#include "RingBuffer.h"
+
+// Runs any number of robots from one process. A single event loop thread
+// poll()s every serial link, splits the streams into frames, and pushes the
+// telemetry samples into a ring per device, timestamped on the shared host
+// clock. Commands from any thread go through one queue to the loop, which
+// writes them either to one device or to all of them back to back, now or at
+// a given host time (e.g. a synchronised start).
+
+const size_t kMaxTelemetryValues =
+    kNumDriveScalarSignals + 12 * kNumDriveActuatorSignals;
+const size_t kMaxCommandSize = 256;
+const uint32_t kTelemetryRingSize = 256;
+
+// Microseconds on the host's monotonic clock, shared by all devices.
+uint64_t HostMicros();
+
+// One DebugData row from a 0x46 telemetry packet.
+struct TelemetrySample {
+  uint64_t host_micros;      // device timestamp on the host clock
+  uint64_t received_micros;  // when the packet was parsed
+  uint32_t device_micros;
+  uint16_t num_values;
+  float values[kMaxTelemetryValues];
+};
+
+// Maps a device's micros() onto the host clock. Each observation pairs a
+// device timestamp with its arrival time; the smallest difference over a
+// window is the best estimate of the offset (least queueing), and the change
+// between windows gives the crystal drift. The estimate is late by the
+// smallest transport delay plus, for batched telemetry, up to one control
+// tick (a full packet goes out on the next sample). Both are the same for
+// every robot on the same firmware and link, so the robots stay aligned with
+// each other.
+class ClockSync {
+ public:
+  explicit ClockSync(uint64_t window_micros = 500000)
+      : window_micros_(window_micros) {}
+
+  void Observe(uint32_t device_micros, uint64_t host_micros);
+  uint64_t ToHost(uint32_t device_micros) const;
+
+  bool Synced() const { return windows_ > 0; }
+  double DriftPpm() const { return slope_ * 1e6; }
+
+ private:
+  uint64_t window_micros_;
+  // 32-bit device time extended to 64 bits.
+  bool started_ = false;
+  uint32_t last_device_ = 0;
+  int64_t last_extended_ = 0;
+
+  uint64_t window_start_ = 0;
+  int64_t window_min_ = INT64_MAX;
+  int64_t window_min_device_ = 0;
+  uint32_t windows_ = 0;
+  int64_t offset_ = 0;  // host - device at offset_device_
+  int64_t offset_device_ = 0;
+  double slope_ = 0.0;
+
+  int64_t Extend(uint32_t device_micros) const;
+};
+
+class Device {
+ public:
+  struct Stats {
+    uint64_t bytes;
+    uint32_t msgpack_frames;
+    uint32_t telemetry_frames;
+    uint32_t state_frames;
+    uint32_t energy_frames;
+    uint32_t samples;
+    uint32_t dropped_samples;  // telemetry ring full
+    uint32_t write_errors;
+  };
+
+  Device(const std::string &path, int fd) : path_(path), fd_(fd), stats_() {}
+  ~Device();
+
+  const std::string &Path() const { return path_; }
+
+  // Consumed by one application thread.
+  SpscRing<TelemetrySample, kTelemetryRingSize> &Telemetry() {
+    return telemetry_;
+  }
+
+  // The following are written by the loop thread; read them after Stop().
+  const ClockSync &Clock() const { return clock_; }
+  const Stats &GetStats() const { return stats_; }
+  uint64_t SkippedBytes() const { return parser_.SkippedBytes(); }
+
+ private:
+  friend class HostRuntime;
+
+  std::string path_;
+  int fd_;
+  FrameParser parser_;
+  ClockSync clock_;
+  SpscRing<TelemetrySample, kTelemetryRingSize> telemetry_;
+  Stats stats_;
+
+  void HandleTelemetry(const FrameParser::Frame &frame, uint64_t now);
+};
+
+class HostRuntime {
+ public:
+  struct LoopStats {
+    uint64_t cpu_micros;  // loop thread CPU time
+    uint64_t wakeups;
+    uint32_t commands;
+    uint32_t broadcasts;
+    // Time from the first to the last write of each broadcast.
+    std::vector<uint32_t> broadcast_skew_micros;
+  };
+
+  HostRuntime();
+  ~HostRuntime();
+
+  // Opens a serial device in raw mode. Before Start() only.
+  bool AddDevice(const char *path);
+  size_t NumDevices() const { return devices_.size(); }
+  Device &GetDevice(size_t index) { return *devices_[index]; }
+
+  bool Start();
+  void Stop();
+
+  // Queue a framed command (0x00, length, msgpack) for one device or for
+  // all of them, to be written at host time at_micros (0 = now). Safe from
+  // any thread. Returns false if the queue is full.
+  bool Send(size_t device, const uint8_t *frame, size_t size,
+            uint64_t at_micros = 0);
+  bool Broadcast(const uint8_t *frame, size_t size, uint64_t at_micros = 0);
+
+  // Valid after Stop().
+  const LoopStats &GetLoopStats() const { return loop_stats_; }
+
+ private:
+  struct Command {
+    int32_t device;  // -1 for all
+    uint32_t size;
+    uint64_t at_micros;
+    uint8_t bytes[kMaxCommandSize];
+  };
+
+  std::vector<std::unique_ptr<Device>> devices_;
+  MpscRing<Command, 64> commands_;
+  int wake_pipe_[2];
+  std::thread thread_;
+  std::atomic<bool> running_;
+  LoopStats loop_stats_;
+
+  bool Queue(int32_t device, const uint8_t *frame, size_t size,
+             uint64_t at_micros);
+  void Write(const Command &command, uint64_t now);
+  void Run();
+};
+
+// A framed command {key: value} with a single bool, e.g. {"idle": true}.
+size_t EncodeBoolCommand(const char *key, bool value, uint8_t *out);
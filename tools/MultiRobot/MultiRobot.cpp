@@ -0,0 +1,281 @@
+// Host runtime for several robots, and its scaling benchmark.
+//
+// Usage:
+//   multi_robot bench [--max N] [--duration S] [--broadcasts K]
+//   multi_robot run PORT... [--duration S]
+//
+// bench runs HostRuntime against 1, 2, 4, ... N simulated robots on ptys
+// (PtyFleet), each streaming batched telemetry at the firmware control rate,
+// and prints per fleet size:
+//   - CPU use of the event loop and of the application thread draining the
+//     telemetry rings, in % of one core
+//   - sample latency from the device tick to the application, which includes
+//     the firmware's packet batching, and ring drops
+//   - error of the shared clock against the simulated device clocks
+//   - for synchronised broadcasts scheduled 5 ms ahead: the spread of the
+//     writes, the spread of the arrival at the devices, and the lateness
+//     from the scheduled time to the last arrival
+//
+// Both end with a synchronised {"idle": true} to every robot. run streams
+// telemetry from real robots (they must have {"batch": true} set) and prints
+// the per-device counters.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "HostRuntime.h"
+#include "PtyFleet.h"
+
+namespace {
+
+const uint64_t kBroadcastLead = 5000;    // [us] schedule ahead
+const uint64_t kClockSettle = 1000000;  // [us] before checking the clock
+const uint64_t kDrainPeriod = 1000;     // [us] application thread
+
+struct Config {
+  size_t max_devices = 32;
+  double duration = 3.0;
+  size_t broadcasts = 10;
+};
+
+uint32_t Percentile(std::vector<uint32_t> &values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  return values[std::min<size_t>(p * values.size(), values.size() - 1)];
+}
+
+uint64_t ThreadCpuMicros() {
+  timespec cpu;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+  return cpu.tv_sec * 1000000ull + cpu.tv_nsec / 1000;
+}
+
+// The application side: drains every device's ring, as a controller or
+// logger would. fleet is null for real robots.
+struct Consumer {
+  std::vector<uint32_t> latency_micros;
+  std::vector<uint32_t> clock_error_micros;
+  uint64_t samples = 0;
+  uint64_t cpu_micros = 0;
+
+  void Run(HostRuntime &runtime, const PtyFleet *fleet,
+           const std::atomic<bool> &running) {
+    uint64_t start = HostMicros();
+    TelemetrySample sample;
+    while (running) {
+      uint64_t now = HostMicros();
+      for (size_t i = 0; i < runtime.NumDevices(); i++) {
+        Device &device = runtime.GetDevice(i);
+        while (device.Telemetry().Pop(sample)) {
+          samples++;
+          uint64_t truth =
+              fleet ? fleet->HostMicrosAt(i, sample.device_micros)
+                    : sample.host_micros;
+          latency_micros.push_back(now - std::min(now, truth));
+          if (fleet && now - start > kClockSettle) {
+            int64_t error = int64_t(sample.host_micros) - int64_t(truth);
+            clock_error_micros.push_back(std::abs(error));
+          }
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(kDrainPeriod));
+    }
+    cpu_micros = ThreadCpuMicros();
+  }
+};
+
+bool ParseArgs(int argc, char **argv, int first, Config &config,
+               std::vector<const char *> *ports) {
+  for (int i = first; i < argc; i++) {
+    const char *flag = argv[i];
+    if (ports && strncmp(flag, "--", 2)) {
+      ports->push_back(flag);
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (!strcmp(flag, "--max")) {
+      config.max_devices = atoi(value);
+    } else if (!strcmp(flag, "--duration")) {
+      config.duration = atof(value);
+    } else if (!strcmp(flag, "--broadcasts")) {
+      config.broadcasts = atoi(value);
+    } else {
+      fprintf(stderr, "Invalid argument: %s %s\n", flag, value);
+      return false;
+    }
+  }
+  return true;
+}
+
+void PrintUsage() {
+  fprintf(stderr,
+          "usage: multi_robot bench [--max N] [--duration S] [--broadcasts K]\n"
+          "       multi_robot run PORT... [--duration S]\n");
+}
+
+// Runs the loop and the consumer for duration seconds, with broadcasts of
+// {"idle": true} spread over the run and a last one at the end that leaves
+// every robot idle. Returns the scheduled times.
+std::vector<uint64_t> RunFor(HostRuntime &runtime, Consumer &consumer,
+                             const PtyFleet *fleet, const Config &config) {
+  std::atomic<bool> running(true);
+  std::thread consumer_thread(&Consumer::Run, &consumer, std::ref(runtime),
+                              fleet, std::cref(running));
+  uint8_t idle[32];
+  size_t idle_size = EncodeBoolCommand("idle", true, idle);
+  std::vector<uint64_t> scheduled;
+  uint64_t start = HostMicros();
+  uint64_t duration = config.duration * 1e6;
+  for (size_t b = 1; b <= config.broadcasts + 1; b++) {
+    uint64_t at = start + duration * b / (config.broadcasts + 1);
+    uint64_t now = HostMicros();
+    if (at > now + kBroadcastLead) {
+      std::this_thread::sleep_for(
+          std::chrono::microseconds(at - kBroadcastLead - now));
+    }
+    if (runtime.Broadcast(idle, idle_size, at)) {
+      scheduled.push_back(at);
+    }
+  }
+  std::this_thread::sleep_for(std::chrono::microseconds(2 * kBroadcastLead));
+  runtime.Stop();
+  running = false;
+  consumer_thread.join();
+  return scheduled;
+}
+
+int Bench(const Config &config) {
+  printf("%7s %8s %8s %9s %9s %7s %8s %8s %9s %9s %9s\n", "devices",
+         "loop%", "app%", "lat p50", "lat p99", "drops", "clk p50", "clk p99",
+         "wr skew", "rx skew", "late max");
+  int status = 0;
+  for (size_t n = 1; n <= config.max_devices; n *= 2) {
+    PtyFleet fleet;
+    HostRuntime runtime;
+    if (!fleet.Create(n, n)) {
+      return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (!runtime.AddDevice(fleet.Path(i).c_str())) {
+        return 1;
+      }
+    }
+    fleet.Start();
+    if (!runtime.Start()) {
+      return 1;
+    }
+    Consumer consumer;
+    uint64_t start = HostMicros();
+    std::vector<uint64_t> scheduled = RunFor(runtime, consumer, &fleet, config);
+    double wall = HostMicros() - start;
+    fleet.Stop();
+
+    uint64_t drops = 0;
+    uint64_t skipped = 0;
+    for (size_t i = 0; i < n; i++) {
+      drops += runtime.GetDevice(i).GetStats().dropped_samples +
+               fleet.GetStats(i).bytes_dropped;
+      skipped += runtime.GetDevice(i).SkippedBytes();
+    }
+    // Arrival of broadcast b at every device.
+    std::vector<uint32_t> receive_skew;
+    uint32_t late = 0;
+    for (size_t b = 0; b < scheduled.size(); b++) {
+      uint64_t first = UINT64_MAX;
+      uint64_t last = 0;
+      for (size_t i = 0; i < n; i++) {
+        const auto &times = fleet.GetStats(i).command_micros;
+        if (b >= times.size()) {
+          status = 1;
+          continue;
+        }
+        first = std::min(first, times[b]);
+        last = std::max(last, times[b]);
+      }
+      if (last >= first) {
+        receive_skew.push_back(last - first);
+        late = std::max<uint32_t>(late, last - std::min(last, scheduled[b]));
+      }
+    }
+    std::vector<uint32_t> write_skew =
+        runtime.GetLoopStats().broadcast_skew_micros;
+    printf("%7zu %7.1f%% %7.1f%% %9u %9u %7llu %8u %8u %9u %9u %9u\n", n,
+           100.0 * runtime.GetLoopStats().cpu_micros / wall,
+           100.0 * consumer.cpu_micros / wall,
+           Percentile(consumer.latency_micros, 0.5),
+           Percentile(consumer.latency_micros, 0.99),
+           static_cast<unsigned long long>(drops),
+           Percentile(consumer.clock_error_micros, 0.5),
+           Percentile(consumer.clock_error_micros, 0.99),
+           Percentile(write_skew, 1.0), Percentile(receive_skew, 1.0), late);
+    if (skipped > 0) {
+      printf("        %llu bytes skipped by the frame parser\n",
+             static_cast<unsigned long long>(skipped));
+      status = 1;
+    }
+  }
+  printf("latency, clock error, skew and lateness in us; skews are maxima\n");
+  return status;
+}
+
+int Run(const Config &config, const std::vector<const char *> &ports) {
+  HostRuntime runtime;
+  for (const char *port : ports) {
+    if (!runtime.AddDevice(port)) {
+      return 1;
+    }
+  }
+  if (!runtime.Start()) {
+    return 1;
+  }
+  Config run = config;
+  run.broadcasts = 0;
+  Consumer consumer;
+  uint64_t start = HostMicros();
+  RunFor(runtime, consumer, nullptr, run);
+  double wall = HostMicros() - start;
+
+  printf("loop %.1f%% cpu, application %.1f%% cpu, %llu samples\n",
+         100.0 * runtime.GetLoopStats().cpu_micros / wall,
+         100.0 * consumer.cpu_micros / wall,
+         static_cast<unsigned long long>(consumer.samples));
+  for (size_t i = 0; i < runtime.NumDevices(); i++) {
+    Device &device = runtime.GetDevice(i);
+    const Device::Stats &stats = device.GetStats();
+    printf("%s: %llu bytes, %u telemetry, %u msgpack, %u state, %u energy "
+           "frames, %u samples, %u dropped, drift %.1f ppm\n",
+           device.Path().c_str(), static_cast<unsigned long long>(stats.bytes),
+           stats.telemetry_frames, stats.msgpack_frames, stats.state_frames,
+           stats.energy_frames, stats.samples, stats.dropped_samples,
+           device.Clock().DriftPpm());
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Config config;
+  if (argc >= 2 && !strcmp(argv[1], "bench") &&
+      ParseArgs(argc, argv, 2, config, nullptr)) {
+    return Bench(config);
+  }
+  std::vector<const char *> ports;
+  if (argc >= 3 && !strcmp(argv[1], "run") &&
+      ParseArgs(argc, argv, 2, config, &ports) && !ports.empty()) {
+    return Run(config, ports);
+  }
+  PrintUsage();
+  return 1;
+}
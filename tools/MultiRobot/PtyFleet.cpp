@@ -0,0 +1,161 @@
+#include "PtyFleet.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+size_t PtyFleet::Output::write(const uint8_t *buffer, size_t size) {
+  if (pending_.size() + size > kMaxPending) {
+    stats_.bytes_dropped += size;
+    return 0;
+  }
+  pending_.insert(pending_.end(), buffer, buffer + size);
+  return size;
+}
+
+void PtyFleet::Output::Flush(int fd) {
+  if (pending_.empty()) {
+    return;
+  }
+  ssize_t n = ::write(fd, pending_.data(), pending_.size());
+  if (n > 0) {
+    stats_.bytes_written += n;
+    pending_.erase(pending_.begin(), pending_.begin() + n);
+  }
+}
+
+PtyFleet::~PtyFleet() {
+  Stop();
+  for (auto &device : devices_) {
+    close(device->fd);
+  }
+}
+
+bool PtyFleet::Create(size_t n, uint32_t seed) {
+  std::mt19937 random(seed);
+  std::uniform_int_distribution<uint32_t> offset;
+  std::uniform_real_distribution<double> drift_ppm(-50.0, 50.0);
+  for (size_t i = 0; i < n; i++) {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+      perror("posix_openpt");
+      if (fd >= 0) {
+        close(fd);
+      }
+      return false;
+    }
+    // Raw on both ends, like the USB serial link.
+    termios tty;
+    if (tcgetattr(fd, &tty) == 0) {
+      cfmakeraw(&tty);
+      tcsetattr(fd, TCSANOW, &tty);
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    std::unique_ptr<SimulatedRobot> device(new SimulatedRobot);
+    device->fd = fd;
+    device->path = ptsname(fd);
+    device->clock_offset = offset(random);
+    device->clock_rate = 1.0 + drift_ppm(random) * 1e-6;
+    devices_.push_back(std::move(device));
+  }
+  return true;
+}
+
+uint32_t PtyFleet::DeviceMicros(size_t i, uint64_t host_micros) const {
+  const SimulatedRobot &device = *devices_[i];
+  return device.clock_offset +
+         uint32_t(uint64_t((host_micros - start_micros_) * device.clock_rate));
+}
+
+uint64_t PtyFleet::HostMicrosAt(size_t i, uint32_t device_micros) const {
+  const SimulatedRobot &device = *devices_[i];
+  return start_micros_ + uint64_t(uint32_t(device_micros - device.clock_offset) /
+                                  device.clock_rate);
+}
+
+void PtyFleet::Start() {
+  start_micros_ = HostMicros();
+  running_ = true;
+  thread_ = std::thread(&PtyFleet::Run, this);
+}
+
+void PtyFleet::Stop() {
+  running_ = false;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+void PtyFleet::Run() {
+  float values[kMaxTelemetryValues];
+  std::vector<pollfd> fds(devices_.size());
+  for (size_t i = 0; i < devices_.size(); i++) {
+    fds[i] = {devices_[i]->fd, POLLIN, 0};
+  }
+  uint64_t next_tick = HostMicros();
+  while (running_) {
+    // Wait for commands until the next tick so that they are timestamped on
+    // arrival rather than at tick granularity.
+    uint64_t now = HostMicros();
+    if (now < next_tick) {
+      int timeout = (next_tick - now + 999) / 1000;
+      if (poll(fds.data(), fds.size(), timeout) > 0) {
+        ReadCommands(fds, HostMicros());
+        continue;
+      }
+      now = HostMicros();
+      if (now < next_tick) {
+        continue;
+      }
+    }
+    // If the thread fell behind, carry on from now instead of bursting the
+    // missed ticks.
+    next_tick = std::max(next_tick + tick_micros_, now);
+
+    for (size_t i = 0; i < devices_.size(); i++) {
+      SimulatedRobot &device = *devices_[i];
+      uint32_t device_now = DeviceMicros(i, now);
+      for (size_t v = 0; v < kMaxTelemetryValues; v++) {
+        values[v] = std::sin(device_now * 1e-6f + v);
+      }
+      device.batcher.AddSample(device_now, values);
+      device.batcher.Poll(device_now);
+      device.output.Flush(device.fd);
+    }
+  }
+}
+
+void PtyFleet::ReadCommands(std::vector<pollfd> &fds, uint64_t now) {
+  uint8_t buffer[1024];
+  for (size_t i = 0; i < devices_.size(); i++) {
+    if (!(fds[i].revents & POLLIN)) {
+      continue;
+    }
+    SimulatedRobot &device = *devices_[i];
+    ssize_t n;
+    while ((n = read(device.fd, buffer, sizeof(buffer))) > 0) {
+      device.input.insert(device.input.end(), buffer, buffer + n);
+    }
+    // Command frames: 0x00, length, msgpack.
+    size_t position = 0;
+    while (device.input.size() - position >= 2) {
+      if (device.input[position] != 0x00) {
+        position++;
+        continue;
+      }
+      size_t size = 2 + device.input[position + 1];
+      if (device.input.size() - position < size) {
+        break;
+      }
+      device.stats.command_micros.push_back(now);
+      position += size;
+    }
+    device.input.erase(device.input.begin(), device.input.begin() + position);
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <poll.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HostRuntime.h"
+#include "Platform.h"
+#include "TelemetryBatcher.h"
+
+// Stand-ins for N robots on pseudo-terminals. One thread plays the firmware
+// side of every pty: each control tick it adds a DebugData-sized sample to
+// the device's TelemetryBatcher (the firmware's own packet format, packet
+// size and latency deadline), and it records when command frames arrive.
+// Every device has its own clock offset and crystal drift so that the host
+// has something to synchronise.
+class PtyFleet {
+ public:
+  struct DeviceStats {
+    uint64_t bytes_written;
+    uint64_t bytes_dropped;  // host not reading, output buffer full
+    std::vector<uint64_t> command_micros;  // host time of each command
+  };
+
+  explicit PtyFleet(uint32_t tick_micros = 1000) : tick_micros_(tick_micros) {}
+  ~PtyFleet();
+
+  // Opens n ptys; the host side opens Path(i).
+  bool Create(size_t n, uint32_t seed);
+  const std::string &Path(size_t i) const { return devices_[i]->path; }
+
+  void Start();
+  void Stop();
+
+  // The device clock at a host time, as the firmware would report it.
+  uint32_t DeviceMicros(size_t i, uint64_t host_micros) const;
+  // The inverse: true host time of a device timestamp, to check ClockSync.
+  uint64_t HostMicrosAt(size_t i, uint32_t device_micros) const;
+
+  // Valid after Stop().
+  const DeviceStats &GetStats(size_t i) const { return devices_[i]->stats; }
+
+ private:
+  // TelemetryBatcher's output, buffered until the pty accepts it.
+  class Output : public Print {
+   public:
+    explicit Output(DeviceStats &stats) : stats_(stats) {}
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int availableForWrite() override { return kMaxPending - pending_.size(); }
+    void Flush(int fd);
+
+   private:
+    static const size_t kMaxPending = 1 << 18;
+    DeviceStats &stats_;
+    std::vector<uint8_t> pending_;
+  };
+
+  static const uint32_t kPacketSize = 8 * kUsbHighSpeedPacketSize;
+  static const uint32_t kBatchLatency = 20000;
+
+  struct SimulatedRobot {
+    int fd;
+    std::string path;
+    uint32_t clock_offset;
+    double clock_rate;  // device micros per host micro
+    DeviceStats stats;
+    Output output;
+    TelemetryBatcher<kPacketSize, kMaxTelemetryValues> batcher;
+    std::vector<uint8_t> input;
+
+    SimulatedRobot() : stats(), output(stats), batcher(output, kBatchLatency) {}
+  };
+
+  uint32_t tick_micros_;
+  uint64_t start_micros_ = 0;
+  std::vector<std::unique_ptr<SimulatedRobot>> devices_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+
+  void Run();
+  void ReadCommands(std::vector<pollfd> &fds, uint64_t now);
+};
@@ -0,0 +1,352 @@
+// Host side of the policy observations ({"policy": mask}, see
+// PolicyObservation.h).
+//
+//   policy_observation decode <capture> [out.csv]
+//       Find the 0x4A 0x4A frames in a serial capture and print one line per
+//       policy step: micros, step, then the stacked observation, oldest step
+//       first, to out.csv or stdout. Reports the policy rate and any steps
+//       missing from the capture.
+//   policy_observation check [ticks] [seed]
+//       Feed random rows through PolicyObservation over a range of
+//       configurations and compare every observation with a plain stack of
+//       normalised window averages computed in double. Then time a tick and
+//       a step with every DebugData column stacked 5 deep. Exits non-zero on
+//       a mismatch.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "DriveSignals.h"
+#include "PolicyObservation.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t kNumColumns =
+    kNumDriveScalarSignals + 12 * kNumDriveActuatorSignals;
+// Statistics per {"policy_norm"} command (kPolicyNormalizationChunk).
+const uint32_t kNormalizationChunk = 8;
+// Relative to the clip or, without one, the largest normalised value.
+const double kTolerance = 1e-5;
+
+class VectorPrint : public Print {
+ public:
+  size_t write(const uint8_t *buffer, size_t size) override {
+    bytes.insert(bytes.end(), buffer, buffer + size);
+    return size;
+  }
+  std::vector<uint8_t> bytes;
+};
+
+struct Frame {
+  uint32_t micros;
+  uint32_t step;
+  uint8_t history;
+  uint16_t num_features;
+  std::vector<float> values;
+};
+
+std::vector<Frame> FindFrames(const uint8_t *data, size_t size) {
+  std::vector<Frame> frames;
+  size_t i = 0;
+  while (i + kPolicyFrameHeaderSize <= size) {
+    if (data[i] != kPolicyFrameMarker || data[i + 1] != kPolicyFrameMarker) {
+      i++;
+      continue;
+    }
+    uint16_t length = data[i + 2] << 8 | data[i + 3];
+    Frame frame;
+    memcpy(&frame.micros, data + i + 4, 4);
+    memcpy(&frame.step, data + i + 8, 4);
+    frame.history = data[i + 12];
+    memcpy(&frame.num_features, data + i + 14, 2);
+    size_t num_values = frame.history * frame.num_features;
+    if (num_values == 0 || num_values > kPolicyMaxValues ||
+        length != kPolicyFrameHeaderSize - 4 + 4 * num_values ||
+        i + 4 + length > size) {
+      i++;
+      continue;
+    }
+    frame.values.resize(num_values);
+    memcpy(frame.values.data(), data + i + kPolicyFrameHeaderSize,
+           4 * num_values);
+    frames.push_back(frame);
+    i += 4 + length;
+  }
+  return frames;
+}
+
+int Decode(const char *path, const char *csv_path) {
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    fprintf(stderr, "Could not open %s\n", path);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[1 << 16];
+  size_t count;
+  while ((count = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    data.insert(data.end(), buffer, buffer + count);
+  }
+  fclose(in);
+
+  FILE *out = csv_path ? fopen(csv_path, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "Could not create %s\n", csv_path);
+    return 1;
+  }
+  std::vector<Frame> frames = FindFrames(data.data(), data.size());
+  uint32_t missing = 0;
+  for (size_t f = 0; f < frames.size(); f++) {
+    const Frame &frame = frames[f];
+    if (f > 0 && frame.step > frames[f - 1].step) {
+      missing += frame.step - frames[f - 1].step - 1;
+    }
+    fprintf(out, "%u,%u,", frame.micros, frame.step);
+    for (float value : frame.values) {
+      fprintf(out, "%g,", value);
+    }
+    fprintf(out, "\n");
+  }
+  if (csv_path) {
+    fclose(out);
+  }
+  if (frames.empty()) {
+    fprintf(stderr, "No policy frames in %s\n", path);
+    return 1;
+  }
+  // Keep the report off the rows when they go to stdout.
+  FILE *report = csv_path ? stdout : stderr;
+  const Frame &first = frames.front();
+  const Frame &last = frames.back();
+  double seconds = (last.micros - first.micros) * 1e-6;
+  fprintf(report,
+          "%zu frames, %u features x %u steps, %.1f Hz, %u steps missing\n",
+          frames.size(), last.num_features, last.history,
+          seconds > 0 ? (last.step - first.step) / seconds : 0.0, missing);
+  return 0;
+}
+
+struct Config {
+  uint32_t num_features;
+  uint8_t history;
+  uint16_t decimation;
+  float clip;
+};
+
+// The observation as a policy trained on the host would build it: window
+// averages of the raw columns, normalised and clipped, the last history of
+// them stacked oldest first and the first repeated until there are enough.
+class ReferenceObservation {
+ public:
+  ReferenceObservation(const Config &config, const uint8_t *columns,
+                       const std::vector<float> &mean,
+                       const std::vector<float> &stddev)
+      : config_(config),
+        columns_(columns, columns + config.num_features),
+        mean_(mean),
+        stddev_(stddev),
+        sum_(config.num_features, 0.0),
+        ticks_(0) {}
+
+  bool AddTick(const float *row) {
+    for (uint32_t i = 0; i < config_.num_features; i++) {
+      sum_[i] += row[columns_[i]];
+    }
+    if (++ticks_ < config_.decimation) {
+      return false;
+    }
+    ticks_ = 0;
+    std::vector<double> step(config_.num_features);
+    for (uint32_t i = 0; i < config_.num_features; i++) {
+      double average = sum_[i] / config_.decimation;
+      double stddev = stddev_[i] > 0 ? stddev_[i] : 1.0;
+      double value = (average - mean_[i]) / stddev;
+      if (config_.clip > 0) {
+        value = std::max<double>(-config_.clip,
+                                 std::min<double>(config_.clip, value));
+      }
+      step[i] = value;
+      sum_[i] = 0.0;
+    }
+    if (steps_.empty()) {
+      steps_.assign(config_.history, step);
+    } else {
+      steps_.pop_front();
+      steps_.push_back(step);
+    }
+    return true;
+  }
+
+  double Value(uint32_t index) const {
+    return steps_[index / config_.num_features][index % config_.num_features];
+  }
+
+ private:
+  Config config_;
+  std::vector<uint8_t> columns_;
+  std::vector<float> mean_;
+  std::vector<float> stddev_;
+  std::vector<double> sum_;
+  uint16_t ticks_;
+  std::deque<std::vector<double>> steps_;
+};
+
+// Rows of columns with very different scales and offsets, like positions,
+// currents and tick counts side by side.
+void RandomRow(std::mt19937 &random, uint32_t tick, float *row) {
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  for (uint32_t c = 0; c < kNumColumns; c++) {
+    float scale = powf(10.0f, static_cast<float>(c % 5) - 2);
+    row[c] = scale * (c % 3 + sinf(0.01f * tick + c) + 0.1f * noise(random));
+  }
+}
+
+// Largest difference from the reference relative to the clip or the
+// largest value, over ticks rows.
+double Compare(const Config &config, uint32_t ticks, std::mt19937 &random,
+               uint32_t &steps) {
+  std::vector<uint8_t> columns(config.num_features);
+  std::vector<float> mean(config.num_features), stddev(config.num_features);
+  for (uint32_t i = 0; i < config.num_features; i++) {
+    columns[i] = random() % kNumColumns;
+    float scale = powf(10.0f, static_cast<float>(columns[i] % 5) - 2);
+    mean[i] = scale * (columns[i] % 3);
+    // Some features without statistics.
+    stddev[i] = i % 7 == 3 ? 0.0f : 0.5f * scale;
+  }
+  static PolicyObservation policy;
+  if (!policy.Configure(columns.data(), config.num_features, config.history,
+                        config.decimation)) {
+    return INFINITY;
+  }
+  for (uint32_t start = 0; start < config.num_features;
+       start += kNormalizationChunk) {
+    uint32_t count =
+        std::min<uint32_t>(kNormalizationChunk, config.num_features - start);
+    policy.SetNormalization(start, &mean[start], &stddev[start], count);
+  }
+  policy.SetClip(config.clip);
+  ReferenceObservation reference(config, columns.data(), mean, stddev);
+
+  double worst = 0.0;
+  float row[kNumColumns];
+  steps = 0;
+  for (uint32_t tick = 0; tick < ticks; tick++) {
+    RandomRow(random, tick, row);
+    bool step = policy.AddTick(row, tick);
+    if (step != reference.AddTick(row)) {
+      return INFINITY;
+    }
+    if (!step) {
+      continue;
+    }
+    steps++;
+    double scale = config.clip > 0 ? config.clip : 1.0;
+    for (uint32_t i = 0; i < policy.Size(); i++) {
+      scale = std::max(scale, std::abs(reference.Value(i)));
+    }
+    for (uint32_t i = 0; i < policy.Size(); i++) {
+      double error =
+          std::abs(policy.Observation()[i] - reference.Value(i)) / scale;
+      if (!(error <= worst)) worst = error;
+    }
+  }
+
+  // The frame carries the same observation.
+  VectorPrint capture;
+  policy.WriteFrame(capture);
+  std::vector<Frame> frames =
+      FindFrames(capture.bytes.data(), capture.bytes.size());
+  if (frames.size() != 1 || frames[0].step != policy.Steps() ||
+      memcmp(frames[0].values.data(), policy.Observation(),
+             4 * policy.Size())) {
+    return INFINITY;
+  }
+  return worst;
+}
+
+void Bench() {
+  static PolicyObservation policy;
+  uint8_t columns[kNumColumns];
+  for (uint32_t c = 0; c < kNumColumns; c++) {
+    columns[c] = c;
+  }
+  const uint16_t kDecimation = 10;
+  const uint32_t kTicks = 1000000;
+  policy.Configure(columns, kNumColumns, 5, kDecimation);
+  policy.SetClip(5.0f);
+  std::mt19937 random(1);
+  std::vector<float> rows(16 * kNumColumns);
+  for (uint32_t r = 0; r < 16; r++) {
+    RandomRow(random, r, &rows[r * kNumColumns]);
+  }
+  float sink = 0.0f;
+  Clock::time_point start = Clock::now();
+  for (uint32_t tick = 0; tick < kTicks; tick++) {
+    if (policy.AddTick(&rows[(tick % 16) * kNumColumns], tick)) {
+      sink += policy.Observation()[tick % policy.Size()];
+    }
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  printf("%u features x 5, a step every %u ticks: %.1f ns/tick (%d)\n",
+         kNumColumns, kDecimation, seconds * 1e9 / kTicks, sink > 0);
+}
+
+int Check(uint32_t ticks, uint32_t seed) {
+  const Config configs[] = {
+      {1, 1, 1, 0.0f},         {12, 3, 10, 0.0f},
+      {42, 4, 20, 5.0f},       {kNumColumns, 5, 10, 5.0f},
+      {kPolicyMaxFeatures / 2, kPolicyMaxValues / (kPolicyMaxFeatures / 2),
+       7, 3.0f},
+      // Histories of 128 and more: twice the history no longer fits a byte.
+      {1, 200, 1, 0.0f},       {2, 255, 3, 2.0f},
+  };
+  std::mt19937 random(seed);
+  int status = 0;
+  for (const Config &config : configs) {
+    uint32_t steps = 0;
+    double error = Compare(config, ticks, random, steps);
+    printf("%3u features x %u, every %2u ticks, clip %.0f: %u steps, "
+           "max difference %.2e\n",
+           config.num_features, config.history, config.decimation,
+           config.clip, steps, error);
+    if (!(error <= kTolerance)) {
+      printf("FAIL: the observations disagree with the reference\n");
+      status = 1;
+    }
+  }
+  // Too large to fit.
+  uint8_t columns[kPolicyMaxFeatures] = {};
+  PolicyObservation policy;
+  if (policy.Configure(columns, kPolicyMaxFeatures, 6, 1) ||
+      policy.Enabled()) {
+    printf("FAIL: accepted an observation larger than kPolicyMaxValues\n");
+    status = 1;
+  }
+  Bench();
+  return status;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc >= 3 && !strcmp(argv[1], "decode")) {
+    return Decode(argv[2], argc >= 4 ? argv[3] : nullptr);
+  }
+  if (argc >= 2 && !strcmp(argv[1], "check")) {
+    return Check(argc >= 3 ? atoi(argv[2]) : 10000,
+                 argc >= 4 ? atoi(argv[3]) : 1);
+  }
+  fprintf(stderr,
+          "usage: policy_observation decode <capture> [out.csv]\n"
+          "       policy_observation check [ticks] [seed]\n");
+  return 1;
+}
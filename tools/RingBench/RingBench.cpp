@@ -0,0 +1,268 @@
+// Stress test and throughput benchmark for lib/RingBuffer on the host.
+//
+//   ring_bench [items] [producers]
+//
+// The stress runs move `items` sequence numbers through each ring with the
+// producers and the consumer on their own threads, mixing single, batch and
+// zero-copy calls, and check that nothing is lost, duplicated or reordered.
+// The benchmarks then report the cost per item of the single-threaded and
+// cross-thread paths. The ring is the same code the firmware uses between
+// interrupts and loop(); the host just provides real parallelism to shake out
+// ordering bugs. Exits non-zero if a check fails.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.h"
+
+namespace {
+
+const uint32_t kCapacity = 1024;
+const uint32_t kBatch = 16;
+
+typedef std::chrono::steady_clock Clock;
+
+double Seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Producer and consumer each cycle through the three ways of moving items.
+bool StressSpsc(uint32_t num_items) {
+  static SpscRing<uint32_t, kCapacity> ring;
+  std::thread producer([num_items] {
+    uint32_t next = 0;
+    uint32_t batch[kBatch];
+    for (uint32_t round = 0; next < num_items; round++) {
+      switch (round % 3) {
+        case 0: {
+          if (ring.Push(next)) {
+            next++;
+          }
+          break;
+        }
+        case 1: {
+          uint32_t count = num_items - next < kBatch ? num_items - next : kBatch;
+          for (uint32_t i = 0; i < count; i++) {
+            batch[i] = next + i;
+          }
+          next += ring.PushBatch(batch, count);
+          break;
+        }
+        case 2: {
+          auto span = ring.Reserve(num_items - next);
+          for (uint32_t i = 0; i < span.size; i++) {
+            span.data[i] = next + i;
+          }
+          ring.Commit(span.size);
+          next += span.size;
+          if (span.size == 0) {
+            std::this_thread::yield();
+          }
+          break;
+        }
+      }
+    }
+  });
+
+  uint32_t expected = 0;
+  uint32_t errors = 0;
+  uint32_t batch[kBatch];
+  for (uint32_t round = 0; expected < num_items; round++) {
+    uint32_t count = 0;
+    const uint32_t *items = batch;
+    switch (round % 3) {
+      case 0: {
+        count = ring.Pop(batch[0]);
+        break;
+      }
+      case 1: {
+        count = ring.PopBatch(batch, kBatch);
+        break;
+      }
+      case 2: {
+        auto span = ring.Peek(kBatch);
+        items = span.data;
+        count = span.size;
+        break;
+      }
+    }
+    if (count == 0) {
+      std::this_thread::yield();
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      errors += items[i] != expected++;
+    }
+    if (round % 3 == 2) {
+      ring.Release(count);
+    }
+  }
+  producer.join();
+  errors += !ring.Empty();
+  printf("spsc stress: %u items, %u errors\n", num_items, errors);
+  return errors == 0;
+}
+
+// Items are producer << 24 | sequence. Each producer's sequence must arrive in
+// order, and a batch must arrive contiguously.
+bool StressMpsc(uint32_t num_items, uint32_t num_producers) {
+  static MpscRing<uint32_t, kCapacity> ring;
+  uint32_t per_producer = num_items / num_producers;
+  std::vector<std::thread> producers;
+  for (uint32_t p = 0; p < num_producers; p++) {
+    producers.emplace_back([p, per_producer] {
+      uint32_t batch[kBatch];
+      uint32_t next = 0;
+      while (next < per_producer) {
+        uint32_t count = next % 3 == 0 ? 1 : kBatch;
+        if (count > per_producer - next) {
+          count = per_producer - next;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+          batch[i] = p << 24 | (next + i);
+        }
+        if (ring.PushBatch(batch, count)) {
+          next += count;
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::vector<uint32_t> expected(num_producers, 0);
+  uint32_t received = 0;
+  uint32_t errors = 0;
+  uint32_t batch[kBatch];
+  while (received < per_producer * num_producers) {
+    uint32_t count = ring.PopBatch(batch, kBatch);
+    if (count == 0) {
+      std::this_thread::yield();
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t p = batch[i] >> 24;
+      uint32_t sequence = batch[i] & 0xffffff;
+      if (p >= num_producers || sequence != expected[p]) {
+        errors++;
+      } else {
+        expected[p]++;
+      }
+    }
+    received += count;
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  errors += !ring.Empty();
+  printf("mpsc stress: %u producers, %u items, %u errors\n", num_producers,
+         received, errors);
+  return errors == 0;
+}
+
+// Push a whole batch, yielding while the ring is full so that the benchmark
+// also makes progress on machines with fewer cores than threads.
+template <uint32_t CAPACITY>
+void PushAll(SpscRing<uint32_t, CAPACITY> &ring, const uint32_t *items,
+             uint32_t count) {
+  for (uint32_t done = 0; done < count;) {
+    uint32_t pushed = ring.PushBatch(items + done, count - done);
+    if (pushed == 0) {
+      std::this_thread::yield();
+    }
+    done += pushed;
+  }
+}
+
+template <uint32_t CAPACITY>
+void PushAll(MpscRing<uint32_t, CAPACITY> &ring, const uint32_t *items,
+             uint32_t count) {
+  while (!ring.PushBatch(items, count)) {
+    std::this_thread::yield();
+  }
+}
+
+template <typename Ring>
+void BenchmarkSingleThread(const char *name, uint32_t num_items) {
+  static Ring ring;
+  uint32_t batch[kBatch];
+  uint32_t sum = 0;
+
+  auto start = Clock::now();
+  for (uint32_t n = 0; n < num_items; n++) {
+    ring.Push(n);
+    ring.Pop(batch[0]);
+    sum += batch[0];
+  }
+  double single = Seconds(start);
+
+  start = Clock::now();
+  for (uint32_t n = 0; n < num_items; n += kBatch) {
+    for (uint32_t i = 0; i < kBatch; i++) {
+      batch[i] = n + i;
+    }
+    ring.PushBatch(batch, kBatch);
+    ring.PopBatch(batch, kBatch);
+    sum += batch[0];
+  }
+  double batched = Seconds(start);
+
+  printf("%s, one thread [ns/item]: push+pop %.2f, batch of %u %.2f (%u)\n",
+         name, 1e9 * single / num_items, kBatch, 1e9 * batched / num_items,
+         sum & 1);
+}
+
+template <typename Ring>
+void BenchmarkCrossThread(const char *name, uint32_t num_items,
+                          uint32_t num_producers) {
+  static Ring ring;
+  auto start = Clock::now();
+  std::vector<std::thread> producers;
+  for (uint32_t p = 0; p < num_producers; p++) {
+    producers.emplace_back([num_items, num_producers] {
+      uint32_t batch[kBatch] = {};
+      for (uint32_t n = 0; n < num_items / num_producers; n += kBatch) {
+        PushAll(ring, batch, kBatch);
+      }
+    });
+  }
+  uint32_t batch[kBatch];
+  uint32_t popped = 0;
+  uint32_t total = num_items / num_producers / kBatch * kBatch * num_producers;
+  while (popped < total) {
+    uint32_t count = ring.PopBatch(batch, kBatch);
+    if (count == 0) {
+      std::this_thread::yield();
+    }
+    popped += count;
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  double seconds = Seconds(start);
+  printf("%s, %u producer(s) + consumer: %.1f M items/s\n", name,
+         num_producers, popped / seconds / 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  uint32_t num_items = argc > 1 ? atoi(argv[1]) : 10000000;
+  uint32_t num_producers = argc > 2 ? atoi(argv[2]) : 3;
+  if (num_producers < 1 || num_producers > 255) {
+    fprintf(stderr, "producers must be between 1 and 255\n");
+    return 1;
+  }
+
+  bool ok = StressSpsc(num_items);
+  ok = StressMpsc(num_items, num_producers) && ok;
+
+  BenchmarkSingleThread<SpscRing<uint32_t, kCapacity>>("spsc", num_items);
+  BenchmarkSingleThread<MpscRing<uint32_t, kCapacity>>("mpsc", num_items);
+  BenchmarkCrossThread<SpscRing<uint32_t, kCapacity>>("spsc", num_items, 1);
+  BenchmarkCrossThread<MpscRing<uint32_t, kCapacity>>("mpsc", num_items, 1);
+  BenchmarkCrossThread<MpscRing<uint32_t, kCapacity>>("mpsc", num_items,
+                                                      num_producers);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,86 @@
+#include "FaultMessages.h"
+
+#include <cstring>
+
+namespace {
+
+struct FaultMessage {
+  const char *text;
+  FaultKind kind;
+};
+
+const FaultMessage kFaultMessages[] = {
+    {"] hit fault position", FaultKind::kPosition},
+    {"] hit fault velocity", FaultKind::kVelocity},
+    {"Requested current too large", FaultKind::kCurrent},
+    {"Initial position is not zero", FaultKind::kHomingPosition},
+    {"Invalid actuator index", FaultKind::kInvalidActuator},
+};
+
+const char *kFaultKindNames[kNumFaultKinds] = {
+    "position", "velocity", "current", "homing_position", "invalid_actuator",
+};
+
+// The i of "actuator[i]" just before p, or -1.
+int ActuatorBefore(const uint8_t *begin, const uint8_t *p) {
+  const char prefix[] = "actuator[";
+  int actuator = 0;
+  int scale = 1;
+  while (p > begin && p[-1] >= '0' && p[-1] <= '9' && scale <= 10) {
+    p--;
+    actuator += (*p - '0') * scale;
+    scale *= 10;
+  }
+  size_t prefix_length = sizeof(prefix) - 1;
+  if (scale == 1 || p - begin < static_cast<ptrdiff_t>(prefix_length) ||
+      memcmp(p - prefix_length, prefix, prefix_length) != 0) {
+    return -1;
+  }
+  return actuator;
+}
+
+}  // namespace
+
+const char *FaultKindName(FaultKind kind) {
+  return kFaultKindNames[static_cast<uint8_t>(kind)];
+}
+
+void FaultStats::Merge(const FaultStats &later) {
+  for (uint8_t k = 0; k < kNumFaultKinds; k++) {
+    Kind &kind = kinds[k];
+    const Kind &other = later.kinds[k];
+    if (other.count == 0) continue;
+    if (kind.count == 0) {
+      kind.first_millis = other.first_millis;
+    }
+    kind.count += other.count;
+    kind.last_millis = other.last_millis;
+    for (size_t i = 0; i < kind.per_actuator.size(); i++) {
+      kind.per_actuator[i] += other.per_actuator[i];
+    }
+  }
+}
+
+void ScanFaultMessages(const uint8_t *text, size_t size,
+                       uint32_t time_millis, FaultStats &stats) {
+  for (const FaultMessage &message : kFaultMessages) {
+    size_t length = strlen(message.text);
+    const uint8_t *p = text;
+    const uint8_t *end = text + size;
+    while (const void *found = memmem(p, end - p, message.text, length)) {
+      const uint8_t *match = static_cast<const uint8_t *>(found);
+      FaultStats::Kind &kind = stats.kinds[static_cast<uint8_t>(message.kind)];
+      if (kind.count == 0) {
+        kind.first_millis = time_millis;
+      }
+      kind.count++;
+      kind.last_millis = time_millis;
+      int actuator = ActuatorBefore(text, match);
+      if (actuator >= 0 &&
+          actuator < static_cast<int>(kind.per_actuator.size())) {
+        kind.per_actuator[actuator]++;
+      }
+      p = match + length;
+    }
+  }
+}
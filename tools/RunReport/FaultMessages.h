@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Faults counted from the messages the firmware prints when it enters
+// kError (DriveSystem::CheckErrors(), CommandCurrents() and homing), which
+// sit in the capture between the binary frames. Stream timeouts are
+// recorded without a message and do not show up here.
+enum class FaultKind : uint8_t {
+  kPosition,
+  kVelocity,
+  kCurrent,
+  kHomingPosition,
+  kInvalidActuator,
+};
+const uint8_t kNumFaultKinds = 5;
+
+const char *FaultKindName(FaultKind kind);
+
+struct FaultStats {
+  struct Kind {
+    uint32_t count = 0;
+    uint32_t first_millis = 0;  // device time of the status frame before
+    uint32_t last_millis = 0;
+    std::array<uint32_t, 12> per_actuator = {};  // where the message says
+  };
+  std::array<Kind, kNumFaultKinds> kinds;
+
+  // Fold in the faults that came after these.
+  void Merge(const FaultStats &later);
+};
+
+// Count the fault messages in text, at device time time_millis.
+void ScanFaultMessages(const uint8_t *text, size_t size,
+                       uint32_t time_millis, FaultStats &stats);
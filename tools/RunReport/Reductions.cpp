@@ -0,0 +1,285 @@
+#include "Reductions.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const char *kQuantityNames[kNumQuantities] = {
+    "pos",     "vel",     "cur",     "pref",      "vref",
+    "cref",    "lcur",    "pos_err", "vel_err",   "cur_err",
+    "saturated", "elec_power", "mech_power",
+};
+
+const char *kQuantityUnits[kNumQuantities] = {
+    "rad", "rad/s", "A", "rad", "rad/s", "A", "A", "rad", "rad/s", "A",
+    "", "W", "W",
+};
+
+const char *kIntegralUnits[kNumQuantities] = {
+    "rad s", "rad", "A s", "rad s", "rad", "A s", "A s", "rad s", "rad", "A s",
+    "s", "J", "J",
+};
+
+const char *kAggregateNames[kNumAggregates] = {
+    "mean", "rms", "min", "max", "max_abs", "integral",
+};
+
+// Relative slack for comparing the commanded current with max_current.
+const float kSaturationTolerance = 1e-4f;
+
+int ColumnIndex(const char *key) {
+  for (uint8_t c = 0; c < kNumStatusColumns; c++) {
+    if (strcmp(kStatusColumns[c].key, key) == 0) {
+      return c;
+    }
+  }
+  return -1;
+}
+
+const int kTimeColumn = ColumnIndex("ts");
+const int kPositionColumn = ColumnIndex("pos");
+const int kVelocityColumn = ColumnIndex("vel");
+const int kCurrentColumn = ColumnIndex("cur");
+const int kPositionReferenceColumn = ColumnIndex("pref");
+const int kVelocityReferenceColumn = ColumnIndex("vref");
+const int kCurrentReferenceColumn = ColumnIndex("cref");
+const int kCommandedCurrentColumn = ColumnIndex("lcur");
+
+// Joint values of an actuator column, or NaN if the frame did not hold it.
+void Column(const StatusColumns &columns, size_t row, int column,
+            float *out) {
+  if (column < 0 || !(columns.presence[row] & (1 << column))) {
+    for (size_t j = 0; j < kStatusActuators; j++) {
+      out[j] = NAN;
+    }
+    return;
+  }
+  memcpy(out, columns.data[column] + row * kStatusActuators,
+         kStatusActuators * sizeof(float));
+}
+
+}  // namespace
+
+const char *QuantityName(Quantity quantity) {
+  return kQuantityNames[static_cast<uint8_t>(quantity)];
+}
+
+const char *AggregateName(Aggregate aggregate) {
+  return kAggregateNames[static_cast<uint8_t>(aggregate)];
+}
+
+const char *ReductionUnit(const Reduction &reduction) {
+  uint8_t q = static_cast<uint8_t>(reduction.quantity);
+  return reduction.aggregate == Aggregate::kIntegral ? kIntegralUnits[q]
+                                                     : kQuantityUnits[q];
+}
+
+bool ParseReduction(const std::string &text, Reduction &reduction) {
+  size_t colon = text.find(':');
+  if (colon == std::string::npos) return false;
+  std::string aggregate = text.substr(0, colon);
+  std::string quantity = text.substr(colon + 1);
+  bool found_aggregate = false;
+  bool found_quantity = false;
+  for (uint8_t a = 0; a < kNumAggregates; a++) {
+    if (aggregate == kAggregateNames[a]) {
+      reduction.aggregate = static_cast<Aggregate>(a);
+      found_aggregate = true;
+    }
+  }
+  for (uint8_t q = 0; q < kNumQuantities; q++) {
+    if (quantity == kQuantityNames[q]) {
+      reduction.quantity = static_cast<Quantity>(q);
+      found_quantity = true;
+    }
+  }
+  return found_aggregate && found_quantity;
+}
+
+std::vector<Reduction> DefaultReductions() {
+  return {
+      {Aggregate::kRms, Quantity::kPositionError},
+      {Aggregate::kMaxAbs, Quantity::kPositionError},
+      {Aggregate::kRms, Quantity::kVelocityError},
+      {Aggregate::kRms, Quantity::kCurrent},
+      {Aggregate::kMaxAbs, Quantity::kCurrent},
+      {Aggregate::kIntegral, Quantity::kSaturated},
+      {Aggregate::kMean, Quantity::kElectricalPower},
+      {Aggregate::kIntegral, Quantity::kElectricalPower},
+      {Aggregate::kIntegral, Quantity::kMechanicalPower},
+  };
+}
+
+void Accumulator::Merge(const Accumulator &other) {
+  count += other.count;
+  sum += other.sum;
+  sum_squares += other.sum_squares;
+  integral += other.integral;
+  min = other.min < min ? other.min : min;
+  max = other.max > max ? other.max : max;
+}
+
+double Accumulator::Value(Aggregate aggregate) const {
+  if (count == 0) return NAN;
+  switch (aggregate) {
+    case Aggregate::kMean:
+      return sum / count;
+    case Aggregate::kRms:
+      return sqrt(sum_squares / count);
+    case Aggregate::kMin:
+      return min;
+    case Aggregate::kMax:
+      return max;
+    case Aggregate::kMaxAbs:
+      return std::max(std::abs(min), std::abs(max));
+    case Aggregate::kIntegral:
+      return integral;
+  }
+  return NAN;
+}
+
+Reducer::Reducer(const std::vector<Reduction> &reductions,
+                 const PowerModel &power, uint32_t window_millis)
+    : power_(power), window_millis_(window_millis) {
+  slots_.fill(-1);
+  for (const Reduction &reduction : reductions) {
+    int8_t &slot = slots_[static_cast<uint8_t>(reduction.quantity)];
+    if (slot < 0) {
+      slot = quantities_.size();
+      quantities_.push_back(reduction.quantity);
+    }
+  }
+  totals_.resize(quantities_.size());
+}
+
+size_t Reducer::Slot(const Reduction &reduction) const {
+  return slots_[static_cast<uint8_t>(reduction.quantity)];
+}
+
+void Reducer::Evaluate(Quantity quantity, const StatusColumns &columns,
+                       size_t row, float *out) const {
+  float a[kStatusActuators];
+  float b[kStatusActuators];
+  switch (quantity) {
+    case Quantity::kPosition:
+      return Column(columns, row, kPositionColumn, out);
+    case Quantity::kVelocity:
+      return Column(columns, row, kVelocityColumn, out);
+    case Quantity::kCurrent:
+      return Column(columns, row, kCurrentColumn, out);
+    case Quantity::kPositionReference:
+      return Column(columns, row, kPositionReferenceColumn, out);
+    case Quantity::kVelocityReference:
+      return Column(columns, row, kVelocityReferenceColumn, out);
+    case Quantity::kCurrentReference:
+      return Column(columns, row, kCurrentReferenceColumn, out);
+    case Quantity::kCommandedCurrent:
+      return Column(columns, row, kCommandedCurrentColumn, out);
+    case Quantity::kPositionError:
+    case Quantity::kVelocityError:
+    case Quantity::kCurrentError: {
+      bool position = quantity == Quantity::kPositionError;
+      bool velocity = quantity == Quantity::kVelocityError;
+      Column(columns, row,
+             position   ? kPositionReferenceColumn
+             : velocity ? kVelocityReferenceColumn
+                        : kCurrentReferenceColumn,
+             a);
+      Column(columns, row,
+             position   ? kPositionColumn
+             : velocity ? kVelocityColumn
+                        : kCurrentColumn,
+             b);
+      for (size_t j = 0; j < kStatusActuators; j++) {
+        out[j] = a[j] - b[j];
+      }
+      return;
+    }
+    case Quantity::kSaturated: {
+      Column(columns, row, kCommandedCurrentColumn, a);
+      float limit = power_.max_current * (1 - kSaturationTolerance);
+      for (size_t j = 0; j < kStatusActuators; j++) {
+        out[j] = power_.max_current <= 0 || a[j] != a[j]
+                     ? NAN
+                     : std::abs(a[j]) >= limit;
+      }
+      return;
+    }
+    case Quantity::kElectricalPower:
+    case Quantity::kMechanicalPower: {
+      Column(columns, row, kCurrentColumn, a);
+      Column(columns, row, kVelocityColumn, b);
+      bool electrical = quantity == Quantity::kElectricalPower;
+      for (size_t j = 0; j < kStatusActuators; j++) {
+        out[j] = power_.torque_constant * a[j] * b[j];
+        if (electrical) {
+          out[j] += power_.winding_resistance * a[j] * a[j];
+        }
+      }
+      return;
+    }
+  }
+}
+
+void Reducer::AddFrame(const StatusColumns &columns, size_t row, float dt) {
+  std::vector<JointAccumulators> *window = nullptr;
+  if (window_millis_ > 0 && kTimeColumn >= 0 &&
+      (columns.presence[row] & (1 << kTimeColumn))) {
+    uint32_t index = columns.data[kTimeColumn][row] / window_millis_;
+    window = &windows_[index];
+    if (window->empty()) {
+      window->resize(quantities_.size());
+    }
+    has_window_ = true;
+    current_window_ = index;
+  }
+  float values[kStatusActuators];
+  for (size_t q = 0; q < quantities_.size(); q++) {
+    Evaluate(quantities_[q], columns, row, values);
+    for (size_t j = 0; j < kStatusActuators; j++) {
+      totals_[q][j].Add(values[j], dt);
+      if (window != nullptr) {
+        (*window)[q][j].Add(values[j], dt);
+      }
+    }
+  }
+}
+
+void Reducer::Merge(const Reducer &later) {
+  for (size_t q = 0; q < totals_.size(); q++) {
+    for (size_t j = 0; j < kStatusActuators; j++) {
+      totals_[q][j].Merge(later.totals_[q][j]);
+    }
+  }
+  for (const auto &entry : later.windows_) {
+    std::vector<JointAccumulators> &window = windows_[entry.first];
+    if (window.empty()) {
+      window = entry.second;
+      continue;
+    }
+    for (size_t q = 0; q < window.size(); q++) {
+      for (size_t j = 0; j < kStatusActuators; j++) {
+        window[q][j].Merge(entry.second[q][j]);
+      }
+    }
+  }
+  if (later.has_window_) {
+    has_window_ = true;
+    current_window_ = later.current_window_;
+  }
+}
+
+std::vector<std::pair<uint32_t, std::vector<JointAccumulators>>>
+Reducer::TakeWindows(bool all) {
+  std::vector<std::pair<uint32_t, std::vector<JointAccumulators>>> taken;
+  for (auto it = windows_.begin(); it != windows_.end();) {
+    if (!all && has_window_ && it->first == current_window_) {
+      ++it;
+      continue;
+    }
+    taken.emplace_back(it->first, std::move(it->second));
+    it = windows_.erase(it);
+  }
+  return taken;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../TelemetryDecoder/StatusDecoder.h"
+
+// Declarative reductions over the status stream. A reduction is an aggregate
+// of a per-joint quantity, written "aggregate:quantity", e.g. "rms:pos_err".
+// Every quantity is accumulated once into count, sum, sum of squares,
+// minimum, maximum and time integral per joint, from which all aggregates
+// follow, and accumulators merge by adding up. So a stretch of frames can be
+// reduced on its own and the partial results merged in any grouping, for the
+// whole run as well as per time window.
+
+enum class Quantity : uint8_t {
+  kPosition,           // pos [rad]
+  kVelocity,           // vel [rad/s]
+  kCurrent,            // cur [A]
+  kPositionReference,  // pref [rad]
+  kVelocityReference,  // vref [rad/s]
+  kCurrentReference,   // cref [A]
+  kCommandedCurrent,   // lcur [A]
+  kPositionError,      // pref - pos [rad]
+  kVelocityError,      // vref - vel [rad/s]
+  kCurrentError,       // cref - cur [A]
+  kSaturated,          // 1 while |lcur| is at max_current, else 0
+  kElectricalPower,    // mechanical power + copper loss [W]
+  kMechanicalPower,    // torque * vel [W]
+};
+const uint8_t kNumQuantities = 13;
+
+enum class Aggregate : uint8_t {
+  kMean,
+  kRms,
+  kMin,
+  kMax,
+  kMaxAbs,
+  kIntegral,  // over time, [unit s]: energy, or time saturated
+};
+const uint8_t kNumAggregates = 6;
+
+const char *QuantityName(Quantity quantity);
+const char *AggregateName(Aggregate aggregate);
+
+struct Reduction {
+  Aggregate aggregate;
+  Quantity quantity;
+};
+
+// Unit of a reduction's value, e.g. "J" for integral:elec_power.
+const char *ReductionUnit(const Reduction &reduction);
+
+// Parses "aggregate:quantity". Returns false for an unknown name.
+bool ParseReduction(const std::string &text, Reduction &reduction);
+
+// The report the run report prints when no reduction is given.
+std::vector<Reduction> DefaultReductions();
+
+// Constants that the status stream does not carry. Power is estimated from
+// the C610 current and velocity readings.
+struct PowerModel {
+  float torque_constant = 0.25f;    // [Nm/A] at the output, as LegPlant
+  float winding_resistance = 0.3f;  // [Ohm]
+  float max_current = 0.0f;         // [A], 0 if unknown: kSaturated is NaN
+};
+
+// Running statistics of one quantity of one joint. NaN samples (signals the
+// frame did not hold) are left out.
+struct Accumulator {
+  uint64_t count = 0;
+  double sum = 0;
+  double sum_squares = 0;
+  double integral = 0;
+  float min = std::numeric_limits<float>::infinity();
+  float max = -std::numeric_limits<float>::infinity();
+
+  void Add(float x, float dt) {
+    if (x != x) return;
+    count++;
+    sum += x;
+    sum_squares += static_cast<double>(x) * x;
+    integral += static_cast<double>(x) * dt;
+    min = x < min ? x : min;
+    max = x > max ? x : max;
+  }
+  void Merge(const Accumulator &other);
+  // NaN without samples.
+  double Value(Aggregate aggregate) const;
+};
+
+typedef std::array<Accumulator, kStatusActuators> JointAccumulators;
+
+// Accumulators for the quantities a set of reductions uses, over the whole
+// stretch and per window of window_millis of device time.
+class Reducer {
+ public:
+  Reducer(const std::vector<Reduction> &reductions, const PowerModel &power,
+          uint32_t window_millis);
+
+  // Add one decoded status frame, held for dt seconds (0 for the first
+  // frame and after gaps).
+  void AddFrame(const StatusColumns &columns, size_t row, float dt);
+
+  // Fold in the reducer of the frames that came after this one's.
+  void Merge(const Reducer &later);
+
+  // Remove and return the windows, in order, except the one the last frame
+  // fell in unless all is set.
+  std::vector<std::pair<uint32_t, std::vector<JointAccumulators>>>
+  TakeWindows(bool all);
+
+  const std::vector<JointAccumulators> &Totals() const { return totals_; }
+  // Index into Totals() and window accumulators of a reduction's quantity.
+  size_t Slot(const Reduction &reduction) const;
+  uint32_t WindowMillis() const { return window_millis_; }
+
+ private:
+  void Evaluate(Quantity quantity, const StatusColumns &columns, size_t row,
+                float *out) const;
+
+  PowerModel power_;
+  uint32_t window_millis_;
+  std::vector<Quantity> quantities_;
+  std::array<int8_t, kNumQuantities> slots_;
+  std::vector<JointAccumulators> totals_;
+  std::map<uint32_t, std::vector<JointAccumulators>> windows_;
+  bool has_window_ = false;
+  uint32_t current_window_ = 0;
+};
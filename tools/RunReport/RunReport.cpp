@@ -0,0 +1,381 @@
+// Post-run report over a serial capture of the msgpack status stream: joint
+// tracking errors, time at the current limit, power and energy, and the
+// faults the firmware printed.
+//
+// Usage:
+//   run_report <capture> [--metric aggregate:quantity]... [--max-current A]
+//              [--kt NM_PER_A] [--resistance OHM] [--window S --csv path]
+//              [--threads T] [--chunk MB]
+//
+// Aggregates: mean, rms, min, max, max_abs, integral. Quantities: pos, vel,
+// cur, pref, vref, cref, lcur, pos_err, vel_err, cur_err, saturated (needs
+// --max-current, the value sent with {"max_current": ...}), elec_power,
+// mech_power. Without --metric the report covers tracking error, current,
+// saturation time, power and energy.
+//
+// The capture is scanned for frames by chunk (tools/TelemetryDecoder), then
+// worker threads take the chunks in order, decode and reduce each into a
+// partial result, which is merged into the report as soon as the chunks
+// before it are in. Windows of --window seconds of device time are written
+// to the CSV file as they complete, so memory stays bounded by the chunks in
+// flight. Values are integrated over the time since the previous frame,
+// skipping gaps over 100 ms; device resets restart the clock and with it
+// the windows.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../TelemetryDecoder/FrameScan.h"
+#include "../TelemetryDecoder/StatusDecoder.h"
+#include "../common/MappedFile.h"
+#include "../common/WorkStealingPool.h"
+#include "FaultMessages.h"
+#include "Reductions.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t kDefaultChunkBytes = 4 << 20;
+const uint32_t kMaxGapMillis = 100;
+const uint64_t kNoFrame = UINT64_MAX;
+
+struct Config {
+  std::string capture;
+  std::vector<Reduction> reductions;
+  PowerModel power;
+  float window_seconds = 0;
+  std::string csv;
+  size_t threads = 0;
+  size_t chunk_bytes = kDefaultChunkBytes;
+};
+
+// One decoded frame, reused for every frame of a chunk.
+class FrameBuffer {
+ public:
+  FrameBuffer() {
+    for (uint8_t c = 0; c < kNumStatusColumns; c++) {
+      columns_.data[c] = values_[c];
+    }
+    columns_.presence = &presence_;
+  }
+
+  bool Decode(const uint8_t *frame) {
+    return DecodeStatusFrame(frame + kMsgPackFrameHeader,
+                             MsgPackPayloadSize(frame), columns_, 0);
+  }
+  const StatusColumns &Columns() const { return columns_; }
+  // Device time, if the frame held it. ts is the first signal.
+  bool Time(uint32_t &millis) const {
+    if (!(presence_ & 1)) return false;
+    millis = values_[0][0];
+    return true;
+  }
+
+ private:
+  uint32_t values_[kNumStatusColumns][kStatusActuators];
+  StatusPresence presence_;
+  StatusColumns columns_;
+};
+
+// What one or more consecutive chunks add up to.
+struct Partial {
+  explicit Partial(const Config &config)
+      : reducer(config.reductions, config.power,
+                std::lround(config.window_seconds * 1000)) {}
+
+  void Merge(const Partial &later) {
+    reducer.Merge(later.reducer);
+    faults.Merge(later.faults);
+    frames += later.frames;
+    malformed += later.malformed;
+    covered_seconds += later.covered_seconds;
+  }
+
+  Reducer reducer;
+  FaultStats faults;
+  size_t frames = 0;
+  size_t malformed = 0;
+  double covered_seconds = 0;  // sum of the integration steps
+};
+
+// Frame offsets and the frame before each chunk's first one.
+struct Frames {
+  const uint8_t *data;
+  size_t size;
+  std::vector<CaptureChunk> chunks;
+  std::vector<uint64_t> previous;  // kNoFrame for the first frame
+  size_t last_chunk;               // holding the capture's last frame
+};
+
+uint64_t FrameEnd(const Frames &frames, uint64_t offset) {
+  return offset + kMsgPackFrameHeader +
+         MsgPackPayloadSize(frames.data + offset) + kMsgPackFrameTrailer;
+}
+
+void ReduceChunk(const Frames &frames, size_t c, Partial &partial) {
+  FrameBuffer buffer;
+  bool has_previous = false;
+  uint32_t previous_millis = 0;
+  uint64_t text_begin = 0;
+  if (frames.previous[c] != kNoFrame) {
+    const uint8_t *previous = frames.data + frames.previous[c];
+    has_previous = buffer.Decode(previous) && buffer.Time(previous_millis);
+    text_begin = FrameEnd(frames, frames.previous[c]);
+  }
+
+  for (uint64_t offset : frames.chunks[c].frames) {
+    // Text and other frames since the previous status frame.
+    ScanFaultMessages(frames.data + text_begin, offset - text_begin,
+                      previous_millis, partial.faults);
+    text_begin = FrameEnd(frames, offset);
+
+    partial.frames++;
+    if (!buffer.Decode(frames.data + offset)) {
+      partial.malformed++;
+      continue;
+    }
+    uint32_t millis;
+    float dt = 0;
+    if (buffer.Time(millis)) {
+      if (has_previous && millis >= previous_millis &&
+          millis - previous_millis <= kMaxGapMillis) {
+        dt = (millis - previous_millis) * 1e-3f;
+      }
+      has_previous = true;
+      previous_millis = millis;
+    }
+    partial.covered_seconds += dt;
+    partial.reducer.AddFrame(buffer.Columns(), 0, dt);
+  }
+  if (c == frames.last_chunk) {
+    ScanFaultMessages(frames.data + text_begin, frames.size - text_begin,
+                      previous_millis, partial.faults);
+  }
+}
+
+// Folds the chunks' partial results into the report in chunk order, and
+// writes the windows that can no longer change.
+class StreamingMerge {
+ public:
+  StreamingMerge(const Config &config, size_t num_chunks, FILE *csv)
+      : config_(config), pending_(num_chunks), total_(config), csv_(csv) {}
+
+  void Add(size_t chunk, std::unique_ptr<Partial> partial) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_[chunk] = std::move(partial);
+    while (next_ < pending_.size() && pending_[next_]) {
+      total_.Merge(*pending_[next_]);
+      pending_[next_].reset();
+      next_++;
+      // Later chunks can still add to the window in progress.
+      WriteWindows(false);
+    }
+  }
+
+  // After the last chunk.
+  const Partial &Finish() {
+    WriteWindows(true);
+    return total_;
+  }
+
+ private:
+  void WriteWindows(bool all) {
+    if (csv_ == nullptr) return;
+    auto windows = total_.reducer.TakeWindows(all);
+    for (const auto &window : windows) {
+      fprintf(csv_, "%.3f",
+              window.first * 1e-3 * total_.reducer.WindowMillis());
+      for (const Reduction &reduction : config_.reductions) {
+        const JointAccumulators &joints =
+            window.second[total_.reducer.Slot(reduction)];
+        for (const Accumulator &joint : joints) {
+          fprintf(csv_, ",%.6g", joint.Value(reduction.aggregate));
+        }
+      }
+      fprintf(csv_, "\n");
+    }
+  }
+
+  const Config &config_;
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Partial>> pending_;
+  size_t next_ = 0;
+  Partial total_;
+  FILE *csv_;
+};
+
+void WriteCsvHeader(const Config &config, FILE *csv) {
+  fprintf(csv, "t");
+  for (const Reduction &reduction : config.reductions) {
+    for (size_t j = 0; j < kStatusActuators; j++) {
+      fprintf(csv, ",%s:%s[%zu]", AggregateName(reduction.aggregate),
+              QuantityName(reduction.quantity), j);
+    }
+  }
+  fprintf(csv, "\n");
+}
+
+void PrintReport(const Config &config, const Partial &total, size_t bytes,
+                 size_t threads, double seconds) {
+  printf("%.1f MB, %zu status frames, %zu malformed, %.1f s of device time\n",
+         bytes / 1e6, total.frames, total.malformed, total.covered_seconds);
+  printf("reduced in %.2f s on %zu threads: %.0f MB/s, %.2f M frames/s\n\n",
+         seconds, threads, bytes / 1e6 / seconds,
+         total.frames / seconds * 1e-6);
+
+  printf("%-22s %-6s", "reduction", "unit");
+  for (size_t j = 0; j < kStatusActuators; j++) {
+    printf(" %9zu", j);
+  }
+  printf(" %9s\n", "all");
+  for (const Reduction &reduction : config.reductions) {
+    std::string name = std::string(AggregateName(reduction.aggregate)) + ":" +
+                       QuantityName(reduction.quantity);
+    printf("%-22s %-6s", name.c_str(), ReductionUnit(reduction));
+    Accumulator all;
+    for (const Accumulator &joint :
+         total.reducer.Totals()[total.reducer.Slot(reduction)]) {
+      printf(" %9.4g", joint.Value(reduction.aggregate));
+      all.Merge(joint);
+    }
+    printf(" %9.4g\n", all.Value(reduction.aggregate));
+  }
+
+  printf("\nfaults:");
+  bool any = false;
+  for (uint8_t k = 0; k < kNumFaultKinds; k++) {
+    const FaultStats::Kind &kind = total.faults.kinds[k];
+    if (kind.count == 0) continue;
+    any = true;
+    printf("\n  %-17s %5u  first %.3f s, last %.3f s",
+           FaultKindName(static_cast<FaultKind>(k)), kind.count,
+           kind.first_millis * 1e-3, kind.last_millis * 1e-3);
+    for (size_t i = 0; i < kind.per_actuator.size(); i++) {
+      if (kind.per_actuator[i] > 0) {
+        printf(", actuator %zu: %u", i, kind.per_actuator[i]);
+      }
+    }
+  }
+  printf(any ? "\n" : " none\n");
+}
+
+bool ParseArgs(int argc, char **argv, Config &config) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--metric" && has_value) {
+      Reduction reduction;
+      if (!ParseReduction(argv[++i], reduction)) {
+        fprintf(stderr, "unknown metric %s\n", argv[i]);
+        return false;
+      }
+      config.reductions.push_back(reduction);
+    } else if (arg == "--max-current" && has_value) {
+      config.power.max_current = atof(argv[++i]);
+    } else if (arg == "--kt" && has_value) {
+      config.power.torque_constant = atof(argv[++i]);
+    } else if (arg == "--resistance" && has_value) {
+      config.power.winding_resistance = atof(argv[++i]);
+    } else if (arg == "--window" && has_value) {
+      config.window_seconds = atof(argv[++i]);
+    } else if (arg == "--csv" && has_value) {
+      config.csv = argv[++i];
+    } else if (arg == "--threads" && has_value) {
+      config.threads = atoi(argv[++i]);
+    } else if (arg == "--chunk" && has_value) {
+      config.chunk_bytes = std::max(1.0, atof(argv[++i]) * (1 << 20));
+    } else if (config.capture.empty() && arg[0] != '-') {
+      config.capture = arg;
+    } else {
+      fprintf(stderr, "unknown argument %s\n", arg.c_str());
+      return false;
+    }
+  }
+  if (config.reductions.empty()) {
+    config.reductions = DefaultReductions();
+  }
+  if ((config.window_seconds > 0) != !config.csv.empty()) {
+    fprintf(stderr, "--window and --csv go together\n");
+    return false;
+  }
+  return !config.capture.empty();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Config config;
+  if (!ParseArgs(argc, argv, config)) {
+    printf("usage: run_report <capture> [--metric aggregate:quantity]... "
+           "[--max-current A]\n"
+           "                  [--kt NM_PER_A] [--resistance OHM] "
+           "[--window S --csv path]\n"
+           "                  [--threads T] [--chunk MB]\n");
+    return 2;
+  }
+  MappedFile capture;
+  if (!capture.OpenRead(config.capture)) {
+    fprintf(stderr, "cannot read %s\n", config.capture.c_str());
+    return 1;
+  }
+  FILE *csv = nullptr;
+  if (!config.csv.empty()) {
+    csv = fopen(config.csv.c_str(), "w");
+    if (csv == nullptr) {
+      fprintf(stderr, "cannot write %s\n", config.csv.c_str());
+      return 1;
+    }
+    WriteCsvHeader(config, csv);
+  }
+
+  Clock::time_point start = Clock::now();
+  WorkStealingPool pool(config.threads);
+  Frames frames;
+  frames.data = capture.Data();
+  frames.size = capture.Size();
+  frames.chunks =
+      ScanCapture(pool, frames.data, frames.size, config.chunk_bytes);
+  frames.previous.resize(frames.chunks.size());
+  frames.last_chunk = 0;
+  uint64_t previous = kNoFrame;
+  for (size_t c = 0; c < frames.chunks.size(); c++) {
+    frames.previous[c] = previous;
+    if (!frames.chunks[c].frames.empty()) {
+      previous = frames.chunks[c].frames.back();
+      frames.last_chunk = c;
+    }
+  }
+
+  // Workers take chunks in order, so that the merge only ever waits for the
+  // few chunks in flight.
+  StreamingMerge merge(config, frames.chunks.size(), csv);
+  std::atomic<size_t> next_chunk{0};
+  for (size_t t = 0; t < pool.NumThreads(); t++) {
+    pool.Submit([&] {
+      for (size_t c; (c = next_chunk++) < frames.chunks.size();) {
+        std::unique_ptr<Partial> partial(new Partial(config));
+        ReduceChunk(frames, c, *partial);
+        merge.Add(c, std::move(partial));
+      }
+    });
+  }
+  pool.Wait();
+  const Partial &total = merge.Finish();
+  double seconds =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  if (csv != nullptr) {
+    fclose(csv);
+  }
+  PrintReport(config, total, frames.size, pool.NumThreads(), seconds);
+  return 0;
+}
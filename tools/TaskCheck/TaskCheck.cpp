@@ -0,0 +1,189 @@
+// Check of the cooperative tasks in src/Task.h on the host, with a fake
+// micros() clock that the tasks themselves advance to stand for the work
+// they do.
+//
+//   task_check
+//
+// Covers NextTick() and SleepFor() sequencing, the TaskRunner budget and
+// round-robin, frame pool exhaustion (the coroutine is not created and the
+// Task is empty) and cancellation, by assigning Task() and by Cancel().
+// Exits non-zero on a failure.
+
+#include <cstdio>
+#include <vector>
+
+#include "Task.h"
+
+namespace {
+
+const uint32_t kBudget = 200;  // micros, as TASK_BUDGET in main.cpp
+
+uint32_t now_micros = 0;
+uint32_t FakeMicros() { return now_micros; }
+
+int failures = 0;
+
+void Expect(bool ok, const char *what) {
+  if (!ok) {
+    printf("FAIL: %s\n", what);
+    failures++;
+  }
+}
+
+// Records each step it reaches, taking work_micros of fake time per step.
+Task Steps(std::vector<int> &log, int id, int num_steps,
+           uint32_t work_micros) {
+  for (int step = 0; step < num_steps; step++) {
+    now_micros += work_micros;
+    log.push_back(id * 100 + step);
+    co_await NextTick();
+  }
+}
+
+Task Sleeper(std::vector<int> &log, uint32_t duration_micros) {
+  log.push_back(0);
+  co_await SleepFor(duration_micros);
+  log.push_back(1);
+}
+
+// Sets *destroyed when its frame is destroyed, finished or not.
+struct Guard {
+  bool *destroyed;
+  ~Guard() { *destroyed = true; }
+};
+
+Task Guarded(bool *destroyed, bool *finished) {
+  Guard guard{destroyed};
+  co_await NextTick();
+  co_await NextTick();
+  *finished = true;
+}
+
+void CheckNextTick() {
+  std::vector<int> log;
+  Task task = Steps(log, 1, 3, 0);
+  Expect(!task.Done() && log.empty(), "a task only starts on Resume()");
+  task.Resume();
+  Expect(log == std::vector<int>{100},
+         "Resume() runs up to the first co_await");
+  task.Resume();
+  task.Resume();
+  Expect(log == (std::vector<int>{100, 101, 102}) && !task.Done(),
+         "each Resume() runs one step");
+  task.Resume();
+  Expect(task.Done(), "the task is done after its last step");
+  task.Resume();
+  Expect(log.size() == 3, "Resume() does nothing once the task is done");
+}
+
+void CheckSleep() {
+  now_micros = 0;
+  TaskRunner runner(FakeMicros, kBudget);
+  std::vector<int> log;
+  uint32_t id = runner.Start(Sleeper(log, 1000));
+  runner.Run();
+  Expect(log == std::vector<int>{0}, "a started task runs on the next Run()");
+  now_micros = 999;
+  runner.Run();
+  Expect(log.size() == 1, "SleepFor() holds the task until the time passes");
+  now_micros = 1000;
+  runner.Run();
+  Expect(log.size() == 2 && !runner.Running(id),
+         "SleepFor() resumes once the time has passed");
+}
+
+void CheckBudget() {
+  now_micros = 0;
+  TaskRunner runner(FakeMicros, kBudget);
+  std::vector<int> log;
+  runner.Start(Steps(log, 1, 2, 150));
+  runner.Start(Steps(log, 2, 2, 150));
+  runner.Start(Steps(log, 3, 2, 150));
+
+  // 150 us into the budget the second task still starts; at 300 us the
+  // third waits for the next Run().
+  runner.Run();
+  Expect(log == (std::vector<int>{100, 200}), "Run() stops once over budget");
+  Expect(runner.GetStats().deferred == 1, "the deferred task is counted");
+  runner.Run();
+  Expect(log.size() == 4 && log[2] == 300,
+         "the deferred task goes first on the next Run()");
+
+  // Every Run() resumes at least one task, even one longer than the budget.
+  log.clear();
+  TaskRunner slow_runner(FakeMicros, kBudget);
+  uint32_t id = slow_runner.Start(Steps(log, 4, 3, 2 * kBudget));
+  slow_runner.Run();
+  slow_runner.Run();
+  Expect(log.size() == 2, "a task longer than the budget still progresses");
+  Expect(slow_runner.GetStats().overruns == 2 &&
+             slow_runner.GetStats().max_resume_micros == 2 * kBudget,
+         "resumes longer than the budget are counted");
+  slow_runner.Cancel(id);
+}
+
+void CheckPoolExhaustion() {
+  std::vector<int> log;
+  std::vector<Task> tasks;
+  uint32_t failed = TaskFramePool::FailedAllocations();
+  for (uint32_t i = 0; i < TaskFramePool::kNumFrames; i++) {
+    tasks.push_back(Steps(log, 1, 1, 0));
+  }
+  Expect(TaskFramePool::FramesInUse() == TaskFramePool::kNumFrames,
+         "each task takes a frame");
+  Task extra = Steps(log, 2, 1, 0);
+  Expect(extra.Done(), "with the pool exhausted the task is empty");
+  Expect(TaskFramePool::FailedAllocations() == failed + 1,
+         "the failed allocation is counted");
+  extra.Resume();
+  Expect(log.empty(), "an empty task does nothing");
+
+  TaskRunner runner(FakeMicros, kBudget);
+  Expect(runner.Start(Steps(log, 3, 1, 0)) == TaskRunner::kNoTask,
+         "Start() refuses an empty task");
+
+  tasks.pop_back();
+  Task retry = Steps(log, 4, 1, 0);
+  Expect(!retry.Done(), "a freed frame is reused");
+  retry = Task();
+  tasks.clear();
+  Expect(TaskFramePool::FramesInUse() == 0, "every frame is freed");
+}
+
+void CheckCancel() {
+  bool destroyed = false;
+  bool finished = false;
+  Task task = Guarded(&destroyed, &finished);
+  task.Resume();
+  Expect(!destroyed && TaskFramePool::FramesInUse() == 1,
+         "the task is suspended");
+  task = Task();
+  Expect(destroyed && !finished && task.Done(),
+         "assigning Task() destroys the task where it is suspended");
+  Expect(TaskFramePool::FramesInUse() == 0, "cancelling frees the frame");
+
+  destroyed = false;
+  now_micros = 0;
+  TaskRunner runner(FakeMicros, kBudget);
+  uint32_t id = runner.Start(Guarded(&destroyed, &finished));
+  runner.Run();
+  Expect(runner.Running(id), "the started task runs");
+  runner.Cancel(id);
+  Expect(destroyed && !finished && !runner.Running(id),
+         "Cancel() destroys the task where it is suspended");
+  Expect(TaskFramePool::FramesInUse() == 0, "Cancel() frees the frame");
+}
+
+}  // namespace
+
+int main() {
+  CheckNextTick();
+  CheckSleep();
+  CheckBudget();
+  CheckPoolExhaustion();
+  CheckCancel();
+  if (failures == 0) {
+    printf("All task checks passed\n");
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+#include "FrameScan.h"
+
+#include <algorithm>
+
+#include "../common/WorkStealingPool.h"
+#include "StatusDecoder.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const uint8_t *FindFrameMarkerScalar(const uint8_t *p, const uint8_t *end) {
+  for (; end - p >= 2; p++) {
+    if (p[0] == kMsgPackFrameMarker && p[1] == kMsgPackFrameMarker) {
+      return p;
+    }
+  }
+  return end;
+}
+
+bool IsMapHeader(uint8_t b) {
+  return (b & 0xf0) == 0x80 || b == 0xde || b == 0xdf;
+}
+
+void ScanChunk(const uint8_t *data, size_t size, size_t begin, size_t end,
+               CaptureChunk &chunk) {
+  const uint8_t *p = data + begin;
+  const uint8_t *limit = data + end;
+  const uint8_t *data_end = data + size;
+  // A marker pair can straddle the chunk end.
+  const uint8_t *search_end = std::min(limit + 1, data_end);
+  while (p < limit) {
+    p = FindFrameMarker(p, search_end);
+    if (p >= limit) break;
+    size_t payload = MsgPackFrameAt(p, data_end);
+    if (payload == 0) {
+      p++;
+      continue;
+    }
+    if (IsStatusFrame(p + kMsgPackFrameHeader, payload)) {
+      chunk.frames.push_back(p - data);
+    } else {
+      chunk.other_frames++;
+    }
+    p += kMsgPackFrameHeader + payload + kMsgPackFrameTrailer;
+    chunk.end = p - data;
+  }
+}
+
+}  // namespace
+
+const uint8_t *FindFrameMarker(const uint8_t *p, const uint8_t *end) {
+  // Compare the block at p and the one a byte later against the marker; a bit
+  // set in both is a pair. The second load needs one byte past the block.
+#if defined(__AVX2__)
+  const __m256i marker = _mm256_set1_epi8(kMsgPackFrameMarker);
+  while (end - p >= 33) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1));
+    uint32_t pairs = _mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(a, marker), _mm256_cmpeq_epi8(b, marker)));
+    if (pairs != 0) {
+      return p + __builtin_ctz(pairs);
+    }
+    p += 32;
+  }
+#elif defined(__SSE2__)
+  const __m128i marker = _mm_set1_epi8(kMsgPackFrameMarker);
+  while (end - p >= 17) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1));
+    uint32_t pairs = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, marker), _mm_cmpeq_epi8(b, marker)));
+    if (pairs != 0) {
+      return p + __builtin_ctz(pairs);
+    }
+    p += 16;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const uint8x16_t marker = vdupq_n_u8(kMsgPackFrameMarker);
+  while (end - p >= 17) {
+    uint8x16_t pairs = vandq_u8(vceqq_u8(vld1q_u8(p), marker),
+                                vceqq_u8(vld1q_u8(p + 1), marker));
+    if (vmaxvq_u8(pairs) != 0) {
+      return FindFrameMarkerScalar(p, p + 17);
+    }
+    p += 16;
+  }
+#endif
+  return FindFrameMarkerScalar(p, end);
+}
+
+size_t MsgPackFrameAt(const uint8_t *p, const uint8_t *end) {
+  if (end - p < static_cast<ptrdiff_t>(kMsgPackFrameHeader + 1 +
+                                       kMsgPackFrameTrailer) ||
+      p[0] != kMsgPackFrameMarker || p[1] != kMsgPackFrameMarker) {
+    return 0;
+  }
+  size_t size = (p[2] << 8) | p[3];
+  if (size == 0 || size > kMaxMsgPackPayload ||
+      static_cast<size_t>(end - p) <
+          kMsgPackFrameHeader + size + kMsgPackFrameTrailer) {
+    return 0;
+  }
+  const uint8_t *payload = p + kMsgPackFrameHeader;
+  if (!IsMapHeader(payload[0]) || payload[size] != '\r' ||
+      payload[size + 1] != '\n') {
+    return 0;
+  }
+  return size;
+}
+
+std::vector<CaptureChunk> ScanCapture(WorkStealingPool &pool,
+                                      const uint8_t *data, size_t size,
+                                      size_t chunk_bytes) {
+  std::vector<CaptureChunk> chunks((size + chunk_bytes - 1) / chunk_bytes);
+  pool.ParallelFor(0, chunks.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      ScanChunk(data, size, c * chunk_bytes,
+                std::min(size, (c + 1) * chunk_bytes), chunks[c]);
+    }
+  });
+  // Drop what a chunk found inside the last frame of the chunk before.
+  uint64_t covered = 0;
+  size_t rows = 0;
+  for (CaptureChunk &chunk : chunks) {
+    auto first = std::lower_bound(chunk.frames.begin(), chunk.frames.end(),
+                                  covered);
+    chunk.frames.erase(chunk.frames.begin(), first);
+    chunk.first_row = rows;
+    rows += chunk.frames.size();
+    covered = std::max(covered, chunk.end);
+  }
+  return chunks;
+}
+
+const char *FrameScanUnit() {
+#if defined(__AVX2__)
+  return "AVX2";
+#elif defined(__SSE2__)
+  return "SSE2";
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WorkStealingPool;
+
+// Frame boundaries in a raw serial capture. DriveSystem::WriteMsgPackFrame()
+// writes
+//
+//   0x45 0x45  start bytes
+//   uint16     payload length, big-endian
+//   payload    one msgpack map
+//   CR LF
+//
+// between text lines and the other binary frames (0x46 telemetry batches,
+// 0x47 lockstep states, 0x48 energy frames), whose payloads can contain the
+// start bytes too. A candidate only counts as a frame if its length is
+// plausible, the payload starts with a map and CR LF follows it; the decoder
+// then skips the whole frame, so start bytes inside a payload are never
+// looked at.
+
+const uint8_t kMsgPackFrameMarker = 0x45;
+const size_t kMsgPackFrameHeader = 4;   // start bytes and length
+const size_t kMsgPackFrameTrailer = 2;  // CR LF
+// Status and query replies are well under 1 KB; the documents they are built
+// in hold 2048 bytes.
+const size_t kMaxMsgPackPayload = 4096;
+
+// First p in [begin, end - 1) with p[0] and p[1] both start bytes, or end if
+// there is none. 16 or 32 bytes at a time with SSE2, AVX2 or NEON.
+const uint8_t *FindFrameMarker(const uint8_t *begin, const uint8_t *end);
+
+// Payload size of the msgpack frame starting at p, or 0 if none does. The
+// frame has to end before end.
+size_t MsgPackFrameAt(const uint8_t *p, const uint8_t *end);
+
+// Payload size of a frame MsgPackFrameAt() accepted.
+inline size_t MsgPackPayloadSize(const uint8_t *frame) {
+  return (frame[2] << 8) | frame[3];
+}
+
+// The status frames (IsStatusFrame()) that start in one chunk of a capture.
+struct CaptureChunk {
+  std::vector<uint64_t> frames;  // offsets in the capture
+  uint64_t end = 0;              // end of the last msgpack frame found
+  size_t other_frames = 0;       // query replies and schemas
+  size_t first_row = 0;          // index of frames[0] among all frames
+};
+
+// Split size bytes into chunks of chunk_bytes and find the frames of each
+// on pool. A frame can run past the end of its chunk; start bytes that the
+// next chunk finds inside it are dropped.
+std::vector<CaptureChunk> ScanCapture(WorkStealingPool &pool,
+                                      const uint8_t *data, size_t size,
+                                      size_t chunk_bytes);
+
+// The instruction set FindFrameMarker() was built for.
+const char *FrameScanUnit();
@@ -0,0 +1,346 @@
+#include "StatusDecoder.h"
+
+#include <cmath>
+#include <cstring>
+
+#define SCALAR_COLUMN(key, label, type, scale, option, accessor) \
+  {#key, DriveSignalTypeOf<type>::value, 1},
+#define ACTUATOR_COLUMN(key, label, type, scale, option, accessor) \
+  {#key, DriveSignalTypeOf<type>::value, kStatusActuators},
+const StatusColumn kStatusColumns[kNumStatusColumns] = {
+    DRIVE_SCALAR_SIGNALS(SCALAR_COLUMN)
+        DRIVE_ACTUATOR_SIGNALS(ACTUATOR_COLUMN)};
+#undef SCALAR_COLUMN
+#undef ACTUATOR_COLUMN
+
+namespace {
+
+const uint32_t kMissingFloat = 0x7fc00000;  // quiet NaN
+const int kMaxDepth = 32;
+
+#define KEY_LENGTH(key, label, type, scale, option, accessor) \
+  sizeof(#key) - 1,
+const uint8_t kKeyLengths[kNumStatusColumns] = {
+    DRIVE_SCALAR_SIGNALS(KEY_LENGTH) DRIVE_ACTUATOR_SIGNALS(KEY_LENGTH)};
+#undef KEY_LENGTH
+
+// Column index of key, trying hint and the columns after it first, or -1.
+int FindColumn(const char *key, uint32_t length, uint8_t hint) {
+  for (uint8_t n = 0; n < kNumStatusColumns; n++) {
+    uint8_t c = (hint + n) % kNumStatusColumns;
+    if (kKeyLengths[c] == length &&
+        memcmp(kStatusColumns[c].key, key, length) == 0) {
+      return c;
+    }
+  }
+  return -1;
+}
+
+// Cursor over one msgpack payload. Every read checks the bounds and fails
+// instead of running past the end.
+class Reader {
+ public:
+  Reader(const uint8_t *data, size_t size) : p_(data), end_(data + size) {}
+
+  bool ReadMapSize(uint32_t &n) {
+    if (!Need(1)) return false;
+    uint8_t b = *p_;
+    if ((b & 0xf0) == 0x80) {
+      p_++;
+      n = b & 0x0f;
+      return true;
+    }
+    if (b == 0xde || b == 0xdf) {
+      p_++;
+      return Length(b == 0xde ? 2 : 4, n);
+    }
+    return false;
+  }
+
+  bool ReadArraySize(uint32_t &n) {
+    if (!Need(1)) return false;
+    uint8_t b = *p_;
+    if ((b & 0xf0) == 0x90) {
+      p_++;
+      n = b & 0x0f;
+      return true;
+    }
+    if (b == 0xdc || b == 0xdd) {
+      p_++;
+      return Length(b == 0xdc ? 2 : 4, n);
+    }
+    return false;
+  }
+
+  bool ReadString(const char *&s, uint32_t &length) {
+    if (!Need(1)) return false;
+    uint8_t b = *p_;
+    bool ok;
+    if ((b & 0xe0) == 0xa0) {
+      p_++;
+      length = b & 0x1f;
+      ok = true;
+    } else if (b >= 0xd9 && b <= 0xdb) {
+      p_++;
+      ok = Length(1 << (b - 0xd9), length);
+    } else {
+      return false;
+    }
+    if (!ok || !Need(length)) return false;
+    s = reinterpret_cast<const char *>(p_);
+    p_ += length;
+    return true;
+  }
+
+  // Any integer, float, nil (NaN) or boolean.
+  bool ReadNumber(double &x) {
+    if (!Need(1)) return false;
+    uint8_t b = *p_++;
+    if (b <= 0x7f) {
+      x = b;
+      return true;
+    }
+    if (b >= 0xe0) {
+      x = static_cast<int8_t>(b);
+      return true;
+    }
+    switch (b) {
+      case 0xc0:
+        x = NAN;
+        return true;
+      case 0xc2:
+      case 0xc3:
+        x = b - 0xc2;
+        return true;
+      case 0xca: {
+        if (!Need(4)) return false;
+        uint32_t bits = BigEndian(4);
+        float f;
+        memcpy(&f, &bits, 4);
+        x = f;
+        return true;
+      }
+      case 0xcb: {
+        if (!Need(8)) return false;
+        uint64_t bits = BigEndian(8);
+        memcpy(&x, &bits, 8);
+        return true;
+      }
+      case 0xcc:
+      case 0xcd:
+      case 0xce:
+      case 0xcf: {
+        size_t n = 1 << (b - 0xcc);
+        if (!Need(n)) return false;
+        x = BigEndian(n);
+        return true;
+      }
+      case 0xd0:
+      case 0xd1:
+      case 0xd2:
+      case 0xd3: {
+        size_t n = 1 << (b - 0xd0);
+        if (!Need(n)) return false;
+        uint64_t bits = BigEndian(n);
+        int shift = 64 - 8 * n;  // sign-extend
+        x = static_cast<int64_t>(bits << shift) >> shift;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The fast path for the firmware's arrays: count float32s, each a 0xca
+  // byte and 4 big-endian bytes. Leaves the cursor alone if the array is
+  // anything else.
+  bool ReadFloat32Array(size_t count, uint32_t *out) {
+    size_t size = 1 + 5 * count;
+    if (count > 15 || !Need(size) || p_[0] != (0x90 | count)) return false;
+    const uint8_t *p = p_ + 1;
+    for (size_t k = 0; k < count; k++) {
+      if (p[5 * k] != 0xca) return false;
+    }
+    for (size_t k = 0; k < count; k++) {
+      uint32_t bits;
+      memcpy(&bits, p + 5 * k + 1, 4);
+      out[k] = __builtin_bswap32(bits);
+    }
+    p_ += size;
+    return true;
+  }
+
+  // Step over one value of any type, including nested maps and arrays.
+  bool Skip(int depth = 0) {
+    if (!Need(1) || depth > kMaxDepth) return false;
+    uint8_t b = *p_;
+    uint32_t n;
+    if (b <= 0x7f || b >= 0xe0 || b == 0xc0 || b == 0xc2 || b == 0xc3) {
+      p_++;
+      return true;
+    }
+    if ((b & 0xe0) == 0xa0 || (b >= 0xd9 && b <= 0xdb)) {
+      const char *s;
+      return ReadString(s, n);
+    }
+    if ((b & 0xf0) == 0x90 || b == 0xdc || b == 0xdd) {
+      if (!ReadArraySize(n)) return false;
+      for (uint32_t i = 0; i < n; i++) {
+        if (!Skip(depth + 1)) return false;
+      }
+      return true;
+    }
+    if ((b & 0xf0) == 0x80 || b == 0xde || b == 0xdf) {
+      if (!ReadMapSize(n)) return false;
+      for (uint32_t i = 0; i < 2 * n; i++) {
+        if (!Skip(depth + 1)) return false;
+      }
+      return true;
+    }
+    p_++;
+    switch (b) {
+      case 0xc4:  // bin 8, 16, 32
+      case 0xc5:
+      case 0xc6:
+        return Length(1 << (b - 0xc4), n) && Advance(n);
+      case 0xc7:  // ext 8, 16, 32: length, type, data
+      case 0xc8:
+      case 0xc9:
+        return Length(1 << (b - 0xc7), n) && Advance(n + 1);
+      case 0xd4:  // fixext 1 to 16: type, data
+      case 0xd5:
+      case 0xd6:
+      case 0xd7:
+      case 0xd8:
+        return Advance(1 + (1 << (b - 0xd4)));
+      case 0xca:
+      case 0xce:
+      case 0xd2:
+        return Advance(4);
+      case 0xcb:
+      case 0xcf:
+      case 0xd3:
+        return Advance(8);
+      case 0xcc:
+      case 0xd0:
+        return Advance(1);
+      case 0xcd:
+      case 0xd1:
+        return Advance(2);
+    }
+    return false;
+  }
+
+ private:
+  bool Need(size_t n) const { return static_cast<size_t>(end_ - p_) >= n; }
+
+  bool Advance(size_t n) {
+    if (!Need(n)) return false;
+    p_ += n;
+    return true;
+  }
+
+  uint64_t BigEndian(size_t n) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < n; i++) {
+      value = (value << 8) | *p_++;
+    }
+    return value;
+  }
+
+  // The n-byte length field after a type byte.
+  bool Length(size_t n, uint32_t &length) {
+    if (!Need(n)) return false;
+    length = BigEndian(n);
+    return true;
+  }
+
+  const uint8_t *p_;
+  const uint8_t *end_;
+};
+
+uint32_t MissingValue(DriveSignalType type) {
+  return type == DriveSignalType::kFloat ? kMissingFloat : 0;
+}
+
+bool ReadValue(Reader &in, DriveSignalType type, uint32_t &out) {
+  double x;
+  if (!in.ReadNumber(x)) return false;
+  if (type == DriveSignalType::kFloat) {
+    float f = x;
+    memcpy(&out, &f, 4);
+  } else {
+    out = x >= 0 ? static_cast<uint32_t>(x) : 0;
+  }
+  return true;
+}
+
+bool ReadColumn(Reader &in, const StatusColumn &column, uint32_t *out) {
+  if (column.count == 1) {
+    return ReadValue(in, column.type, out[0]);
+  }
+  if (column.type == DriveSignalType::kFloat &&
+      in.ReadFloat32Array(column.count, out)) {
+    return true;
+  }
+  uint32_t n;
+  if (!in.ReadArraySize(n)) return false;
+  for (uint32_t k = 0; k < n; k++) {
+    bool ok = k < column.count ? ReadValue(in, column.type, out[k]) : in.Skip();
+    if (!ok) return false;
+  }
+  for (uint32_t k = n; k < column.count; k++) {
+    out[k] = MissingValue(column.type);
+  }
+  return true;
+}
+
+}  // namespace
+
+bool IsStatusFrame(const uint8_t *payload, size_t size) {
+  Reader in(payload, size);
+  uint32_t n;
+  const char *key;
+  uint32_t length;
+  return in.ReadMapSize(n) && n > 0 && in.ReadString(key, length) &&
+         FindColumn(key, length, 0) >= 0;
+}
+
+bool DecodeStatusFrame(const uint8_t *payload, size_t size,
+                       const StatusColumns &columns, size_t row) {
+  Reader in(payload, size);
+  StatusPresence presence = 0;
+  uint32_t n;
+  bool ok = in.ReadMapSize(n);
+  uint8_t hint = 0;
+  for (uint32_t i = 0; ok && i < n; i++) {
+    const char *key;
+    uint32_t length;
+    if (!in.ReadString(key, length)) {
+      ok = false;
+      break;
+    }
+    int c = FindColumn(key, length, hint);
+    if (c < 0) {
+      ok = in.Skip();
+      continue;
+    }
+    hint = c + 1;
+    const StatusColumn &column = kStatusColumns[c];
+    ok = ReadColumn(in, column, columns.data[c] + row * column.count);
+    presence |= 1 << c;
+  }
+  if (!ok) {
+    presence = 0;
+  }
+  for (uint8_t c = 0; c < kNumStatusColumns; c++) {
+    if (!(presence & (1 << c))) {
+      const StatusColumn &column = kStatusColumns[c];
+      uint32_t *out = columns.data[c] + row * column.count;
+      for (size_t k = 0; k < column.count; k++) {
+        out[k] = MissingValue(column.type);
+      }
+    }
+  }
+  columns.presence[row] = presence;
+  return ok;
+}
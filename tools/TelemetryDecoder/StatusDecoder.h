@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "DriveSignals.h"
+
+// Decodes the msgpack maps of PrintMsgPackStatus() into columns, one per
+// drive signal in the order of DriveSignals.h. A column holds count 4-byte
+// values per frame: uint32 for ts, float for everything else.
+//
+// The firmware writes the keys in table order and every float as a float32,
+// so the decoder first tries the key after the previous one and reads a
+// 12-float array as 12 fixed 5-byte records. Anything else (a reordered
+// map, float64 or integer values, other array lengths, unknown keys) goes
+// through a general msgpack reader, which is slower but gives the same
+// columns.
+
+struct StatusColumn {
+  const char *key;
+  DriveSignalType type;
+  uint8_t count;
+};
+
+const size_t kStatusActuators = 12;
+const uint8_t kNumStatusColumns =
+    kNumDriveScalarSignals + kNumDriveActuatorSignals;
+extern const StatusColumn kStatusColumns[kNumStatusColumns];
+
+// Bit c of a row's presence mask is set if the frame held column c.
+typedef uint16_t StatusPresence;
+static_assert(kNumStatusColumns <= 16, "StatusPresence needs more bits");
+
+// Column storage for every frame of a capture; data[c] holds
+// kStatusColumns[c].count values per row.
+struct StatusColumns {
+  uint32_t *data[kNumStatusColumns];
+  StatusPresence *presence;
+};
+
+// True if payload is a status map rather than another msgpack reply: its
+// first key is one of the columns. Query replies start with "qid" and the
+// schema with "row".
+bool IsStatusFrame(const uint8_t *payload, size_t size);
+
+// Decode one status map into row of columns. Signals missing from the frame
+// are NaN, or 0 for ts, and clear their presence bit. Returns false if the
+// payload is not valid msgpack; the row is then all missing.
+bool DecodeStatusFrame(const uint8_t *payload, size_t size,
+                       const StatusColumns &columns, size_t row);
@@ -0,0 +1,466 @@
+// Decoder for serial captures of the msgpack status stream
+// (DriveSystem::PrintMsgPackStatus()), for logs that are too large for the
+// Python tooling.
+//
+// Usage:
+//   telemetry_decoder decode <capture> <out_dir> [--threads T] [--chunk MB]
+//   telemetry_decoder synth <capture> <frames> [seed]
+//   telemetry_decoder check <work_dir> [frames] [--threads T]
+//
+// decode maps the capture, splits it into chunks and, on a pool of threads,
+// finds the frames of every chunk, then decodes them straight into .npy
+// files in out_dir: one per signal of DriveSignals.h, shape (frames,) or
+// (frames, 12), plus presence.npy, a uint16 per frame with bit c set if the
+// frame held signal c. Signals a frame did not hold are NaN (ts: 0). Load
+// them with numpy.load("out_dir/pos.npy", mmap_mode="r").
+//
+// synth writes a capture in the firmware's format, with text lines, 0x46
+// telemetry batches and query replies in between. check runs synth and
+// decode in work_dir, compares every value and exits non-zero on a mismatch.
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../common/MappedFile.h"
+#include "../common/WorkStealingPool.h"
+#include "FrameScan.h"
+#include "StatusDecoder.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "the .npy files are written in host byte order as '<'");
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t kNpyHeader = 128;  // keeps the data 64-byte aligned
+const size_t kDefaultChunkBytes = 4 << 20;
+
+double Seconds(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Version 1.0 .npy header for a C-order array of rows x count values.
+void WriteNpyHeader(uint8_t *out, const char *descr, size_t rows,
+                    size_t count) {
+  char shape[64];
+  if (count == 1) {
+    snprintf(shape, sizeof(shape), "(%zu,)", rows);
+  } else {
+    snprintf(shape, sizeof(shape), "(%zu, %zu)", rows, count);
+  }
+  char dict[kNpyHeader];
+  int length = snprintf(dict, sizeof(dict),
+                        "{'descr': '%s', 'fortran_order': False, "
+                        "'shape': %s, }",
+                        descr, shape);
+  memcpy(out, "\x93NUMPY\x01\x00", 8);
+  uint16_t header_length = kNpyHeader - 10;
+  memcpy(out + 8, &header_length, 2);
+  memset(out + 10, ' ', header_length);
+  memcpy(out + 10, dict, length);
+  out[kNpyHeader - 1] = '\n';
+}
+
+const char *NpyDescr(DriveSignalType type) {
+  return type == DriveSignalType::kFloat ? "<f4" : "<u4";
+}
+
+struct DecodeStats {
+  size_t bytes = 0;
+  size_t frames = 0;
+  size_t other_frames = 0;
+  size_t malformed = 0;
+  size_t threads = 0;
+  double scan_seconds = 0;
+  double decode_seconds = 0;
+};
+
+bool Decode(const std::string &capture_path, const std::string &out_dir,
+            size_t threads, size_t chunk_bytes, DecodeStats &stats) {
+  MappedFile capture;
+  if (!capture.OpenRead(capture_path)) {
+    fprintf(stderr, "cannot read %s\n", capture_path.c_str());
+    return false;
+  }
+  const uint8_t *data = capture.Data();
+  size_t size = capture.Size();
+  WorkStealingPool pool(threads);
+  stats.bytes = size;
+  stats.threads = pool.NumThreads();
+
+  Clock::time_point start = Clock::now();
+  std::vector<CaptureChunk> chunks =
+      ScanCapture(pool, data, size, chunk_bytes);
+  for (const CaptureChunk &chunk : chunks) {
+    stats.frames += chunk.frames.size();
+    stats.other_frames += chunk.other_frames;
+  }
+  stats.scan_seconds = Seconds(start);
+
+  start = Clock::now();
+  mkdir(out_dir.c_str(), 0755);
+  std::vector<MappedFile> files(kNumStatusColumns + 1);
+  StatusColumns columns;
+  for (uint8_t c = 0; c <= kNumStatusColumns; c++) {
+    bool presence = c == kNumStatusColumns;
+    std::string name = presence ? "presence" : kStatusColumns[c].key;
+    size_t count = presence ? 1 : kStatusColumns[c].count;
+    size_t value_size = presence ? sizeof(StatusPresence) : 4;
+    std::string path = out_dir + "/" + name + ".npy";
+    if (!files[c].Create(path, kNpyHeader +
+                                   stats.frames * count * value_size)) {
+      fprintf(stderr, "cannot write %s\n", path.c_str());
+      return false;
+    }
+    uint8_t *file = files[c].Data();
+    WriteNpyHeader(file, presence ? "<u2" : NpyDescr(kStatusColumns[c].type),
+                   stats.frames, count);
+    if (presence) {
+      columns.presence = reinterpret_cast<StatusPresence *>(file + kNpyHeader);
+    } else {
+      columns.data[c] = reinterpret_cast<uint32_t *>(file + kNpyHeader);
+    }
+  }
+  std::vector<size_t> malformed(chunks.size());
+  pool.ParallelFor(0, chunks.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t c = begin; c < end; c++) {
+      const CaptureChunk &chunk = chunks[c];
+      for (size_t i = 0; i < chunk.frames.size(); i++) {
+        const uint8_t *frame = data + chunk.frames[i];
+        if (!DecodeStatusFrame(frame + kMsgPackFrameHeader,
+                               MsgPackPayloadSize(frame), columns,
+                               chunk.first_row + i)) {
+          malformed[c]++;
+        }
+      }
+    }
+  });
+  for (size_t count : malformed) {
+    stats.malformed += count;
+  }
+  stats.decode_seconds = Seconds(start);
+  return true;
+}
+
+void PrintStats(const DecodeStats &stats) {
+  double mb = stats.bytes / 1e6;
+  double total = stats.scan_seconds + stats.decode_seconds;
+  printf("%.1f MB, %zu status frames, %zu other frames, %zu malformed\n", mb,
+         stats.frames, stats.other_frames, stats.malformed);
+  printf("scan (%s) %.3f s, decode %.3f s on %zu threads: %.0f MB/s, "
+         "%.2f M frames/s\n",
+         FrameScanUnit(), stats.scan_seconds, stats.decode_seconds,
+         stats.threads, mb / total, stats.frames / total * 1e-6);
+}
+
+// Synthetic captures. The values are a function of the frame, column and
+// index, so check can recompute them.
+
+uint64_t Mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+float SynthValue(uint64_t frame, size_t column, size_t k) {
+  int32_t steps = Mix(frame << 16 | column << 8 | k) % 200001;
+  return (steps - 100000) * 1e-4f;
+}
+
+// Every 64th value as a float64, which the firmware never sends.
+bool SynthAsDouble(uint64_t frame, size_t column, size_t k) {
+  return (Mix(frame << 16 | column << 8 | k) >> 40) % 64 == 0;
+}
+
+// Columns the frame holds, as if the print options changed every 500 frames.
+StatusPresence SynthPresence(uint64_t frame) {
+  StatusPresence all = (1 << kNumStatusColumns) - 1;
+  switch (frame / 500 % 3) {
+    case 1:
+      return all & ~0x5554;  // every other column after ts
+    case 2:
+      return (1 << (kNumDriveScalarSignals + 3)) - 1;
+  }
+  return all;
+}
+
+class MsgPackWriter {
+ public:
+  explicit MsgPackWriter(std::vector<uint8_t> &out) : out_(out) {}
+
+  void Map(uint8_t n) { out_.push_back(0x80 | n); }
+  void Array(uint8_t n) { out_.push_back(0x90 | n); }
+  void String(const char *s) {
+    size_t length = strlen(s);
+    out_.push_back(0xa0 | length);
+    out_.insert(out_.end(), s, s + length);
+  }
+  // Smallest encoding, like ArduinoJson.
+  void Uint(uint32_t x) {
+    if (x <= 0x7f) {
+      out_.push_back(x);
+    } else if (x <= 0xff) {
+      out_.push_back(0xcc);
+      BigEndian(x, 1);
+    } else if (x <= 0xffff) {
+      out_.push_back(0xcd);
+      BigEndian(x, 2);
+    } else {
+      out_.push_back(0xce);
+      BigEndian(x, 4);
+    }
+  }
+  void Float(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, 4);
+    out_.push_back(0xca);
+    BigEndian(bits, 4);
+  }
+  void Double(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, 8);
+    out_.push_back(0xcb);
+    BigEndian(bits, 8);
+  }
+
+ private:
+  void BigEndian(uint64_t x, int n) {
+    for (int i = n - 1; i >= 0; i--) {
+      out_.push_back(x >> (8 * i));
+    }
+  }
+
+  std::vector<uint8_t> &out_;
+};
+
+void AppendMsgPackFrame(const std::vector<uint8_t> &payload,
+                        std::vector<uint8_t> &out) {
+  out.push_back(kMsgPackFrameMarker);
+  out.push_back(kMsgPackFrameMarker);
+  out.push_back(payload.size() >> 8);
+  out.push_back(payload.size() & 0xff);
+  out.insert(out.end(), payload.begin(), payload.end());
+  out.push_back('\r');
+  out.push_back('\n');
+}
+
+void AppendStatusFrame(uint64_t frame, std::vector<uint8_t> &out) {
+  std::vector<uint8_t> payload;
+  MsgPackWriter writer(payload);
+  StatusPresence presence = SynthPresence(frame);
+  writer.Map(__builtin_popcount(presence));
+  for (uint8_t c = 0; c < kNumStatusColumns; c++) {
+    if (!(presence & (1 << c))) continue;
+    const StatusColumn &column = kStatusColumns[c];
+    writer.String(column.key);
+    if (column.count > 1) {
+      writer.Array(column.count);
+    }
+    for (size_t k = 0; k < column.count; k++) {
+      if (column.type == DriveSignalType::kUint32) {
+        writer.Uint(frame);
+      } else if (SynthAsDouble(frame, c, k)) {
+        writer.Double(SynthValue(frame, c, k));
+      } else {
+        writer.Float(SynthValue(frame, c, k));
+      }
+    }
+  }
+  AppendMsgPackFrame(payload, out);
+}
+
+// A {"qid", "ts", "pos"} query reply, which is not a status frame.
+void AppendQueryReply(uint64_t frame, std::vector<uint8_t> &out) {
+  std::vector<uint8_t> payload;
+  MsgPackWriter writer(payload);
+  writer.Map(3);
+  writer.String("qid");
+  writer.Uint(frame & 0xff);
+  writer.String("ts");
+  writer.Uint(frame);
+  writer.String("pos");
+  writer.Array(kStatusActuators);
+  for (size_t k = 0; k < kStatusActuators; k++) {
+    writer.Float(-SynthValue(frame, 0, k));
+  }
+  AppendMsgPackFrame(payload, out);
+}
+
+// A 0x46 batch whose random payload holds start bytes and a plausible
+// length.
+void AppendTelemetryBatch(std::mt19937 &random, std::vector<uint8_t> &out) {
+  uint8_t payload[64];
+  for (uint8_t &b : payload) {
+    b = random();
+  }
+  size_t at = random() % (sizeof(payload) - 8);
+  payload[at] = kMsgPackFrameMarker;
+  payload[at + 1] = kMsgPackFrameMarker;
+  payload[at + 2] = 0;
+  payload[at + 3] = random() % 16;
+  payload[at + 4] = 0x81;
+  out.push_back(0x46);
+  out.push_back(0x46);
+  out.push_back(0);
+  out.push_back(sizeof(payload));
+  out.insert(out.end(), payload, payload + sizeof(payload));
+}
+
+bool Synth(const std::string &path, uint64_t frames, uint32_t seed) {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    fprintf(stderr, "cannot write %s\n", path.c_str());
+    return false;
+  }
+  std::mt19937 random(seed);
+  std::vector<uint8_t> out;
+  const char *line = "Motion done\r\n";
+  for (uint64_t frame = 0; frame < frames; frame++) {
+    if (frame % 97 == 0) {
+      out.insert(out.end(), line, line + strlen(line));
+    }
+    if (frame % 50 == 0) {
+      AppendTelemetryBatch(random, out);
+    }
+    if (frame % 200 == 0) {
+      AppendQueryReply(frame, out);
+    }
+    AppendStatusFrame(frame, out);
+    if (out.size() > (1 << 20)) {
+      fwrite(out.data(), 1, out.size(), file);
+      out.clear();
+    }
+  }
+  fwrite(out.data(), 1, out.size(), file);
+  return fclose(file) == 0;
+}
+
+// Data of a .npy file written by Decode(), or nullptr if its size is off.
+const uint8_t *NpyData(const MappedFile &file, size_t bytes) {
+  if (file.Size() != kNpyHeader + bytes ||
+      memcmp(file.Data(), "\x93NUMPY", 6) != 0) {
+    return nullptr;
+  }
+  return file.Data() + kNpyHeader;
+}
+
+size_t Verify(const std::string &dir, uint64_t frames) {
+  size_t mismatches = 0;
+  MappedFile presence_file;
+  presence_file.OpenRead(dir + "/presence.npy");
+  const StatusPresence *presence = reinterpret_cast<const StatusPresence *>(
+      NpyData(presence_file, frames * sizeof(StatusPresence)));
+  if (presence == nullptr) {
+    printf("presence.npy: wrong size\n");
+    return 1;
+  }
+  for (uint64_t frame = 0; frame < frames; frame++) {
+    mismatches += presence[frame] != SynthPresence(frame);
+  }
+  for (uint8_t c = 0; c < kNumStatusColumns; c++) {
+    const StatusColumn &column = kStatusColumns[c];
+    MappedFile file;
+    file.OpenRead(dir + "/" + column.key + ".npy");
+    const uint32_t *values = reinterpret_cast<const uint32_t *>(
+        NpyData(file, frames * column.count * 4));
+    if (values == nullptr) {
+      printf("%s.npy: wrong size\n", column.key);
+      mismatches++;
+      continue;
+    }
+    for (uint64_t frame = 0; frame < frames; frame++) {
+      bool present = SynthPresence(frame) & (1 << c);
+      for (size_t k = 0; k < column.count; k++) {
+        uint32_t actual = values[frame * column.count + k];
+        uint32_t expected;
+        if (column.type == DriveSignalType::kUint32) {
+          expected = present ? frame : 0;
+        } else {
+          float value = present ? SynthValue(frame, c, k) : NAN;
+          memcpy(&expected, &value, 4);
+        }
+        if (actual != expected) {
+          if (mismatches < 10) {
+            printf("%s[%llu][%zu]: %08x, expected %08x\n", column.key,
+                   static_cast<unsigned long long>(frame), k, actual,
+                   expected);
+          }
+          mismatches++;
+        }
+      }
+    }
+  }
+  return mismatches;
+}
+
+void PrintUsage() {
+  printf("usage:\n"
+         "  telemetry_decoder decode <capture> <out_dir> [--threads T] "
+         "[--chunk MB]\n"
+         "  telemetry_decoder synth <capture> <frames> [seed]\n"
+         "  telemetry_decoder check <work_dir> [frames] [--threads T]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::string> args;
+  size_t threads = 0;
+  size_t chunk_bytes = kDefaultChunkBytes;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--threads" && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (arg == "--chunk" && i + 1 < argc) {
+      chunk_bytes = std::max(1.0, atof(argv[++i]) * (1 << 20));
+    } else {
+      args.push_back(arg);
+    }
+  }
+  if (args.empty()) {
+    PrintUsage();
+    return 2;
+  }
+
+  if (args[0] == "decode" && args.size() == 3) {
+    DecodeStats stats;
+    if (!Decode(args[1], args[2], threads, chunk_bytes, stats)) return 1;
+    PrintStats(stats);
+    return stats.malformed > 0;
+  }
+  if (args[0] == "synth" && args.size() >= 3) {
+    uint32_t seed = args.size() > 3 ? atoi(args[3].c_str()) : 1;
+    return Synth(args[1], atoll(args[2].c_str()), seed) ? 0 : 1;
+  }
+  if (args[0] == "check" && args.size() >= 2) {
+    uint64_t frames = args.size() > 2 ? atoll(args[2].c_str()) : 1000000;
+    std::string capture = args[1] + "/capture.bin";
+    std::string columns = args[1] + "/columns";
+    mkdir(args[1].c_str(), 0755);
+    DecodeStats stats;
+    if (!Synth(capture, frames, 1) ||
+        !Decode(capture, columns, threads, chunk_bytes, stats)) {
+      return 1;
+    }
+    PrintStats(stats);
+    size_t mismatches = Verify(columns, frames);
+    printf("%zu mismatches\n", mismatches);
+    if (mismatches > 0 || stats.frames != frames || stats.malformed > 0) {
+      printf("FAIL: decoded columns differ from the synthetic capture\n");
+      return 1;
+    }
+    return 0;
+  }
+  PrintUsage();
+  return 2;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped into memory, read-only or created for writing.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() {
+    if (data_ != nullptr) munmap(data_, size_);
+    if (fd_ >= 0) close(fd_);
+  }
+
+  bool OpenRead(const std::string &path) {
+    fd_ = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd_ < 0 || fstat(fd_, &st) != 0) return false;
+    size_ = st.st_size;
+    return size_ == 0 || Map(PROT_READ, MAP_PRIVATE);
+  }
+
+  bool Create(const std::string &path, size_t size) {
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    size_ = size;
+    return fd_ >= 0 && ftruncate(fd_, size) == 0 &&
+           Map(PROT_READ | PROT_WRITE, MAP_SHARED);
+  }
+
+  uint8_t *Data() const { return static_cast<uint8_t *>(data_); }
+  size_t Size() const { return size_; }
+
+ private:
+  bool Map(int protection, int flags) {
+    void *data = mmap(nullptr, size_, protection, flags, fd_, 0);
+    if (data == MAP_FAILED) return false;
+    data_ = data;
+    madvise(data_, size_, MADV_WILLNEED);
+    return true;
+  }
+
+  int fd_ = -1;
+  void *data_ = nullptr;
+  size_t size_ = 0;
+};
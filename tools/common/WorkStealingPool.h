@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size thread pool for the host tools. Every worker owns a deque: it
+// pops its own work from the back and, once empty, steals from the front of
+// the other workers' deques. Jobs are expected to be coarse (a chunk of a
+// sweep or a slice of a log), so a mutex per deque is cheap enough.
+class WorkStealingPool {
+ public:
+  using Job = std::function<void()>;
+
+  // num_threads == 0 uses every hardware thread.
+  explicit WorkStealingPool(size_t num_threads = 0);
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  size_t NumThreads() const { return workers_.size(); }
+
+  // Queue a job. Jobs are dealt round-robin to the workers' deques.
+  void Submit(Job job);
+
+  // Split [begin, end) into chunks of at most grain indices and run
+  // fn(chunk_begin, chunk_end) for each of them. Blocks until all are done.
+  void ParallelFor(size_t begin, size_t end, size_t grain,
+                   const std::function<void(size_t, size_t)> &fn);
+
+  // Block until every submitted job has finished.
+  void Wait();
+
+  // Number of jobs that were executed by a worker other than the one they
+  // were queued on.
+  size_t Steals() const { return steals_.load(); }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  bool PopLocal(size_t worker, Job &job);
+  bool Steal(size_t worker, Job &job);
+  void WorkerLoop(size_t worker);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  // Jobs submitted but not finished, and jobs still sitting in a deque.
+  std::atomic<size_t> pending_{0};
+  std::atomic<size_t> queued_{0};
+  std::atomic<size_t> next_queue_{0};
+  std::atomic<size_t> steals_{0};
+  bool stop_ = false;
+};
+
+inline WorkStealingPool::WorkStealingPool(size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  if (num_threads == 0) {
+    num_threads = 1;
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    queues_.emplace_back(new Queue);
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    workers_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+inline WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+inline void WorkStealingPool::Submit(Job job) {
+  size_t q = next_queue_++ % queues_.size();
+  pending_++;
+  {
+    std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+    queues_[q]->jobs.push_back(std::move(job));
+  }
+  queued_++;
+  {
+    // Taking the lock orders this notify after a worker's empty-check.
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+  }
+  wake_.notify_one();
+}
+
+inline void WorkStealingPool::ParallelFor(
+    size_t begin, size_t end, size_t grain,
+    const std::function<void(size_t, size_t)> &fn) {
+  if (grain == 0) {
+    grain = 1;
+  }
+  for (size_t chunk = begin; chunk < end; chunk += grain) {
+    size_t chunk_end = chunk + grain < end ? chunk + grain : end;
+    Submit([&fn, chunk, chunk_end] { fn(chunk, chunk_end); });
+  }
+  Wait();
+}
+
+inline void WorkStealingPool::Wait() {
+  std::unique_lock<std::mutex> lock(wake_mutex_);
+  idle_.wait(lock, [this] { return pending_.load() == 0; });
+}
+
+inline bool WorkStealingPool::PopLocal(size_t worker, Job &job) {
+  Queue &q = *queues_[worker];
+  std::lock_guard<std::mutex> lock(q.mutex);
+  if (q.jobs.empty()) {
+    return false;
+  }
+  job = std::move(q.jobs.back());
+  q.jobs.pop_back();
+  queued_--;
+  return true;
+}
+
+inline bool WorkStealingPool::Steal(size_t worker, Job &job) {
+  for (size_t offset = 1; offset < queues_.size(); offset++) {
+    Queue &q = *queues_[(worker + offset) % queues_.size()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.jobs.empty()) {
+      job = std::move(q.jobs.front());
+      q.jobs.pop_front();
+      queued_--;
+      steals_++;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void WorkStealingPool::WorkerLoop(size_t worker) {
+  while (true) {
+    Job job;
+    if (PopLocal(worker, job) || Steal(worker, job)) {
+      job();
+      if (--pending_ == 0) {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        idle_.notify_all();
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    if (stop_) {
+      return;
+    }
+    // Re-check under the lock: Submit() bumps queued_ before notifying.
+    wake_.wait(lock, [this] { return stop_ || queued_.load() > 0; });
+  }
+}